@@ -1,8 +1,160 @@
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
+#include <libavutil/time.h>
 }
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <mutex>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+// 스트림 하나에서 추출한 코덱 정보
+struct StreamInfo {
+  int index;
+  AVMediaType codec_type;
+  AVCodecID codec_id;
+  int64_t bit_rate;
+  int width;
+  int height;
+  int sample_rate;
+  int channels;
+};
+
+// 파일 하나의 스캔 결과
+struct ScanResult {
+  std::string path;
+  int error;
+  const char* error_message;
+  // 결과를 얻기까지 거친 경로 (cache, header, limited, full)
+  const char* probe_path;
+  int64_t bytes_read;
+  std::vector<StreamInfo> streams;
+};
+
+enum OutputFormat { OUTPUT_JSONL, OUTPUT_CSV };
+
+// 캐시 항목이 유효한지 판단하는 키
+// 파일 크기나 수정 시간이 바뀌면 해당 항목만 무효화됨
+struct CacheKey {
+  int64_t size;
+  int64_t mtime_ns;
+  // --cache-hash 옵션을 사용한 경우에만 파일 앞부분의 해시를 비교 (사용하지 않으면 0)
+  uint64_t head_hash;
+};
+
+// 캐시 파일 레이아웃
+// [CacheHeader][CacheEntry x entry_count][CacheStream x stream_count][경로 문자열]
+// 항목은 path_hash 순으로 정렬되어 있어 mmap한 상태 그대로 이진 탐색할 수 있음
+struct CacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t entry_count;
+  uint64_t stream_count;
+  uint64_t string_size;
+};
+
+struct CacheEntry {
+  uint64_t path_hash;
+  int64_t size;
+  int64_t mtime_ns;
+  uint64_t head_hash;
+  uint64_t path_offset;
+  uint32_t path_length;
+  uint32_t stream_offset;
+  uint32_t stream_count;
+  uint32_t reserved;
+};
+
+struct CacheStream {
+  int64_t bit_rate;
+  int32_t index;
+  int32_t codec_type;
+  int32_t codec_id;
+  int32_t width;
+  int32_t height;
+  int32_t sample_rate;
+  int32_t channels;
+  int32_t reserved;
+};
+
+struct CacheRecord {
+  CacheKey key;
+  std::vector<StreamInfo> streams;
+};
+
+struct ProbeCache {
+  const char* filename;
+  bool use_head_hash;
+  // 이전 실행에서 저장한 캐시 파일을 mmap한 영역 (읽기 전용이므로 잠금 없이 조회)
+  uint8_t* data;
+  size_t data_size;
+  const CacheHeader* header;
+  const CacheEntry* entries;
+  const CacheStream* streams;
+  const char* strings;
+  // 이번 실행에서 새로 탐색한 결과
+  std::mutex mutex;
+  std::unordered_map<std::string, CacheRecord> updates;
+};
+
+struct ProbeOptions {
+  int timeout_ms;
+  // fast 모드에서는 헤더에 있는 정보만으로 충분하면 avformat_find_stream_info()를 생략함
+  bool fast;
+  int64_t probesize;
+  int64_t analyze_duration;
+  ProbeCache* cache;
+};
+
+struct BatchOptions {
+  const char* source;
+  const char* output_path;
+  OutputFormat format;
+  int jobs;
+  ProbeOptions probe;
+};
+
+// 파일 하나를 스캔할 때 사용하는 타임아웃 정보
+struct ProbeDeadline {
+  int64_t deadline_us;
+};
+
+int probe_file(const char* filename, const ProbeOptions& options, ScanResult* result);
+int probe_fast(const char* filename, const ProbeOptions& options, ProbeDeadline* deadline,
+               ScanResult* result);
+int probe_full(const char* filename, ProbeDeadline* deadline, ScanResult* result);
+int open_format(const char* filename, AVDictionary** av_options, ProbeDeadline* deadline,
+                AVFormatContext** av_format_ctx);
+bool has_required_fields(AVFormatContext* av_format_ctx);
+void extract_streams(AVFormatContext* av_format_ctx, ScanResult* result);
+void close_format(AVFormatContext** av_format_ctx, ScanResult* result);
+int interrupt_callback(void* opaque);
+int open_cache(const char* filename, bool use_head_hash, ProbeCache* cache);
+int make_cache_key(const char* filename, bool use_head_hash, CacheKey* key);
+bool lookup_cache(ProbeCache* cache, const std::string& path, const CacheKey& key,
+                  ScanResult* result);
+void update_cache(ProbeCache* cache, const CacheKey& key, const ScanResult& result);
+int save_cache(ProbeCache* cache);
+void close_cache(ProbeCache* cache);
+uint64_t hash_bytes(const void* data, size_t size);
+int collect_inputs(const char* source, std::vector<std::string>* paths);
+int walk_directory(const std::string& dirname, std::vector<std::string>* paths);
+int run_batch(const BatchOptions& options);
+std::string format_record(const ScanResult& result, OutputFormat format);
+std::string escape_json(const std::string& value);
+std::string escape_csv(const std::string& value);
+void print_result(const ScanResult& result);
 
 int main(int argc, const char** argv) {
   // FFmpeg 라이브러리의 로그 레벨을 지정할 수 있음
@@ -10,45 +162,863 @@ int main(int argc, const char** argv) {
 
   if (argc < 2) {
     printf("Couldn't find video file\n");
+    printf("usage: %s <file> [probe options]\n", argv[0]);
+    printf("       %s --batch <list file|directory> [--jobs N] [--format jsonl|csv] "
+           "[--output file] [--timeout ms] [probe options]\n",
+           argv[0]);
+    printf("probe options: [--fast] [--probesize bytes] [--analyzeduration us] "
+           "[--cache file] [--cache-hash]\n");
     return 0;
   }
 
-  // 컨테이너 정보를 담고 있는 AVFormatContext 구조체에 메모리 할당
-  AVFormatContext* av_format_ctx = avformat_alloc_context();
+  bool batch = strcmp(argv[1], "--batch") == 0;
+  if (batch && argc < 3) {
+    printf("Couldn't find list file or directory\n");
+    return 0;
+  }
 
-  // 만약 AVFormatContext 구조체를 메모리 할당하지 않았으면 avformat_open_input() 메서드가 자동으로 할당해줌
-  // AVFormatContext 구조체에 파일로부터 읽은 컨테이너 정보를 저장
-  if (avformat_open_input(&av_format_ctx, argv[1], nullptr, nullptr) < 0) {
-    printf("Couldn't open video file\n");
+  BatchOptions options;
+  options.source = batch ? argv[2] : argv[1];
+  options.output_path = nullptr;
+  options.format = OUTPUT_JSONL;
+  options.jobs = (int) std::thread::hardware_concurrency();
+  options.probe.timeout_ms = batch ? 10000 : 0;
+  options.probe.fast = false;
+  // fast 모드의 기본 제한값은 헤더를 읽기에 충분한 정도로만 작게 설정
+  options.probe.probesize = 32 * 1024;
+  options.probe.analyze_duration = 100 * 1000;
+  options.probe.cache = nullptr;
+
+  const char* cache_filename = nullptr;
+  bool cache_hash = false;
+
+  for (int index = batch ? 3 : 2; index < argc; ++index) {
+    if (strcmp(argv[index], "--fast") == 0) {
+      options.probe.fast = true;
+    } else if (strcmp(argv[index], "--probesize") == 0 && index + 1 < argc) {
+      options.probe.probesize = atoll(argv[++index]);
+    } else if (strcmp(argv[index], "--analyzeduration") == 0 && index + 1 < argc) {
+      options.probe.analyze_duration = atoll(argv[++index]);
+    } else if (strcmp(argv[index], "--timeout") == 0 && index + 1 < argc) {
+      options.probe.timeout_ms = atoi(argv[++index]);
+    } else if (strcmp(argv[index], "--cache") == 0 && index + 1 < argc) {
+      cache_filename = argv[++index];
+    } else if (strcmp(argv[index], "--cache-hash") == 0) {
+      cache_hash = true;
+    } else if (batch && strcmp(argv[index], "--jobs") == 0 && index + 1 < argc) {
+      options.jobs = atoi(argv[++index]);
+    } else if (batch && strcmp(argv[index], "--format") == 0 && index + 1 < argc) {
+      ++index;
+      if (strcmp(argv[index], "csv") == 0) {
+        options.format = OUTPUT_CSV;
+      } else if (strcmp(argv[index], "jsonl") == 0) {
+        options.format = OUTPUT_JSONL;
+      } else {
+        printf("Unknown output format : %s\n", argv[index]);
+        return 0;
+      }
+    } else if (batch && strcmp(argv[index], "--output") == 0 && index + 1 < argc) {
+      options.output_path = argv[++index];
+    } else {
+      printf("Unknown option : %s\n", argv[index]);
+      return 0;
+    }
+  }
+
+  ProbeCache cache;
+  if (cache_filename) {
+    open_cache(cache_filename, cache_hash, &cache);
+    options.probe.cache = &cache;
+  }
+
+  int ret = 0;
+  if (!batch) {
+    ScanResult result;
+    if (probe_file(options.source, options.probe, &result) < 0) {
+      printf("%s\n", result.error_message);
+      ret = 1;
+    } else {
+      print_result(result);
+    }
+  } else {
+    if (options.jobs <= 0) {
+      options.jobs = 1;
+    }
+
+    // 배치 모드에서는 파일마다 출력되는 FFmpeg 로그가 결과를 가리지 않도록 에러만 출력
+    av_log_set_level(AV_LOG_ERROR);
+
+    ret = run_batch(options) < 0 ? 1 : 0;
+  }
+
+  if (cache_filename) {
+    save_cache(&cache);
+    close_cache(&cache);
+  }
+
+  return ret;
+}
+
+int probe_file(const char* filename, const ProbeOptions& options, ScanResult* result) {
+  result->path = filename;
+  result->error = 0;
+  result->error_message = nullptr;
+  result->probe_path = nullptr;
+  result->bytes_read = 0;
+  result->streams.clear();
+
+  // 캐시에 크기와 수정 시간이 같은 항목이 있으면 미디어 파일을 열지 않고 바로 결과를 사용
+  CacheKey key;
+  bool has_key = false;
+  if (options.cache) {
+    has_key = make_cache_key(filename, options.cache->use_head_hash, &key) >= 0;
+    if (has_key && lookup_cache(options.cache, result->path, key, result)) {
+      return 0;
+    }
+  }
+
+  // 느리거나 멈춘 입력이 워커를 계속 점유하지 않도록 블로킹 I/O를 제한 시간 이후 중단시킴
+  // 제한 시간은 fast 경로와 full 경로를 합친 전체 시간에 적용됨
+  ProbeDeadline deadline;
+  deadline.deadline_us =
+          options.timeout_ms > 0 ? av_gettime_relative() + options.timeout_ms * 1000LL : 0;
+
+  int ret = 1;
+  if (options.fast) {
+    // 제한된 범위 안에서 필요한 정보를 모두 얻지 못했으면(1) 전체 탐색으로 다시 시도
+    ret = probe_fast(filename, options, &deadline, result);
+  }
+
+  if (ret > 0) {
+    ret = probe_full(filename, &deadline, result);
+  }
+
+  // 탐색에 실패한 파일은 다음 실행에서 다시 시도하도록 캐시에 저장하지 않음
+  if (ret == 0 && has_key) {
+    update_cache(options.cache, key, *result);
+  }
+
+  return ret;
+}
+
+int probe_fast(const char* filename, const ProbeOptions& options, ProbeDeadline* deadline,
+               ScanResult* result) {
+  AVFormatContext* av_format_ctx = nullptr;
+  AVDictionary* av_options = nullptr;
+
+  // probesize는 읽을 최대 바이트 수, analyzeduration은 분석할 최대 시간(마이크로초)
+  av_dict_set_int(&av_options, "probesize", FFMAX(options.probesize, (int64_t) 32), 0);
+  av_dict_set_int(&av_options, "analyzeduration", FFMAX(options.analyze_duration, (int64_t) 1),
+                  0);
+
+  int ret = open_format(filename, &av_options, deadline, &av_format_ctx);
+  av_dict_free(&av_options);
+  if (ret < 0) {
+    result->error = ret;
+    result->error_message = "Couldn't open video file";
+    return -1;
+  }
+
+  // MP4, MKV, MOV 같은 컨테이너는 헤더만 읽어도 해상도, 샘플레이트, 채널 정보가 채워짐
+  if (has_required_fields(av_format_ctx)) {
+    result->probe_path = "header";
+    extract_streams(av_format_ctx, result);
+    close_format(&av_format_ctx, result);
     return 0;
   }
 
-  // AVFormatContext 구조체에 스트림 관련 정보를 읽어서 저장
-  if (avformat_find_stream_info(av_format_ctx, nullptr) < 0) {
-    printf("Failed to retrieve input stream information\n");
+  // 헤더에 정보가 없으면 작은 probesize/analyzeduration 안에서만 패킷을 읽어 분석
+  if (avformat_find_stream_info(av_format_ctx, nullptr) >= 0 &&
+      has_required_fields(av_format_ctx)) {
+    result->probe_path = "limited";
+    extract_streams(av_format_ctx, result);
+    close_format(&av_format_ctx, result);
     return 0;
   }
 
+  close_format(&av_format_ctx, result);
+  return 1;
+}
+
+int probe_full(const char* filename, ProbeDeadline* deadline, ScanResult* result) {
+  AVFormatContext* av_format_ctx = nullptr;
+
+  int ret = open_format(filename, nullptr, deadline, &av_format_ctx);
+  if (ret < 0) {
+    result->error = ret;
+    result->error_message = "Couldn't open video file";
+    return -1;
+  }
+
+  // AVFormatContext 구조체에 스트림 관련 정보를 읽어서 저장
+  // 이 과정에서 일부 패킷을 디먹싱하고 디코딩까지 하기 때문에 시간이 가장 많이 소요됨
+  ret = avformat_find_stream_info(av_format_ctx, nullptr);
+  if (ret < 0) {
+    result->error = ret;
+    result->error_message = "Failed to retrieve input stream information";
+    close_format(&av_format_ctx, result);
+    return -1;
+  }
+
+  result->probe_path = "full";
+  extract_streams(av_format_ctx, result);
+  close_format(&av_format_ctx, result);
+
+  return 0;
+}
+
+int open_format(const char* filename, AVDictionary** av_options, ProbeDeadline* deadline,
+                AVFormatContext** av_format_ctx) {
+  // 컨테이너 정보를 담고 있는 AVFormatContext 구조체에 메모리 할당
+  *av_format_ctx = avformat_alloc_context();
+  if (!*av_format_ctx) {
+    return AVERROR(ENOMEM);
+  }
+
+  (*av_format_ctx)->interrupt_callback.callback = interrupt_callback;
+  (*av_format_ctx)->interrupt_callback.opaque = deadline;
+
+  // 만약 AVFormatContext 구조체를 메모리 할당하지 않았으면 avformat_open_input() 메서드가 자동으로 할당해줌
+  // AVFormatContext 구조체에 파일로부터 읽은 컨테이너 정보를 저장
+  // 실패하면 avformat_open_input() 함수가 AVFormatContext 구조체를 해제함
+  return avformat_open_input(av_format_ctx, filename, nullptr, av_options);
+}
+
+bool has_required_fields(AVFormatContext* av_format_ctx) {
+  bool found = false;
+
   for (int index = 0; index < av_format_ctx->nb_streams; ++index) {
-    // AVCodecParameters 구조체는 스트림에 사용된 코덱 속성에 대한 정보를 가지고 있음
     AVCodecParameters* av_codec_params = av_format_ctx->streams[index]->codecpar;
 
     if (av_codec_params->codec_type == AVMEDIA_TYPE_VIDEO) {
-      printf("-------- video info --------\n");
-      printf("codec_id : %d\n", av_codec_params->codec_id);
-      printf("bitrate : %lld\n", av_codec_params->bit_rate);
-      printf("width : %d, height : %d\n", av_codec_params->width, av_codec_params->height);
+      if (av_codec_params->codec_id == AV_CODEC_ID_NONE || av_codec_params->width <= 0 ||
+          av_codec_params->height <= 0) {
+        return false;
+      }
+      found = true;
     } else if (av_codec_params->codec_type == AVMEDIA_TYPE_AUDIO) {
-      printf("-------- audio info --------\n");
-      printf("codec_id : %d\n", av_codec_params->codec_id);
-      printf("bitrate : %lld\n", av_codec_params->bit_rate);
-      printf("sample_rate : %d\n", av_codec_params->sample_rate);
-      printf("number of channels : %d\n", av_codec_params->channels);
+      if (av_codec_params->codec_id == AV_CODEC_ID_NONE || av_codec_params->sample_rate <= 0 ||
+          av_codec_params->channels <= 0) {
+        return false;
+      }
+      found = true;
+    }
+  }
+
+  return found;
+}
+
+void extract_streams(AVFormatContext* av_format_ctx, ScanResult* result) {
+  for (int index = 0; index < av_format_ctx->nb_streams; ++index) {
+    // AVCodecParameters 구조체는 스트림에 사용된 코덱 속성에 대한 정보를 가지고 있음
+    AVCodecParameters* av_codec_params = av_format_ctx->streams[index]->codecpar;
+
+    if (av_codec_params->codec_type != AVMEDIA_TYPE_VIDEO &&
+        av_codec_params->codec_type != AVMEDIA_TYPE_AUDIO) {
+      continue;
     }
+
+    StreamInfo info;
+    info.index = index;
+    info.codec_type = av_codec_params->codec_type;
+    info.codec_id = av_codec_params->codec_id;
+    info.bit_rate = av_codec_params->bit_rate;
+    info.width = av_codec_params->width;
+    info.height = av_codec_params->height;
+    info.sample_rate = av_codec_params->sample_rate;
+    info.channels = av_codec_params->channels;
+    result->streams.push_back(info);
+  }
+}
+
+void close_format(AVFormatContext** av_format_ctx, ScanResult* result) {
+  // 닫기 전에 실제로 읽은 바이트 수를 누적
+  if ((*av_format_ctx)->pb) {
+    result->bytes_read += (*av_format_ctx)->pb->bytes_read;
   }
 
   // AVFormatContext 구조체에 할당한 메모리 해제
-  avformat_close_input(&av_format_ctx);
+  avformat_close_input(av_format_ctx);
+}
+
+int interrupt_callback(void* opaque) {
+  ProbeDeadline* deadline = (ProbeDeadline*) opaque;
+  return deadline->deadline_us > 0 && av_gettime_relative() > deadline->deadline_us;
+}
+
+int open_cache(const char* filename, bool use_head_hash, ProbeCache* cache) {
+  cache->filename = filename;
+  cache->use_head_hash = use_head_hash;
+  cache->data = nullptr;
+  cache->data_size = 0;
+  cache->header = nullptr;
+  cache->entries = nullptr;
+  cache->streams = nullptr;
+  cache->strings = nullptr;
+
+  // 캐시 파일이 없으면 빈 캐시로 시작
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return 0;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(CacheHeader)) {
+    close(fd);
+    return 0;
+  }
+
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    fprintf(stderr, "Couldn't map cache file : %s\n", filename);
+    return -1;
+  }
+
+  // 각 개수를 파일 크기로 먼저 제한해서 크기 계산이 overflow되지 않도록 함
+  const CacheHeader* header = (const CacheHeader*) data;
+  uint64_t file_size = (uint64_t) st.st_size;
+  bool valid = memcmp(header->magic, "SCNC", 4) == 0 && header->version == 1 &&
+               header->entry_count <= file_size / sizeof(CacheEntry) &&
+               header->stream_count <= file_size / sizeof(CacheStream) &&
+               header->string_size <= file_size &&
+               sizeof(CacheHeader) + header->entry_count * sizeof(CacheEntry) +
+                               header->stream_count * sizeof(CacheStream) +
+                               header->string_size ==
+                       file_size;
+
+  const CacheEntry* entries = (const CacheEntry*) ((uint8_t*) data + sizeof(CacheHeader));
+  // 조회할 때는 범위를 확인하지 않으므로 모든 항목의 경로와 스트림 범위, 정렬 순서를 여기서 확인
+  for (uint64_t index = 0; valid && index < header->entry_count; ++index) {
+    const CacheEntry& entry = entries[index];
+    valid = entry.path_offset <= header->string_size &&
+            entry.path_length <= header->string_size - entry.path_offset &&
+            entry.stream_offset <= header->stream_count &&
+            entry.stream_count <= header->stream_count - entry.stream_offset &&
+            (index == 0 || entries[index - 1].path_hash <= entry.path_hash);
+  }
+
+  if (!valid) {
+    // 형식이 다르거나 손상된 캐시 파일은 무시하고 새로 만듦
+    fprintf(stderr, "Ignoring invalid cache file : %s\n", filename);
+    munmap(data, st.st_size);
+    return 0;
+  }
+
+  cache->data = (uint8_t*) data;
+  cache->data_size = st.st_size;
+  cache->header = header;
+  cache->entries = entries;
+  cache->streams = (const CacheStream*) (cache->entries + header->entry_count);
+  cache->strings = (const char*) (cache->streams + header->stream_count);
+
+  // 워커 스레드들이 처음부터 순서대로 항목을 조회하지는 않으므로 미리 읽어두도록 알림
+  madvise(cache->data, cache->data_size, MADV_WILLNEED);
 
   return 0;
-}
\ No newline at end of file
+}
+
+int make_cache_key(const char* filename, bool use_head_hash, CacheKey* key) {
+  // stat()은 파일 내용을 읽지 않고 메타데이터만 조회함
+  struct stat st;
+  if (stat(filename, &st) < 0) {
+    return -1;
+  }
+
+  key->size = st.st_size;
+  key->mtime_ns = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+  key->head_hash = 0;
+
+  if (use_head_hash) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+      return -1;
+    }
+
+    uint8_t buffer[64 * 1024];
+    size_t length = fread(buffer, 1, sizeof(buffer), file);
+    fclose(file);
+    key->head_hash = hash_bytes(buffer, length);
+  }
+
+  return 0;
+}
+
+bool lookup_cache(ProbeCache* cache, const std::string& path, const CacheKey& key,
+                  ScanResult* result) {
+  if (!cache->header) {
+    return false;
+  }
+
+  uint64_t path_hash = hash_bytes(path.data(), path.size());
+
+  // path_hash 순으로 정렬되어 있으므로 같은 해시를 가진 첫 항목을 이진 탐색으로 찾음
+  const CacheEntry* begin = cache->entries;
+  const CacheEntry* end = cache->entries + cache->header->entry_count;
+  const CacheEntry* entry =
+          std::lower_bound(begin, end, path_hash, [](const CacheEntry& entry, uint64_t hash) {
+            return entry.path_hash < hash;
+          });
+
+  for (; entry != end && entry->path_hash == path_hash; ++entry) {
+    if (entry->path_length != path.size() ||
+        memcmp(cache->strings + entry->path_offset, path.data(), path.size()) != 0) {
+      continue;
+    }
+
+    if (entry->size != key.size || entry->mtime_ns != key.mtime_ns ||
+        entry->head_hash != key.head_hash) {
+      return false;
+    }
+
+    for (uint32_t index = 0; index < entry->stream_count; ++index) {
+      const CacheStream& stream = cache->streams[entry->stream_offset + index];
+      StreamInfo info;
+      info.index = stream.index;
+      info.codec_type = (AVMediaType) stream.codec_type;
+      info.codec_id = (AVCodecID) stream.codec_id;
+      info.bit_rate = stream.bit_rate;
+      info.width = stream.width;
+      info.height = stream.height;
+      info.sample_rate = stream.sample_rate;
+      info.channels = stream.channels;
+      result->streams.push_back(info);
+    }
+    result->probe_path = "cache";
+    return true;
+  }
+
+  return false;
+}
+
+void update_cache(ProbeCache* cache, const CacheKey& key, const ScanResult& result) {
+  CacheRecord record;
+  record.key = key;
+  record.streams = result.streams;
+
+  std::lock_guard<std::mutex> lock(cache->mutex);
+  cache->updates[result.path] = record;
+}
+
+int save_cache(ProbeCache* cache) {
+  if (cache->updates.empty()) {
+    return 0;
+  }
+
+  struct PendingEntry {
+    uint64_t path_hash;
+    const char* path;
+    uint32_t path_length;
+    CacheKey key;
+    const CacheStream* old_streams;
+    const std::vector<StreamInfo>* new_streams;
+    uint32_t stream_count;
+  };
+
+  std::vector<PendingEntry> pending;
+  pending.reserve(cache->updates.size() + (cache->header ? cache->header->entry_count : 0));
+
+  // 이번 실행에서 갱신되지 않은 기존 항목은 그대로 유지
+  if (cache->header) {
+    for (uint64_t index = 0; index < cache->header->entry_count; ++index) {
+      const CacheEntry& entry = cache->entries[index];
+      std::string path(cache->strings + entry.path_offset, entry.path_length);
+      if (cache->updates.count(path)) {
+        continue;
+      }
+
+      PendingEntry item;
+      item.path_hash = entry.path_hash;
+      item.path = cache->strings + entry.path_offset;
+      item.path_length = entry.path_length;
+      item.key.size = entry.size;
+      item.key.mtime_ns = entry.mtime_ns;
+      item.key.head_hash = entry.head_hash;
+      item.old_streams = cache->streams + entry.stream_offset;
+      item.new_streams = nullptr;
+      item.stream_count = entry.stream_count;
+      pending.push_back(item);
+    }
+  }
+
+  for (const auto& update : cache->updates) {
+    PendingEntry item;
+    item.path_hash = hash_bytes(update.first.data(), update.first.size());
+    item.path = update.first.data();
+    item.path_length = (uint32_t) update.first.size();
+    item.key = update.second.key;
+    item.old_streams = nullptr;
+    item.new_streams = &update.second.streams;
+    item.stream_count = (uint32_t) update.second.streams.size();
+    pending.push_back(item);
+  }
+
+  std::sort(pending.begin(), pending.end(), [](const PendingEntry& a, const PendingEntry& b) {
+    return a.path_hash < b.path_hash;
+  });
+
+  CacheHeader header;
+  memcpy(header.magic, "SCNC", 4);
+  header.version = 1;
+  header.entry_count = pending.size();
+  header.stream_count = 0;
+  header.string_size = 0;
+
+  std::vector<CacheEntry> entries(pending.size());
+  std::vector<CacheStream> streams;
+  for (size_t index = 0; index < pending.size(); ++index) {
+    const PendingEntry& item = pending[index];
+    CacheEntry& entry = entries[index];
+    entry.path_hash = item.path_hash;
+    entry.size = item.key.size;
+    entry.mtime_ns = item.key.mtime_ns;
+    entry.head_hash = item.key.head_hash;
+    entry.path_offset = header.string_size;
+    entry.path_length = item.path_length;
+    entry.stream_offset = (uint32_t) streams.size();
+    entry.stream_count = item.stream_count;
+    entry.reserved = 0;
+    header.string_size += item.path_length;
+
+    if (item.old_streams) {
+      streams.insert(streams.end(), item.old_streams, item.old_streams + item.stream_count);
+      continue;
+    }
+
+    for (const StreamInfo& info : *item.new_streams) {
+      CacheStream stream;
+      stream.bit_rate = info.bit_rate;
+      stream.index = info.index;
+      stream.codec_type = info.codec_type;
+      stream.codec_id = info.codec_id;
+      stream.width = info.width;
+      stream.height = info.height;
+      stream.sample_rate = info.sample_rate;
+      stream.channels = info.channels;
+      stream.reserved = 0;
+      streams.push_back(stream);
+    }
+  }
+  header.stream_count = streams.size();
+
+  // 기존 캐시 파일을 mmap한 상태이므로 임시 파일에 쓴 후 rename()으로 교체
+  std::string temp_filename = std::string(cache->filename) + ".tmp";
+  FILE* file = fopen(temp_filename.c_str(), "wb");
+  if (!file) {
+    fprintf(stderr, "Couldn't create cache file : %s\n", temp_filename.c_str());
+    return -1;
+  }
+
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+  if (!entries.empty()) {
+    written = written && fwrite(entries.data(), sizeof(CacheEntry), entries.size(), file) ==
+                                 entries.size();
+  }
+  if (!streams.empty()) {
+    written = written && fwrite(streams.data(), sizeof(CacheStream), streams.size(), file) ==
+                                 streams.size();
+  }
+  for (const PendingEntry& item : pending) {
+    written = written && fwrite(item.path, 1, item.path_length, file) == item.path_length;
+  }
+
+  if (fclose(file) != 0 || !written || rename(temp_filename.c_str(), cache->filename) < 0) {
+    fprintf(stderr, "Failed to write cache file : %s\n", cache->filename);
+    unlink(temp_filename.c_str());
+    return -1;
+  }
+
+  return 0;
+}
+
+void close_cache(ProbeCache* cache) {
+  if (cache->data) {
+    munmap(cache->data, cache->data_size);
+    cache->data = nullptr;
+  }
+  cache->header = nullptr;
+  cache->updates.clear();
+}
+
+uint64_t hash_bytes(const void* data, size_t size) {
+  // FNV-1a 64비트 해시
+  const uint8_t* bytes = (const uint8_t*) data;
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t index = 0; index < size; ++index) {
+    hash ^= bytes[index];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+int collect_inputs(const char* source, std::vector<std::string>* paths) {
+  struct stat st;
+  if (stat(source, &st) < 0) {
+    printf("Couldn't find list file or directory : %s\n", source);
+    return -1;
+  }
+
+  if (S_ISDIR(st.st_mode)) {
+    return walk_directory(source, paths);
+  }
+
+  // 목록 파일은 한 줄에 경로 하나씩 기록되어 있음
+  FILE* list_file = fopen(source, "r");
+  if (!list_file) {
+    printf("Couldn't open list file : %s\n", source);
+    return -1;
+  }
+
+  char line[4096];
+  while (fgets(line, sizeof(line), list_file)) {
+    size_t length = strlen(line);
+    while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+      line[--length] = '\0';
+    }
+    if (length > 0) {
+      paths->push_back(line);
+    }
+  }
+
+  fclose(list_file);
+  return 0;
+}
+
+int walk_directory(const std::string& dirname, std::vector<std::string>* paths) {
+  DIR* dir = opendir(dirname.c_str());
+  if (!dir) {
+    printf("Couldn't open directory : %s\n", dirname.c_str());
+    return -1;
+  }
+
+  struct dirent* entry;
+  while ((entry = readdir(dir))) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+
+    std::string path = dirname + "/" + entry->d_name;
+    struct stat st;
+    if (stat(path.c_str(), &st) < 0) {
+      continue;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+      walk_directory(path, paths);
+    } else if (S_ISREG(st.st_mode)) {
+      paths->push_back(path);
+    }
+  }
+
+  closedir(dir);
+  return 0;
+}
+
+int run_batch(const BatchOptions& options) {
+  std::vector<std::string> paths;
+  if (collect_inputs(options.source, &paths) < 0) {
+    return -1;
+  }
+
+  FILE* output = stdout;
+  if (options.output_path) {
+    output = fopen(options.output_path, "w");
+    if (!output) {
+      printf("Couldn't create output file : %s\n", options.output_path);
+      return -1;
+    }
+  }
+
+  if (options.format == OUTPUT_CSV) {
+    fprintf(output, "path,status,probe,bytes_read,video_codec_id,video_bitrate,width,height,"
+                    "audio_codec_id,audio_bitrate,sample_rate,channels\n");
+  }
+
+  // 워커들은 공유 인덱스에서 다음 파일을 하나씩 가져가므로
+  // 느린 파일이 있어도 나머지 워커는 계속 다른 파일을 처리함
+  std::atomic<size_t> next_index(0);
+  std::atomic<size_t> failed_count(0);
+  std::atomic<size_t> cache_count(0), header_count(0), limited_count(0), full_count(0);
+  std::atomic<int64_t> total_bytes_read(0);
+  std::mutex output_mutex;
+
+  int64_t start_time = av_gettime_relative();
+
+  auto worker = [&]() {
+    ScanResult result;
+    while (true) {
+      size_t index = next_index.fetch_add(1);
+      if (index >= paths.size()) {
+        break;
+      }
+
+      if (probe_file(paths[index].c_str(), options.probe, &result) < 0) {
+        ++failed_count;
+      } else if (strcmp(result.probe_path, "cache") == 0) {
+        ++cache_count;
+      } else if (strcmp(result.probe_path, "header") == 0) {
+        ++header_count;
+      } else if (strcmp(result.probe_path, "limited") == 0) {
+        ++limited_count;
+      } else {
+        ++full_count;
+      }
+      total_bytes_read += result.bytes_read;
+
+      std::string record = format_record(result, options.format);
+
+      std::lock_guard<std::mutex> lock(output_mutex);
+      fwrite(record.data(), 1, record.size(), output);
+    }
+  };
+
+  int jobs = (int) FFMIN((size_t) options.jobs, FFMAX(paths.size(), (size_t) 1));
+  std::vector<std::thread> workers;
+  for (int index = 0; index < jobs; ++index) {
+    workers.emplace_back(worker);
+  }
+  for (std::thread& thread : workers) {
+    thread.join();
+  }
+
+  double elapsed = (av_gettime_relative() - start_time) / 1000000.0;
+
+  if (output != stdout) {
+    fclose(output);
+  }
+
+  fprintf(stderr, "scanned %zu files (%zu failed) with %d jobs in %.3f sec (%.1f files/sec)\n",
+          paths.size(), failed_count.load(), jobs, elapsed,
+          elapsed > 0 ? paths.size() / elapsed : 0.0);
+  fprintf(stderr,
+          "probe path : cache %zu, header %zu, limited %zu, full %zu / bytes read : %lld\n",
+          cache_count.load(), header_count.load(), limited_count.load(), full_count.load(),
+          (long long) total_bytes_read.load());
+
+  return 0;
+}
+
+std::string format_record(const ScanResult& result, OutputFormat format) {
+  char buffer[256];
+  std::string record;
+
+  if (format == OUTPUT_CSV) {
+    const StreamInfo* video = nullptr;
+    const StreamInfo* audio = nullptr;
+    for (const StreamInfo& info : result.streams) {
+      if (info.codec_type == AVMEDIA_TYPE_VIDEO && !video) {
+        video = &info;
+      } else if (info.codec_type == AVMEDIA_TYPE_AUDIO && !audio) {
+        audio = &info;
+      }
+    }
+
+    record = escape_csv(result.path);
+    snprintf(buffer, sizeof(buffer), ",%s,%s,%lld", result.error < 0 ? "error" : "ok",
+             result.probe_path ? result.probe_path : "", (long long) result.bytes_read);
+    record += buffer;
+    if (video) {
+      snprintf(buffer, sizeof(buffer), ",%d,%lld,%d,%d", video->codec_id,
+               (long long) video->bit_rate, video->width, video->height);
+    } else {
+      snprintf(buffer, sizeof(buffer), ",,,,");
+    }
+    record += buffer;
+    if (audio) {
+      snprintf(buffer, sizeof(buffer), ",%d,%lld,%d,%d", audio->codec_id,
+               (long long) audio->bit_rate, audio->sample_rate, audio->channels);
+    } else {
+      snprintf(buffer, sizeof(buffer), ",,,,");
+    }
+    record += buffer;
+    record += "\n";
+    return record;
+  }
+
+  record = "{\"path\":\"" + escape_json(result.path) + "\"";
+  if (result.error < 0) {
+    char error_string[AV_ERROR_MAX_STRING_SIZE];
+    av_strerror(result.error, error_string, sizeof(error_string));
+    record += ",\"status\":\"error\",\"message\":\"" + escape_json(result.error_message) +
+              "\",\"error\":\"" + escape_json(error_string) + "\"}\n";
+    return record;
+  }
+
+  snprintf(buffer, sizeof(buffer), ",\"status\":\"ok\",\"probe\":\"%s\",\"bytes_read\":%lld",
+           result.probe_path, (long long) result.bytes_read);
+  record += buffer;
+  record += ",\"streams\":[";
+  for (size_t index = 0; index < result.streams.size(); ++index) {
+    const StreamInfo& info = result.streams[index];
+    if (info.codec_type == AVMEDIA_TYPE_VIDEO) {
+      snprintf(buffer, sizeof(buffer),
+               "%s{\"index\":%d,\"type\":\"video\",\"codec_id\":%d,\"bitrate\":%lld,"
+               "\"width\":%d,\"height\":%d}",
+               index > 0 ? "," : "", info.index, info.codec_id, (long long) info.bit_rate,
+               info.width, info.height);
+    } else {
+      snprintf(buffer, sizeof(buffer),
+               "%s{\"index\":%d,\"type\":\"audio\",\"codec_id\":%d,\"bitrate\":%lld,"
+               "\"sample_rate\":%d,\"channels\":%d}",
+               index > 0 ? "," : "", info.index, info.codec_id, (long long) info.bit_rate,
+               info.sample_rate, info.channels);
+    }
+    record += buffer;
+  }
+  record += "]}\n";
+
+  return record;
+}
+
+std::string escape_json(const std::string& value) {
+  std::string escaped;
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if ((unsigned char) c < 0x20) {
+      char buffer[8];
+      snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+      escaped += buffer;
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+std::string escape_csv(const std::string& value) {
+  if (value.find_first_of(",\"\n") == std::string::npos) {
+    return value;
+  }
+
+  std::string escaped = "\"";
+  for (char c : value) {
+    if (c == '"') {
+      escaped += '"';
+    }
+    escaped += c;
+  }
+  escaped += "\"";
+  return escaped;
+}
+
+void print_result(const ScanResult& result) {
+  printf("probe path : %s / bytes read : %lld\n", result.probe_path,
+         (long long) result.bytes_read);
+
+  for (const StreamInfo& info : result.streams) {
+    if (info.codec_type == AVMEDIA_TYPE_VIDEO) {
+      printf("-------- video info --------\n");
+      printf("codec_id : %d\n", info.codec_id);
+      printf("bitrate : %lld\n", (long long) info.bit_rate);
+      printf("width : %d, height : %d\n", info.width, info.height);
+    } else if (info.codec_type == AVMEDIA_TYPE_AUDIO) {
+      printf("-------- audio info --------\n");
+      printf("codec_id : %d\n", info.codec_id);
+      printf("bitrate : %lld\n", (long long) info.bit_rate);
+      printf("sample_rate : %d\n", info.sample_rate);
+      printf("number of channels : %d\n", info.channels);
+    }
+  }
+}
@@ -1,18 +1,92 @@
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
+#include <libavutil/time.h>
 }
+#include <algorithm>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+// mmap으로 매핑한 입력 파일
+struct MappedFile {
+  uint8_t* data;
+  int64_t size;
+  int64_t pos;
+};
 
 struct FileContext {
   AVFormatContext* av_format_ctx;
+  AVIOContext* avio_ctx;
+  MappedFile mapped_file;
   int v_index;
   int a_index;
 };
 
+// 인덱스 파일 레이아웃
+// [IndexHeader][IndexStream x stream_count][IndexEntry x entry_count]
+// 모든 레코드가 고정 크기이므로 mmap한 상태 그대로 사용할 수 있음
+struct IndexHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t stream_count;
+  uint32_t reserved;
+  uint64_t entry_count;
+  // 인덱스를 만든 입력 파일의 크기와 수정 시간 (파일이 바뀌면 인덱스를 사용하지 않음)
+  int64_t file_size;
+  int64_t mtime_ns;
+};
+
+struct IndexStream {
+  int32_t index;
+  int32_t codec_type;
+  int32_t time_base_num;
+  int32_t time_base_den;
+  uint64_t entry_offset;
+  uint64_t entry_count;
+  uint64_t packet_count;
+};
+
+// 스트림별 키프레임 정보 (pts 순으로 정렬)
+struct IndexEntry {
+  int64_t pts;
+  int64_t dts;
+  int64_t pos;
+  int32_t size;
+  int32_t flags;
+};
+
+// 명령행에서 지정한 스트림 선택 조건
+// nullptr이면 해당 타입의 첫 번째 스트림, "none"이면 사용하지 않음,
+// 숫자면 스트림 인덱스, 그 외에는 language 메타데이터(예: eng, kor)로 선택
+struct StreamSelection {
+  const char* video;
+  const char* audio;
+  // 선택하지 않은 스트림을 디먹서 단계에서 버릴지 여부 (--no-discard로 비교 가능)
+  bool discard;
+};
+
 FileContext input_ctx;
 
-int open_input(const char* filename);
+int open_input(const char* filename, bool use_mmap, const StreamSelection& selection);
+bool match_stream(AVStream* av_stream, const char* spec);
+void discard_unused_streams(const StreamSelection& selection);
+void print_read_stats(int64_t packet_count, int64_t dropped_count);
+int open_mapped_input(const char* filename, MappedFile* mapped_file, AVIOContext** avio_ctx);
+int read_mapped_file(void* opaque, uint8_t* buf, int buf_size);
+int64_t seek_mapped_file(void* opaque, int64_t offset, int whence);
+void close_mapped_input(MappedFile* mapped_file, AVIOContext** avio_ctx);
+double get_cpu_time();
+int64_t get_file_mtime(const char* filename);
+int build_index(const char* filename, const char* index_filename);
+int seek_with_index(const char* filename, const char* index_filename, int stream_index,
+                    double seconds);
 void release();
 
 int main(int argc, const char** argv) {
@@ -20,18 +94,82 @@ int main(int argc, const char** argv) {
 
   if (argc < 2) {
     printf("Couldn't find video file\n");
+    printf("usage: %s <file> [--mmap] [--bench]\n", argv[0]);
+    printf("       %s <file> [--mmap] --build-index <index file>\n", argv[0]);
+    printf("       %s <file> [--mmap] --seek <index file> <stream index> <seconds>\n", argv[0]);
+    printf("stream options: [--video index|lang|none] [--audio index|lang|none] "
+           "[--no-discard]\n");
     return 0;
   }
 
-  if (open_input(argv[1]) < 0) {
+  bool use_mmap = false;
+  StreamSelection selection;
+  selection.video = nullptr;
+  selection.audio = nullptr;
+  selection.discard = true;
+  bool bench = false;
+  const char* build_index_filename = nullptr;
+  const char* seek_index_filename = nullptr;
+  int seek_stream_index = -1;
+  double seek_seconds = 0;
+
+  for (int index = 2; index < argc; ++index) {
+    if (strcmp(argv[index], "--mmap") == 0) {
+      use_mmap = true;
+    } else if (strcmp(argv[index], "--video") == 0 && index + 1 < argc) {
+      selection.video = argv[++index];
+    } else if (strcmp(argv[index], "--audio") == 0 && index + 1 < argc) {
+      selection.audio = argv[++index];
+    } else if (strcmp(argv[index], "--no-discard") == 0) {
+      selection.discard = false;
+    } else if (strcmp(argv[index], "--bench") == 0) {
+      bench = true;
+    } else if (strcmp(argv[index], "--build-index") == 0 && index + 1 < argc) {
+      build_index_filename = argv[++index];
+    } else if (strcmp(argv[index], "--seek") == 0 && index + 3 < argc) {
+      seek_index_filename = argv[++index];
+      seek_stream_index = atoi(argv[++index]);
+      seek_seconds = atof(argv[++index]);
+    } else {
+      printf("Unknown option : %s\n", argv[index]);
+      return 0;
+    }
+  }
+
+  // 인덱스는 모든 스트림의 키프레임을 기록해야 하고, 탐색은 선택하지 않은 스트림도 대상이 될 수
+  // 있으므로 선택하지 않은 스트림도 버리지 않음
+  if (build_index_filename || seek_index_filename) {
+    selection.discard = false;
+  }
+
+  if (open_input(argv[1], use_mmap, selection) < 0) {
     release();
-    return 0;
+    return 1;
+  }
+
+  if (build_index_filename) {
+    int ret = build_index(argv[1], build_index_filename);
+    release();
+    return ret < 0 ? 1 : 0;
+  }
+
+  if (seek_index_filename) {
+    int ret = seek_with_index(argv[1], seek_index_filename, seek_stream_index, seek_seconds);
+    release();
+    return ret < 0 ? 1 : 0;
   }
 
   // AVPacket 구조체는 코덱으로 압축된 스트림 데이터를 저장하는 데 사용
   AVPacket av_packet;
   int ret;
 
+  // --bench 옵션을 사용하면 패킷마다 출력하지 않고 처리량과 CPU 사용량만 측정
+  int64_t packet_count = 0;
+  int64_t dropped_count = 0;
+  int64_t byte_count = 0;
+  int64_t start_time = av_gettime_relative();
+  double start_cpu_time = get_cpu_time();
+
   while (true) {
     // AVFormatContext 구조체로부터 패킷을 순서대로 읽어 AVPacket 구조체에 저장
     ret = av_read_frame(input_ctx.av_format_ctx, &av_packet);
@@ -39,27 +177,69 @@ int main(int argc, const char** argv) {
       //더 이상 읽어올 패킷이 없음
       printf("End of frame");
       break;
+    } else if (ret < 0) {
+      printf("Error occurred when reading packet\n");
+      break;
     }
 
-    if (av_packet.stream_index == input_ctx.v_index) {
-      printf("Video packet\n");
-    } else if (av_packet.stream_index == input_ctx.a_index) {
-      printf("Audio packet\n");
+    ++packet_count;
+    byte_count += av_packet.size;
+
+    if (av_packet.stream_index != input_ctx.v_index &&
+        av_packet.stream_index != input_ctx.a_index) {
+      // 선택하지 않은 스트림의 패킷 (--no-discard를 사용한 경우에만 도달)
+      ++dropped_count;
+    } else if (!bench) {
+      if (av_packet.stream_index == input_ctx.v_index) {
+        printf("Video packet\n");
+      } else {
+        printf("Audio packet\n");
+      }
     }
 
     // AVPacket 구조체에 할당한 메모리 해제
     av_packet_unref(&av_packet);
   }
 
+  printf("\n");
+  print_read_stats(packet_count, dropped_count);
+
+  if (bench) {
+    double elapsed = (av_gettime_relative() - start_time) / 1000000.0;
+    double cpu_time = get_cpu_time() - start_cpu_time;
+    double gigabytes = byte_count / (1024.0 * 1024.0 * 1024.0);
+    printf("[%s] packets : %lld, bytes : %lld, elapsed : %.3f sec, cpu : %.3f sec\n",
+           use_mmap ? "mmap" : "file", (long long) packet_count, (long long) byte_count, elapsed,
+           cpu_time);
+    printf("[%s] %.1f packets/sec, %.1f MB/sec, %.3f cpu sec/GB\n", use_mmap ? "mmap" : "file",
+           elapsed > 0 ? packet_count / elapsed : 0.0,
+           elapsed > 0 ? byte_count / elapsed / (1024.0 * 1024.0) : 0.0,
+           gigabytes > 0 ? cpu_time / gigabytes : 0.0);
+  }
+
   release();
 
-  return 0;
+  return ret == AVERROR_EOF ? 0 : 1;
 }
 
-int open_input(const char* filename) {
+int open_input(const char* filename, bool use_mmap, const StreamSelection& selection) {
   input_ctx.av_format_ctx = nullptr;
+  input_ctx.avio_ctx = nullptr;
   input_ctx.v_index = input_ctx.a_index = -1;
 
+  // 기본 file 프로토콜 대신 mmap으로 매핑한 메모리에서 바로 읽는 AVIOContext를 사용
+  if (use_mmap) {
+    if (open_mapped_input(filename, &input_ctx.mapped_file, &input_ctx.avio_ctx) < 0) {
+      return -1;
+    }
+
+    input_ctx.av_format_ctx = avformat_alloc_context();
+    if (!input_ctx.av_format_ctx) {
+      return -1;
+    }
+    input_ctx.av_format_ctx->pb = input_ctx.avio_ctx;
+  }
+
   if (avformat_open_input(&input_ctx.av_format_ctx, filename, nullptr, nullptr) < 0) {
     printf("Couldn't open video file\n");
     return -1;
@@ -71,10 +251,13 @@ int open_input(const char* filename) {
   }
 
   for (int index = 0; index < input_ctx.av_format_ctx->nb_streams; ++index) {
-    AVCodecParameters* av_codec_params = input_ctx.av_format_ctx->streams[index]->codecpar;
-    if (av_codec_params->codec_type == AVMEDIA_TYPE_VIDEO && input_ctx.v_index < 0) {
+    AVStream* av_stream = input_ctx.av_format_ctx->streams[index];
+    AVCodecParameters* av_codec_params = av_stream->codecpar;
+    if (av_codec_params->codec_type == AVMEDIA_TYPE_VIDEO && input_ctx.v_index < 0 &&
+        match_stream(av_stream, selection.video)) {
       input_ctx.v_index = index;
-    } else if (av_codec_params->codec_type == AVMEDIA_TYPE_AUDIO && input_ctx.a_index < 0) {
+    } else if (av_codec_params->codec_type == AVMEDIA_TYPE_AUDIO && input_ctx.a_index < 0 &&
+               match_stream(av_stream, selection.audio)) {
       input_ctx.a_index = index;
     }
   }
@@ -84,6 +267,394 @@ int open_input(const char* filename) {
     return -1;
   }
 
+  discard_unused_streams(selection);
+
+  return 0;
+}
+
+bool match_stream(AVStream* av_stream, const char* spec) {
+  if (!spec) {
+    return true;
+  }
+
+  if (strcmp(spec, "none") == 0) {
+    return false;
+  }
+
+  if (spec[0] >= '0' && spec[0] <= '9') {
+    return av_stream->index == atoi(spec);
+  }
+
+  AVDictionaryEntry* language = av_dict_get(av_stream->metadata, "language", nullptr, 0);
+  return language && strcmp(language->value, spec) == 0;
+}
+
+void discard_unused_streams(const StreamSelection& selection) {
+  if (!selection.discard) {
+    return;
+  }
+
+  // AVDISCARD_ALL로 지정한 스트림은 디먹서가 패킷을 만들지 않으므로
+  // av_read_frame() 함수가 해당 패킷을 할당하거나 복사하지 않음
+  for (int index = 0; index < input_ctx.av_format_ctx->nb_streams; ++index) {
+    if (index != input_ctx.v_index && index != input_ctx.a_index) {
+      input_ctx.av_format_ctx->streams[index]->discard = AVDISCARD_ALL;
+    }
+  }
+}
+
+void print_read_stats(int64_t packet_count, int64_t dropped_count) {
+  AVIOContext* pb = input_ctx.av_format_ctx->pb;
+  printf("packets read : %lld (dropped %lld), bytes read : %lld\n", (long long) packet_count,
+         (long long) dropped_count, pb ? (long long) pb->bytes_read : -1LL);
+}
+
+int open_mapped_input(const char* filename, MappedFile* mapped_file, AVIOContext** avio_ctx) {
+  mapped_file->data = nullptr;
+  mapped_file->size = 0;
+  mapped_file->pos = 0;
+
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    printf("Couldn't open input file %s\n", filename);
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+    printf("Couldn't map empty or unknown size file %s\n", filename);
+    close(fd);
+    return -1;
+  }
+
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    printf("Couldn't map input file %s\n", filename);
+    return -1;
+  }
+
+  // 대부분 앞에서부터 순서대로 읽으므로 커널이 미리 읽어두도록 알림
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+  madvise(data, st.st_size, MADV_WILLNEED);
+
+  mapped_file->data = (uint8_t*) data;
+  mapped_file->size = st.st_size;
+
+  // AVIOContext 내부 버퍼는 av_malloc()으로 할당해야 하며 해제도 직접 해야 함
+  const int buffer_size = 32 * 1024;
+  uint8_t* buffer = (uint8_t*) av_malloc(buffer_size);
+  if (!buffer) {
+    return -1;
+  }
+
+  *avio_ctx = avio_alloc_context(buffer, buffer_size, 0, mapped_file, read_mapped_file, nullptr,
+                                 seek_mapped_file);
+  if (!*avio_ctx) {
+    av_free(buffer);
+    printf("Couldn't create AVIOContext\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+int read_mapped_file(void* opaque, uint8_t* buf, int buf_size) {
+  MappedFile* mapped_file = (MappedFile*) opaque;
+
+  int64_t remaining = mapped_file->size - mapped_file->pos;
+  if (remaining <= 0) {
+    return AVERROR_EOF;
+  }
+
+  // read() 시스템 콜 없이 매핑된 메모리에서 바로 복사
+  int size = (int) FFMIN((int64_t) buf_size, remaining);
+  memcpy(buf, mapped_file->data + mapped_file->pos, size);
+  mapped_file->pos += size;
+
+  return size;
+}
+
+int64_t seek_mapped_file(void* opaque, int64_t offset, int whence) {
+  MappedFile* mapped_file = (MappedFile*) opaque;
+
+  // AVSEEK_SIZE는 위치를 바꾸지 않고 파일 크기만 요청하는 경우
+  if (whence & AVSEEK_SIZE) {
+    return mapped_file->size;
+  }
+
+  int64_t pos;
+  switch (whence & ~AVSEEK_FORCE) {
+    case SEEK_SET:
+      pos = offset;
+      break;
+    case SEEK_CUR:
+      pos = mapped_file->pos + offset;
+      break;
+    case SEEK_END:
+      pos = mapped_file->size + offset;
+      break;
+    default:
+      return AVERROR(EINVAL);
+  }
+
+  if (pos < 0 || pos > mapped_file->size) {
+    return AVERROR(EINVAL);
+  }
+
+  // 임의 위치로 이동한 경우 이동한 위치부터 미리 읽어두도록 알림
+  if (pos != mapped_file->pos && pos < mapped_file->size) {
+    int64_t page_size = sysconf(_SC_PAGESIZE);
+    int64_t start = pos / page_size * page_size;
+    madvise(mapped_file->data + start, FFMIN(mapped_file->size - start, (int64_t) 4 << 20),
+            MADV_WILLNEED);
+  }
+
+  mapped_file->pos = pos;
+  return pos;
+}
+
+void close_mapped_input(MappedFile* mapped_file, AVIOContext** avio_ctx) {
+  if (*avio_ctx) {
+    av_freep(&(*avio_ctx)->buffer);
+    avio_context_free(avio_ctx);
+  }
+
+  if (mapped_file->data) {
+    munmap(mapped_file->data, mapped_file->size);
+    mapped_file->data = nullptr;
+  }
+}
+
+double get_cpu_time() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+}
+
+int64_t get_file_mtime(const char* filename) {
+  struct stat st;
+  if (stat(filename, &st) < 0) {
+    return -1;
+  }
+  return st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+}
+
+int build_index(const char* filename, const char* index_filename) {
+  AVFormatContext* av_format_ctx = input_ctx.av_format_ctx;
+  std::vector<std::vector<IndexEntry>> keyframes(av_format_ctx->nb_streams);
+  std::vector<uint64_t> packet_counts(av_format_ctx->nb_streams, 0);
+
+  AVPacket av_packet;
+  int ret;
+
+  // 디먹싱 루프에서 버리던 pts, dts, pos, size, 키프레임 플래그를 스트림별로 모음
+  while (true) {
+    ret = av_read_frame(av_format_ctx, &av_packet);
+    if (ret == AVERROR_EOF) {
+      break;
+    } else if (ret < 0) {
+      printf("Error occurred when reading packet\n");
+      return -1;
+    }
+
+    ++packet_counts[av_packet.stream_index];
+
+    if (av_packet.flags & AV_PKT_FLAG_KEY) {
+      IndexEntry entry;
+      // pts가 없는 패킷은 dts로 대신함
+      entry.pts = av_packet.pts != AV_NOPTS_VALUE ? av_packet.pts : av_packet.dts;
+      entry.dts = av_packet.dts;
+      entry.pos = av_packet.pos;
+      entry.size = av_packet.size;
+      entry.flags = av_packet.flags;
+      keyframes[av_packet.stream_index].push_back(entry);
+    }
+
+    av_packet_unref(&av_packet);
+  }
+
+  IndexHeader header;
+  memcpy(header.magic, "PIDX", 4);
+  header.version = 2;
+  header.stream_count = av_format_ctx->nb_streams;
+  header.reserved = 0;
+  header.entry_count = 0;
+  header.file_size = av_format_ctx->pb ? avio_size(av_format_ctx->pb) : -1;
+  header.mtime_ns = get_file_mtime(filename);
+
+  std::vector<IndexStream> streams(av_format_ctx->nb_streams);
+  for (int index = 0; index < av_format_ctx->nb_streams; ++index) {
+    AVStream* av_stream = av_format_ctx->streams[index];
+    std::vector<IndexEntry>& entries = keyframes[index];
+
+    // 시간으로 이진 탐색할 수 있도록 pts 순으로 정렬
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const IndexEntry& a, const IndexEntry& b) { return a.pts < b.pts; });
+
+    streams[index].index = index;
+    streams[index].codec_type = av_stream->codecpar->codec_type;
+    streams[index].time_base_num = av_stream->time_base.num;
+    streams[index].time_base_den = av_stream->time_base.den;
+    streams[index].entry_offset = header.entry_count;
+    streams[index].entry_count = entries.size();
+    streams[index].packet_count = packet_counts[index];
+    header.entry_count += entries.size();
+  }
+
+  FILE* file = fopen(index_filename, "wb");
+  if (!file) {
+    printf("Couldn't create index file : %s\n", index_filename);
+    return -1;
+  }
+
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+  if (!streams.empty()) {
+    written = written && fwrite(streams.data(), sizeof(IndexStream), streams.size(), file) ==
+                                 streams.size();
+  }
+  for (const std::vector<IndexEntry>& entries : keyframes) {
+    if (!entries.empty()) {
+      written = written && fwrite(entries.data(), sizeof(IndexEntry), entries.size(), file) ==
+                                   entries.size();
+    }
+  }
+
+  if (fclose(file) != 0 || !written) {
+    printf("Failed to write index file : %s\n", index_filename);
+    return -1;
+  }
+
+  for (const IndexStream& stream : streams) {
+    printf("stream %d : %llu packets, %llu keyframes\n", stream.index,
+           (unsigned long long) stream.packet_count, (unsigned long long) stream.entry_count);
+  }
+
+  return 0;
+}
+
+int seek_with_index(const char* filename, const char* index_filename, int stream_index,
+                    double seconds) {
+  AVFormatContext* av_format_ctx = input_ctx.av_format_ctx;
+
+  int fd = open(index_filename, O_RDONLY);
+  if (fd < 0) {
+    printf("Couldn't open index file : %s\n", index_filename);
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(IndexHeader)) {
+    printf("Invalid index file : %s\n", index_filename);
+    close(fd);
+    return -1;
+  }
+
+  // 인덱스 파일 전체를 읽지 않고 mmap으로 필요한 부분만 접근
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    printf("Couldn't map index file : %s\n", index_filename);
+    return -1;
+  }
+
+  const IndexHeader* header = (const IndexHeader*) data;
+  const IndexStream* streams = (const IndexStream*) (header + 1);
+  const IndexEntry* entries = (const IndexEntry*) (streams + header->stream_count);
+
+  // 항목 개수를 파일 크기로 먼저 제한해서 크기 계산이 overflow되지 않도록 함
+  uint64_t index_size = (uint64_t) st.st_size;
+  bool valid = memcmp(header->magic, "PIDX", 4) == 0 && header->version == 2 &&
+               header->entry_count <= index_size / sizeof(IndexEntry) &&
+               sizeof(IndexHeader) + (uint64_t) header->stream_count * sizeof(IndexStream) +
+                               header->entry_count * sizeof(IndexEntry) ==
+                       index_size &&
+               header->stream_count == av_format_ctx->nb_streams;
+
+  // 탐색할 때는 범위를 확인하지 않으므로 모든 스트림의 항목 범위와 time_base를 여기서 확인
+  for (uint32_t index = 0; valid && index < header->stream_count; ++index) {
+    const IndexStream& stream = streams[index];
+    valid = stream.entry_offset <= header->entry_count &&
+            stream.entry_count <= header->entry_count - stream.entry_offset &&
+            stream.time_base_num > 0 && stream.time_base_den > 0;
+  }
+
+  if (!valid) {
+    printf("Invalid index file : %s\n", index_filename);
+    munmap(data, st.st_size);
+    return -1;
+  }
+
+  // 인덱스를 만든 뒤 입력 파일이 바뀌었으면 pos, pts가 맞지 않으므로 사용하지 않음
+  int64_t file_size = av_format_ctx->pb ? avio_size(av_format_ctx->pb) : -1;
+  if (header->file_size < 0 || header->file_size != file_size ||
+      header->mtime_ns != get_file_mtime(filename)) {
+    printf("Index file is out of date : %s\n", index_filename);
+    munmap(data, st.st_size);
+    return -1;
+  }
+
+  if (stream_index < 0 || stream_index >= (int) header->stream_count ||
+      streams[stream_index].entry_count == 0) {
+    printf("No keyframes indexed for stream %d\n", stream_index);
+    munmap(data, st.st_size);
+    return -1;
+  }
+
+  const IndexStream& stream = streams[stream_index];
+  AVRational time_base = av_make_q(stream.time_base_num, stream.time_base_den);
+  int64_t target = av_rescale_q((int64_t) (seconds * AV_TIME_BASE), av_make_q(1, AV_TIME_BASE),
+                                time_base);
+
+  // target 이하의 pts를 가진 마지막 키프레임을 이진 탐색으로 찾음
+  const IndexEntry* begin = entries + stream.entry_offset;
+  const IndexEntry* end = begin + stream.entry_count;
+  const IndexEntry* keyframe = std::upper_bound(
+          begin, end, target, [](int64_t pts, const IndexEntry& entry) { return pts < entry.pts; });
+  if (keyframe != begin) {
+    --keyframe;
+  }
+
+  IndexEntry entry = *keyframe;
+  munmap(data, st.st_size);
+
+  printf("keyframe : pts %lld (%.3f sec), pos %lld, size %d\n", (long long) entry.pts,
+         entry.pts * av_q2d(time_base), (long long) entry.pos, entry.size);
+
+  // 바이트 위치로 탐색할 수 있는 컨테이너는 컨테이너의 탐색 로직을 거치지 않고 바로 이동
+  // MP4처럼 바이트 탐색을 지원하지 않는 컨테이너는 키프레임의 정확한 타임스탬프로 탐색
+  int ret = -1;
+  if (entry.pos >= 0 && !(av_format_ctx->iformat->flags & AVFMT_NO_BYTE_SEEK)) {
+    ret = av_seek_frame(av_format_ctx, -1, entry.pos, AVSEEK_FLAG_BYTE);
+    printf("seek mode : byte\n");
+  }
+  if (ret < 0) {
+    int64_t timestamp = entry.dts != AV_NOPTS_VALUE ? entry.dts : entry.pts;
+    ret = av_seek_frame(av_format_ctx, stream_index, timestamp, AVSEEK_FLAG_BACKWARD);
+    printf("seek mode : timestamp\n");
+  }
+  if (ret < 0) {
+    printf("Failed to seek to keyframe\n");
+    return -1;
+  }
+
+  AVPacket av_packet;
+  bool found = false;
+  while (!found && av_read_frame(av_format_ctx, &av_packet) >= 0) {
+    if (av_packet.stream_index == stream_index) {
+      printf("first packet : pts %lld, pos %lld, key %d\n", (long long) av_packet.pts,
+             (long long) av_packet.pos, (av_packet.flags & AV_PKT_FLAG_KEY) ? 1 : 0);
+      found = true;
+    }
+    av_packet_unref(&av_packet);
+  }
+
+  if (!found) {
+    printf("No packet read for stream %d after seeking\n", stream_index);
+    return -1;
+  }
+
   return 0;
 }
 
@@ -91,4 +662,7 @@ void release() {
   if (input_ctx.av_format_ctx) {
     avformat_close_input(&input_ctx.av_format_ctx);
   }
-}
\ No newline at end of file
+
+  // 직접 생성한 AVIOContext는 avformat_close_input() 함수가 해제하지 않음
+  close_mapped_input(&input_ctx.mapped_file, &input_ctx.avio_ctx);
+}
@@ -1,61 +1,311 @@
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
+#include <libavutil/time.h>
 }
+#include <atomic>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <mutex>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// mmap으로 매핑한 입력 파일
+struct MappedFile {
+  uint8_t* data;
+  int64_t size;
+  int64_t pos;
+};
 
 struct FileContext {
   AVFormatContext* av_format_ctx;
+  AVIOContext* avio_ctx;
+  MappedFile mapped_file;
   int v_index;
   int a_index;
 };
 
-FileContext input_file_ctx, output_file_ctx;
+// 명령행에서 지정한 스트림 선택 조건
+// nullptr이면 해당 타입의 첫 번째 스트림, "none"이면 사용하지 않음,
+// 숫자면 스트림 인덱스, 그 외에는 language 메타데이터(예: eng, kor)로 선택
+struct StreamSelection {
+  const char* video;
+  const char* audio;
+  // 선택하지 않은 스트림을 디먹서 단계에서 버릴지 여부 (--no-discard로 비교 가능)
+  bool discard;
+};
+
+// 출력 방식
+// OUTPUT_FILE : 하나의 파일로 출력하며 av_write_trailer()에서 인덱스(moov 등)를 씀
+// OUTPUT_FRAGMENTED : 키프레임마다 moof/mdat 조각을 바로 써서 작업 도중에도 재생할 수 있는 fragmented MP4
+// OUTPUT_SEGMENTED : 일정 길이마다 키프레임에서 잘라 여러 파일로 나누고 재생 목록(m3u8)을 갱신
+enum OutputMode { OUTPUT_FILE, OUTPUT_FRAGMENTED, OUTPUT_SEGMENTED };
+
+struct RemuxOptions {
+  bool use_mmap;
+  StreamSelection selection;
+  OutputMode output_mode;
+  double segment_time;
+  const char* playlist;
+  // 재생 목록에 유지할 최근 세그먼트 수 (0이면 모든 세그먼트를 유지)
+  int playlist_size;
+  // 인터리버에 쌓아둘 수 있는 최대 크기(byte)와 가장 앞선/뒤처진 패킷의 최대 시간 차이(AV_TIME_BASE 단위)
+  int64_t interleave_bytes;
+  int64_t interleave_duration;
+};
+
+// 인터리버에 쌓여 있는 패킷과 AV_TIME_BASE 단위의 DTS
+struct BufferedPacket {
+  AVPacket* av_packet;
+  int64_t time;
+};
 
-int open_input(const char* filename);
-int create_output(const char* filename);
-void release();
+// av_interleaved_write_frame()은 모든 스트림의 패킷이 모일 때까지 제한 없이 버퍼링하므로
+// 오디오/비디오가 크게 어긋나거나 한쪽 스트림이 드문드문한 입력에서는 메모리가 계속 늘어남
+// 대신 출력 스트림마다 큐를 두고 DTS가 가장 작은 패킷부터 av_write_frame()으로 씀
+// 모든 스트림에 패킷이 있어야 쓸 수 있으며, 용량이나 시간 제한을 넘으면 비어 있는 스트림을
+// 기다리지 않고 바로 씀 (early flush). 이 경우 스트림 사이의 인터리빙은 느슨해지지만
+// 스트림마다 DTS 순서는 유지되므로 출력 파일은 올바름
+// 패킷을 읽는 쪽은 인터리버가 제한 아래로 내려갈 때까지 다음 패킷을 읽지 않음 (backpressure)
+// 다른 스트림보다 idle_duration 이상 뒤처진 스트림은 끝났거나 드문드문한 것으로 보고 기다리지 않음
+// (한 트랙이 먼저 끝난 뒤 버퍼가 제한에 걸린 채로 early flush가 반복되지 않도록 함)
+struct Interleaver {
+  std::vector<std::deque<BufferedPacket>> queues;
+  std::vector<int64_t> last_times;
+  // 처음 받은 패킷과 지금까지 받은 가장 늦은 패킷의 시간 (AV_TIME_BASE 단위)
+  int64_t start_time;
+  int64_t newest_time;
+  int64_t buffered_bytes;
+  int64_t max_bytes;
+  int64_t max_duration;
+  int64_t idle_duration;
+};
+
+// 입력/출력 파일 한 쌍에 대한 리먹싱 작업
+// 전역 변수 없이 작업마다 자신의 컨텍스트를 가지므로 여러 작업을 동시에 실행할 수 있음
+struct RemuxJob {
+  std::string input_filename;
+  std::string output_filename;
+  FileContext input_file_ctx;
+  FileContext output_file_ctx;
+  // 실행 결과
+  int error;
+  int64_t packet_count;
+  int64_t dropped_count;
+  int64_t bytes_read;
+  int64_t bytes_written;
+  double elapsed;
+  // 인터리버 통계 (출력 스트림 인덱스 기준)
+  int64_t peak_buffered_bytes;
+  std::vector<int64_t> peak_buffered_packets;
+  int64_t early_flush_count;
+};
+
+// 워커 스레드마다 가지고 있는 작업 큐
+// 자신의 큐는 앞에서 꺼내고, 비어 있으면 다른 워커의 큐 뒤에서 작업을 가져옴
+struct WorkerQueue {
+  std::mutex mutex;
+  std::deque<size_t> jobs;
+};
+
+void init_job(RemuxJob* job, const std::string& input_filename,
+              const std::string& output_filename);
+int run_job(RemuxJob* job, const RemuxOptions& options, bool verbose);
+int open_input(RemuxJob* job, bool use_mmap, const StreamSelection& selection);
+bool match_stream(AVStream* av_stream, const char* spec);
+void discard_unused_streams(RemuxJob* job, const StreamSelection& selection);
+void print_read_stats(const RemuxJob* job);
+int open_mapped_input(const char* filename, MappedFile* mapped_file, AVIOContext** avio_ctx);
+int read_mapped_file(void* opaque, uint8_t* buf, int buf_size);
+int64_t seek_mapped_file(void* opaque, int64_t offset, int whence);
+void close_mapped_input(MappedFile* mapped_file, AVIOContext** avio_ctx);
+int create_output(RemuxJob* job, const RemuxOptions& options);
+std::string default_playlist_name(const std::string& output_filename);
+int remux(RemuxJob* job, const RemuxOptions& options);
+void init_interleaver(Interleaver* interleaver, const RemuxOptions& options, int nb_streams);
+int interleave_packet(RemuxJob* job, Interleaver* interleaver, AVPacket* av_packet);
+int write_interleaved(RemuxJob* job, Interleaver* interleaver, bool finished);
+bool interleaver_full(const Interleaver* interleaver);
+bool stream_idle(const Interleaver* interleaver, int index);
+void free_interleaver(Interleaver* interleaver);
+void print_interleave_stats(const RemuxJob* job);
+void release(RemuxJob* job);
+int read_manifest(const char* filename, std::vector<RemuxJob>* jobs);
+bool next_job(std::vector<WorkerQueue>& queues, int worker, size_t* job_index);
+int run_manifest(const char* filename, int jobs, const RemuxOptions& options);
 
 int main(int argc, const char** argv) {
   av_log_set_level(AV_LOG_INFO);
 
+  bool manifest = argc >= 2 && strcmp(argv[1], "--manifest") == 0;
   if (argc < 3) {
     printf("Not enough arguments entered.\n");
+    printf("usage: %s <input> <output> [--mmap]\n", argv[0]);
+    printf("       %s --manifest <file> [--jobs N] [--mmap]\n", argv[0]);
+    printf("output options: [--fragmented] [--segment seconds] [--playlist file] "
+           "[--playlist-size N]\n");
+    printf("interleave options: [--interleave-size MB] [--interleave-duration seconds]\n");
+    printf("stream options: [--video index|lang|none] [--audio index|lang|none] "
+           "[--no-discard]\n");
     return 0;
   }
 
-  if (open_input(argv[1]) < 0) {
-    release();
-    return 0;
+  RemuxOptions options;
+  options.use_mmap = false;
+  options.selection.video = nullptr;
+  options.selection.audio = nullptr;
+  options.selection.discard = true;
+  options.output_mode = OUTPUT_FILE;
+  options.segment_time = 0;
+  options.playlist = nullptr;
+  options.playlist_size = 0;
+  options.interleave_bytes = 16 * 1024 * 1024;
+  options.interleave_duration = 10 * AV_TIME_BASE;
+  int jobs = (int) std::thread::hardware_concurrency();
+
+  for (int index = 3; index < argc; ++index) {
+    if (strcmp(argv[index], "--mmap") == 0) {
+      options.use_mmap = true;
+    } else if (strcmp(argv[index], "--video") == 0 && index + 1 < argc) {
+      options.selection.video = argv[++index];
+    } else if (strcmp(argv[index], "--audio") == 0 && index + 1 < argc) {
+      options.selection.audio = argv[++index];
+    } else if (strcmp(argv[index], "--no-discard") == 0) {
+      options.selection.discard = false;
+    } else if (strcmp(argv[index], "--fragmented") == 0) {
+      options.output_mode = OUTPUT_FRAGMENTED;
+    } else if (strcmp(argv[index], "--segment") == 0 && index + 1 < argc) {
+      options.output_mode = OUTPUT_SEGMENTED;
+      options.segment_time = atof(argv[++index]);
+    } else if (!manifest && strcmp(argv[index], "--playlist") == 0 && index + 1 < argc) {
+      options.playlist = argv[++index];
+    } else if (strcmp(argv[index], "--playlist-size") == 0 && index + 1 < argc) {
+      options.playlist_size = atoi(argv[++index]);
+    } else if (strcmp(argv[index], "--interleave-size") == 0 && index + 1 < argc) {
+      options.interleave_bytes = (int64_t) (atof(argv[++index]) * 1024 * 1024);
+    } else if (strcmp(argv[index], "--interleave-duration") == 0 && index + 1 < argc) {
+      options.interleave_duration = (int64_t) (atof(argv[++index]) * AV_TIME_BASE);
+    } else if (manifest && strcmp(argv[index], "--jobs") == 0 && index + 1 < argc) {
+      jobs = atoi(argv[++index]);
+    } else {
+      printf("Unknown option : %s\n", argv[index]);
+      return 0;
+    }
   }
 
-  if (create_output(argv[2]) < 0) {
-    release();
+  // 두 제한이 모두 없으면 비어 있는 스트림을 기다리는 동안 제한 없이 버퍼링하게 됨
+  if (options.interleave_bytes <= 0 && options.interleave_duration <= 0) {
+    printf("Either --interleave-size or --interleave-duration must be greater than 0\n");
     return 0;
   }
 
-  // 파일에 대한 정보를 출력
-  av_dump_format(output_file_ctx.av_format_ctx, 0, output_file_ctx.av_format_ctx->url, 1);
+  if (manifest) {
+    // 여러 작업이 동시에 출력하면 로그가 섞이므로 에러만 출력
+    av_log_set_level(AV_LOG_ERROR);
+    return run_manifest(argv[2], FFMAX(jobs, 1), options) < 0 ? 1 : 0;
+  }
+
+  RemuxJob job;
+  init_job(&job, argv[1], argv[2]);
+  return run_job(&job, options, true) < 0 ? 1 : 0;
+}
+
+void init_job(RemuxJob* job, const std::string& input_filename,
+              const std::string& output_filename) {
+  job->input_filename = input_filename;
+  job->output_filename = output_filename;
+  job->input_file_ctx.av_format_ctx = nullptr;
+  job->input_file_ctx.avio_ctx = nullptr;
+  // --mmap을 사용하지 않아도 release()에서 close_mapped_input()을 호출하므로 초기화해 둠
+  job->input_file_ctx.mapped_file.data = nullptr;
+  job->input_file_ctx.mapped_file.size = 0;
+  job->input_file_ctx.mapped_file.pos = 0;
+  job->output_file_ctx.av_format_ctx = nullptr;
+  job->output_file_ctx.avio_ctx = nullptr;
+  job->error = 0;
+  job->packet_count = 0;
+  job->dropped_count = 0;
+  job->bytes_read = 0;
+  job->bytes_written = 0;
+  job->elapsed = 0;
+  job->peak_buffered_bytes = 0;
+  job->peak_buffered_packets.clear();
+  job->early_flush_count = 0;
+}
+
+int run_job(RemuxJob* job, const RemuxOptions& options, bool verbose) {
+  int64_t start_time = av_gettime_relative();
+
+  job->error = open_input(job, options.use_mmap, options.selection);
+  if (job->error >= 0) {
+    job->error = create_output(job, options);
+  }
+
+  if (job->error >= 0) {
+    if (verbose) {
+      // 파일에 대한 정보를 출력
+      av_dump_format(job->output_file_ctx.av_format_ctx, 0,
+                     job->output_file_ctx.av_format_ctx->url, 1);
+    }
+
+    job->error = remux(job, options);
+    if (verbose) {
+      print_read_stats(job);
+      print_interleave_stats(job);
+    }
+  }
+
+  release(job);
+  job->elapsed = (av_gettime_relative() - start_time) / 1000000.0;
+
+  return job->error;
+}
+
+int remux(RemuxJob* job, const RemuxOptions& options) {
+  FileContext& input_file_ctx = job->input_file_ctx;
+  FileContext& output_file_ctx = job->output_file_ctx;
 
   AVPacket av_packet;
   int ret;
 
+  Interleaver interleaver;
+  init_interleaver(&interleaver, options, output_file_ctx.av_format_ctx->nb_streams);
+  job->peak_buffered_packets.assign(output_file_ctx.av_format_ctx->nb_streams, 0);
+
   // 입력 스트림에서 패킷을 하나씩 출력 스트림으로 복사
   while (true) {
     ret = av_read_frame(input_file_ctx.av_format_ctx, &av_packet);
     if (ret == AVERROR_EOF) {
-      printf("End of frame\n");
       break;
+    } else if (ret < 0) {
+      printf("Error occurred when reading packet\n");
+      free_interleaver(&interleaver);
+      return -1;
     }
 
+    ++job->packet_count;
+
+    // 선택하지 않은 스트림은 디먹서 단계에서 버려지므로 --no-discard를 사용한 경우에만 도달
     if (av_packet.stream_index != input_file_ctx.v_index &&
         av_packet.stream_index != input_file_ctx.a_index) {
+      ++job->dropped_count;
       av_packet_unref(&av_packet);
       continue;
     }
 
+    // 입력 스트림 인덱스와 출력 스트림 인덱스는 다를 수 있음
+    int out_index = av_packet.stream_index == input_file_ctx.v_index ? output_file_ctx.v_index
+                                                                     : output_file_ctx.a_index;
     AVStream* in_stream = input_file_ctx.av_format_ctx->streams[av_packet.stream_index];
-    AVStream* out_stream = output_file_ctx.av_format_ctx->streams[av_packet.stream_index];
+    AVStream* out_stream = output_file_ctx.av_format_ctx->streams[out_index];
+    av_packet.stream_index = out_index;
 
     // 패킷의 PTS, DTS, Duration을 다시 계산
     av_packet.pts = av_rescale_q_rnd(av_packet.pts, in_stream->time_base, out_stream->time_base,
@@ -68,29 +318,60 @@ int main(int argc, const char** argv) {
     // pos는 스트림의 byte 위치를 의미하며 알 수 없는 경우 -1로 표시
     av_packet.pos = -1;
 
-    // 다시 계산한 패킷 정보를 AVFormatContext 구조체에 입력
-    if (av_interleaved_write_frame(output_file_ctx.av_format_ctx, &av_packet) < 0) {
+    job->bytes_written += av_packet.size;
+
+    // 다시 계산한 패킷을 인터리버에 넣고 순서가 정해진 패킷들을 AVFormatContext 구조체에 입력
+    // 패킷의 데이터는 인터리버로 옮겨지므로 av_packet은 비어 있는 상태가 됨
+    if (interleave_packet(job, &interleaver, &av_packet) < 0) {
       printf("Error occurred when writing packet into file\n");
-      break;
+      free_interleaver(&interleaver);
+      return -1;
     }
+  }
 
-    // av_packet_unref(과거에는 av_free_packet) 함수는 패킷을 다 쓴 후 해제하는 함수 (내부 청소용)
-    // av_packet_free 함수는 동적 할당한 패킷을 해제하는 함수 (할당 해제용)
-    av_packet_unref(&av_packet);
+  // 남아 있는 패킷을 모두 씀
+  ret = write_interleaved(job, &interleaver, true);
+  free_interleaver(&interleaver);
+  if (ret < 0) {
+    printf("Error occurred when writing packet into file\n");
+    return -1;
+  }
+
+  if (input_file_ctx.av_format_ctx->pb) {
+    job->bytes_read = input_file_ctx.av_format_ctx->pb->bytes_read;
   }
 
   // AVPacket 구조체를 쓰는 시점에 정리하지 못한 정보들을 출력 미디어 파일에 씀
   // moov 헤더처럼 모든 스트림 정보가 있어야 추가할 수 있는 정보들이 있음
-  av_write_trailer(output_file_ctx.av_format_ctx);
-  release();
+  if (av_write_trailer(output_file_ctx.av_format_ctx) < 0) {
+    printf("Failed writing trailer into output file\n");
+    return -1;
+  }
 
   return 0;
 }
 
-int open_input(const char* filename) {
+int open_input(RemuxJob* job, bool use_mmap, const StreamSelection& selection) {
+  FileContext& input_file_ctx = job->input_file_ctx;
+  const char* filename = job->input_filename.c_str();
+
   input_file_ctx.av_format_ctx = nullptr;
+  input_file_ctx.avio_ctx = nullptr;
   input_file_ctx.v_index = input_file_ctx.a_index = -1;
 
+  // 기본 file 프로토콜 대신 mmap으로 매핑한 메모리에서 바로 읽는 AVIOContext를 사용
+  if (use_mmap) {
+    if (open_mapped_input(filename, &input_file_ctx.mapped_file, &input_file_ctx.avio_ctx) < 0) {
+      return -1;
+    }
+
+    input_file_ctx.av_format_ctx = avformat_alloc_context();
+    if (!input_file_ctx.av_format_ctx) {
+      return -1;
+    }
+    input_file_ctx.av_format_ctx->pb = input_file_ctx.avio_ctx;
+  }
+
   if (avformat_open_input(&input_file_ctx.av_format_ctx, filename, nullptr, nullptr) < 0) {
     printf("Couldn't open video file\n");
     return -1;
@@ -102,10 +383,13 @@ int open_input(const char* filename) {
   }
 
   for (int index = 0; index < input_file_ctx.av_format_ctx->nb_streams; ++index) {
-    AVCodecParameters* av_codec_params = input_file_ctx.av_format_ctx->streams[index]->codecpar;
-    if (av_codec_params->codec_type == AVMEDIA_TYPE_VIDEO && input_file_ctx.v_index < 0) {
+    AVStream* av_stream = input_file_ctx.av_format_ctx->streams[index];
+    AVCodecParameters* av_codec_params = av_stream->codecpar;
+    if (av_codec_params->codec_type == AVMEDIA_TYPE_VIDEO && input_file_ctx.v_index < 0 &&
+        match_stream(av_stream, selection.video)) {
       input_file_ctx.v_index = index;
-    } else if (av_codec_params->codec_type == AVMEDIA_TYPE_AUDIO && input_file_ctx.a_index < 0) {
+    } else if (av_codec_params->codec_type == AVMEDIA_TYPE_AUDIO && input_file_ctx.a_index < 0 &&
+               match_stream(av_stream, selection.audio)) {
       input_file_ctx.a_index = index;
     }
   }
@@ -115,14 +399,32 @@ int open_input(const char* filename) {
     return -1;
   }
 
+  discard_unused_streams(job, selection);
+
   return 0;
 }
 
-int create_output(const char* filename) {
+int create_output(RemuxJob* job, const RemuxOptions& options) {
+  FileContext& input_file_ctx = job->input_file_ctx;
+  FileContext& output_file_ctx = job->output_file_ctx;
+  const char* filename = job->output_filename.c_str();
+
   output_file_ctx.av_format_ctx = nullptr;
+  output_file_ctx.avio_ctx = nullptr;
   output_file_ctx.v_index = output_file_ctx.a_index = -1;
 
-  if (avformat_alloc_output_context2(&(output_file_ctx.av_format_ctx), nullptr, nullptr, filename) < 0) {
+  // 세그먼트 출력은 segment 먹서가 출력 파일 이름 패턴(예: out_%05d.ts)으로 파일을 나누어 씀
+  const char* format_name = nullptr;
+  if (options.output_mode == OUTPUT_SEGMENTED) {
+    if (!strchr(filename, '%')) {
+      printf("Segment output needs a file name pattern such as out_%%05d.ts\n");
+      return -1;
+    }
+    format_name = "segment";
+  }
+
+  if (avformat_alloc_output_context2(&(output_file_ctx.av_format_ctx), nullptr, format_name,
+                                     filename) < 0) {
     printf("Couldn't create output file context\n");
     return -1;
   }
@@ -149,9 +451,9 @@ int create_output(const char* filename) {
     }
 
     if (index == input_file_ctx.v_index) {
-      output_file_ctx.v_index = index;
+      output_file_ctx.v_index = out_stream->index;
     } else {
-      output_file_ctx.a_index = index;
+      output_file_ctx.a_index = out_stream->index;
     }
   }
 
@@ -163,9 +465,40 @@ int create_output(const char* filename) {
     }
   }
 
+  AVDictionary* av_options = nullptr;
+  if (options.output_mode == OUTPUT_FRAGMENTED) {
+    // 빈 moov를 먼저 쓰고 키프레임마다 moof/mdat 조각을 써서 인덱스를 메모리에 쌓아두지 않음
+    av_dict_set(&av_options, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+  } else if (options.output_mode == OUTPUT_SEGMENTED) {
+    std::string playlist =
+            options.playlist ? options.playlist : default_playlist_name(job->output_filename);
+    // segment_time이 지난 후 처음 나오는 키프레임에서 다음 세그먼트를 시작함
+    av_dict_set(&av_options, "segment_time", std::to_string(options.segment_time).c_str(), 0);
+    av_dict_set(&av_options, "segment_list", playlist.c_str(), 0);
+    av_dict_set(&av_options, "segment_list_type", "m3u8", 0);
+    av_dict_set_int(&av_options, "segment_list_size", options.playlist_size, 0);
+    av_dict_set(&av_options, "segment_list_flags", "+live", 0);
+    av_dict_set_int(&av_options, "reset_timestamps", 0, 0);
+  }
+
+  // 패킷을 쓸 때마다 바로 내보내서 첫 번째 조각을 빨리 재생할 수 있도록 함
+  if (options.output_mode != OUTPUT_FILE) {
+    output_file_ctx.av_format_ctx->flags |= AVFMT_FLAG_FLUSH_PACKETS;
+  }
+
   // avformat_write_header() 함수는 컨테이너의 규격에 맞는 헤더를 생성하는 함수
   // AVFormatContext 구조체의 컨테이너 정보와 AVStream 구조체의 스트림 정보를 기반으로 헤더를 씀
-  if (avformat_write_header(output_file_ctx.av_format_ctx, nullptr) < 0) {
+  int ret = avformat_write_header(output_file_ctx.av_format_ctx, &av_options);
+
+  // 먹서가 사용하지 않은 옵션은 av_options에 남아 있음 (예: MP4가 아닌 컨테이너의 movflags)
+  AVDictionaryEntry* unused = nullptr;
+  while ((unused = av_dict_get(av_options, "", unused, AV_DICT_IGNORE_SUFFIX))) {
+    printf("Output option '%s' is not supported by %s\n", unused->key,
+           output_file_ctx.av_format_ctx->oformat->name);
+  }
+  av_dict_free(&av_options);
+
+  if (ret < 0) {
     printf("Failed writing header into output file\n");
     return -1;
   }
@@ -173,15 +506,464 @@ int create_output(const char* filename) {
   return 0;
 }
 
-void release() {
+void init_interleaver(Interleaver* interleaver, const RemuxOptions& options, int nb_streams) {
+  interleaver->queues.assign(nb_streams, std::deque<BufferedPacket>());
+  interleaver->last_times.assign(nb_streams, AV_NOPTS_VALUE);
+  interleaver->start_time = AV_NOPTS_VALUE;
+  interleaver->newest_time = AV_NOPTS_VALUE;
+  interleaver->buffered_bytes = 0;
+  interleaver->max_bytes = options.interleave_bytes;
+  interleaver->max_duration = options.interleave_duration;
+  // 시간 제한을 사용하지 않으면 기본 시간 제한(10초)만큼 뒤처진 스트림을 기다리지 않음
+  interleaver->idle_duration =
+          options.interleave_duration > 0 ? options.interleave_duration : 10 * AV_TIME_BASE;
+}
+
+int interleave_packet(RemuxJob* job, Interleaver* interleaver, AVPacket* av_packet) {
+  int index = av_packet->stream_index;
+  AVRational time_base = job->output_file_ctx.av_format_ctx->streams[index]->time_base;
+
+  // DTS가 없으면 PTS를, 둘 다 없으면 같은 스트림의 직전 패킷 시간을 사용해 순서를 유지
+  int64_t time = av_packet->dts != AV_NOPTS_VALUE ? av_packet->dts : av_packet->pts;
+  if (time != AV_NOPTS_VALUE) {
+    time = av_rescale_q(time, time_base, av_get_time_base_q());
+  } else {
+    time = interleaver->last_times[index] != AV_NOPTS_VALUE ? interleaver->last_times[index] : 0;
+  }
+  interleaver->last_times[index] = time;
+  if (interleaver->start_time == AV_NOPTS_VALUE) {
+    interleaver->start_time = time;
+  }
+  if (interleaver->newest_time == AV_NOPTS_VALUE || time > interleaver->newest_time) {
+    interleaver->newest_time = time;
+  }
+
+  BufferedPacket buffered;
+  buffered.av_packet = av_packet_alloc();
+  if (!buffered.av_packet) {
+    av_packet_unref(av_packet);
+    return -1;
+  }
+  buffered.time = time;
+  av_packet_move_ref(buffered.av_packet, av_packet);
+
+  interleaver->queues[index].push_back(buffered);
+  interleaver->buffered_bytes += buffered.av_packet->size;
+  job->peak_buffered_bytes = FFMAX(job->peak_buffered_bytes, interleaver->buffered_bytes);
+  job->peak_buffered_packets[index] =
+          FFMAX(job->peak_buffered_packets[index], (int64_t) interleaver->queues[index].size());
+
+  return write_interleaved(job, interleaver, false);
+}
+
+int write_interleaved(RemuxJob* job, Interleaver* interleaver, bool finished) {
+  while (true) {
+    // 큐의 맨 앞 패킷 중 DTS가 가장 작은 스트림을 찾음
+    int next = -1;
+    bool waiting = false;
+    for (size_t index = 0; index < interleaver->queues.size(); ++index) {
+      const std::deque<BufferedPacket>& queue = interleaver->queues[index];
+      if (queue.empty()) {
+        // 끝났거나 오랫동안 패킷이 없는 스트림은 기다리지 않음
+        if (!stream_idle(interleaver, (int) index)) {
+          waiting = true;
+        }
+      } else if (next < 0 || queue.front().time < interleaver->queues[next].front().time) {
+        next = (int) index;
+      }
+    }
+
+    if (next < 0) {
+      return 0;
+    }
+    if (waiting && !finished) {
+      // 비어 있는 스트림의 패킷이 더 앞설 수 있으므로 기다려야 하지만 제한을 넘으면 바로 씀
+      if (!interleaver_full(interleaver)) {
+        return 0;
+      }
+      ++job->early_flush_count;
+    }
+
+    BufferedPacket buffered = interleaver->queues[next].front();
+    interleaver->queues[next].pop_front();
+    interleaver->buffered_bytes -= buffered.av_packet->size;
+
+    // 순서는 이미 정해졌으므로 먹서 내부에서 다시 버퍼링하지 않도록 av_write_frame()을 사용
+    int ret = av_write_frame(job->output_file_ctx.av_format_ctx, buffered.av_packet);
+
+    // av_packet_unref(과거에는 av_free_packet) 함수는 패킷을 다 쓴 후 해제하는 함수 (내부 청소용)
+    // av_packet_free 함수는 동적 할당한 패킷을 해제하는 함수 (할당 해제용)
+    av_packet_free(&buffered.av_packet);
+    if (ret < 0) {
+      return ret;
+    }
+  }
+}
+
+bool interleaver_full(const Interleaver* interleaver) {
+  if (interleaver->max_bytes > 0 && interleaver->buffered_bytes > interleaver->max_bytes) {
+    return true;
+  }
+  if (interleaver->max_duration <= 0) {
+    return false;
+  }
+
+  // 큐에 남아 있는 가장 오래된 패킷과 가장 최근 패킷의 시간 차이
+  int64_t oldest = INT64_MAX;
+  int64_t newest = INT64_MIN;
+  for (const std::deque<BufferedPacket>& queue : interleaver->queues) {
+    if (!queue.empty()) {
+      oldest = FFMIN(oldest, queue.front().time);
+      newest = FFMAX(newest, queue.back().time);
+    }
+  }
+  return oldest != INT64_MAX && newest - oldest > interleaver->max_duration;
+}
+
+bool stream_idle(const Interleaver* interleaver, int index) {
+  if (interleaver->newest_time == AV_NOPTS_VALUE) {
+    return false;
+  }
+
+  // 아직 패킷을 받지 못한 스트림은 첫 패킷의 시간부터 기다린 것으로 봄
+  int64_t last_time = interleaver->last_times[index] != AV_NOPTS_VALUE
+                              ? interleaver->last_times[index]
+                              : interleaver->start_time;
+  return interleaver->newest_time - last_time > interleaver->idle_duration;
+}
+
+void free_interleaver(Interleaver* interleaver) {
+  for (std::deque<BufferedPacket>& queue : interleaver->queues) {
+    for (BufferedPacket& buffered : queue) {
+      av_packet_free(&buffered.av_packet);
+    }
+    queue.clear();
+  }
+  interleaver->buffered_bytes = 0;
+}
+
+void print_interleave_stats(const RemuxJob* job) {
+  printf("interleaver peak : %.1f KB, early flushes : %lld\n", job->peak_buffered_bytes / 1024.0,
+         (long long) job->early_flush_count);
+  for (size_t index = 0; index < job->peak_buffered_packets.size(); ++index) {
+    printf("  output stream %zu : peak %lld packets\n", index,
+           (long long) job->peak_buffered_packets[index]);
+  }
+}
+
+std::string default_playlist_name(const std::string& output_filename) {
+  // out_%05d.ts -> out.m3u8
+  std::string prefix = output_filename.substr(0, output_filename.find('%'));
+  while (!prefix.empty() &&
+         (prefix.back() == '_' || prefix.back() == '-' || prefix.back() == '.')) {
+    prefix.pop_back();
+  }
+  return (prefix.empty() ? std::string("playlist") : prefix) + ".m3u8";
+}
+
+bool match_stream(AVStream* av_stream, const char* spec) {
+  if (!spec) {
+    return true;
+  }
+
+  if (strcmp(spec, "none") == 0) {
+    return false;
+  }
+
+  if (spec[0] >= '0' && spec[0] <= '9') {
+    return av_stream->index == atoi(spec);
+  }
+
+  AVDictionaryEntry* language = av_dict_get(av_stream->metadata, "language", nullptr, 0);
+  return language && strcmp(language->value, spec) == 0;
+}
+
+void discard_unused_streams(RemuxJob* job, const StreamSelection& selection) {
+  FileContext& input_file_ctx = job->input_file_ctx;
+
+  if (!selection.discard) {
+    return;
+  }
+
+  // AVDISCARD_ALL로 지정한 스트림은 디먹서가 패킷을 만들지 않으므로
+  // av_read_frame() 함수가 해당 패킷을 할당하거나 복사하지 않음
+  for (int index = 0; index < input_file_ctx.av_format_ctx->nb_streams; ++index) {
+    if (index != input_file_ctx.v_index && index != input_file_ctx.a_index) {
+      input_file_ctx.av_format_ctx->streams[index]->discard = AVDISCARD_ALL;
+    }
+  }
+}
+
+void print_read_stats(const RemuxJob* job) {
+  printf("packets read : %lld (dropped %lld), bytes read : %lld\n",
+         (long long) job->packet_count, (long long) job->dropped_count,
+         (long long) job->bytes_read);
+}
+
+int open_mapped_input(const char* filename, MappedFile* mapped_file, AVIOContext** avio_ctx) {
+  mapped_file->data = nullptr;
+  mapped_file->size = 0;
+  mapped_file->pos = 0;
+
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    printf("Couldn't open input file %s\n", filename);
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+    printf("Couldn't map empty or unknown size file %s\n", filename);
+    close(fd);
+    return -1;
+  }
+
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    printf("Couldn't map input file %s\n", filename);
+    return -1;
+  }
+
+  // 대부분 앞에서부터 순서대로 읽으므로 커널이 미리 읽어두도록 알림
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+  madvise(data, st.st_size, MADV_WILLNEED);
+
+  mapped_file->data = (uint8_t*) data;
+  mapped_file->size = st.st_size;
+
+  // AVIOContext 내부 버퍼는 av_malloc()으로 할당해야 하며 해제도 직접 해야 함
+  const int buffer_size = 32 * 1024;
+  uint8_t* buffer = (uint8_t*) av_malloc(buffer_size);
+  if (!buffer) {
+    return -1;
+  }
+
+  *avio_ctx = avio_alloc_context(buffer, buffer_size, 0, mapped_file, read_mapped_file, nullptr,
+                                 seek_mapped_file);
+  if (!*avio_ctx) {
+    av_free(buffer);
+    printf("Couldn't create AVIOContext\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+int read_mapped_file(void* opaque, uint8_t* buf, int buf_size) {
+  MappedFile* mapped_file = (MappedFile*) opaque;
+
+  int64_t remaining = mapped_file->size - mapped_file->pos;
+  if (remaining <= 0) {
+    return AVERROR_EOF;
+  }
+
+  // read() 시스템 콜 없이 매핑된 메모리에서 바로 복사
+  int size = (int) FFMIN((int64_t) buf_size, remaining);
+  memcpy(buf, mapped_file->data + mapped_file->pos, size);
+  mapped_file->pos += size;
+
+  return size;
+}
+
+int64_t seek_mapped_file(void* opaque, int64_t offset, int whence) {
+  MappedFile* mapped_file = (MappedFile*) opaque;
+
+  // AVSEEK_SIZE는 위치를 바꾸지 않고 파일 크기만 요청하는 경우
+  if (whence & AVSEEK_SIZE) {
+    return mapped_file->size;
+  }
+
+  int64_t pos;
+  switch (whence & ~AVSEEK_FORCE) {
+    case SEEK_SET:
+      pos = offset;
+      break;
+    case SEEK_CUR:
+      pos = mapped_file->pos + offset;
+      break;
+    case SEEK_END:
+      pos = mapped_file->size + offset;
+      break;
+    default:
+      return AVERROR(EINVAL);
+  }
+
+  if (pos < 0 || pos > mapped_file->size) {
+    return AVERROR(EINVAL);
+  }
+
+  // 임의 위치로 이동한 경우 이동한 위치부터 미리 읽어두도록 알림
+  if (pos != mapped_file->pos && pos < mapped_file->size) {
+    int64_t page_size = sysconf(_SC_PAGESIZE);
+    int64_t start = pos / page_size * page_size;
+    madvise(mapped_file->data + start, FFMIN(mapped_file->size - start, (int64_t) 4 << 20),
+            MADV_WILLNEED);
+  }
+
+  mapped_file->pos = pos;
+  return pos;
+}
+
+void close_mapped_input(MappedFile* mapped_file, AVIOContext** avio_ctx) {
+  if (*avio_ctx) {
+    av_freep(&(*avio_ctx)->buffer);
+    avio_context_free(avio_ctx);
+  }
+
+  if (mapped_file->data) {
+    munmap(mapped_file->data, mapped_file->size);
+    mapped_file->data = nullptr;
+  }
+}
+
+void release(RemuxJob* job) {
+  FileContext& input_file_ctx = job->input_file_ctx;
+  FileContext& output_file_ctx = job->output_file_ctx;
+
   // avformat_open_input() 함수로 메모리를 할당했으면 avformat_close_input() 함수로 해제해야 메모리 릭이 발생하지 않음
   if (input_file_ctx.av_format_ctx) {
     avformat_close_input(&input_file_ctx.av_format_ctx);
   }
 
+  // 직접 생성한 AVIOContext는 avformat_close_input() 함수가 해제하지 않음
+  close_mapped_input(&input_file_ctx.mapped_file, &input_file_ctx.avio_ctx);
+
+  if (!output_file_ctx.av_format_ctx) {
+    return;
+  }
+
   if (!(output_file_ctx.av_format_ctx->oformat->flags & AVFMT_NOFILE)) {
     avio_closep(&output_file_ctx.av_format_ctx->pb);
   }
   // AVFormatContext 구조체 내부에 할당한 메모리를 해제
   avformat_free_context(output_file_ctx.av_format_ctx);
-}
\ No newline at end of file
+  output_file_ctx.av_format_ctx = nullptr;
+}
+
+int read_manifest(const char* filename, std::vector<RemuxJob>* jobs) {
+  FILE* manifest = fopen(filename, "r");
+  if (!manifest) {
+    printf("Couldn't open manifest file : %s\n", filename);
+    return -1;
+  }
+
+  // 한 줄에 "입력 파일<TAB>출력 파일" 형식으로 기록되어 있음 (TAB이 없으면 첫 번째 공백으로 구분)
+  char line[8192];
+  while (fgets(line, sizeof(line), manifest)) {
+    size_t length = strlen(line);
+    while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+      line[--length] = '\0';
+    }
+    if (length == 0 || line[0] == '#') {
+      continue;
+    }
+
+    char* separator = strchr(line, '\t');
+    if (!separator) {
+      separator = strchr(line, ' ');
+    }
+    if (!separator) {
+      printf("Invalid manifest line : %s\n", line);
+      continue;
+    }
+
+    *separator = '\0';
+    RemuxJob job;
+    init_job(&job, line, separator + 1);
+    jobs->push_back(job);
+  }
+
+  fclose(manifest);
+  return 0;
+}
+
+bool next_job(std::vector<WorkerQueue>& queues, int worker, size_t* job_index) {
+  {
+    WorkerQueue& queue = queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.jobs.empty()) {
+      *job_index = queue.jobs.front();
+      queue.jobs.pop_front();
+      return true;
+    }
+  }
+
+  // 자신의 큐가 비었으면 다른 워커의 큐에서 가장 나중에 처리될 작업을 가져옴
+  for (size_t offset = 1; offset < queues.size(); ++offset) {
+    WorkerQueue& queue = queues[(worker + offset) % queues.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.jobs.empty()) {
+      *job_index = queue.jobs.back();
+      queue.jobs.pop_back();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+int run_manifest(const char* filename, int jobs, const RemuxOptions& options) {
+  std::vector<RemuxJob> remux_jobs;
+  if (read_manifest(filename, &remux_jobs) < 0) {
+    return -1;
+  }
+
+  int workers = (int) FFMIN((size_t) jobs, FFMAX(remux_jobs.size(), (size_t) 1));
+
+  // 작업을 워커 큐에 골고루 나누어 넣음
+  std::vector<WorkerQueue> queues(workers);
+  for (size_t index = 0; index < remux_jobs.size(); ++index) {
+    queues[index % workers].jobs.push_back(index);
+  }
+
+  std::atomic<size_t> failed_count(0);
+  std::mutex output_mutex;
+  int64_t start_time = av_gettime_relative();
+
+  auto worker = [&](int worker_index) {
+    size_t job_index;
+    while (next_job(queues, worker_index, &job_index)) {
+      RemuxJob& job = remux_jobs[job_index];
+
+      // 작업마다 컨텍스트가 분리되어 있으므로 한 작업이 실패해도 다른 작업에 영향을 주지 않음
+      if (run_job(&job, options, false) < 0) {
+        ++failed_count;
+      }
+
+      std::lock_guard<std::mutex> lock(output_mutex);
+      printf("[%s] %s -> %s : %lld packets, %.1f MB, %.3f sec\n",
+             job.error < 0 ? "failed" : "done", job.input_filename.c_str(),
+             job.output_filename.c_str(), (long long) job.packet_count,
+             job.bytes_written / (1024.0 * 1024.0), job.elapsed);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int index = 0; index < workers; ++index) {
+    threads.emplace_back(worker, index);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  double elapsed = (av_gettime_relative() - start_time) / 1000000.0;
+
+  int64_t packet_count = 0;
+  int64_t bytes_read = 0;
+  int64_t bytes_written = 0;
+  for (const RemuxJob& job : remux_jobs) {
+    packet_count += job.packet_count;
+    bytes_read += job.bytes_read;
+    bytes_written += job.bytes_written;
+  }
+
+  printf("%zu jobs (%zu failed) with %d workers in %.3f sec\n", remux_jobs.size(),
+         failed_count.load(), workers, elapsed);
+  printf("packets : %lld (%.1f packets/sec), read : %.1f MB/sec, written : %.1f MB/sec\n",
+         (long long) packet_count, elapsed > 0 ? packet_count / elapsed : 0.0,
+         elapsed > 0 ? bytes_read / elapsed / (1024.0 * 1024.0) : 0.0,
+         elapsed > 0 ? bytes_written / elapsed / (1024.0 * 1024.0) : 0.0);
+
+  return failed_count > 0 ? -1 : 0;
+}
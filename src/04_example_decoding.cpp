@@ -2,23 +2,408 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/avutil.h>
+#include <libavutil/buffer.h>
 #include <libavutil/common.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+#include <libswscale/swscale.h>
 }
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <mutex>
+#include <string>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// mmap으로 매핑한 입력 파일
+struct MappedFile {
+  uint8_t* data;
+  int64_t size;
+  int64_t pos;
+};
 
 struct FileContext {
   AVFormatContext* av_format_ctx;
+  AVIOContext* avio_ctx;
+  MappedFile mapped_file;
   AVCodecContext* video_codec_ctx;
   AVCodecContext* audio_codec_ctx;
   int v_index;
   int a_index;
+  // 디코더에 보낸 패킷 수와 디코딩한 프레임 수 (--verify에서 비교)
+  int64_t video_packet_count;
+  int64_t audio_packet_count;
+  int64_t video_frame_count;
+  int64_t audio_frame_count;
+};
+
+// 디코더 스레드 정책
+// thread_type : FF_THREAD_FRAME은 여러 프레임을 동시에 디코딩해서 처리량이 높지만 스레드 수만큼 지연이 생기고,
+//               FF_THREAD_SLICE는 한 프레임의 슬라이스를 나누어 지연은 없지만 슬라이스가 적은 영상에서는 효과가 작음
+// thread_count : 0이면 CPU 코어 수에 맞춰 자동으로 결정
+// low_delay : 프레임 스레딩을 끄고 AV_CODEC_FLAG_LOW_DELAY를 설정해서 프레임을 최대한 빨리 내보냄
+// 명령행 옵션에서 -1은 설정하지 않았다는 의미
+struct ThreadPolicy {
+  int thread_type;
+  int thread_count;
+  int low_delay;
+};
+
+// 설정 파일의 한 줄 : <코덱 이름|*> <해상도 구간|*> <frame|slice|both> <스레드 수> [low-delay]
+// 예: h264 fhd frame 8
+struct ThreadPolicyRule {
+  std::string codec;
+  std::string bucket;
+  ThreadPolicy policy;
+};
+
+struct ThreadOptions {
+  std::vector<ThreadPolicyRule> rules;
+  ThreadPolicy overrides;
+};
+
+// 보정(calibration) 모드에서 한 정책으로 디코딩한 결과
+struct CalibrationRun {
+  ThreadPolicy policy;
+  int64_t frame_count;
+  int64_t start_time;
+  int64_t first_frame_time;
+  double fps;
+  double first_frame_latency;
+};
+
+// 썸네일 추출 옵션
+// interval초마다 그 시점 직전의 키프레임 하나만 디코딩해서 width 너비로 줄인 후
+// sprite_columns가 0이면 <output>_00001.jpg 형식의 이미지들로, 아니면 격자 이미지 하나(<output>.jpg)로 씀
+struct ThumbnailOptions {
+  const char* output;
+  double interval;
+  int width;
+  int sprite_columns;
+  bool benchmark;
+};
+
+// 썸네일을 줄이고 쓰는 데 필요한 상태
+struct ThumbnailWriter {
+  SwsContext* sws_ctx;
+  AVFrame* thumb_frame;
+  AVFrame* sprite_frame;
+  int thumb_count;
+  // 같은 키프레임을 다시 디코딩하지 않도록 마지막으로 사용한 키프레임의 PTS를 기억
+  int64_t last_key_pts;
+  int64_t decoded_count;
+};
+
+// 키프레임에서 시작하는 디코딩 구간 (PTS는 스트림의 time_base 단위)
+// start_pts의 키프레임부터 end_pts의 키프레임 직전 프레임까지 담당하며,
+// 첫 구간의 start_pts와 마지막 구간의 end_pts는 AV_NOPTS_VALUE (제한 없음)
+struct ChunkRange {
+  int64_t start_pts;
+  int64_t end_pts;
+  int64_t packet_count;
+};
+
+// 구간을 디코딩하는 스레드 하나 (입력 파일과 디코더를 스레드마다 따로 열어서 서로 공유하지 않음)
+struct ChunkWorker {
+  std::thread thread;
+  AVFormatContext* av_format_ctx;
+  AVCodecContext* av_codec_ctx;
+  int v_index;
+  // 현재 디코딩 중인 구간
+  int range_index;
+  int range_count;
+  int64_t frame_count;
+  // 구간 밖의 프레임이라 버린 수 (open GOP의 앞쪽 B 프레임 등)
+  int64_t dropped_count;
+  int64_t busy_time;
+  int64_t wait_time;
+  int error;
+};
+
+// 구간마다 디코딩한 프레임을 모아두었다가 표시 순서대로 내보내는 재정렬 버퍼
+// 지금 내보내는 구간(next_range)보다 뒤의 구간은 max_frames까지만 쌓을 수 있고,
+// next_range를 디코딩하는 스레드는 기다리지 않으므로 버퍼가 가득 차도 멈추지 않음
+struct ReorderBuffer {
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::vector<std::deque<AVFrame*>> frames;
+  std::vector<bool> finished;
+  size_t next_range;
+  size_t frame_count;
+  size_t max_frames;
+  size_t peak_frames;
+  bool stop;
+};
+
+// GOP 단위 병렬 디코딩 (--chunks)
+struct ChunkDecoder {
+  const char* filename;
+  std::vector<ChunkRange> ranges;
+  std::vector<ChunkWorker*> workers;
+  // 다음으로 디코딩할 구간 (스레드들이 앞에서부터 하나씩 가져감)
+  std::atomic<int> next_range;
+  ReorderBuffer reorder;
+};
+
+// 디코딩한 프레임을 처리하는 함수 (0 이상을 반환하면 계속 디코딩)
+typedef int (*FrameHandler)(AVCodecContext* av_codec_ctx, AVFrame* av_frame, void* opaque);
+
+// 특정 시각의 프레임 요청 하나
+// 요청 시각에 화면에 보이는 프레임(PTS가 요청 시각 이하인 마지막 프레임)으로 응답
+struct FrameRequest {
+  // 입력한 순서
+  int index;
+  double time;
+  // 스트림 time_base 단위의 요청 시각
+  int64_t pts;
+  // 요청 시각이 속한 GOP (키프레임 인덱스의 위치)
+  int gop;
+};
+
+// 요청한 프레임을 받는 함수 (0 이상을 반환하면 계속 진행)
+typedef int (*RequestHandler)(const FrameRequest* request, AVFrame* av_frame, void* opaque);
+
+// 여러 시각의 프레임을 GOP 단위로 묶어서 디코딩하는 상태
+// requests는 시각 순서로 정렬되어 있고, 지금 디코딩하는 GOP의 요청은 [next, group_end) 구간
+struct FrameServer {
+  std::vector<FrameRequest> requests;
+  std::vector<int64_t> keyframes;
+  size_t next;
+  size_t group_end;
+  RequestHandler handle_request;
+  void* opaque;
+  // 요청 시각을 지나는 프레임이 나와야 응답할 수 있으므로 직전 프레임을 들고 있음
+  AVFrame* previous;
+  // 탐색한 후 디코딩한 프레임 수 (요청마다 따로 탐색했다면 디코딩했을 프레임 수를 계산하는 데 사용)
+  int64_t gop_frames;
+  int64_t previous_position;
+  int64_t last_emitted_pts;
+  int64_t seek_count;
+  int64_t decoded_count;
+  int64_t unique_count;
+  int64_t naive_count;
+  int64_t missing_count;
+};
+
+// 디먹싱 스레드가 스트림별로 채워두는 패킷 큐 (미리 할당한 패킷을 링 버퍼로 사용)
+struct PacketQueue {
+  std::vector<AVPacket*> packets;
+  // 디먹싱한 순서를 유지하기 위해 패킷마다 붙이는 일련번호
+  std::vector<uint64_t> sequences;
+  size_t head;
+  size_t count;
+  size_t high_watermark;
+  // 큐가 가득 차서 디먹싱 스레드가 기다린 횟수
+  uint64_t producer_stalls;
+};
+
+struct DemuxThread {
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable not_full;
+  std::condition_variable not_empty;
+  // 스트림 인덱스별 큐 (디코딩하지 않는 스트림은 크기가 0)
+  std::vector<PacketQueue> queues;
+  uint64_t next_sequence;
+  // 큐가 비어서 디코딩 루프가 기다린 횟수
+  uint64_t consumer_stalls;
+  bool running;
+  bool finished;
+  bool stop;
+  int error;
+};
+
+// 한 스레드만 넣고 한 스레드만 꺼내는 lock-free 링 버퍼 (single producer, single consumer)
+// head는 꺼내는 스레드만, tail은 넣는 스레드만 바꾸므로 mutex 없이 atomic 변수만으로 동기화
+// nullptr은 스트림의 끝(EOS)을 알리는 용도로 사용
+struct SpscQueue {
+  std::vector<void*> slots;
+  std::atomic<size_t> head;
+  std::atomic<size_t> tail;
+};
+
+// 파이프라인의 한 단계 (스레드 하나)
+// busy_time은 실제 작업 시간, wait_time은 큐가 비거나 가득 차서 기다린 시간 (마이크로초)
+struct PipelineStage {
+  const char* name;
+  std::thread thread;
+  int64_t busy_time;
+  int64_t wait_time;
+  int64_t items;
+  int error;
+  // 결과를 넘길 다음 단계의 큐
+  SpscQueue* output;
+  // 다 쓴 패킷을 디먹싱 단계로 돌려보내는 큐와 다음 단계에서 돌려받은 프레임 큐 (디코딩 단계만 사용)
+  SpscQueue* packet_returns;
+  SpscQueue* frame_returns;
+};
+
+// 디먹싱 -> 비디오 디코딩 / 오디오 디코딩 -> 프레임 처리(메인 스레드)로 이어지는 디코딩 파이프라인
+// 비디오와 오디오가 각자의 스레드와 큐를 가지므로 오디오 디코딩이 느린 비디오 프레임을 기다리지 않음
+struct DecodePipeline {
+  SpscQueue video_packets;
+  SpscQueue audio_packets;
+  SpscQueue video_frames;
+  SpscQueue audio_frames;
+  PipelineStage demux;
+  PipelineStage video_decode;
+  PipelineStage audio_decode;
+  PipelineStage sink;
+  // 다 쓴 패킷과 프레임을 만든 단계로 돌려보내서 다시 사용하는 큐 (방향마다 SPSC 큐 하나)
+  SpscQueue video_packet_returns;
+  SpscQueue audio_packet_returns;
+  SpscQueue video_frame_returns;
+  SpscQueue audio_frame_returns;
+  // 재사용하지 못하고 새로 할당한 AVPacket, AVFrame 수
+  std::atomic<int64_t> packet_allocations;
+  std::atomic<int64_t> frame_allocations;
+  // 한 단계에서 에러가 발생하면 나머지 단계도 기다리지 않고 종료
+  std::atomic<bool> stop;
+};
+
+// (픽셀 포맷, 너비, 높이)마다 하나씩 만드는 프레임 버퍼 풀
+// 한 프레임의 모든 plane을 버퍼 하나에 담고, 다 쓴 버퍼는 해제하지 않고 풀로 돌아가서 재사용됨
+struct FramePool {
+  int format;
+  int width;
+  int height;
+  int linesizes[4];
+  // 버퍼 시작 위치부터 각 plane까지의 거리
+  size_t offsets[4];
+  size_t size;
+  AVBufferPool* buffer_pool;
+};
+
+// AVCodecContext::get_buffer2로 설치하는 프레임 버퍼 할당기
+// 디코더가 프레임 스레딩을 사용하면 여러 스레드에서 동시에 호출되므로 풀 목록은 mutex로 보호
+struct FrameAllocator {
+  bool enabled;
+  bool hugepages;
+  std::mutex mutex;
+  std::vector<FramePool*> pools;
+  // get_buffer2 호출 수와 풀이 실제로 새 메모리를 할당한 수
+  std::atomic<int64_t> frame_count;
+  std::atomic<int64_t> allocation_count;
+  std::atomic<int64_t> hugepage_count;
+};
+
+// 명령행에서 지정한 스트림 선택 조건
+// nullptr이면 해당 타입의 첫 번째 스트림, "none"이면 사용하지 않음,
+// 숫자면 스트림 인덱스, 그 외에는 language 메타데이터(예: eng, kor)로 선택
+struct StreamSelection {
+  const char* video;
+  const char* audio;
+  // 선택하지 않은 스트림을 디먹서 단계에서 버릴지 여부 (--no-discard로 비교 가능)
+  bool discard;
 };
 
 FileContext input_file_ctx;
+DemuxThread demux_thread;
+DecodePipeline pipeline;
+ThreadOptions thread_options;
+ThumbnailOptions thumbnail_options;
+FrameAllocator frame_allocator;
+ChunkDecoder chunk_decoder;
+
+// 캐시 라인과 AVX-512 레지스터 크기에 맞춘 정렬 단위
+const int frame_alignment = 64;
+
+// 디코더가 같은 에러를 계속 반환할 때 무한 반복하지 않도록 연속으로 건너뛰는 프레임 수를 제한
+const int max_decode_errors = 16;
 
-int open_input(const char* filename);
-int open_decoder(AVCodecParameters* av_codec_params, AVCodecContext** av_codec_ctx);
-int decode_packet(AVCodecContext** av_codec_ctx, AVPacket* av_packet, AVFrame** av_frame);
+int open_input(const char* filename, bool use_mmap, const StreamSelection& selection);
+bool match_stream(AVStream* av_stream, const char* spec);
+void discard_unused_streams(const StreamSelection& selection);
+void print_read_stats(int64_t packet_count, int64_t dropped_count);
+int open_mapped_input(const char* filename, MappedFile* mapped_file, AVIOContext** avio_ctx);
+int read_mapped_file(void* opaque, uint8_t* buf, int buf_size);
+int64_t seek_mapped_file(void* opaque, int64_t offset, int whence);
+void close_mapped_input(MappedFile* mapped_file, AVIOContext** avio_ctx);
+int start_demux_thread(int queue_size);
+void demux_loop();
+int read_packet(AVPacket* av_packet);
+void stop_demux_thread();
+void print_demux_stats();
+void init_spsc_queue(SpscQueue* queue, int capacity);
+bool spsc_push(SpscQueue* queue, void* item);
+bool spsc_pop(SpscQueue* queue, void** item);
+bool push_item(SpscQueue* queue, void* item, PipelineStage* stage);
+bool pop_item(SpscQueue* queue, void** item, PipelineStage* stage);
+void init_stage(PipelineStage* stage, const char* name);
+int run_pipeline(int queue_size);
+void pipeline_demux_loop();
+void pipeline_decode_loop(AVCodecContext* av_codec_ctx, SpscQueue* packets, SpscQueue* frames,
+                          PipelineStage* stage);
+void drain_queue(SpscQueue* queue, bool frames);
+void print_pipeline_stats(double elapsed);
+int push_frame(AVCodecContext* av_codec_ctx, AVFrame* av_frame, void* opaque);
+void print_frame(AVCodecContext* av_codec_ctx, AVFrame* av_frame);
+int show_frame(AVCodecContext* av_codec_ctx, AVFrame* av_frame, void* opaque);
+void count_frame(AVCodecContext* av_codec_ctx);
+int verify_frame_counts();
+int open_decoder(AVCodecParameters* av_codec_params, AVCodecContext** av_codec_ctx,
+                 const ThreadPolicy* policy);
+int decode_packet(AVCodecContext* av_codec_ctx, AVPacket* av_packet, AVFrame* av_frame,
+                  FrameHandler handle_frame, void* opaque);
+int flush_decoders(AVFrame* av_frame, FrameHandler handle_frame, void* opaque);
+const char* resolution_bucket(int width, int height);
+int parse_thread_type(const char* name);
+const char* thread_type_name(int thread_type);
+int load_thread_config(const char* filename, std::vector<ThreadPolicyRule>* rules);
+int save_thread_config(const char* filename, const std::vector<ThreadPolicyRule>& rules);
+ThreadPolicy resolve_thread_policy(AVCodecParameters* av_codec_params);
+int calibrate_thread_policy(const char* config_filename, double seconds, bool prefer_latency);
+int count_calibration_frame(AVCodecContext* av_codec_ctx, AVFrame* av_frame, void* opaque);
+int run_thumbnails();
+int extract_keyframe_thumbnails(ThumbnailWriter* writer, bool write);
+int extract_decoded_thumbnails(ThumbnailWriter* writer);
+int init_thumbnail_writer(ThumbnailWriter* writer, int thumb_count);
+int keep_first_frame(AVCodecContext* av_codec_ctx, AVFrame* av_frame, void* opaque);
+int sample_decoded_frame(AVCodecContext* av_codec_ctx, AVFrame* av_frame, void* opaque);
+int add_thumbnail(ThumbnailWriter* writer, AVFrame* av_frame, bool write);
+int write_jpeg(AVFrame* av_frame, const char* filename);
+void free_thumbnail_writer(ThumbnailWriter* writer);
+int run_chunked_decoding(const char* filename, int thread_count, int buffer_frames);
+int build_chunk_ranges(int target_packets);
+int open_chunk_worker(ChunkWorker* worker);
+void chunk_decode_loop(ChunkWorker* worker);
+int decode_chunk_range(ChunkWorker* worker, AVPacket* av_packet, AVFrame* av_frame);
+int queue_chunk_frame(AVCodecContext* av_codec_ctx, AVFrame* av_frame, void* opaque);
+void finish_chunk_range(int range_index);
+void print_chunk_stats(double elapsed, int64_t order_errors);
+int parse_frame_times(const char* list, std::vector<double>* times);
+int load_frame_times(const char* filename, std::vector<double>* times);
+int run_frame_server(const std::vector<double>& times);
+int build_keyframe_index(std::vector<int64_t>* keyframes);
+int serve_frames(FrameServer* server, const std::vector<double>& times,
+                 RequestHandler handle_request, void* opaque);
+int decode_request_group(FrameServer* server, AVPacket* av_packet, AVFrame* av_frame);
+int serve_decoded_frame(AVCodecContext* av_codec_ctx, AVFrame* av_frame, void* opaque);
+int emit_request(FrameServer* server, AVFrame* av_frame, int64_t position);
+int show_requested_frame(const FrameRequest* request, AVFrame* av_frame, void* opaque);
+int get_pooled_buffer(AVCodecContext* av_codec_ctx, AVFrame* av_frame, int flags);
+FramePool* find_frame_pool(AVCodecContext* av_codec_ctx, int format, int width, int height);
+AVBufferRef* allocate_pool_buffer(void* opaque, int size);
+void free_pool_buffer(void* opaque, uint8_t* data);
+void free_hugepage_buffer(void* opaque, uint8_t* data);
+void release_frame_pools();
+void print_frame_pool_stats(int64_t page_faults);
+int64_t get_page_faults();
+AVPacket* get_packet(SpscQueue* returns, SpscQueue* more_returns);
+AVFrame* get_frame(SpscQueue* returns);
+void return_packet(SpscQueue* returns, AVPacket* av_packet);
+void return_frame(SpscQueue* returns, AVFrame* av_frame);
 void release();
 
 int main(int argc, const char** argv) {
@@ -26,14 +411,166 @@ int main(int argc, const char** argv) {
 
   if (argc < 2) {
     printf("Not enough arguments entered\n");
+    printf("usage: %s <input> [--mmap] [--read-ahead packets] [--pipeline queue_size] [--verify]\n",
+           argv[0]);
+    printf("stream options: [--video index|lang|none] [--audio index|lang|none] "
+           "[--no-discard]\n");
+    printf("thread options: [--threads N] [--thread-type frame|slice|both] [--low-delay] "
+           "[--thread-config file]\n");
+    printf("calibration : [--calibrate config_file] [--calibrate-seconds N] "
+           "[--calibrate-goal throughput|latency]\n");
+    printf("memory options: [--frame-pool] [--hugepages]\n");
+    printf("thumbnails : [--thumbnails output_prefix] [--interval seconds] [--thumb-width N] "
+           "[--sprite columns] [--thumbnail-bench]\n");
+    printf("chunked decoding : [--chunks threads] [--chunk-buffer frames]\n");
+    printf("frame server : [--frames-at seconds,seconds,...] [--frames-file file]\n");
     return -1;
   }
 
-  if (open_input(argv[1]) < 0) {
+  bool use_mmap = false;
+  StreamSelection selection;
+  selection.video = nullptr;
+  selection.audio = nullptr;
+  selection.discard = true;
+  int read_ahead = 0;
+  int pipeline_queue_size = 0;
+  bool verify = false;
+  const char* calibrate_config = nullptr;
+  double calibrate_seconds = 10;
+  bool prefer_latency = false;
+  thread_options.overrides.thread_type = -1;
+  thread_options.overrides.thread_count = -1;
+  thread_options.overrides.low_delay = -1;
+  thumbnail_options.output = nullptr;
+  thumbnail_options.interval = 10;
+  thumbnail_options.width = 160;
+  thumbnail_options.sprite_columns = 0;
+  thumbnail_options.benchmark = false;
+  int chunk_threads = -1;
+  int chunk_buffer = 256;
+  std::vector<double> frame_times;
+  for (int index = 2; index < argc; ++index) {
+    if (strcmp(argv[index], "--mmap") == 0) {
+      use_mmap = true;
+    } else if (strcmp(argv[index], "--video") == 0 && index + 1 < argc) {
+      selection.video = argv[++index];
+    } else if (strcmp(argv[index], "--audio") == 0 && index + 1 < argc) {
+      selection.audio = argv[++index];
+    } else if (strcmp(argv[index], "--no-discard") == 0) {
+      selection.discard = false;
+    } else if (strcmp(argv[index], "--read-ahead") == 0 && index + 1 < argc) {
+      read_ahead = atoi(argv[++index]);
+    } else if (strcmp(argv[index], "--pipeline") == 0 && index + 1 < argc) {
+      pipeline_queue_size = atoi(argv[++index]);
+    } else if (strcmp(argv[index], "--verify") == 0) {
+      verify = true;
+    } else if (strcmp(argv[index], "--threads") == 0 && index + 1 < argc) {
+      thread_options.overrides.thread_count = atoi(argv[++index]);
+    } else if (strcmp(argv[index], "--thread-type") == 0 && index + 1 < argc) {
+      thread_options.overrides.thread_type = parse_thread_type(argv[++index]);
+      if (thread_options.overrides.thread_type < 0) {
+        printf("Unknown thread type : %s\n", argv[index]);
+        return -1;
+      }
+    } else if (strcmp(argv[index], "--low-delay") == 0) {
+      thread_options.overrides.low_delay = 1;
+    } else if (strcmp(argv[index], "--thread-config") == 0 && index + 1 < argc) {
+      if (load_thread_config(argv[++index], &thread_options.rules) < 0) {
+        return -1;
+      }
+    } else if (strcmp(argv[index], "--frame-pool") == 0) {
+      frame_allocator.enabled = true;
+    } else if (strcmp(argv[index], "--hugepages") == 0) {
+      frame_allocator.enabled = true;
+      frame_allocator.hugepages = true;
+    } else if (strcmp(argv[index], "--thumbnails") == 0 && index + 1 < argc) {
+      thumbnail_options.output = argv[++index];
+    } else if (strcmp(argv[index], "--interval") == 0 && index + 1 < argc) {
+      thumbnail_options.interval = atof(argv[++index]);
+    } else if (strcmp(argv[index], "--thumb-width") == 0 && index + 1 < argc) {
+      thumbnail_options.width = atoi(argv[++index]);
+    } else if (strcmp(argv[index], "--sprite") == 0 && index + 1 < argc) {
+      thumbnail_options.sprite_columns = atoi(argv[++index]);
+    } else if (strcmp(argv[index], "--thumbnail-bench") == 0) {
+      thumbnail_options.benchmark = true;
+    } else if (strcmp(argv[index], "--chunks") == 0 && index + 1 < argc) {
+      chunk_threads = atoi(argv[++index]);
+    } else if (strcmp(argv[index], "--chunk-buffer") == 0 && index + 1 < argc) {
+      chunk_buffer = atoi(argv[++index]);
+    } else if (strcmp(argv[index], "--frames-at") == 0 && index + 1 < argc) {
+      if (parse_frame_times(argv[++index], &frame_times) < 0) {
+        return -1;
+      }
+    } else if (strcmp(argv[index], "--frames-file") == 0 && index + 1 < argc) {
+      if (load_frame_times(argv[++index], &frame_times) < 0) {
+        return -1;
+      }
+    } else if (strcmp(argv[index], "--calibrate") == 0 && index + 1 < argc) {
+      calibrate_config = argv[++index];
+    } else if (strcmp(argv[index], "--calibrate-seconds") == 0 && index + 1 < argc) {
+      calibrate_seconds = atof(argv[++index]);
+    } else if (strcmp(argv[index], "--calibrate-goal") == 0 && index + 1 < argc) {
+      prefer_latency = strcmp(argv[++index], "latency") == 0;
+    } else {
+      printf("Unknown option : %s\n", argv[index]);
+      return -1;
+    }
+  }
+
+  // 구간 병렬 디코딩과 프레임 서버는 비디오 스트림만 디코딩
+  if (chunk_threads >= 0 || !frame_times.empty()) {
+    selection.audio = "none";
+  }
+
+  int64_t page_faults = get_page_faults();
+  if (open_input(argv[1], use_mmap, selection) < 0) {
     release();
     return -1;
   }
 
+  // 보정 모드는 정책마다 같은 구간을 디코딩해서 가장 좋은 정책을 설정 파일에 기록
+  if (calibrate_config) {
+    int ret = calibrate_thread_policy(calibrate_config, calibrate_seconds, prefer_latency);
+    release();
+    return ret < 0 ? -1 : 0;
+  }
+
+  // 썸네일 모드는 필요한 시점으로 탐색하면서 키프레임만 디코딩
+  if (thumbnail_options.output || thumbnail_options.benchmark) {
+    int ret = run_thumbnails();
+    release();
+    return ret < 0 ? -1 : 0;
+  }
+
+  // 프레임 서버는 요청한 시각들을 GOP별로 묶어서 GOP마다 한 번만 디코딩
+  if (!frame_times.empty()) {
+    int ret = run_frame_server(frame_times);
+    release();
+    return ret < 0 ? -1 : 0;
+  }
+
+  // 구간 병렬 디코딩은 스레드마다 입력 파일을 따로 열어서 키프레임 구간을 나누어 디코딩
+  if (chunk_threads >= 0) {
+    int ret = run_chunked_decoding(argv[1], chunk_threads, chunk_buffer);
+    print_frame_pool_stats(get_page_faults() - page_faults);
+    if (ret >= 0 && verify) {
+      ret = verify_frame_counts();
+    }
+    release();
+    return ret < 0 ? -1 : 0;
+  }
+
+  // 파이프라인의 디먹싱 단계가 read-ahead 역할도 하므로 --read-ahead는 사용하지 않음
+  if (pipeline_queue_size > 0) {
+    int ret = run_pipeline(pipeline_queue_size);
+    print_frame_pool_stats(get_page_faults() - page_faults);
+    if (ret >= 0 && verify) {
+      ret = verify_frame_counts();
+    }
+    release();
+    return ret < 0 ? -1 : 0;
+  }
+
   // AVFrame 구조체는 디코딩한 raw 데이터를 저장하는 구조체
   AVFrame* decoded_frame = av_frame_alloc();
   if (!decoded_frame) {
@@ -41,57 +578,98 @@ int main(int argc, const char** argv) {
     return -1;
   }
 
+  // 디먹싱을 별도 스레드에서 미리 해두면 저장장치 지연이 디코딩을 멈추게 하지 않음
+  if (read_ahead > 0 && start_demux_thread(read_ahead) < 0) {
+    av_frame_free(&decoded_frame);
+    release();
+    return -1;
+  }
+
   AVPacket av_packet;
+  int64_t packet_count = 0;
+  int64_t dropped_count = 0;
+  int ret;
 
   while (true) {
-    int ret = av_read_frame(input_file_ctx.av_format_ctx, &av_packet);
+    ret = read_packet(&av_packet);
     if (ret == AVERROR_EOF) {
       printf("End of frame\n");
       break;
+    } else if (ret < 0) {
+      printf("Error occurred when reading packet\n");
+      break;
     }
 
+    ++packet_count;
+
+    // 선택하지 않은 스트림의 패킷은 디코딩하지 않음 (--no-discard를 사용한 경우에만 도달)
     if (av_packet.stream_index != input_file_ctx.v_index &&
         av_packet.stream_index != input_file_ctx.a_index) {
+      ++dropped_count;
       av_packet_unref(&av_packet);
+      continue;
     }
 
     AVStream* av_stream = input_file_ctx.av_format_ctx->streams[av_packet.stream_index];
-    AVCodecContext** av_codec_ctx;
+    AVCodecContext* av_codec_ctx;
     if (av_packet.stream_index == input_file_ctx.v_index) {
-      av_codec_ctx = &(input_file_ctx.video_codec_ctx);
+      av_codec_ctx = input_file_ctx.video_codec_ctx;
+      ++input_file_ctx.video_packet_count;
     } else {
-      av_codec_ctx = &(input_file_ctx.audio_codec_ctx);
+      av_codec_ctx = input_file_ctx.audio_codec_ctx;
+      ++input_file_ctx.audio_packet_count;
     }
 
-    av_packet_rescale_ts(&av_packet, av_stream->time_base, (*av_codec_ctx)->time_base);
+    av_packet_rescale_ts(&av_packet, av_stream->time_base, av_codec_ctx->time_base);
 
-    ret = decode_packet(av_codec_ctx, &av_packet, &decoded_frame);
-    if (ret >= 0) {
-      printf("-----------------------\n");
-      if ((*av_codec_ctx)->codec_type == AVMEDIA_TYPE_VIDEO) {
-        printf("Video : frame->width, height : %dx%d\n", decoded_frame->width,
-               decoded_frame->height);
-        printf("Video : frame->sample_aspect_ratio : %d/%d\n",
-               decoded_frame->sample_aspect_ratio.num, decoded_frame->sample_aspect_ratio.den);
-      } else {
-        printf("Audio : frame->nb_samples : %d\n", decoded_frame->nb_samples);
-        printf("Audio : frame->channels : %d\n", decoded_frame->channels);
-      }
-      av_frame_unref(decoded_frame);
-    }
+    ret = decode_packet(av_codec_ctx, &av_packet, decoded_frame, show_frame, nullptr);
     av_packet_unref(&av_packet);
+    // 디코딩하지 못한 패킷은 decode_packet()이 건너뛰므로 음수면 더 진행할 수 없는 에러
+    if (ret < 0) {
+      break;
+    }
   }
 
+  // 파일을 끝까지 읽었으면 디코더 내부에 남아 있는 프레임을 모두 꺼냄
+  if (ret == AVERROR_EOF) {
+    ret = flush_decoders(decoded_frame, show_frame, nullptr);
+  }
+
+  print_read_stats(packet_count, dropped_count);
+  print_demux_stats();
+  print_frame_pool_stats(get_page_faults() - page_faults);
+
+  if (ret >= 0 && verify) {
+    ret = verify_frame_counts();
+  }
+
+  av_frame_free(&decoded_frame);
   release();
 
-  return 0;
+  return ret < 0 ? -1 : 0;
 }
 
-int open_input(const char* filename) {
+int open_input(const char* filename, bool use_mmap, const StreamSelection& selection) {
   input_file_ctx.av_format_ctx = nullptr;
+  input_file_ctx.avio_ctx = nullptr;
   input_file_ctx.video_codec_ctx = nullptr;
   input_file_ctx.audio_codec_ctx = nullptr;
   input_file_ctx.v_index = input_file_ctx.a_index = -1;
+  input_file_ctx.video_packet_count = input_file_ctx.audio_packet_count = 0;
+  input_file_ctx.video_frame_count = input_file_ctx.audio_frame_count = 0;
+
+  // 기본 file 프로토콜 대신 mmap으로 매핑한 메모리에서 바로 읽는 AVIOContext를 사용
+  if (use_mmap) {
+    if (open_mapped_input(filename, &input_file_ctx.mapped_file, &input_file_ctx.avio_ctx) < 0) {
+      return -1;
+    }
+
+    input_file_ctx.av_format_ctx = avformat_alloc_context();
+    if (!input_file_ctx.av_format_ctx) {
+      return -1;
+    }
+    input_file_ctx.av_format_ctx->pb = input_file_ctx.avio_ctx;
+  }
 
   if (avformat_open_input(&(input_file_ctx.av_format_ctx), filename, nullptr, nullptr) < 0) {
     printf("Couldn't open input file %s\n", filename);
@@ -104,14 +682,25 @@ int open_input(const char* filename) {
   }
 
   for (int index = 0; index < input_file_ctx.av_format_ctx->nb_streams; ++index) {
-    AVCodecParameters* av_codec_params = input_file_ctx.av_format_ctx->streams[index]->codecpar;
-    if (av_codec_params->codec_type == AVMEDIA_TYPE_VIDEO && input_file_ctx.v_index < 0) {
-      if (open_decoder(av_codec_params, &(input_file_ctx.video_codec_ctx)) < 0) {
+    AVStream* av_stream = input_file_ctx.av_format_ctx->streams[index];
+    AVCodecParameters* av_codec_params = av_stream->codecpar;
+    if (av_codec_params->codec_type == AVMEDIA_TYPE_VIDEO && input_file_ctx.v_index < 0 &&
+        match_stream(av_stream, selection.video)) {
+      ThreadPolicy policy = resolve_thread_policy(av_codec_params);
+      if (open_decoder(av_codec_params, &(input_file_ctx.video_codec_ctx), &policy) < 0) {
         break;
       }
+      printf("video decoder : %s %dx%d (%s), thread_type %s, threads %d%s\n",
+             avcodec_get_name(av_codec_params->codec_id), av_codec_params->width,
+             av_codec_params->height,
+             resolution_bucket(av_codec_params->width, av_codec_params->height),
+             thread_type_name(input_file_ctx.video_codec_ctx->active_thread_type),
+             input_file_ctx.video_codec_ctx->thread_count,
+             policy.low_delay > 0 ? ", low delay" : "");
       input_file_ctx.v_index = index;
-    } else if (av_codec_params->codec_type == AVMEDIA_TYPE_AUDIO && input_file_ctx.a_index < 0) {
-      if (open_decoder(av_codec_params, &(input_file_ctx.audio_codec_ctx)) < 0) {
+    } else if (av_codec_params->codec_type == AVMEDIA_TYPE_AUDIO && input_file_ctx.a_index < 0 &&
+               match_stream(av_stream, selection.audio)) {
+      if (open_decoder(av_codec_params, &(input_file_ctx.audio_codec_ctx), nullptr) < 0) {
         break;
       }
       input_file_ctx.a_index = index;
@@ -122,10 +711,13 @@ int open_input(const char* filename) {
     }
   }
 
+  discard_unused_streams(selection);
+
   return 0;
 }
 
-int open_decoder(AVCodecParameters* av_codec_params, AVCodecContext** av_codec_ctx) {
+int open_decoder(AVCodecParameters* av_codec_params, AVCodecContext** av_codec_ctx,
+                 const ThreadPolicy* policy) {
   // 코덱 ID를 통해 FFmpeg 라이브러리가 자동으로 코덱을 찾도록 함
   AVCodec* av_decoder = avcodec_find_decoder(av_codec_params->codec_id);
   if (!av_decoder) {
@@ -144,6 +736,25 @@ int open_decoder(AVCodecParameters* av_codec_params, AVCodecContext** av_codec_c
     return -1;
   }
 
+  // 디코더가 직접 버퍼를 할당받을 수 있는 경우(DR1)에만 풀에서 비디오 프레임 버퍼를 가져오도록 함
+  if (frame_allocator.enabled && av_codec_params->codec_type == AVMEDIA_TYPE_VIDEO &&
+      (av_decoder->capabilities & AV_CODEC_CAP_DR1)) {
+    (*av_codec_ctx)->get_buffer2 = get_pooled_buffer;
+    (*av_codec_ctx)->opaque = &frame_allocator;
+  }
+
+  // 스레드 설정은 avcodec_open2() 함수를 호출하기 전에 해야 적용됨
+  // policy가 nullptr이면 libavcodec 기본값(스레드 1개)을 사용
+  if (policy) {
+    (*av_codec_ctx)->thread_count = policy->thread_count;
+    (*av_codec_ctx)->thread_type = policy->thread_type;
+    if (policy->low_delay > 0) {
+      // 프레임 스레딩은 스레드 수만큼 프레임을 붙잡고 있으므로 슬라이스 스레딩만 사용
+      (*av_codec_ctx)->thread_type &= ~FF_THREAD_FRAME;
+      (*av_codec_ctx)->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    }
+  }
+
   if (avcodec_open2(*av_codec_ctx, av_decoder, nullptr) < 0) {
     printf("Couldn't open codec\n");
     return -1;
@@ -152,33 +763,2363 @@ int open_decoder(AVCodecParameters* av_codec_params, AVCodecContext** av_codec_c
   return 0;
 }
 
-int decode_packet(AVCodecContext** av_codec_ctx, AVPacket* av_packet, AVFrame** av_frame) {
-  int ret;
+const char* resolution_bucket(int width, int height) {
+  // 해상도가 비슷하면 같은 스레드 정책이 잘 맞으므로 높이(세로 영상은 너비) 기준으로 묶음
+  int lines = FFMIN(width, height);
+  if (lines <= 480) {
+    return "sd";
+  } else if (lines <= 720) {
+    return "hd";
+  } else if (lines <= 1080) {
+    return "fhd";
+  }
+  return "uhd";
+}
+
+int parse_thread_type(const char* name) {
+  if (strcmp(name, "frame") == 0) {
+    return FF_THREAD_FRAME;
+  } else if (strcmp(name, "slice") == 0) {
+    return FF_THREAD_SLICE;
+  } else if (strcmp(name, "both") == 0) {
+    return FF_THREAD_FRAME | FF_THREAD_SLICE;
+  }
+  return -1;
+}
+
+const char* thread_type_name(int thread_type) {
+  if (thread_type == (FF_THREAD_FRAME | FF_THREAD_SLICE)) {
+    return "both";
+  } else if (thread_type == FF_THREAD_FRAME) {
+    return "frame";
+  } else if (thread_type == FF_THREAD_SLICE) {
+    return "slice";
+  }
+  return "none";
+}
+
+int load_thread_config(const char* filename, std::vector<ThreadPolicyRule>* rules) {
+  FILE* file = fopen(filename, "r");
+  if (!file) {
+    printf("Couldn't open thread config %s\n", filename);
+    return -1;
+  }
+
+  char line[512];
+  int line_number = 0;
+  while (fgets(line, sizeof(line), file)) {
+    ++line_number;
+    if (line[0] == '#' || line[0] == '\n') {
+      continue;
+    }
+
+    char codec[64], bucket[16], type[16], option[16] = "";
+    int thread_count;
+    int fields = sscanf(line, "%63s %15s %15s %d %15s", codec, bucket, type, &thread_count, option);
+    if (fields < 4 || parse_thread_type(type) < 0) {
+      printf("Invalid thread config line %d : %s", line_number, line);
+      continue;
+    }
+
+    ThreadPolicyRule rule;
+    rule.codec = codec;
+    rule.bucket = bucket;
+    rule.policy.thread_type = parse_thread_type(type);
+    rule.policy.thread_count = thread_count;
+    rule.policy.low_delay = strcmp(option, "low-delay") == 0 ? 1 : 0;
+    rules->push_back(rule);
+  }
+
+  fclose(file);
+  return 0;
+}
+
+int save_thread_config(const char* filename, const std::vector<ThreadPolicyRule>& rules) {
+  FILE* file = fopen(filename, "w");
+  if (!file) {
+    printf("Couldn't write thread config %s\n", filename);
+    return -1;
+  }
+
+  fprintf(file,
+          "# codec bucket(sd|hd|fhd|uhd) thread_type(frame|slice|both) threads [low-delay]\n");
+  for (const ThreadPolicyRule& rule : rules) {
+    fprintf(file, "%s %s %s %d%s\n", rule.codec.c_str(), rule.bucket.c_str(),
+            thread_type_name(rule.policy.thread_type), rule.policy.thread_count,
+            rule.policy.low_delay > 0 ? " low-delay" : "");
+  }
+
+  fclose(file);
+  return 0;
+}
+
+ThreadPolicy resolve_thread_policy(AVCodecParameters* av_codec_params) {
+  // 기본값은 코어 수만큼의 스레드로 프레임/슬라이스 스레딩을 모두 허용
+  ThreadPolicy policy;
+  policy.thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+  policy.thread_count = 0;
+  policy.low_delay = 0;
+
+  // 설정 파일은 코덱과 해상도 구간이 모두 일치하는 규칙을 우선하고, 없으면 *로 지정한 규칙을 사용
+  const char* codec = avcodec_get_name(av_codec_params->codec_id);
+  const char* bucket = resolution_bucket(av_codec_params->width, av_codec_params->height);
+  int best_score = -1;
+  for (const ThreadPolicyRule& rule : thread_options.rules) {
+    bool codec_match = rule.codec == codec;
+    bool bucket_match = rule.bucket == bucket;
+    if ((!codec_match && rule.codec != "*") || (!bucket_match && rule.bucket != "*")) {
+      continue;
+    }
+
+    int score = (codec_match ? 2 : 0) + (bucket_match ? 1 : 0);
+    if (score > best_score) {
+      best_score = score;
+      policy = rule.policy;
+    }
+  }
+
+  // 명령행 옵션은 설정 파일보다 우선
+  if (thread_options.overrides.thread_type >= 0) {
+    policy.thread_type = thread_options.overrides.thread_type;
+  }
+  if (thread_options.overrides.thread_count >= 0) {
+    policy.thread_count = thread_options.overrides.thread_count;
+  }
+  if (thread_options.overrides.low_delay >= 0) {
+    policy.low_delay = thread_options.overrides.low_delay;
+  }
+
+  return policy;
+}
+
+int calibrate_thread_policy(const char* config_filename, double seconds, bool prefer_latency) {
+  if (input_file_ctx.v_index < 0) {
+    printf("Calibration needs a video stream\n");
+    return -1;
+  }
+
+  AVStream* av_stream = input_file_ctx.av_format_ctx->streams[input_file_ctx.v_index];
+  AVCodecParameters* av_codec_params = av_stream->codecpar;
+
+  // 디먹싱 시간이 섞이지 않도록 보정에 사용할 구간의 패킷을 미리 읽어둠
+  std::vector<AVPacket*> packets;
+  int64_t first_pts = AV_NOPTS_VALUE;
+  int64_t limit = av_rescale_q((int64_t) (seconds * AV_TIME_BASE), av_get_time_base_q(),
+                               av_stream->time_base);
+  while (true) {
+    AVPacket* av_packet = av_packet_alloc();
+    if (!av_packet || av_read_frame(input_file_ctx.av_format_ctx, av_packet) < 0) {
+      av_packet_free(&av_packet);
+      break;
+    }
+    if (av_packet->stream_index != input_file_ctx.v_index) {
+      av_packet_free(&av_packet);
+      continue;
+    }
+
+    int64_t pts = av_packet->pts != AV_NOPTS_VALUE ? av_packet->pts : av_packet->dts;
+    if (first_pts == AV_NOPTS_VALUE) {
+      first_pts = pts;
+    }
+    if (pts != AV_NOPTS_VALUE && pts - first_pts > limit) {
+      av_packet_free(&av_packet);
+      break;
+    }
+    packets.push_back(av_packet);
+  }
+
+  // 후보 정책 : 2의 거듭제곱 스레드 수와 코어 수에 대해 프레임/슬라이스 스레딩, 두 가지 모두, 저지연
+  std::vector<ThreadPolicy> candidates;
+  int cores = FFMAX((int) std::thread::hardware_concurrency(), 1);
+  std::vector<int> thread_counts;
+  for (int thread_count = 1; thread_count < cores; thread_count *= 2) {
+    thread_counts.push_back(thread_count);
+  }
+  thread_counts.push_back(cores);
+  for (int thread_count : thread_counts) {
+    candidates.push_back({FF_THREAD_FRAME, thread_count, 0});
+    if (thread_count > 1) {
+      candidates.push_back({FF_THREAD_SLICE, thread_count, 0});
+    }
+  }
+  candidates.push_back({FF_THREAD_FRAME | FF_THREAD_SLICE, cores, 0});
+  candidates.push_back({FF_THREAD_SLICE, cores, 1});
+
+  AVFrame* av_frame = av_frame_alloc();
+  std::vector<CalibrationRun> runs;
+  int ret = av_frame ? 0 : AVERROR(ENOMEM);
+
+  printf("calibrating %s %dx%d with %zu packets\n", avcodec_get_name(av_codec_params->codec_id),
+         av_codec_params->width, av_codec_params->height, packets.size());
+  for (size_t index = 0; index < candidates.size() && ret >= 0; ++index) {
+    AVCodecContext* av_codec_ctx = nullptr;
+    if (open_decoder(av_codec_params, &av_codec_ctx, &candidates[index]) < 0) {
+      avcodec_free_context(&av_codec_ctx);
+      continue;
+    }
+
+    CalibrationRun run;
+    run.policy = candidates[index];
+    run.frame_count = 0;
+    run.first_frame_time = -1;
+    run.start_time = av_gettime_relative();
+
+    // 후보 하나가 디코딩에 실패해도 그 후보만 실패로 기록하고 나머지 후보는 계속 측정
+    // 메모리 할당 실패만 전체 보정을 중단함
+    int run_ret = 0;
+    for (AVPacket* av_packet : packets) {
+      run_ret = decode_packet(av_codec_ctx, av_packet, av_frame, count_calibration_frame, &run);
+      if (run_ret < 0) {
+        break;
+      }
+    }
+    if (run_ret >= 0) {
+      run_ret = decode_packet(av_codec_ctx, nullptr, av_frame, count_calibration_frame, &run);
+      run_ret = run_ret == AVERROR_EOF ? 0 : run_ret;
+    }
+    avcodec_free_context(&av_codec_ctx);
+
+    if (run_ret < 0) {
+      printf("  %-5s threads %2d %-9s : failed\n", thread_type_name(run.policy.thread_type),
+             run.policy.thread_count, run.policy.low_delay ? "low-delay" : "");
+      if (run_ret == AVERROR(ENOMEM)) {
+        ret = run_ret;
+      }
+      continue;
+    }
+
+    double elapsed = (av_gettime_relative() - run.start_time) / 1000000.0;
+    run.fps = elapsed > 0 ? run.frame_count / elapsed : 0.0;
+    run.first_frame_latency =
+            run.first_frame_time >= 0 ? (run.first_frame_time - run.start_time) / 1000.0 : -1;
+    runs.push_back(run);
+
+    printf("  %-5s threads %2d %-9s : %8.1f frames/sec, first frame %.2f ms\n",
+           thread_type_name(run.policy.thread_type), run.policy.thread_count,
+           run.policy.low_delay ? "low-delay" : "", run.fps, run.first_frame_latency);
+  }
+
+  av_frame_free(&av_frame);
+  for (AVPacket*& av_packet : packets) {
+    av_packet_free(&av_packet);
+  }
 
-  ret = avcodec_send_packet(*av_codec_ctx, av_packet);
   if (ret < 0) {
-    printf("Couldn't send AVPacket");
-    return ret;
+    printf("Calibration failed\n");
+    return -1;
   }
 
-  ret = avcodec_receive_frame(*av_codec_ctx, *av_frame);
-  if (ret >= 0) {
-    (*av_frame)->pts = (*av_frame)->best_effort_timestamp;
+  // throughput는 초당 프레임 수가 가장 높은 정책을, latency는 첫 프레임이 가장 빨리 나오는 정책을 선택
+  // 프레임을 하나도 만들지 못한 정책은 선택하지 않음
+  const CalibrationRun* best = nullptr;
+  for (const CalibrationRun& run : runs) {
+    if (run.frame_count == 0 || run.first_frame_latency < 0) {
+      continue;
+    }
+    if (!best || (prefer_latency ? run.first_frame_latency < best->first_frame_latency
+                                 : run.fps > best->fps)) {
+      best = &run;
+    }
+  }
+  if (!best) {
+    printf("Calibration failed : no thread policy produced frames\n");
+    return -1;
   }
 
-  return ret;
+  ThreadPolicyRule rule;
+  rule.codec = avcodec_get_name(av_codec_params->codec_id);
+  rule.bucket = resolution_bucket(av_codec_params->width, av_codec_params->height);
+  rule.policy = best->policy;
+  printf("best for %s %s (%s) : %s threads %d%s\n", rule.codec.c_str(), rule.bucket.c_str(),
+         prefer_latency ? "latency" : "throughput", thread_type_name(rule.policy.thread_type),
+         rule.policy.thread_count, rule.policy.low_delay ? " low-delay" : "");
+
+  // 기존 설정 파일이 있으면 같은 (코덱, 해상도 구간) 규칙만 바꾸고 나머지는 유지
+  std::vector<ThreadPolicyRule> rules;
+  FILE* existing = fopen(config_filename, "r");
+  if (existing) {
+    fclose(existing);
+    load_thread_config(config_filename, &rules);
+  }
+
+  bool replaced = false;
+  for (ThreadPolicyRule& existing_rule : rules) {
+    if (existing_rule.codec == rule.codec && existing_rule.bucket == rule.bucket) {
+      existing_rule.policy = rule.policy;
+      replaced = true;
+    }
+  }
+  if (!replaced) {
+    rules.push_back(rule);
+  }
+
+  return save_thread_config(config_filename, rules);
 }
 
-void release() {
-  if (input_file_ctx.av_format_ctx) {
-    avformat_close_input(&(input_file_ctx.av_format_ctx));
+int count_calibration_frame(AVCodecContext* av_codec_ctx, AVFrame* av_frame, void* opaque) {
+  CalibrationRun* run = (CalibrationRun*) opaque;
+  if (run->first_frame_time < 0) {
+    run->first_frame_time = av_gettime_relative();
   }
+  ++run->frame_count;
+  return 0;
+}
 
-  if (input_file_ctx.video_codec_ctx) {
-    avcodec_close(input_file_ctx.video_codec_ctx);
+// 패킷 하나를 디코딩하고 나오는 모든 프레임을 handle_frame으로 넘김
+// av_packet이 nullptr이면 디코더를 flush해서 내부에 남아 있는 프레임을 모두 꺼냄
+// 디코더는 다음 상태를 반복함
+// 1. 패킷을 보냄 (send) : 내부 버퍼가 가득 차면 EAGAIN을 반환하므로 프레임을 먼저 꺼낸 후 다시 보냄
+// 2. 프레임을 꺼냄 (receive) : 패킷 하나에서 프레임이 여러 개 나올 수 있으므로 EAGAIN이 나올 때까지 꺼냄
+// 3. 끝 (EOF) : flush한 후 모든 프레임을 꺼내면 AVERROR_EOF를 반환
+// 반환 값은 정상이면 0, flush가 끝나면 AVERROR_EOF, handle_frame이 실패하거나 메모리가 부족하면 음수
+// 코덱이 디코딩하지 못한 패킷이나 프레임은 건너뛰고 계속 진행하므로 에러로 반환하지 않음
+int decode_packet(AVCodecContext* av_codec_ctx, AVPacket* av_packet, AVFrame* av_frame,
+                  FrameHandler handle_frame, void* opaque) {
+  bool sent = false;
+  int error_count = 0;
+
+  while (true) {
+    if (!sent) {
+      int ret = avcodec_send_packet(av_codec_ctx, av_packet);
+      if (ret >= 0 || (ret == AVERROR_EOF && !av_packet)) {
+        // 이미 flush를 시작한 디코더에 다시 nullptr을 보내면 AVERROR_EOF가 나오지만 정상
+        sent = true;
+      } else if (ret == AVERROR(ENOMEM)) {
+        printf("Couldn't send AVPacket\n");
+        return ret;
+      } else if (ret != AVERROR(EAGAIN)) {
+        // 손상된 패킷은 건너뜀 (flush 중이면 더 꺼낼 프레임이 없는 것으로 봄)
+        printf("Couldn't send AVPacket, skipped\n");
+        return av_packet ? 0 : AVERROR_EOF;
+      }
+    }
+
+    int frame_count = 0;
+    int ret;
+    while (true) {
+      ret = avcodec_receive_frame(av_codec_ctx, av_frame);
+      if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF || ret == AVERROR(ENOMEM)) {
+        break;
+      }
+      ++frame_count;
+      if (ret < 0) {
+        // 디코딩 에러는 해당 프레임만 버리고 남은 프레임을 계속 꺼냄
+        // 에러가 계속 이어지면 이 패킷은 포기함 (flush 중이면 더 꺼낼 프레임이 없는 것으로 봄)
+        printf("Couldn't receive AVFrame, skipped\n");
+        if (++error_count >= max_decode_errors) {
+          printf("Too many decoding errors, packet skipped\n");
+          return av_packet ? 0 : AVERROR_EOF;
+        }
+        continue;
+      }
+      error_count = 0;
+
+      av_frame->pts = av_frame->best_effort_timestamp;
+      ret = handle_frame(av_codec_ctx, av_frame, opaque);
+      av_frame_unref(av_frame);
+      if (ret < 0) {
+        return ret;
+      }
+    }
+
+    if (ret == AVERROR_EOF) {
+      return sent ? AVERROR_EOF : AVERROR_BUG;
+    } else if (ret == AVERROR(ENOMEM)) {
+      printf("Couldn't receive AVFrame\n");
+      return ret;
+    }
+
+    if (sent) {
+      return 0;
+    }
+
+    // send와 receive가 모두 EAGAIN이면 디코더가 API 규칙을 어긴 것이므로 무한 반복하지 않음
+    if (frame_count == 0) {
+      printf("Decoder accepts neither packets nor returns frames\n");
+      return AVERROR_BUG;
+    }
   }
+}
 
-  if (input_file_ctx.audio_codec_ctx) {
-    avcodec_close(input_file_ctx.audio_codec_ctx);
+int flush_decoders(AVFrame* av_frame, FrameHandler handle_frame, void* opaque) {
+  AVCodecContext* av_codec_ctxs[] = {input_file_ctx.video_codec_ctx,
+                                     input_file_ctx.audio_codec_ctx};
+  for (AVCodecContext* av_codec_ctx : av_codec_ctxs) {
+    if (!av_codec_ctx) {
+      continue;
+    }
+
+    int ret = decode_packet(av_codec_ctx, nullptr, av_frame, handle_frame, opaque);
+    if (ret < 0 && ret != AVERROR_EOF) {
+      return ret;
+    }
+  }
+
+  return 0;
+}
+
+int show_frame(AVCodecContext* av_codec_ctx, AVFrame* av_frame, void* opaque) {
+  count_frame(av_codec_ctx);
+  print_frame(av_codec_ctx, av_frame);
+  return 0;
+}
+
+void count_frame(AVCodecContext* av_codec_ctx) {
+  if (av_codec_ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+    ++input_file_ctx.video_frame_count;
+  } else {
+    ++input_file_ctx.audio_frame_count;
+  }
+}
+
+int verify_frame_counts() {
+  // 컨테이너가 기록한 프레임 수(nb_frames)와 실제로 디코딩한 프레임 수를 비교
+  // nb_frames를 알 수 없는 컨테이너(0)는 비교하지 않음
+  int mismatch_count = 0;
+  int indexes[] = {input_file_ctx.v_index, input_file_ctx.a_index};
+  int64_t packet_counts[] = {input_file_ctx.video_packet_count, input_file_ctx.audio_packet_count};
+  int64_t frame_counts[] = {input_file_ctx.video_frame_count, input_file_ctx.audio_frame_count};
+
+  for (int type = 0; type < 2; ++type) {
+    if (indexes[type] < 0) {
+      continue;
+    }
+
+    int64_t nb_frames = input_file_ctx.av_format_ctx->streams[indexes[type]]->nb_frames;
+    const char* result = "unknown";
+    if (nb_frames > 0) {
+      result = nb_frames == frame_counts[type] ? "ok" : "MISMATCH";
+      if (nb_frames != frame_counts[type]) {
+        ++mismatch_count;
+      }
+    }
+
+    printf("verify stream %d (%s) : packets %lld, frames %lld, nb_frames %lld : %s\n",
+           indexes[type], type == 0 ? "video" : "audio", (long long) packet_counts[type],
+           (long long) frame_counts[type], (long long) nb_frames, result);
+  }
+
+  return mismatch_count > 0 ? -1 : 0;
+}
+
+void print_frame(AVCodecContext* av_codec_ctx, AVFrame* av_frame) {
+  printf("-----------------------\n");
+  if (av_codec_ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+    printf("Video : frame->width, height : %dx%d\n", av_frame->width, av_frame->height);
+    printf("Video : frame->sample_aspect_ratio : %d/%d\n", av_frame->sample_aspect_ratio.num,
+           av_frame->sample_aspect_ratio.den);
+  } else {
+    printf("Audio : frame->nb_samples : %d\n", av_frame->nb_samples);
+    printf("Audio : frame->channels : %d\n", av_frame->channels);
   }
+}
+
+bool match_stream(AVStream* av_stream, const char* spec) {
+  if (!spec) {
+    return true;
+  }
+
+  if (strcmp(spec, "none") == 0) {
+    return false;
+  }
+
+  if (spec[0] >= '0' && spec[0] <= '9') {
+    return av_stream->index == atoi(spec);
+  }
+
+  AVDictionaryEntry* language = av_dict_get(av_stream->metadata, "language", nullptr, 0);
+  return language && strcmp(language->value, spec) == 0;
+}
+
+void discard_unused_streams(const StreamSelection& selection) {
+  if (!selection.discard) {
+    return;
+  }
+
+  // AVDISCARD_ALL로 지정한 스트림은 디먹서가 패킷을 만들지 않으므로
+  // av_read_frame() 함수가 해당 패킷을 할당하거나 복사하지 않음
+  for (int index = 0; index < input_file_ctx.av_format_ctx->nb_streams; ++index) {
+    if (index != input_file_ctx.v_index && index != input_file_ctx.a_index) {
+      input_file_ctx.av_format_ctx->streams[index]->discard = AVDISCARD_ALL;
+    }
+  }
+}
+
+void print_read_stats(int64_t packet_count, int64_t dropped_count) {
+  AVIOContext* pb = input_file_ctx.av_format_ctx->pb;
+  printf("packets read : %lld (dropped %lld), bytes read : %lld\n", (long long) packet_count,
+         (long long) dropped_count, pb ? (long long) pb->bytes_read : -1LL);
+}
+
+int open_mapped_input(const char* filename, MappedFile* mapped_file, AVIOContext** avio_ctx) {
+  mapped_file->data = nullptr;
+  mapped_file->size = 0;
+  mapped_file->pos = 0;
+
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    printf("Couldn't open input file %s\n", filename);
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+    printf("Couldn't map empty or unknown size file %s\n", filename);
+    close(fd);
+    return -1;
+  }
+
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    printf("Couldn't map input file %s\n", filename);
+    return -1;
+  }
+
+  // 대부분 앞에서부터 순서대로 읽으므로 커널이 미리 읽어두도록 알림
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+  madvise(data, st.st_size, MADV_WILLNEED);
+
+  mapped_file->data = (uint8_t*) data;
+  mapped_file->size = st.st_size;
+
+  // AVIOContext 내부 버퍼는 av_malloc()으로 할당해야 하며 해제도 직접 해야 함
+  const int buffer_size = 32 * 1024;
+  uint8_t* buffer = (uint8_t*) av_malloc(buffer_size);
+  if (!buffer) {
+    return -1;
+  }
+
+  *avio_ctx = avio_alloc_context(buffer, buffer_size, 0, mapped_file, read_mapped_file, nullptr,
+                                 seek_mapped_file);
+  if (!*avio_ctx) {
+    av_free(buffer);
+    printf("Couldn't create AVIOContext\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+int read_mapped_file(void* opaque, uint8_t* buf, int buf_size) {
+  MappedFile* mapped_file = (MappedFile*) opaque;
+
+  int64_t remaining = mapped_file->size - mapped_file->pos;
+  if (remaining <= 0) {
+    return AVERROR_EOF;
+  }
+
+  // read() 시스템 콜 없이 매핑된 메모리에서 바로 복사
+  int size = (int) FFMIN((int64_t) buf_size, remaining);
+  memcpy(buf, mapped_file->data + mapped_file->pos, size);
+  mapped_file->pos += size;
+
+  return size;
+}
+
+int64_t seek_mapped_file(void* opaque, int64_t offset, int whence) {
+  MappedFile* mapped_file = (MappedFile*) opaque;
+
+  // AVSEEK_SIZE는 위치를 바꾸지 않고 파일 크기만 요청하는 경우
+  if (whence & AVSEEK_SIZE) {
+    return mapped_file->size;
+  }
+
+  int64_t pos;
+  switch (whence & ~AVSEEK_FORCE) {
+    case SEEK_SET:
+      pos = offset;
+      break;
+    case SEEK_CUR:
+      pos = mapped_file->pos + offset;
+      break;
+    case SEEK_END:
+      pos = mapped_file->size + offset;
+      break;
+    default:
+      return AVERROR(EINVAL);
+  }
+
+  if (pos < 0 || pos > mapped_file->size) {
+    return AVERROR(EINVAL);
+  }
+
+  // 임의 위치로 이동한 경우 이동한 위치부터 미리 읽어두도록 알림
+  if (pos != mapped_file->pos && pos < mapped_file->size) {
+    int64_t page_size = sysconf(_SC_PAGESIZE);
+    int64_t start = pos / page_size * page_size;
+    madvise(mapped_file->data + start, FFMIN(mapped_file->size - start, (int64_t) 4 << 20),
+            MADV_WILLNEED);
+  }
+
+  mapped_file->pos = pos;
+  return pos;
+}
+
+void close_mapped_input(MappedFile* mapped_file, AVIOContext** avio_ctx) {
+  if (*avio_ctx) {
+    av_freep(&(*avio_ctx)->buffer);
+    avio_context_free(avio_ctx);
+  }
+
+  if (mapped_file->data) {
+    munmap(mapped_file->data, mapped_file->size);
+    mapped_file->data = nullptr;
+  }
+}
+
+int start_demux_thread(int queue_size) {
+  AVFormatContext* av_format_ctx = input_file_ctx.av_format_ctx;
+
+  demux_thread.queues.resize(av_format_ctx->nb_streams);
+  for (int index = 0; index < av_format_ctx->nb_streams; ++index) {
+    PacketQueue& queue = demux_thread.queues[index];
+    queue.head = queue.count = queue.high_watermark = 0;
+    queue.producer_stalls = 0;
+
+    if (index != input_file_ctx.v_index && index != input_file_ctx.a_index) {
+      continue;
+    }
+
+    // 디코딩 루프에서 패킷을 주고받을 때 메모리를 할당하지 않도록 큐의 패킷을 미리 할당
+    queue.packets.resize(queue_size, nullptr);
+    queue.sequences.resize(queue_size, 0);
+    for (AVPacket*& av_packet : queue.packets) {
+      av_packet = av_packet_alloc();
+      if (!av_packet) {
+        printf("Couldn't allocate packet queue\n");
+        return -1;
+      }
+    }
+  }
+
+  demux_thread.next_sequence = 0;
+  demux_thread.consumer_stalls = 0;
+  demux_thread.finished = false;
+  demux_thread.stop = false;
+  demux_thread.error = 0;
+  demux_thread.thread = std::thread(demux_loop);
+  demux_thread.running = true;
+
+  return 0;
+}
+
+void demux_loop() {
+  AVPacket* av_packet = av_packet_alloc();
+  int ret = av_packet ? 0 : AVERROR(ENOMEM);
+
+  while (ret >= 0) {
+    ret = av_read_frame(input_file_ctx.av_format_ctx, av_packet);
+    if (ret < 0) {
+      break;
+    }
+
+    // 디코딩하지 않는 스트림의 패킷은 큐에 넣지 않음
+    if (av_packet->stream_index >= (int) demux_thread.queues.size() ||
+        demux_thread.queues[av_packet->stream_index].packets.empty()) {
+      av_packet_unref(av_packet);
+      continue;
+    }
+
+    PacketQueue& queue = demux_thread.queues[av_packet->stream_index];
+    std::unique_lock<std::mutex> lock(demux_thread.mutex);
+    if (queue.count == queue.packets.size()) {
+      ++queue.producer_stalls;
+      demux_thread.not_full.wait(
+              lock, [&]() { return demux_thread.stop || queue.count < queue.packets.size(); });
+    }
+
+    if (demux_thread.stop) {
+      av_packet_unref(av_packet);
+      break;
+    }
+
+    // 패킷 데이터는 복사하지 않고 참조만 미리 할당한 패킷으로 옮김
+    size_t slot = (queue.head + queue.count) % queue.packets.size();
+    av_packet_move_ref(queue.packets[slot], av_packet);
+    queue.sequences[slot] = demux_thread.next_sequence++;
+    ++queue.count;
+    queue.high_watermark = FFMAX(queue.high_watermark, queue.count);
+
+    lock.unlock();
+    demux_thread.not_empty.notify_one();
+  }
+
+  av_packet_free(&av_packet);
+
+  std::lock_guard<std::mutex> lock(demux_thread.mutex);
+  demux_thread.finished = true;
+  demux_thread.error = ret == AVERROR_EOF ? 0 : ret;
+  demux_thread.not_empty.notify_one();
+}
+
+int read_packet(AVPacket* av_packet) {
+  // 디먹싱 스레드를 사용하지 않으면 av_read_frame() 함수와 동일하게 동작
+  if (!demux_thread.running) {
+    return av_read_frame(input_file_ctx.av_format_ctx, av_packet);
+  }
+
+  std::unique_lock<std::mutex> lock(demux_thread.mutex);
+  while (true) {
+    // 스트림별 큐 중 가장 먼저 디먹싱한 패킷을 꺼내서 원래 순서를 유지
+    PacketQueue* oldest = nullptr;
+    for (PacketQueue& queue : demux_thread.queues) {
+      if (queue.count > 0 &&
+          (!oldest || queue.sequences[queue.head] < oldest->sequences[oldest->head])) {
+        oldest = &queue;
+      }
+    }
+
+    if (oldest) {
+      av_packet_move_ref(av_packet, oldest->packets[oldest->head]);
+      oldest->head = (oldest->head + 1) % oldest->packets.size();
+      --oldest->count;
+
+      lock.unlock();
+      demux_thread.not_full.notify_one();
+      return 0;
+    }
+
+    if (demux_thread.finished) {
+      return demux_thread.error < 0 ? demux_thread.error : AVERROR_EOF;
+    }
+
+    ++demux_thread.consumer_stalls;
+    demux_thread.not_empty.wait(lock);
+  }
+}
+
+void stop_demux_thread() {
+  if (!demux_thread.running) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(demux_thread.mutex);
+    demux_thread.stop = true;
+  }
+  demux_thread.not_full.notify_all();
+  demux_thread.thread.join();
+  demux_thread.running = false;
+
+  for (PacketQueue& queue : demux_thread.queues) {
+    for (AVPacket*& av_packet : queue.packets) {
+      av_packet_free(&av_packet);
+    }
+    queue.packets.clear();
+  }
+}
+
+void print_demux_stats() {
+  if (!demux_thread.running) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(demux_thread.mutex);
+  for (int index = 0; index < (int) demux_thread.queues.size(); ++index) {
+    const PacketQueue& queue = demux_thread.queues[index];
+    if (queue.packets.empty()) {
+      continue;
+    }
+    printf("read-ahead stream %d : capacity %zu, high watermark %zu, producer stalls %llu\n",
+           index, queue.packets.size(), queue.high_watermark,
+           (unsigned long long) queue.producer_stalls);
+  }
+  printf("read-ahead consumer stalls : %llu\n", (unsigned long long) demux_thread.consumer_stalls);
+}
+
+void init_spsc_queue(SpscQueue* queue, int capacity) {
+  // 인덱스 계산을 비트 연산으로 하기 위해 크기를 2의 거듭제곱으로 맞춤
+  size_t size = 2;
+  while (size < (size_t) capacity) {
+    size <<= 1;
+  }
+  queue->slots.assign(size, nullptr);
+  queue->head.store(0, std::memory_order_relaxed);
+  queue->tail.store(0, std::memory_order_relaxed);
+}
+
+bool spsc_push(SpscQueue* queue, void* item) {
+  size_t tail = queue->tail.load(std::memory_order_relaxed);
+  if (tail - queue->head.load(std::memory_order_acquire) == queue->slots.size()) {
+    return false;
+  }
+
+  queue->slots[tail & (queue->slots.size() - 1)] = item;
+  // release로 저장해야 꺼내는 스레드가 tail을 본 시점에 슬롯의 값도 볼 수 있음
+  queue->tail.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+bool spsc_pop(SpscQueue* queue, void** item) {
+  size_t head = queue->head.load(std::memory_order_relaxed);
+  if (head == queue->tail.load(std::memory_order_acquire)) {
+    return false;
+  }
+
+  *item = queue->slots[head & (queue->slots.size() - 1)];
+  queue->head.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+bool push_item(SpscQueue* queue, void* item, PipelineStage* stage) {
+  if (spsc_push(queue, item)) {
+    return true;
+  }
+
+  // 큐가 가득 차면 잠깐 양보하다가 오래 걸리면 잠들어서 다른 단계가 CPU를 쓸 수 있도록 함
+  int64_t start_time = av_gettime_relative();
+  for (int spin = 0; !spsc_push(queue, item); ++spin) {
+    if (pipeline.stop.load(std::memory_order_relaxed)) {
+      return false;
+    }
+    if (spin < 64) {
+      std::this_thread::yield();
+    } else {
+      av_usleep(100);
+    }
+  }
+  stage->wait_time += av_gettime_relative() - start_time;
+  return true;
+}
+
+bool pop_item(SpscQueue* queue, void** item, PipelineStage* stage) {
+  if (spsc_pop(queue, item)) {
+    return true;
+  }
+
+  int64_t start_time = av_gettime_relative();
+  for (int spin = 0; !spsc_pop(queue, item); ++spin) {
+    if (pipeline.stop.load(std::memory_order_relaxed)) {
+      return false;
+    }
+    if (spin < 64) {
+      std::this_thread::yield();
+    } else {
+      av_usleep(100);
+    }
+  }
+  stage->wait_time += av_gettime_relative() - start_time;
+  return true;
+}
+
+void init_stage(PipelineStage* stage, const char* name) {
+  stage->name = name;
+  stage->busy_time = 0;
+  stage->wait_time = 0;
+  stage->items = 0;
+  stage->error = 0;
+  stage->output = nullptr;
+  stage->packet_returns = nullptr;
+  stage->frame_returns = nullptr;
+}
+
+int run_pipeline(int queue_size) {
+  init_spsc_queue(&pipeline.video_packets, queue_size);
+  init_spsc_queue(&pipeline.audio_packets, queue_size);
+  init_spsc_queue(&pipeline.video_frames, queue_size);
+  init_spsc_queue(&pipeline.audio_frames, queue_size);
+  // 돌려보낸 패킷과 프레임은 큐에 있는 것과 처리 중인 것을 합친 수만큼만 있으면 충분
+  init_spsc_queue(&pipeline.video_packet_returns, queue_size * 2);
+  init_spsc_queue(&pipeline.audio_packet_returns, queue_size * 2);
+  init_spsc_queue(&pipeline.video_frame_returns, queue_size * 2);
+  init_spsc_queue(&pipeline.audio_frame_returns, queue_size * 2);
+  pipeline.packet_allocations = 0;
+  pipeline.frame_allocations = 0;
+  init_stage(&pipeline.demux, "demux");
+  init_stage(&pipeline.video_decode, "video decode");
+  init_stage(&pipeline.audio_decode, "audio decode");
+  init_stage(&pipeline.sink, "frame sink");
+  pipeline.video_decode.packet_returns = &pipeline.video_packet_returns;
+  pipeline.video_decode.frame_returns = &pipeline.video_frame_returns;
+  pipeline.audio_decode.packet_returns = &pipeline.audio_packet_returns;
+  pipeline.audio_decode.frame_returns = &pipeline.audio_frame_returns;
+  pipeline.stop = false;
+
+  int64_t start_time = av_gettime_relative();
+
+  pipeline.demux.thread = std::thread(pipeline_demux_loop);
+  if (input_file_ctx.v_index >= 0) {
+    pipeline.video_decode.thread =
+            std::thread(pipeline_decode_loop, input_file_ctx.video_codec_ctx,
+                        &pipeline.video_packets, &pipeline.video_frames, &pipeline.video_decode);
+  }
+  if (input_file_ctx.a_index >= 0) {
+    pipeline.audio_decode.thread =
+            std::thread(pipeline_decode_loop, input_file_ctx.audio_codec_ctx,
+                        &pipeline.audio_packets, &pipeline.audio_frames, &pipeline.audio_decode);
+  }
+
+  // 메인 스레드가 프레임 처리 단계를 맡아 두 프레임 큐에서 준비된 프레임을 번갈아 꺼냄
+  // 스트림이 없으면 처음부터 끝난 것으로 봄
+  bool video_done = input_file_ctx.v_index < 0;
+  bool audio_done = input_file_ctx.a_index < 0;
+  int64_t idle_start = -1;
+  int spin = 0;
+  while ((!video_done || !audio_done) && !pipeline.stop.load(std::memory_order_relaxed)) {
+    void* item = nullptr;
+    AVCodecContext* av_codec_ctx = nullptr;
+    if (!video_done && spsc_pop(&pipeline.video_frames, &item)) {
+      av_codec_ctx = input_file_ctx.video_codec_ctx;
+      video_done = !item;
+    } else if (!audio_done && spsc_pop(&pipeline.audio_frames, &item)) {
+      av_codec_ctx = input_file_ctx.audio_codec_ctx;
+      audio_done = !item;
+    } else {
+      if (idle_start < 0) {
+        idle_start = av_gettime_relative();
+      }
+      // push_item(), pop_item()과 같이 잠깐 양보하다가 오래 걸리면 잠듦
+      if (spin++ < 64) {
+        std::this_thread::yield();
+      } else {
+        av_usleep(100);
+      }
+      continue;
+    }
+    spin = 0;
+
+    int64_t busy_start = av_gettime_relative();
+    if (idle_start >= 0) {
+      pipeline.sink.wait_time += busy_start - idle_start;
+      idle_start = -1;
+    }
+
+    if (item) {
+      AVFrame* av_frame = (AVFrame*) item;
+      count_frame(av_codec_ctx);
+      print_frame(av_codec_ctx, av_frame);
+      return_frame(av_codec_ctx == input_file_ctx.video_codec_ctx ? &pipeline.video_frame_returns
+                                                                  : &pipeline.audio_frame_returns,
+                   av_frame);
+      ++pipeline.sink.items;
+    }
+    pipeline.sink.busy_time += av_gettime_relative() - busy_start;
+  }
+
+  // 에러로 중단한 경우에도 다른 단계들이 기다리지 않고 끝나도록 알림
+  if (video_done && audio_done) {
+    printf("End of frame\n");
+  } else {
+    pipeline.stop = true;
+  }
+
+  pipeline.demux.thread.join();
+  if (pipeline.video_decode.thread.joinable()) {
+    pipeline.video_decode.thread.join();
+  }
+  if (pipeline.audio_decode.thread.joinable()) {
+    pipeline.audio_decode.thread.join();
+  }
+
+  // 중단한 경우 큐에 남아 있는 패킷과 프레임을 해제
+  drain_queue(&pipeline.video_packets, false);
+  drain_queue(&pipeline.audio_packets, false);
+  drain_queue(&pipeline.video_frames, true);
+  drain_queue(&pipeline.audio_frames, true);
+  drain_queue(&pipeline.video_packet_returns, false);
+  drain_queue(&pipeline.audio_packet_returns, false);
+  drain_queue(&pipeline.video_frame_returns, true);
+  drain_queue(&pipeline.audio_frame_returns, true);
+
+  print_pipeline_stats((av_gettime_relative() - start_time) / 1000000.0);
+
+  if (pipeline.demux.error < 0 || pipeline.video_decode.error < 0 ||
+      pipeline.audio_decode.error < 0) {
+    return -1;
+  }
+  return 0;
+}
+
+void pipeline_demux_loop() {
+  PipelineStage* stage = &pipeline.demux;
+  AVPacket* av_packet = nullptr;
+  int ret = 0;
+
+  while (true) {
+    int64_t busy_start = av_gettime_relative();
+
+    // 디코딩 단계가 돌려보낸 패킷이 있으면 새로 할당하지 않고 다시 사용
+    if (!av_packet) {
+      av_packet = get_packet(&pipeline.video_packet_returns, &pipeline.audio_packet_returns);
+      if (!av_packet) {
+        ret = AVERROR(ENOMEM);
+        break;
+      }
+    }
+
+    ret = av_read_frame(input_file_ctx.av_format_ctx, av_packet);
+    if (ret < 0) {
+      break;
+    }
+
+    // 선택하지 않은 스트림의 패킷은 디코딩하지 않음 (--no-discard를 사용한 경우에만 도달)
+    SpscQueue* queue;
+    AVCodecContext* av_codec_ctx;
+    if (av_packet->stream_index == input_file_ctx.v_index) {
+      queue = &pipeline.video_packets;
+      av_codec_ctx = input_file_ctx.video_codec_ctx;
+      ++input_file_ctx.video_packet_count;
+    } else if (av_packet->stream_index == input_file_ctx.a_index) {
+      queue = &pipeline.audio_packets;
+      av_codec_ctx = input_file_ctx.audio_codec_ctx;
+      ++input_file_ctx.audio_packet_count;
+    } else {
+      av_packet_unref(av_packet);
+      stage->busy_time += av_gettime_relative() - busy_start;
+      continue;
+    }
+
+    AVStream* av_stream = input_file_ctx.av_format_ctx->streams[av_packet->stream_index];
+    av_packet_rescale_ts(av_packet, av_stream->time_base, av_codec_ctx->time_base);
+    ++stage->items;
+    stage->busy_time += av_gettime_relative() - busy_start;
+
+    if (!push_item(queue, av_packet, stage)) {
+      ret = 0;
+      break;
+    }
+    av_packet = nullptr;
+  }
+
+  av_packet_free(&av_packet);
+
+  stage->error = ret == AVERROR_EOF ? 0 : ret;
+  if (stage->error < 0) {
+    printf("Error occurred when reading packet\n");
+  }
+
+  // 디코딩 단계에 스트림의 끝을 알림
+  if (input_file_ctx.v_index >= 0) {
+    push_item(&pipeline.video_packets, nullptr, stage);
+  }
+  if (input_file_ctx.a_index >= 0) {
+    push_item(&pipeline.audio_packets, nullptr, stage);
+  }
+}
+
+void pipeline_decode_loop(AVCodecContext* av_codec_ctx, SpscQueue* packets, SpscQueue* frames,
+                          PipelineStage* stage) {
+  AVFrame* av_frame = av_frame_alloc();
+  int ret = av_frame ? 0 : AVERROR(ENOMEM);
+  stage->output = frames;
+
+  while (ret >= 0) {
+    void* item;
+    if (!pop_item(packets, &item, stage)) {
+      av_frame_free(&av_frame);
+      return;
+    }
+
+    // 프레임 큐가 가득 차서 기다린 시간은 작업 시간에서 제외
+    int64_t busy_start = av_gettime_relative();
+    int64_t wait_time = stage->wait_time;
+
+    // 패킷이 nullptr이면 디코더를 flush해서 내부에 남아 있는 프레임을 모두 꺼냄
+    AVPacket* av_packet = (AVPacket*) item;
+    ret = decode_packet(av_codec_ctx, av_packet, av_frame, push_frame, stage);
+    if (av_packet) {
+      return_packet(stage->packet_returns, av_packet);
+    }
+
+    stage->busy_time += av_gettime_relative() - busy_start - (stage->wait_time - wait_time);
+  }
+
+  av_frame_free(&av_frame);
+  stage->error = ret == AVERROR_EOF ? 0 : ret;
+  if (stage->error < 0) {
+    pipeline.stop = true;
+  }
+
+  // 프레임 처리 단계에 스트림의 끝을 알림
+  push_item(frames, nullptr, stage);
+}
+
+int push_frame(AVCodecContext* av_codec_ctx, AVFrame* av_frame, void* opaque) {
+  PipelineStage* stage = (PipelineStage*) opaque;
+
+  // 디코더가 채운 프레임의 데이터는 복사하지 않고 참조만 새 프레임으로 옮겨서 다음 단계로 넘김
+  AVFrame* output_frame = get_frame(stage->frame_returns);
+  if (!output_frame) {
+    return AVERROR(ENOMEM);
+  }
+  av_frame_move_ref(output_frame, av_frame);
+  ++stage->items;
+
+  if (!push_item(stage->output, output_frame, stage)) {
+    av_frame_free(&output_frame);
+    return AVERROR_EXIT;
+  }
+  return 0;
+}
+
+void drain_queue(SpscQueue* queue, bool frames) {
+  void* item;
+  while (spsc_pop(queue, &item)) {
+    if (!item) {
+      continue;
+    }
+    if (frames) {
+      AVFrame* av_frame = (AVFrame*) item;
+      av_frame_free(&av_frame);
+    } else {
+      AVPacket* av_packet = (AVPacket*) item;
+      av_packet_free(&av_packet);
+    }
+  }
+}
+
+void print_pipeline_stats(double elapsed) {
+  PipelineStage* stages[] = {&pipeline.demux, &pipeline.video_decode, &pipeline.audio_decode,
+                             &pipeline.sink};
+  for (PipelineStage* stage : stages) {
+    // 사용률은 전체 시간 중 실제로 작업한 시간의 비율
+    printf("%-12s : %lld items, busy %.3f sec, waiting %.3f sec, utilization %.1f%%\n",
+           stage->name, (long long) stage->items, stage->busy_time / 1000000.0,
+           stage->wait_time / 1000000.0,
+           elapsed > 0 ? stage->busy_time / 10000.0 / elapsed : 0.0);
+  }
+  printf("pipeline : %lld frames in %.3f sec (%.1f frames/sec)\n", (long long) pipeline.sink.items,
+         elapsed, elapsed > 0 ? pipeline.sink.items / elapsed : 0.0);
+}
+
+int run_thumbnails() {
+  if (input_file_ctx.v_index < 0 || thumbnail_options.interval <= 0) {
+    printf("Thumbnails need a video stream and a positive interval\n");
+    return -1;
+  }
+
+  // 스프라이트는 격자 크기를 미리 정해야 하므로 전체 길이로 썸네일 수를 계산
+  int64_t duration = input_file_ctx.av_format_ctx->duration;
+  int thumb_count = 0;
+  if (duration > 0) {
+    thumb_count = (int) (duration / AV_TIME_BASE / thumbnail_options.interval) + 1;
+  } else if (thumbnail_options.sprite_columns > 0) {
+    printf("Sprite output needs a known duration\n");
+    return -1;
+  }
+
+  ThumbnailWriter writer;
+  if (init_thumbnail_writer(&writer, thumb_count) < 0) {
+    free_thumbnail_writer(&writer);
+    return -1;
+  }
+
+  int64_t start_time = av_gettime_relative();
+  int ret = extract_keyframe_thumbnails(&writer, !thumbnail_options.benchmark);
+  double keyframe_elapsed = (av_gettime_relative() - start_time) / 1000000.0;
+  int64_t keyframe_decoded = writer.decoded_count;
+  int keyframe_thumbs = writer.thumb_count;
+
+  if (ret >= 0 && thumbnail_options.output && !thumbnail_options.benchmark) {
+    printf("%d thumbnails from %lld decoded keyframes in %.3f sec\n", writer.thumb_count,
+           (long long) writer.decoded_count, keyframe_elapsed);
+    if (writer.sprite_frame) {
+      std::string filename = std::string(thumbnail_options.output) + ".jpg";
+      ret = write_jpeg(writer.sprite_frame, filename.c_str());
+    }
+  }
+
+  // 벤치마크는 같은 썸네일을 전체 프레임 디코딩으로 뽑아서 두 방법의 시간을 비교 (파일 쓰기는 제외)
+  if (ret >= 0 && thumbnail_options.benchmark) {
+    writer.thumb_count = 0;
+    writer.decoded_count = 0;
+    start_time = av_gettime_relative();
+    ret = extract_decoded_thumbnails(&writer);
+    double full_elapsed = (av_gettime_relative() - start_time) / 1000000.0;
+
+    printf("keyframe seek : %d thumbnails, %lld frames decoded, %.3f sec\n", keyframe_thumbs,
+           (long long) keyframe_decoded, keyframe_elapsed);
+    printf("full decode   : %d thumbnails, %lld frames decoded, %.3f sec\n", writer.thumb_count,
+           (long long) writer.decoded_count, full_elapsed);
+    printf("speedup : %.1fx\n", keyframe_elapsed > 0 ? full_elapsed / keyframe_elapsed : 0.0);
+  }
+
+  free_thumbnail_writer(&writer);
+  return ret;
+}
+
+int extract_keyframe_thumbnails(ThumbnailWriter* writer, bool write) {
+  AVFormatContext* av_format_ctx = input_file_ctx.av_format_ctx;
+  AVCodecContext* av_codec_ctx = input_file_ctx.video_codec_ctx;
+  AVStream* av_stream = av_format_ctx->streams[input_file_ctx.v_index];
+
+  // 디코더가 키프레임이 아닌 프레임은 버리도록 함 (디먹서 단계에서도 키프레임 패킷만 넘김)
+  av_codec_ctx->skip_frame = AVDISCARD_NONKEY;
+
+  AVPacket av_packet;
+  AVFrame* av_frame = av_frame_alloc();
+  AVFrame* key_frame = av_frame_alloc();
+  if (!av_frame || !key_frame) {
+    av_frame_free(&av_frame);
+    av_frame_free(&key_frame);
+    return AVERROR(ENOMEM);
+  }
+
+  // 전체 길이를 알면 시점 수만큼만 반복하고, 모르면 파일 끝에 도달할 때까지 반복
+  int64_t start_pts = av_stream->start_time != AV_NOPTS_VALUE ? av_stream->start_time : 0;
+  int64_t duration = av_format_ctx->duration;
+  int ret = 0;
+  for (int64_t index = 0; ret >= 0; ++index) {
+    if (duration > 0 && index * thumbnail_options.interval * AV_TIME_BASE > duration) {
+      break;
+    }
+
+    int64_t target = start_pts + av_rescale_q((int64_t) (index * thumbnail_options.interval *
+                                                         AV_TIME_BASE),
+                                              av_get_time_base_q(), av_stream->time_base);
+
+    // 목표 시점 직전의 키프레임으로 탐색한 후 디코더에 남아 있는 이전 위치의 프레임을 버림
+    if (av_seek_frame(av_format_ctx, input_file_ctx.v_index, target, AVSEEK_FLAG_BACKWARD) < 0) {
+      printf("Couldn't seek to %lld\n", (long long) target);
+      ret = -1;
+      break;
+    }
+    avcodec_flush_buffers(av_codec_ctx);
+
+    // 탐색한 위치의 첫 번째 키프레임 패킷을 찾음
+    bool found = false;
+    while ((ret = av_read_frame(av_format_ctx, &av_packet)) >= 0) {
+      if (av_packet.stream_index == input_file_ctx.v_index &&
+          (av_packet.flags & AV_PKT_FLAG_KEY)) {
+        found = true;
+        break;
+      }
+      av_packet_unref(&av_packet);
+    }
+    if (!found) {
+      ret = ret == AVERROR_EOF ? 0 : ret;
+      break;
+    }
+
+    // GOP가 간격보다 길면 여러 시점이 같은 키프레임으로 탐색되므로 이미 만든 썸네일을 다시 사용
+    int64_t key_pts = av_packet.pts != AV_NOPTS_VALUE ? av_packet.pts : av_packet.dts;
+    if (key_pts != AV_NOPTS_VALUE && key_pts == writer->last_key_pts) {
+      av_packet_unref(&av_packet);
+
+      // 길이를 모르는 파일에서 마지막 키프레임 이후로 탐색하면 항상 같은 키프레임이 나오므로
+      // 목표 시점 이후의 패킷이 남아 있는지 확인해서 파일 끝을 판단
+      if (duration <= 0) {
+        bool past_target = false;
+        while (!past_target && av_read_frame(av_format_ctx, &av_packet) >= 0) {
+          past_target = av_packet.stream_index == input_file_ctx.v_index &&
+                        av_packet.pts != AV_NOPTS_VALUE && av_packet.pts >= target;
+          av_packet_unref(&av_packet);
+        }
+        if (!past_target) {
+          break;
+        }
+      }
+
+      ret = add_thumbnail(writer, nullptr, write);
+      continue;
+    }
+    writer->last_key_pts = key_pts;
+
+    // 키프레임 하나를 보낸 후 flush해서 프레임을 바로 꺼냄
+    av_packet_rescale_ts(&av_packet, av_stream->time_base, av_codec_ctx->time_base);
+    ret = decode_packet(av_codec_ctx, &av_packet, av_frame, keep_first_frame, key_frame);
+    av_packet_unref(&av_packet);
+    if (ret >= 0) {
+      ret = decode_packet(av_codec_ctx, nullptr, av_frame, keep_first_frame, key_frame);
+      ret = ret == AVERROR_EOF ? 0 : ret;
+    }
+    if (ret < 0) {
+      break;
+    }
+
+    if (key_frame->format >= 0 && key_frame->width > 0) {
+      ++writer->decoded_count;
+      ret = add_thumbnail(writer, key_frame, write);
+      av_frame_unref(key_frame);
+    }
+  }
+
+  av_codec_ctx->skip_frame = AVDISCARD_DEFAULT;
+  av_frame_free(&av_frame);
+  av_frame_free(&key_frame);
+  return ret;
+}
+
+int extract_decoded_thumbnails(ThumbnailWriter* writer) {
+  AVFormatContext* av_format_ctx = input_file_ctx.av_format_ctx;
+  AVCodecContext* av_codec_ctx = input_file_ctx.video_codec_ctx;
+  AVStream* av_stream = av_format_ctx->streams[input_file_ctx.v_index];
+
+  if (av_seek_frame(av_format_ctx, input_file_ctx.v_index, 0, AVSEEK_FLAG_BACKWARD) < 0) {
+    return -1;
+  }
+  avcodec_flush_buffers(av_codec_ctx);
+
+  AVPacket av_packet;
+  AVFrame* av_frame = av_frame_alloc();
+  if (!av_frame) {
+    return AVERROR(ENOMEM);
+  }
+
+  // 모든 프레임을 디코딩하고 다음 시점을 지난 첫 번째 프레임을 썸네일로 사용
+  int ret;
+  while ((ret = av_read_frame(av_format_ctx, &av_packet)) >= 0) {
+    if (av_packet.stream_index != input_file_ctx.v_index) {
+      av_packet_unref(&av_packet);
+      continue;
+    }
+
+    av_packet_rescale_ts(&av_packet, av_stream->time_base, av_codec_ctx->time_base);
+    ret = decode_packet(av_codec_ctx, &av_packet, av_frame, sample_decoded_frame, writer);
+    av_packet_unref(&av_packet);
+    if (ret < 0) {
+      break;
+    }
+  }
+
+  if (ret == AVERROR_EOF) {
+    ret = decode_packet(av_codec_ctx, nullptr, av_frame, sample_decoded_frame, writer);
+    ret = ret == AVERROR_EOF ? 0 : ret;
+  }
+
+  av_frame_free(&av_frame);
+  return ret;
+}
+
+int sample_decoded_frame(AVCodecContext* av_codec_ctx, AVFrame* av_frame, void* opaque) {
+  ThumbnailWriter* writer = (ThumbnailWriter*) opaque;
+  AVStream* av_stream = input_file_ctx.av_format_ctx->streams[input_file_ctx.v_index];
+  ++writer->decoded_count;
+
+  int64_t start_pts = av_stream->start_time != AV_NOPTS_VALUE ? av_stream->start_time : 0;
+  int64_t pts = av_rescale_q(av_frame->pts, av_codec_ctx->time_base, av_stream->time_base);
+  int64_t target = start_pts + av_rescale_q((int64_t) (writer->thumb_count *
+                                                       thumbnail_options.interval * AV_TIME_BASE),
+                                            av_get_time_base_q(), av_stream->time_base);
+  if (av_frame->pts != AV_NOPTS_VALUE && pts >= target) {
+    return add_thumbnail(writer, av_frame, false);
+  }
+  return 0;
+}
+
+int init_thumbnail_writer(ThumbnailWriter* writer, int thumb_count) {
+  AVCodecContext* av_codec_ctx = input_file_ctx.video_codec_ctx;
+  writer->sws_ctx = nullptr;
+  writer->sprite_frame = nullptr;
+  writer->thumb_count = 0;
+  writer->last_key_pts = AV_NOPTS_VALUE;
+  writer->decoded_count = 0;
+
+  // 원본의 화면 비율(SAR 포함)을 유지하고 YUV 4:2:0이므로 크기를 짝수로 맞춤
+  AVRational sar = av_codec_ctx->sample_aspect_ratio.num > 0 ? av_codec_ctx->sample_aspect_ratio
+                                                              : AVRational{1, 1};
+  int width = FFALIGN(FFMAX(thumbnail_options.width, 2), 2);
+  int height = (int) ((int64_t) width * av_codec_ctx->height * sar.den /
+                      FFMAX((int64_t) av_codec_ctx->width * sar.num, 1));
+  height = FFALIGN(FFMAX(height, 2), 2);
+
+  writer->thumb_frame = av_frame_alloc();
+  if (!writer->thumb_frame) {
+    return -1;
+  }
+  writer->thumb_frame->format = AV_PIX_FMT_YUVJ420P;
+  writer->thumb_frame->width = width;
+  writer->thumb_frame->height = height;
+  if (av_frame_get_buffer(writer->thumb_frame, 0) < 0) {
+    return -1;
+  }
+
+  if (thumbnail_options.sprite_columns > 0 && thumb_count > 0) {
+    int columns = FFMIN(thumbnail_options.sprite_columns, thumb_count);
+    int rows = (thumb_count + columns - 1) / columns;
+
+    writer->sprite_frame = av_frame_alloc();
+    if (!writer->sprite_frame) {
+      return -1;
+    }
+    writer->sprite_frame->format = AV_PIX_FMT_YUVJ420P;
+    writer->sprite_frame->width = width * columns;
+    writer->sprite_frame->height = height * rows;
+    if (av_frame_get_buffer(writer->sprite_frame, 0) < 0) {
+      return -1;
+    }
+
+    // 비어 있는 칸은 검은색으로 채움 (full range라 Y는 0, U/V는 128)
+    for (int plane = 0; plane < 3; ++plane) {
+      int plane_height = plane == 0 ? writer->sprite_frame->height
+                                    : writer->sprite_frame->height / 2;
+      memset(writer->sprite_frame->data[plane], plane == 0 ? 0 : 128,
+             (size_t) writer->sprite_frame->linesize[plane] * plane_height);
+    }
+  }
+
+  return 0;
+}
+
+int keep_first_frame(AVCodecContext* av_codec_ctx, AVFrame* av_frame, void* opaque) {
+  AVFrame* key_frame = (AVFrame*) opaque;
+  if (key_frame->width == 0) {
+    return av_frame_ref(key_frame, av_frame);
+  }
+  return 0;
+}
+
+int add_thumbnail(ThumbnailWriter* writer, AVFrame* av_frame, bool write) {
+  // av_frame이 nullptr이면 직전 썸네일을 그대로 다시 사용
+  if (av_frame) {
+    writer->sws_ctx = sws_getCachedContext(
+            writer->sws_ctx, av_frame->width, av_frame->height, (AVPixelFormat) av_frame->format,
+            writer->thumb_frame->width, writer->thumb_frame->height, AV_PIX_FMT_YUVJ420P,
+            SWS_AREA, nullptr, nullptr, nullptr);
+    if (!writer->sws_ctx) {
+      printf("Couldn't create SwsContext\n");
+      return -1;
+    }
+
+    sws_scale(writer->sws_ctx, av_frame->data, av_frame->linesize, 0, av_frame->height,
+              writer->thumb_frame->data, writer->thumb_frame->linesize);
+  }
+
+  int index = writer->thumb_count++;
+  if (!write) {
+    return 0;
+  }
+
+  if (writer->sprite_frame) {
+    // 스프라이트 격자의 해당 칸에 plane별로 복사
+    AVFrame* sprite = writer->sprite_frame;
+    AVFrame* thumb = writer->thumb_frame;
+    int columns = sprite->width / thumb->width;
+    int rows = sprite->height / thumb->height;
+    if (index >= columns * rows) {
+      return 0;
+    }
+
+    for (int plane = 0; plane < 3; ++plane) {
+      int shift = plane == 0 ? 0 : 1;
+      int x = (index % columns) * (thumb->width >> shift);
+      int y = (index / columns) * (thumb->height >> shift);
+      av_image_copy_plane(sprite->data[plane] + (size_t) y * sprite->linesize[plane] + x,
+                          sprite->linesize[plane], thumb->data[plane], thumb->linesize[plane],
+                          thumb->width >> shift, thumb->height >> shift);
+    }
+    return 0;
+  }
+
+  char filename[1024];
+  snprintf(filename, sizeof(filename), "%s_%05d.jpg", thumbnail_options.output, index + 1);
+  return write_jpeg(writer->thumb_frame, filename);
+}
+
+int write_jpeg(AVFrame* av_frame, const char* filename) {
+  // MJPEG 인코더가 만드는 패킷 하나가 그대로 JPEG 파일 하나가 됨
+  AVCodec* av_encoder = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+  if (!av_encoder) {
+    printf("Couldn't find MJPEG encoder\n");
+    return -1;
+  }
+
+  AVCodecContext* av_codec_ctx = avcodec_alloc_context3(av_encoder);
+  if (!av_codec_ctx) {
+    return -1;
+  }
+  av_codec_ctx->width = av_frame->width;
+  av_codec_ctx->height = av_frame->height;
+  av_codec_ctx->pix_fmt = AV_PIX_FMT_YUVJ420P;
+  av_codec_ctx->time_base = AVRational{1, 25};
+
+  AVPacket* av_packet = av_packet_alloc();
+  int ret = av_packet ? avcodec_open2(av_codec_ctx, av_encoder, nullptr) : AVERROR(ENOMEM);
+  if (ret >= 0) {
+    ret = avcodec_send_frame(av_codec_ctx, av_frame);
+  }
+  if (ret >= 0) {
+    ret = avcodec_receive_packet(av_codec_ctx, av_packet);
+  }
+
+  if (ret >= 0) {
+    FILE* file = fopen(filename, "wb");
+    if (file) {
+      fwrite(av_packet->data, 1, av_packet->size, file);
+      fclose(file);
+    } else {
+      ret = -1;
+    }
+  }
+  if (ret < 0) {
+    printf("Couldn't write thumbnail %s\n", filename);
+  }
+
+  av_packet_free(&av_packet);
+  avcodec_free_context(&av_codec_ctx);
+  return ret;
+}
+
+void free_thumbnail_writer(ThumbnailWriter* writer) {
+  sws_freeContext(writer->sws_ctx);
+  writer->sws_ctx = nullptr;
+  av_frame_free(&writer->thumb_frame);
+  av_frame_free(&writer->sprite_frame);
+}
+
+int run_chunked_decoding(const char* filename, int thread_count, int buffer_frames) {
+  if (input_file_ctx.v_index < 0) {
+    printf("Chunked decoding needs a video stream\n");
+    return -1;
+  }
+  if (thread_count <= 0) {
+    thread_count = (int) std::thread::hardware_concurrency();
+  }
+  thread_count = FFMAX(thread_count, 1);
+  buffer_frames = FFMAX(buffer_frames, 1);
+
+  // 스레드마다 자기 구간을 버퍼에 다 쌓을 수 있을 정도의 크기로 구간을 나눔
+  int64_t start_time = av_gettime_relative();
+  if (build_chunk_ranges(FFMAX(buffer_frames / thread_count, 1)) < 0) {
+    return -1;
+  }
+  double index_elapsed = (av_gettime_relative() - start_time) / 1000000.0;
+  printf("%d keyframe ranges indexed in %.3f sec, %d threads, reorder buffer %d frames\n",
+         (int) chunk_decoder.ranges.size(), index_elapsed, thread_count, buffer_frames);
+
+  ReorderBuffer& reorder = chunk_decoder.reorder;
+  chunk_decoder.filename = filename;
+  chunk_decoder.next_range = 0;
+  reorder.frames.assign(chunk_decoder.ranges.size(), std::deque<AVFrame*>());
+  reorder.finished.assign(chunk_decoder.ranges.size(), false);
+  reorder.next_range = 0;
+  reorder.frame_count = 0;
+  reorder.max_frames = buffer_frames;
+  reorder.peak_frames = 0;
+  reorder.stop = false;
+
+  start_time = av_gettime_relative();
+  for (int index = 0; index < thread_count; ++index) {
+    ChunkWorker* worker = new ChunkWorker();
+    worker->av_format_ctx = nullptr;
+    worker->av_codec_ctx = nullptr;
+    worker->range_index = -1;
+    worker->range_count = 0;
+    worker->frame_count = 0;
+    worker->dropped_count = 0;
+    worker->busy_time = 0;
+    worker->wait_time = 0;
+    worker->error = 0;
+    chunk_decoder.workers.push_back(worker);
+    worker->thread = std::thread(chunk_decode_loop, worker);
+  }
+
+  // 메인 스레드는 구간 순서대로 프레임을 꺼내므로 프레임이 표시 순서대로 처리됨
+  AVCodecContext* av_codec_ctx = input_file_ctx.video_codec_ctx;
+  int64_t last_pts = AV_NOPTS_VALUE;
+  int64_t order_errors = 0;
+  std::unique_lock<std::mutex> lock(reorder.mutex);
+  while (reorder.next_range < reorder.frames.size() && !reorder.stop) {
+    std::deque<AVFrame*>& frames = reorder.frames[reorder.next_range];
+    if (frames.empty()) {
+      if (reorder.finished[reorder.next_range]) {
+        ++reorder.next_range;
+        reorder.changed.notify_all();
+      } else {
+        reorder.changed.wait(lock);
+      }
+      continue;
+    }
+
+    AVFrame* av_frame = frames.front();
+    frames.pop_front();
+    --reorder.frame_count;
+    reorder.changed.notify_all();
+    lock.unlock();
+
+    // 구간 경계에서 프레임이 빠지거나 겹치면 PTS가 거꾸로 가므로 순서를 검사
+    if (av_frame->pts != AV_NOPTS_VALUE) {
+      if (last_pts != AV_NOPTS_VALUE && av_frame->pts <= last_pts) {
+        ++order_errors;
+      }
+      last_pts = av_frame->pts;
+    }
+    count_frame(av_codec_ctx);
+    print_frame(av_codec_ctx, av_frame);
+    av_frame_free(&av_frame);
+
+    lock.lock();
+  }
+
+  // 에러로 중단한 경우 기다리고 있는 스레드들을 깨움
+  reorder.stop = true;
+  reorder.changed.notify_all();
+  lock.unlock();
+
+  int ret = 0;
+  for (ChunkWorker* worker : chunk_decoder.workers) {
+    worker->thread.join();
+    if (worker->error < 0) {
+      ret = worker->error;
+    }
+  }
+  if (ret >= 0) {
+    printf("End of frame\n");
+  }
+
+  print_chunk_stats((av_gettime_relative() - start_time) / 1000000.0, order_errors);
+
+  for (ChunkWorker* worker : chunk_decoder.workers) {
+    if (worker->av_codec_ctx) {
+      avcodec_free_context(&worker->av_codec_ctx);
+    }
+    if (worker->av_format_ctx) {
+      avformat_close_input(&worker->av_format_ctx);
+    }
+    delete worker;
+  }
+  chunk_decoder.workers.clear();
+
+  for (std::deque<AVFrame*>& frames : reorder.frames) {
+    for (AVFrame* av_frame : frames) {
+      av_frame_free(&av_frame);
+    }
+  }
+  reorder.frames.clear();
+
+  return ret;
+}
+
+int build_chunk_ranges(int target_packets) {
+  AVFormatContext* av_format_ctx = input_file_ctx.av_format_ctx;
+  chunk_decoder.ranges.clear();
+
+  // 비디오 패킷만 읽으면서 키프레임 위치를 찾음 (디코딩은 하지 않음)
+  // 구간은 target_packets개 이상의 패킷이 모이면 다음 키프레임에서 나눔
+  AVPacket av_packet;
+  ChunkRange range;
+  range.start_pts = AV_NOPTS_VALUE;
+  range.end_pts = AV_NOPTS_VALUE;
+  range.packet_count = 0;
+
+  int ret;
+  while ((ret = av_read_frame(av_format_ctx, &av_packet)) >= 0) {
+    if (av_packet.stream_index != input_file_ctx.v_index) {
+      av_packet_unref(&av_packet);
+      continue;
+    }
+
+    int64_t pts = av_packet.pts != AV_NOPTS_VALUE ? av_packet.pts : av_packet.dts;
+    if ((av_packet.flags & AV_PKT_FLAG_KEY) && pts != AV_NOPTS_VALUE &&
+        range.packet_count >= target_packets &&
+        (range.start_pts == AV_NOPTS_VALUE || pts > range.start_pts)) {
+      range.end_pts = pts;
+      chunk_decoder.ranges.push_back(range);
+      range.start_pts = pts;
+      range.end_pts = AV_NOPTS_VALUE;
+      range.packet_count = 0;
+    }
+    ++range.packet_count;
+    ++input_file_ctx.video_packet_count;
+    av_packet_unref(&av_packet);
+  }
+
+  if (ret != AVERROR_EOF) {
+    printf("Error occurred when reading packet\n");
+    return -1;
+  }
+  if (range.packet_count > 0 || chunk_decoder.ranges.empty()) {
+    chunk_decoder.ranges.push_back(range);
+  }
+  return 0;
+}
+
+int open_chunk_worker(ChunkWorker* worker) {
+  if (avformat_open_input(&worker->av_format_ctx, chunk_decoder.filename, nullptr, nullptr) < 0) {
+    printf("Couldn't open input file %s\n", chunk_decoder.filename);
+    return -1;
+  }
+
+  if (avformat_find_stream_info(worker->av_format_ctx, nullptr) < 0) {
+    printf("Failed to retrieve input stream information\n");
+    return -1;
+  }
+
+  // 메인 입력과 같은 파일이므로 스트림 인덱스도 같음
+  worker->v_index = input_file_ctx.v_index;
+  for (int index = 0; index < worker->av_format_ctx->nb_streams; ++index) {
+    if (index != worker->v_index) {
+      worker->av_format_ctx->streams[index]->discard = AVDISCARD_ALL;
+    }
+  }
+
+  // 구간 스레드들이 코어를 나누어 쓰므로 스레드 수를 직접 지정하지 않았으면 디코더 스레드는 하나만 사용
+  AVCodecParameters* av_codec_params = worker->av_format_ctx->streams[worker->v_index]->codecpar;
+  ThreadPolicy policy = resolve_thread_policy(av_codec_params);
+  if (thread_options.overrides.thread_count < 0) {
+    policy.thread_count = 1;
+  }
+  return open_decoder(av_codec_params, &worker->av_codec_ctx, &policy);
+}
+
+void chunk_decode_loop(ChunkWorker* worker) {
+  AVPacket av_packet;
+  AVFrame* av_frame = av_frame_alloc();
+  int ret = av_frame ? open_chunk_worker(worker) : AVERROR(ENOMEM);
+
+  while (ret >= 0) {
+    worker->range_index = chunk_decoder.next_range++;
+    if (worker->range_index >= (int) chunk_decoder.ranges.size()) {
+      break;
+    }
+
+    int64_t busy_start = av_gettime_relative();
+    int64_t wait_time = worker->wait_time;
+    ret = decode_chunk_range(worker, &av_packet, av_frame);
+    finish_chunk_range(worker->range_index);
+    ++worker->range_count;
+    worker->busy_time += av_gettime_relative() - busy_start - (worker->wait_time - wait_time);
+  }
+
+  av_frame_free(&av_frame);
+
+  // 다른 스레드와 메인 스레드가 기다리지 않도록 중단을 알림
+  worker->error = ret == AVERROR_EXIT ? 0 : ret;
+  if (worker->error < 0) {
+    std::lock_guard<std::mutex> lock(chunk_decoder.reorder.mutex);
+    chunk_decoder.reorder.stop = true;
+    chunk_decoder.reorder.changed.notify_all();
+  }
+}
+
+int decode_chunk_range(ChunkWorker* worker, AVPacket* av_packet, AVFrame* av_frame) {
+  const ChunkRange& range = chunk_decoder.ranges[worker->range_index];
+  AVStream* av_stream = worker->av_format_ctx->streams[worker->v_index];
+  AVCodecContext* av_codec_ctx = worker->av_codec_ctx;
+
+  // 구간 시작 키프레임으로 탐색한 후 이전 구간에서 남은 디코더 상태를 버림
+  int64_t seek_pts = range.start_pts;
+  if (seek_pts == AV_NOPTS_VALUE) {
+    seek_pts = av_stream->start_time != AV_NOPTS_VALUE ? av_stream->start_time : 0;
+  }
+  if (av_seek_frame(worker->av_format_ctx, worker->v_index, seek_pts, AVSEEK_FLAG_BACKWARD) < 0) {
+    printf("Couldn't seek to %lld\n", (long long) seek_pts);
+    return -1;
+  }
+  avcodec_flush_buffers(av_codec_ctx);
+
+  // 다음 구간의 키프레임 뒤에도 표시 순서가 그 앞인 프레임(open GOP의 B 프레임)이 올 수 있으므로
+  // 끝 키프레임까지 디코더에 보낸 후 PTS가 end_pts보다 작은 패킷은 계속 보냄
+  bool passed_end = false;
+  int ret;
+  while ((ret = av_read_frame(worker->av_format_ctx, av_packet)) >= 0) {
+    if (av_packet->stream_index != worker->v_index) {
+      av_packet_unref(av_packet);
+      continue;
+    }
+
+    int64_t pts = av_packet->pts != AV_NOPTS_VALUE ? av_packet->pts : av_packet->dts;
+    if (range.end_pts != AV_NOPTS_VALUE && pts != AV_NOPTS_VALUE && pts >= range.end_pts) {
+      if (passed_end || !(av_packet->flags & AV_PKT_FLAG_KEY)) {
+        av_packet_unref(av_packet);
+        break;
+      }
+      passed_end = true;
+    }
+
+    av_packet_rescale_ts(av_packet, av_stream->time_base, av_codec_ctx->time_base);
+    ret = decode_packet(av_codec_ctx, av_packet, av_frame, queue_chunk_frame, worker);
+    av_packet_unref(av_packet);
+    if (ret < 0) {
+      return ret;
+    }
+  }
+
+  if (ret < 0 && ret != AVERROR_EOF) {
+    printf("Error occurred when reading packet\n");
+    return ret;
+  }
+
+  ret = decode_packet(av_codec_ctx, nullptr, av_frame, queue_chunk_frame, worker);
+  return ret == AVERROR_EOF ? 0 : ret;
+}
+
+int queue_chunk_frame(AVCodecContext* av_codec_ctx, AVFrame* av_frame, void* opaque) {
+  ChunkWorker* worker = (ChunkWorker*) opaque;
+  const ChunkRange& range = chunk_decoder.ranges[worker->range_index];
+  AVStream* av_stream = worker->av_format_ctx->streams[worker->v_index];
+
+  // 구간 밖의 프레임은 앞뒤 구간이 내보내므로 버림
+  if (av_frame->pts != AV_NOPTS_VALUE) {
+    int64_t pts = av_rescale_q(av_frame->pts, av_codec_ctx->time_base, av_stream->time_base);
+    if ((range.start_pts != AV_NOPTS_VALUE && pts < range.start_pts) ||
+        (range.end_pts != AV_NOPTS_VALUE && pts >= range.end_pts)) {
+      ++worker->dropped_count;
+      return 0;
+    }
+  }
+
+  AVFrame* output_frame = av_frame_alloc();
+  if (!output_frame) {
+    return AVERROR(ENOMEM);
+  }
+  av_frame_move_ref(output_frame, av_frame);
+
+  // 내보낼 차례가 아닌 구간은 버퍼에 자리가 날 때까지 기다림
+  ReorderBuffer& reorder = chunk_decoder.reorder;
+  std::unique_lock<std::mutex> lock(reorder.mutex);
+  int64_t wait_start = av_gettime_relative();
+  while (!reorder.stop && reorder.next_range != (size_t) worker->range_index &&
+         reorder.frame_count >= reorder.max_frames) {
+    reorder.changed.wait(lock);
+  }
+  worker->wait_time += av_gettime_relative() - wait_start;
+
+  if (reorder.stop) {
+    av_frame_free(&output_frame);
+    return AVERROR_EXIT;
+  }
+
+  reorder.frames[worker->range_index].push_back(output_frame);
+  ++reorder.frame_count;
+  reorder.peak_frames = FFMAX(reorder.peak_frames, reorder.frame_count);
+  reorder.changed.notify_all();
+  ++worker->frame_count;
+  return 0;
+}
+
+void finish_chunk_range(int range_index) {
+  std::lock_guard<std::mutex> lock(chunk_decoder.reorder.mutex);
+  chunk_decoder.reorder.finished[range_index] = true;
+  chunk_decoder.reorder.changed.notify_all();
+}
+
+void print_chunk_stats(double elapsed, int64_t order_errors) {
+  int64_t frame_count = 0;
+  int64_t dropped_count = 0;
+  for (size_t index = 0; index < chunk_decoder.workers.size(); ++index) {
+    ChunkWorker* worker = chunk_decoder.workers[index];
+    printf("chunk thread %zu : %d ranges, %lld frames, %lld dropped, busy %.3f sec, "
+           "waiting %.3f sec\n",
+           index, worker->range_count, (long long) worker->frame_count,
+           (long long) worker->dropped_count, worker->busy_time / 1000000.0,
+           worker->wait_time / 1000000.0);
+    frame_count += worker->frame_count;
+    dropped_count += worker->dropped_count;
+  }
+
+  printf("chunked decoding : %lld frames in %.3f sec (%.1f frames/sec), %lld frames "
+         "decoded outside their range, peak reorder buffer %zu frames, order errors %lld\n",
+         (long long) frame_count, elapsed, elapsed > 0 ? frame_count / elapsed : 0.0,
+         (long long) dropped_count, chunk_decoder.reorder.peak_frames, (long long) order_errors);
+}
+
+int parse_frame_times(const char* list, std::vector<double>* times) {
+  const char* begin = list;
+  while (*begin) {
+    char* end;
+    double time = strtod(begin, &end);
+    if (end == begin || (*end && *end != ',')) {
+      printf("Invalid frame time list : %s\n", list);
+      return -1;
+    }
+    times->push_back(time);
+    begin = *end ? end + 1 : end;
+  }
+  return 0;
+}
+
+int load_frame_times(const char* filename, std::vector<double>* times) {
+  FILE* file = fopen(filename, "r");
+  if (!file) {
+    printf("Couldn't open frame time list %s\n", filename);
+    return -1;
+  }
+
+  // 한 줄에 시각(초) 하나, #으로 시작하는 줄은 주석
+  char line[128];
+  int line_number = 0;
+  while (fgets(line, sizeof(line), file)) {
+    ++line_number;
+    if (line[0] == '#' || line[0] == '\n') {
+      continue;
+    }
+
+    double time;
+    if (sscanf(line, "%lf", &time) != 1) {
+      printf("Invalid frame time line %d : %s", line_number, line);
+      continue;
+    }
+    times->push_back(time);
+  }
+
+  fclose(file);
+  return 0;
+}
+
+int run_frame_server(const std::vector<double>& times) {
+  if (input_file_ctx.v_index < 0) {
+    printf("Frame server needs a video stream\n");
+    return -1;
+  }
+
+  FrameServer server;
+  int64_t start_time = av_gettime_relative();
+  int ret = serve_frames(&server, times, show_requested_frame, nullptr);
+  double elapsed = (av_gettime_relative() - start_time) / 1000000.0;
+  if (ret < 0) {
+    return ret;
+  }
+
+  // 중복 디코딩 비율은 디코딩했지만 어떤 요청에도 응답하지 않은 프레임의 비율
+  printf("frame server : %zu requests, %zu keyframes, %lld seeks, %lld missing, %.3f sec\n",
+         server.requests.size(), server.keyframes.size(), (long long) server.seek_count,
+         (long long) server.missing_count, elapsed);
+  printf("batched : %lld frames decoded for %lld distinct frames, redundant decode ratio %.3f\n",
+         (long long) server.decoded_count, (long long) server.unique_count,
+         server.decoded_count > 0
+                 ? (double) (server.decoded_count - server.unique_count) / server.decoded_count
+                 : 0.0);
+  printf("per request (estimated) : %lld frames decoded, redundant decode ratio %.3f, "
+         "batching saves %.1fx\n",
+         (long long) server.naive_count,
+         server.naive_count > 0
+                 ? (double) (server.naive_count - server.unique_count) / server.naive_count
+                 : 0.0,
+         server.decoded_count > 0 ? (double) server.naive_count / server.decoded_count : 0.0);
+  return 0;
+}
+
+int build_keyframe_index(std::vector<int64_t>* keyframes) {
+  AVFormatContext* av_format_ctx = input_file_ctx.av_format_ctx;
+  keyframes->clear();
+
+  // 비디오 패킷만 읽으면서 키프레임의 PTS를 모음 (디코딩은 하지 않음)
+  AVPacket av_packet;
+  int ret;
+  while ((ret = av_read_frame(av_format_ctx, &av_packet)) >= 0) {
+    int64_t pts = av_packet.pts != AV_NOPTS_VALUE ? av_packet.pts : av_packet.dts;
+    if (av_packet.stream_index == input_file_ctx.v_index && (av_packet.flags & AV_PKT_FLAG_KEY) &&
+        pts != AV_NOPTS_VALUE && (keyframes->empty() || pts > keyframes->back())) {
+      keyframes->push_back(pts);
+    }
+    av_packet_unref(&av_packet);
+  }
+
+  if (ret != AVERROR_EOF) {
+    printf("Error occurred when reading packet\n");
+    return -1;
+  }
+  return 0;
+}
+
+// 요청한 시각마다 handle_request를 한 번씩 호출 (호출 순서는 시각 순서)
+int serve_frames(FrameServer* server, const std::vector<double>& times,
+                 RequestHandler handle_request, void* opaque) {
+  AVStream* av_stream = input_file_ctx.av_format_ctx->streams[input_file_ctx.v_index];
+  server->handle_request = handle_request;
+  server->opaque = opaque;
+  server->previous = nullptr;
+  server->seek_count = 0;
+  server->decoded_count = 0;
+  server->unique_count = 0;
+  server->naive_count = 0;
+  server->missing_count = 0;
+  server->last_emitted_pts = AV_NOPTS_VALUE;
+
+  if (build_keyframe_index(&server->keyframes) < 0) {
+    return -1;
+  }
+
+  // 요청을 시각 순서로 정렬하고 요청 시각 직전의 키프레임으로 GOP를 정함
+  int64_t start_pts = av_stream->start_time != AV_NOPTS_VALUE ? av_stream->start_time : 0;
+  server->requests.clear();
+  for (size_t index = 0; index < times.size(); ++index) {
+    FrameRequest request;
+    request.index = (int) index;
+    request.time = times[index];
+    request.pts = start_pts + av_rescale_q((int64_t) (times[index] * AV_TIME_BASE),
+                                           av_get_time_base_q(), av_stream->time_base);
+    request.gop = (int) (std::upper_bound(server->keyframes.begin(), server->keyframes.end(),
+                                          request.pts) -
+                         server->keyframes.begin()) - 1;
+    server->requests.push_back(request);
+  }
+  std::stable_sort(server->requests.begin(), server->requests.end(),
+                   [](const FrameRequest& a, const FrameRequest& b) { return a.pts < b.pts; });
+
+  AVPacket av_packet;
+  AVFrame* av_frame = av_frame_alloc();
+  if (!av_frame) {
+    return AVERROR(ENOMEM);
+  }
+
+  int ret = 0;
+  server->next = 0;
+  while (ret >= 0 && server->next < server->requests.size()) {
+    int gop = server->requests[server->next].gop;
+    server->group_end = server->next;
+    while (server->group_end < server->requests.size() &&
+           server->requests[server->group_end].gop == gop) {
+      ++server->group_end;
+    }
+    ret = decode_request_group(server, &av_packet, av_frame);
+  }
+
+  av_frame_free(&av_frame);
+  av_frame_free(&server->previous);
+  return ret;
+}
+
+int decode_request_group(FrameServer* server, AVPacket* av_packet, AVFrame* av_frame) {
+  AVFormatContext* av_format_ctx = input_file_ctx.av_format_ctx;
+  AVCodecContext* av_codec_ctx = input_file_ctx.video_codec_ctx;
+  AVStream* av_stream = av_format_ctx->streams[input_file_ctx.v_index];
+  int gop = server->requests[server->next].gop;
+
+  // GOP의 키프레임으로 탐색 (첫 키프레임 앞의 시각은 스트림 처음부터 디코딩)
+  // 다음 키프레임이 GOP의 끝
+  int64_t seek_pts = gop >= 0 ? server->keyframes[gop] : AV_NOPTS_VALUE;
+  if (seek_pts == AV_NOPTS_VALUE) {
+    seek_pts = av_stream->start_time != AV_NOPTS_VALUE ? av_stream->start_time : 0;
+  }
+  int64_t end_pts = gop + 1 < (int) server->keyframes.size() ? server->keyframes[gop + 1]
+                                                            : AV_NOPTS_VALUE;
+  if (av_seek_frame(av_format_ctx, input_file_ctx.v_index, seek_pts, AVSEEK_FLAG_BACKWARD) < 0) {
+    printf("Couldn't seek to %lld\n", (long long) seek_pts);
+    return -1;
+  }
+  avcodec_flush_buffers(av_codec_ctx);
+  av_frame_free(&server->previous);
+  server->gop_frames = 0;
+  ++server->seek_count;
+
+  // 같은 GOP의 요청은 디코더 상태를 그대로 이어서 앞에서부터 차례로 응답
+  // 마지막 요청에 응답하면 GOP의 나머지는 디코딩하지 않음
+  // open GOP의 앞쪽 B 프레임은 다음 키프레임 뒤에 오므로 PTS가 end_pts보다 작은 패킷은 계속 보냄
+  bool passed_end = false;
+  int ret;
+  while ((ret = av_read_frame(av_format_ctx, av_packet)) >= 0) {
+    if (av_packet->stream_index != input_file_ctx.v_index) {
+      av_packet_unref(av_packet);
+      continue;
+    }
+
+    int64_t pts = av_packet->pts != AV_NOPTS_VALUE ? av_packet->pts : av_packet->dts;
+    if (end_pts != AV_NOPTS_VALUE && pts != AV_NOPTS_VALUE && pts >= end_pts) {
+      if (passed_end || !(av_packet->flags & AV_PKT_FLAG_KEY)) {
+        av_packet_unref(av_packet);
+        break;
+      }
+      passed_end = true;
+    }
+
+    av_packet_rescale_ts(av_packet, av_stream->time_base, av_codec_ctx->time_base);
+    ret = decode_packet(av_codec_ctx, av_packet, av_frame, serve_decoded_frame, server);
+    av_packet_unref(av_packet);
+    if (ret < 0) {
+      break;
+    }
+  }
+
+  // 모든 요청에 응답해서 중단한 경우
+  if (ret == AVERROR_EXIT) {
+    return 0;
+  } else if (ret < 0 && ret != AVERROR_EOF) {
+    return ret;
+  }
+
+  // GOP의 끝까지 읽었으면 디코더에 남은 프레임을 꺼낸 후 남은 요청은 GOP의 마지막 프레임으로 응답
+  ret = decode_packet(av_codec_ctx, nullptr, av_frame, serve_decoded_frame, server);
+  if (ret == AVERROR_EXIT) {
+    return 0;
+  } else if (ret < 0 && ret != AVERROR_EOF) {
+    return ret;
+  }
+
+  while (server->next < server->group_end) {
+    if (!server->previous) {
+      printf("No frame for %.3f sec\n", server->requests[server->next].time);
+      ++server->missing_count;
+      ++server->next;
+      continue;
+    }
+    ret = emit_request(server, server->previous, server->previous_position);
+    if (ret < 0) {
+      return ret;
+    }
+  }
+  return 0;
+}
+
+int serve_decoded_frame(AVCodecContext* av_codec_ctx, AVFrame* av_frame, void* opaque) {
+  FrameServer* server = (FrameServer*) opaque;
+  AVStream* av_stream = input_file_ctx.av_format_ctx->streams[input_file_ctx.v_index];
+  ++server->decoded_count;
+  ++server->gop_frames;
+
+  // 요청 시각을 지나는 프레임이 나오면 직전 프레임이 그 시각에 보이는 프레임
+  // 첫 프레임보다 앞선 요청은 첫 프레임으로 응답
+  if (av_frame->pts != AV_NOPTS_VALUE) {
+    int64_t pts = av_rescale_q(av_frame->pts, av_codec_ctx->time_base, av_stream->time_base);
+    while (server->next < server->group_end && server->requests[server->next].pts < pts) {
+      int ret = server->previous
+                        ? emit_request(server, server->previous, server->previous_position)
+                        : emit_request(server, av_frame, server->gop_frames);
+      if (ret < 0) {
+        return ret;
+      }
+    }
+  }
+
+  if (server->next == server->group_end) {
+    return AVERROR_EXIT;
+  }
+
+  if (!server->previous) {
+    server->previous = av_frame_alloc();
+    if (!server->previous) {
+      return AVERROR(ENOMEM);
+    }
+  }
+  av_frame_unref(server->previous);
+  av_frame_move_ref(server->previous, av_frame);
+  server->previous_position = server->gop_frames;
+  return 0;
+}
+
+// position은 키프레임부터 이 프레임까지 디코딩한 프레임 수
+int emit_request(FrameServer* server, AVFrame* av_frame, int64_t position) {
+  FrameRequest* request = &server->requests[server->next++];
+  server->naive_count += position;
+  if (av_frame->pts != server->last_emitted_pts || server->unique_count == 0) {
+    ++server->unique_count;
+    server->last_emitted_pts = av_frame->pts;
+  }
+  return server->handle_request(request, av_frame, server->opaque);
+}
+
+int show_requested_frame(const FrameRequest* request, AVFrame* av_frame, void* opaque) {
+  AVCodecContext* av_codec_ctx = input_file_ctx.video_codec_ctx;
+  printf("request %d : %.3f sec -> frame pts %lld (%.3f sec), %dx%d%s\n", request->index,
+         request->time, (long long) av_frame->pts, av_frame->pts * av_q2d(av_codec_ctx->time_base),
+         av_frame->width, av_frame->height, av_frame->key_frame ? ", keyframe" : "");
+  return 0;
+}
+
+AVPacket* get_packet(SpscQueue* returns, SpscQueue* more_returns) {
+  void* item;
+  if (spsc_pop(returns, &item) || (more_returns && spsc_pop(more_returns, &item))) {
+    return (AVPacket*) item;
+  }
+
+  ++pipeline.packet_allocations;
+  return av_packet_alloc();
+}
+
+AVFrame* get_frame(SpscQueue* returns) {
+  void* item;
+  if (spsc_pop(returns, &item)) {
+    return (AVFrame*) item;
+  }
+
+  ++pipeline.frame_allocations;
+  return av_frame_alloc();
+}
+
+void return_packet(SpscQueue* returns, AVPacket* av_packet) {
+  // 데이터 참조만 해제하고 AVPacket 구조체는 돌려보냄 (큐가 가득 차면 해제)
+  av_packet_unref(av_packet);
+  if (!spsc_push(returns, av_packet)) {
+    av_packet_free(&av_packet);
+  }
+}
+
+void return_frame(SpscQueue* returns, AVFrame* av_frame) {
+  // 프레임 버퍼는 여기서 풀로 돌아가고 AVFrame 구조체는 디코딩 단계로 돌려보냄
+  av_frame_unref(av_frame);
+  if (!spsc_push(returns, av_frame)) {
+    av_frame_free(&av_frame);
+  }
+}
+
+int get_pooled_buffer(AVCodecContext* av_codec_ctx, AVFrame* av_frame, int flags) {
+  FrameAllocator* allocator = (FrameAllocator*) av_codec_ctx->opaque;
+
+  // 하드웨어 프레임이나 팔레트 포맷은 plane 구성이 달라서 기본 할당기를 사용
+  const AVPixFmtDescriptor* descriptor = av_pix_fmt_desc_get((AVPixelFormat) av_frame->format);
+  if (!descriptor || (descriptor->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL))) {
+    return avcodec_default_get_buffer2(av_codec_ctx, av_frame, flags);
+  }
+
+  FramePool* pool =
+          find_frame_pool(av_codec_ctx, av_frame->format, av_frame->width, av_frame->height);
+  if (!pool) {
+    return AVERROR(ENOMEM);
+  }
+
+  // av_buffer_pool_get() 함수는 스레드 안전하며 풀에 남는 버퍼가 없을 때만 새로 할당함
+  av_frame->buf[0] = av_buffer_pool_get(pool->buffer_pool);
+  if (!av_frame->buf[0]) {
+    return AVERROR(ENOMEM);
+  }
+  ++allocator->frame_count;
+
+  for (int plane = 0; plane < 4; ++plane) {
+    av_frame->linesize[plane] = pool->linesizes[plane];
+    av_frame->data[plane] = pool->linesizes[plane] ? av_frame->buf[0]->data + pool->offsets[plane]
+                                                   : nullptr;
+  }
+  av_frame->extended_data = av_frame->data;
+
+  return 0;
+}
+
+FramePool* find_frame_pool(AVCodecContext* av_codec_ctx, int format, int width, int height) {
+  FrameAllocator* allocator = (FrameAllocator*) av_codec_ctx->opaque;
+  std::lock_guard<std::mutex> lock(allocator->mutex);
+
+  for (FramePool* pool : allocator->pools) {
+    if (pool->format == format && pool->width == width && pool->height == height) {
+      return pool;
+    }
+  }
+
+  // 디코더가 요구하는 크기와 줄 간격 정렬에 맞춘 후 줄 간격을 다시 64 byte 단위로 올림
+  int aligned_width = width;
+  int aligned_height = height;
+  int linesize_align[AV_NUM_DATA_POINTERS];
+  avcodec_align_dimensions2(av_codec_ctx, &aligned_width, &aligned_height, linesize_align);
+
+  FramePool* pool = new FramePool();
+  pool->format = format;
+  pool->width = width;
+  pool->height = height;
+  if (av_image_fill_linesizes(pool->linesizes, (AVPixelFormat) format, aligned_width) < 0) {
+    delete pool;
+    return nullptr;
+  }
+
+  // 줄 간격이 64 byte의 배수이므로 버퍼 시작 주소만 정렬하면 모든 plane의 시작 주소도 정렬됨
+  // ptr에 nullptr을 넘기면 data에는 버퍼 시작 위치부터 각 plane까지의 거리가 들어감
+  for (int plane = 0; plane < 4; ++plane) {
+    pool->linesizes[plane] = FFALIGN(pool->linesizes[plane], frame_alignment);
+  }
+  uint8_t* data[4];
+  int size = av_image_fill_pointers(data, (AVPixelFormat) format, aligned_height, nullptr,
+                                    pool->linesizes);
+  if (size < 0) {
+    delete pool;
+    return nullptr;
+  }
+  for (int plane = 0; plane < 4; ++plane) {
+    pool->offsets[plane] = (size_t) (uintptr_t) data[plane];
+  }
+  // 디코더가 plane 끝을 넘어서 읽는 경우를 위한 여유 공간
+  pool->size = size + frame_alignment;
+
+  pool->buffer_pool =
+          av_buffer_pool_init2((int) pool->size, allocator, allocate_pool_buffer, nullptr);
+  if (!pool->buffer_pool) {
+    delete pool;
+    return nullptr;
+  }
+
+  allocator->pools.push_back(pool);
+  return pool;
+}
+
+AVBufferRef* allocate_pool_buffer(void* opaque, int size) {
+  FrameAllocator* allocator = (FrameAllocator*) opaque;
+  ++allocator->allocation_count;
+
+  // 4K 프레임은 수 MB이므로 huge page를 사용하면 TLB miss와 page fault가 크게 줄어듦
+  // MAP_HUGETLB는 미리 예약한 huge page가 필요하므로 실패하면 transparent huge page를 요청
+  if (allocator->hugepages) {
+    const size_t hugepage_size = 2 << 20;
+    size_t mapped_size = FFALIGN((size_t) size, hugepage_size);
+    void* data = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (data == MAP_FAILED) {
+      data = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1,
+                  0);
+      if (data != MAP_FAILED) {
+        madvise(data, mapped_size, MADV_HUGEPAGE);
+      }
+    } else {
+      ++allocator->hugepage_count;
+    }
+
+    if (data != MAP_FAILED) {
+      AVBufferRef* buffer = av_buffer_create((uint8_t*) data, size, free_hugepage_buffer,
+                                             (void*) (uintptr_t) mapped_size, 0);
+      if (!buffer) {
+        munmap(data, mapped_size);
+      }
+      return buffer;
+    }
+  }
+
+  void* data = nullptr;
+  if (posix_memalign(&data, frame_alignment, size) != 0) {
+    return nullptr;
+  }
+
+  AVBufferRef* buffer = av_buffer_create((uint8_t*) data, size, free_pool_buffer, nullptr, 0);
+  if (!buffer) {
+    free(data);
+  }
+  return buffer;
+}
+
+void free_pool_buffer(void* opaque, uint8_t* data) {
+  free(data);
+}
+
+void free_hugepage_buffer(void* opaque, uint8_t* data) {
+  munmap(data, (size_t) (uintptr_t) opaque);
+}
+
+void release_frame_pools() {
+  // 아직 사용 중인 버퍼가 있으면 av_buffer_pool_uninit() 함수는 마지막 버퍼가 반환될 때 풀을 해제함
+  for (FramePool* pool : frame_allocator.pools) {
+    av_buffer_pool_uninit(&pool->buffer_pool);
+    delete pool;
+  }
+  frame_allocator.pools.clear();
+}
+
+void print_frame_pool_stats(int64_t page_faults) {
+  if (frame_allocator.enabled) {
+    printf("frame pool : %zu pools, %lld frames, %lld buffer allocations (%lld huge pages)\n",
+           frame_allocator.pools.size(), (long long) frame_allocator.frame_count.load(),
+           (long long) frame_allocator.allocation_count.load(),
+           (long long) frame_allocator.hugepage_count.load());
+  }
+  if (pipeline.demux.name) {
+    printf("pipeline allocations : %lld packets, %lld frames\n",
+           (long long) pipeline.packet_allocations.load(),
+           (long long) pipeline.frame_allocations.load());
+  }
+  printf("page faults : %lld\n", (long long) page_faults);
+}
+
+int64_t get_page_faults() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_minflt + usage.ru_majflt;
+}
+
+void release() {
+  // 디먹싱 스레드가 AVFormatContext 구조체를 사용하고 있으므로 먼저 종료
+  stop_demux_thread();
+
+  if (input_file_ctx.av_format_ctx) {
+    avformat_close_input(&(input_file_ctx.av_format_ctx));
+  }
+
+  // 직접 생성한 AVIOContext는 avformat_close_input() 함수가 해제하지 않음
+  close_mapped_input(&input_file_ctx.mapped_file, &input_file_ctx.avio_ctx);
+
+  if (input_file_ctx.video_codec_ctx) {
+    avcodec_close(input_file_ctx.video_codec_ctx);
+  }
+
+  if (input_file_ctx.audio_codec_ctx) {
+    avcodec_close(input_file_ctx.audio_codec_ctx);
+  }
+
+  // 풀의 버퍼를 사용하는 디코더를 닫은 후에 해제
+  release_frame_pools();
 }
\ No newline at end of file
@@ -5,12 +5,45 @@ extern "C" {
 #include <libavfilter/buffersrc.h>
 #include <libavformat/avformat.h>
 #include <libavutil/avutil.h>
+#include <libavutil/buffer.h>
 #include <libavutil/common.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+#include <libswresample/swresample.h>
+#include <libswscale/swscale.h>
 }
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <condition_variable>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TENSOR_X86 1
+#endif
+
+// mmap으로 매핑한 입력 파일
+struct MappedFile {
+  uint8_t* data;
+  int64_t size;
+  int64_t pos;
+};
 
 struct FileContext {
   AVFormatContext* av_format_ctx;
+  AVIOContext* avio_ctx;
+  MappedFile mapped_file;
   AVCodecContext* video_codec_ctx;
   AVCodecContext* audio_codec_ctx;
   int v_index;
@@ -23,19 +56,330 @@ struct FilterContext {
   AVFilterContext* sink_filter_ctx;
 };
 
+// ABR 래더의 출력 하나 (--ladder)
+// 원본 또는 더 큰 출력의 결과를 split 필터로 나눠 받아서 scale 필터로 줄인 후 버퍼 싱크로 내보냄
+struct Rendition {
+  int width;
+  int height;
+  // 입력으로 사용하는 출력의 인덱스 (-1이면 디코딩한 원본을 직접 줄임)
+  int source;
+  AVFilterContext* sink_filter_ctx;
+  int64_t frame_count;
+};
+
+// 필터 스레드로 넘긴 프레임과 큐에 넣은 시각 (마이크로초, nullptr 프레임은 flush 요청)
+struct QueuedFrame {
+  AVFrame* av_frame;
+  int64_t queued_time;
+};
+
+// 필터 그래프 하나를 전담해서 실행하는 스레드 (--filter-workers)
+// 디코딩 루프는 프레임을 큐에 넣기만 하므로 무거운 비디오 필터가 오디오 필터와 디코딩을 막지 않음
+struct FilterWorker {
+  const char* name;
+  FilterContext* filter_ctx;
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable not_empty;
+  std::condition_variable not_full;
+  std::deque<QueuedFrame> frames;
+  size_t capacity;
+  bool running;
+  bool finished;
+  bool stop;
+  int error;
+  // 프레임을 넣을 때마다 측정한 큐 길이와 큐가 가득 차서 디코딩 루프가 기다린 횟수
+  size_t peak_depth;
+  uint64_t depth_sum;
+  uint64_t queued_count;
+  uint64_t producer_waits;
+  // 필터 그래프에 넣은 프레임 수, 큐에 넣은 후 필터 그래프를 빠져나올 때까지의 시간과
+  // 그중 필터 그래프를 실행한 시간 (마이크로초)
+  int64_t frame_count;
+  int64_t latency_sum;
+  int64_t latency_max;
+  int64_t process_time;
+};
+
+// 영상을 가로 띠(slice)로 나눈 한 부분을 맡는 SwsContext
+// 원본과 결과의 행 범위를 같은 비율로 나누므로 slice마다 따로 만든 SwsContext도 전체와 같은 배율로 줄임
+struct ScaleSlice {
+  SwsContext* sws_ctx;
+  int src_y;
+  int src_height;
+  int dst_y;
+  int dst_height;
+};
+
+// 필터 그래프를 거치지 않고 swscale로 바로 크기를 바꾸는 경로 (--scaler sws)
+// 버퍼 소스/싱크와 필터 사이의 프레임 전달, 포맷 협상 없이 sws_scale()만 호출하며
+// 결과 프레임의 버퍼는 풀에서 가져오고 다 쓰면 풀로 돌아가서 다시 사용됨
+struct VideoScaler {
+  bool enabled;
+  bool benchmark;
+  int thread_count;
+  // SwsContext를 다시 만들지 않도록 마지막 원본 프레임의 포맷과 크기를 기억
+  int src_format;
+  int src_width;
+  int src_height;
+  std::vector<ScaleSlice> slices;
+  AVBufferPool* buffer_pool;
+  int linesizes[4];
+  size_t offsets[4];
+  // slice 스레드 (slice 0은 scale_video_frame()을 호출한 스레드가 처리)
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable start;
+  std::condition_variable done;
+  uint64_t generation;
+  int pending;
+  bool stop;
+  const AVFrame* src_frame;
+  AVFrame* dst_frame;
+  // 프레임 수와 걸린 시간 (마이크로초, --scale-bench는 필터 그래프 경로도 같이 측정)
+  int64_t frame_count;
+  int64_t scale_time;
+  int64_t graph_count;
+  int64_t graph_time;
+};
+
+// 필터 그래프를 거치지 않고 swresample로 바로 dst_ch_layout, dst_sample_rate로 바꾸는 경로 (--resampler swr)
+// 변환 결과는 미리 할당한 링 버퍼에 쌓고 chunk_size 샘플씩 잘라서 내보냄
+// 링 버퍼 크기가 chunk_size의 배수이고 항상 chunk_size 단위로 꺼내므로 청크는 링 버퍼 안에서 연속됨
+struct AudioResampler {
+  bool enabled;
+  SwrContext* swr_ctx;
+  // SwrContext를 다시 만들지 않도록 마지막 입력 프레임의 포맷을 기억
+  int src_format;
+  int src_sample_rate;
+  uint64_t src_channel_layout;
+  int chunk_size;
+  // 링 버퍼 (dst_sample_fmt가 planar이면 채널마다 평면 하나)
+  uint8_t** planes;
+  int plane_count;
+  int sample_bytes;
+  int capacity;
+  int read_pos;
+  int write_pos;
+  int count;
+  // 링 버퍼를 가리키는 청크 프레임 (다음 변환 전까지만 유효)
+  AVFrame* chunk_frame;
+  // 내보낸 청크와 샘플 수, 변환에 걸린 시간 (마이크로초)
+  int64_t chunk_count;
+  int64_t sample_count;
+  int64_t convert_time;
+};
+
+// 필터 그래프와 swresample 경로의 오디오 변환 비교 (--resample-bench streams)
+// 디코딩한 오디오 프레임을 모아두었다가 디코딩이 끝난 후 스트림 수만큼의 스레드에서 두 경로로 각각 변환
+struct ResampleBenchmark {
+  int streams;
+  std::vector<AVFrame*> frames;
+};
+
+// 오디오 변환 벤치마크에서 스레드 하나의 결과
+// 청크의 지연 시간은 그 청크를 만든 프레임을 넣고 청크를 꺼낼 때까지 걸린 시간 (마이크로초)
+struct ResampleResult {
+  int64_t sample_count;
+  int64_t chunk_count;
+  int64_t latency_sum;
+  int64_t latency_max;
+  int error;
+};
+
+// 텐서 변환에 사용할 명령어 집합
+enum TensorSimd { TENSOR_SCALAR, TENSOR_SSE4, TENSOR_AVX2, TENSOR_SIMD_COUNT };
+
+// 디코딩한 YUV 프레임을 크기 변경, RGB 변환, 정규화까지 한 번에 처리해서
+// dst_width x dst_height 크기의 NCHW float32 텐서(1x3xHxW, R, G, B 순서)로 만드는 전처리 단계 (--tensor)
+// 출력의 열과 행마다 원본 좌표와 bilinear 가중치를 미리 계산해두고,
+// 출력 행마다 원본 두 행을 세로로 보간한 임시 행(L1 캐시에 들어가는 크기)에서 가로 보간과 색 변환을 함께 함
+struct TensorConverter {
+  bool enabled;
+  bool benchmark;
+  int simd;
+  const char* output;
+  FILE* file;
+  // 미리 계산한 좌표의 기준이 되는 원본 프레임의 포맷과 크기
+  int src_format;
+  int src_width;
+  int src_height;
+  std::vector<int> x_index;
+  std::vector<float> x_weight;
+  std::vector<int> chroma_x_index;
+  std::vector<float> chroma_x_weight;
+  std::vector<int> y_index;
+  std::vector<float> y_weight;
+  std::vector<int> chroma_y_index;
+  std::vector<float> chroma_y_weight;
+  // 세로로 보간한 Y, U, V 임시 행 (NV12는 U, V가 섞인 행 하나)
+  float* luma_row;
+  float* chroma_rows[2];
+  float* tensor;
+  // Y' -> R'G'B' 변환과 정규화 계수
+  // rgb = (Y - y_offset) * y_scale + u_coef * (U - 128) + v_coef * (V - 128)를 0~255로 자른 후
+  // out = rgb * scale + bias (scale = 1 / (255 * std), bias = -mean / std)
+  float y_offset;
+  float y_scale;
+  float u_coef[3];
+  float v_coef[3];
+  float scale[3];
+  float bias[3];
+  // 명령어 집합별 처리 프레임 수와 시간 (마이크로초), 참조 구현과의 최대 오차
+  int64_t frame_count[TENSOR_SIMD_COUNT];
+  int64_t convert_time[TENSOR_SIMD_COUNT];
+  double max_error[TENSOR_SIMD_COUNT];
+  int64_t validated_count;
+  // 포맷이나 크기가 바뀐 후 첫 프레임은 항상 참조 구현과 비교
+  bool validate_next;
+};
+
+// 디코딩한 프레임을 처리하는 함수 (0 이상을 반환하면 계속 디코딩)
+typedef int (*FrameHandler)(AVCodecContext* av_codec_ctx, AVFrame* av_frame, void* opaque);
+
+// 디먹싱 스레드가 스트림별로 채워두는 패킷 큐 (미리 할당한 패킷을 링 버퍼로 사용)
+struct PacketQueue {
+  std::vector<AVPacket*> packets;
+  // 디먹싱한 순서를 유지하기 위해 패킷마다 붙이는 일련번호
+  std::vector<uint64_t> sequences;
+  size_t head;
+  size_t count;
+  size_t high_watermark;
+  // 큐가 가득 차서 디먹싱 스레드가 기다린 횟수
+  uint64_t producer_stalls;
+};
+
+struct DemuxThread {
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable not_full;
+  std::condition_variable not_empty;
+  // 스트림 인덱스별 큐 (디코딩하지 않는 스트림은 크기가 0)
+  std::vector<PacketQueue> queues;
+  uint64_t next_sequence;
+  // 큐가 비어서 디코딩 루프가 기다린 횟수
+  uint64_t consumer_stalls;
+  bool running;
+  bool finished;
+  bool stop;
+  int error;
+};
+
+// 명령행에서 지정한 스트림 선택 조건
+// nullptr이면 해당 타입의 첫 번째 스트림, "none"이면 사용하지 않음,
+// 숫자면 스트림 인덱스, 그 외에는 language 메타데이터(예: eng, kor)로 선택
+struct StreamSelection {
+  const char* video;
+  const char* audio;
+  // 선택하지 않은 스트림을 디먹서 단계에서 버릴지 여부 (--no-discard로 비교 가능)
+  bool discard;
+};
+
 FileContext input_file_ctx;
+DemuxThread demux_thread;
 FilterContext video_filter_ctx, audio_filter_ctx;
+FilterWorker video_filter_worker, audio_filter_worker;
+// 면적이 큰 순서로 정렬한 ABR 래더 (지정하지 않으면 dst_width x dst_height 하나)
+std::vector<Rendition> renditions;
+VideoScaler video_scaler;
+TensorConverter tensor_converter;
+AudioResampler audio_resampler;
+ResampleBenchmark resample_benchmark;
 
 const int dst_width = 480;
 const int dst_height = 320;
 const int64_t dst_ch_layout = AV_CH_LAYOUT_MONO;
 const int dst_sample_rate = 32000;
-
-int open_input(const char* filename);
+const AVSampleFormat dst_sample_fmt = AV_SAMPLE_FMT_FLTP;
+
+// 결과 프레임의 줄 간격과 버퍼 시작 주소 정렬 단위
+const int frame_alignment = 64;
+
+// 디코더가 같은 에러를 계속 반환할 때 무한 반복하지 않도록 연속으로 건너뛰는 프레임 수를 제한
+const int max_decode_errors = 16;
+
+// 텐서 정규화 값 (ImageNet으로 학습한 모델의 평균과 표준편차, R, G, B 순서)
+const float tensor_mean[3] = {0.485f, 0.456f, 0.406f};
+const float tensor_std[3] = {0.229f, 0.224f, 0.225f};
+// 참조 구현과 비교해서 허용하는 최대 오차 (정규화한 값 기준)
+const double tensor_tolerance = 1e-3;
+
+int open_input(const char* filename, bool use_mmap, const StreamSelection& selection);
+bool match_stream(AVStream* av_stream, const char* spec);
+void discard_unused_streams(const StreamSelection& selection);
+void print_read_stats(int64_t packet_count, int64_t dropped_count);
+int open_mapped_input(const char* filename, MappedFile* mapped_file, AVIOContext** avio_ctx);
+int read_mapped_file(void* opaque, uint8_t* buf, int buf_size);
+int64_t seek_mapped_file(void* opaque, int64_t offset, int whence);
+void close_mapped_input(MappedFile* mapped_file, AVIOContext** avio_ctx);
+int start_demux_thread(int queue_size);
+void demux_loop();
+int read_packet(AVPacket* av_packet);
+void stop_demux_thread();
+void print_demux_stats();
 int open_decoder(AVCodecParameters* av_codec_params, AVCodecContext** av_codec_ctx);
-int decode_packet(AVCodecContext** av_codec_ctx, AVPacket* av_packet, AVFrame** av_frame);
-int init_video_filter();
-int init_audio_filter();
+int decode_packet(AVCodecContext* av_codec_ctx, AVPacket* av_packet, AVFrame* av_frame,
+                  FrameHandler handle_frame, void* opaque);
+int flush_decoders(AVFrame* av_frame, FrameHandler handle_frame, void* opaque);
+int filter_frame(AVCodecContext* av_codec_ctx, AVFrame* av_frame, void* opaque);
+int drain_filter(FilterContext* av_filter_ctx, AVFrame* filtered_frame);
+int drain_sink(AVFilterContext* sink_filter_ctx, Rendition* rendition, AVFrame* filtered_frame);
+int flush_filters(AVFrame* filtered_frame);
+int init_video_filter(const char* filter_desc, int thread_count);
+int init_audio_filter(FilterContext* av_filter_ctx, int thread_count, int chunk_size);
+int parse_ladder(const char* spec);
+void plan_ladder(int src_width, int src_height, bool cascade);
+int link_filter_outputs(AVFilterGraph* av_filter_graph, AVFilterContext* src_filter_ctx,
+                        const std::vector<AVFilterContext*>& dst_filter_ctxs, const char* name);
+void print_ladder_stats();
+void set_filter_threads(AVFilterGraph* av_filter_graph, int thread_count);
+int start_filter_worker(FilterWorker* worker, const char* name, FilterContext* av_filter_ctx,
+                        int queue_size);
+void filter_worker_loop(FilterWorker* worker);
+int queue_filter_frame(FilterWorker* worker, AVFrame* av_frame);
+int finish_filter_worker(FilterWorker* worker);
+void stop_filter_worker(FilterWorker* worker);
+void print_filter_worker_stats(FilterWorker* worker);
+int init_audio_resampler(AudioResampler* resampler, int chunk_size);
+int configure_audio_resampler(AudioResampler* resampler, const AVFrame* src_frame);
+int resample_audio_frame(AudioResampler* resampler, const AVFrame* src_frame, bool verbose);
+void emit_audio_chunk(AudioResampler* resampler, int nb_samples, bool verbose);
+void print_audio_resampler_stats();
+void release_audio_resampler(AudioResampler* resampler);
+int capture_audio_frame(const AVFrame* av_frame);
+void run_resample_benchmark(int chunk_size);
+void resample_benchmark_loop(bool use_graph, int chunk_size, ResampleResult* result);
+void release_resample_benchmark();
+int init_video_scaler(int thread_count);
+int configure_video_scaler(const AVFrame* src_frame);
+int scale_video_frame(const AVFrame* src_frame, AVFrame* dst_frame);
+void scale_slice(const ScaleSlice& slice, const AVFrame* src_frame, AVFrame* dst_frame);
+void video_scaler_loop(int thread_index);
+int benchmark_video_frame(AVFrame* av_frame, AVFrame* filtered_frame);
+AVBufferRef* allocate_scaler_buffer(void* opaque, int size);
+void free_scaler_buffer(void* opaque, uint8_t* data);
+void print_video_scaler_stats();
+void release_video_scaler();
+int parse_tensor_simd(const char* name);
+int init_tensor_converter(const char* simd_name);
+int configure_tensor_converter(const AVFrame* av_frame);
+void compute_tensor_taps(int src_size, int dst_size, std::vector<int>* index,
+                         std::vector<float>* weight);
+int convert_tensor_frame(AVFrame* av_frame);
+void run_tensor_kernel(int simd, const AVFrame* av_frame, float* tensor);
+template <int Format>
+void convert_tensor_scalar(const AVFrame* av_frame, float* tensor);
+#ifdef TENSOR_X86
+template <int Format>
+__attribute__((target("sse4.1"))) void convert_tensor_sse4(const AVFrame* av_frame,
+                                                           float* tensor);
+template <int Format>
+__attribute__((target("avx2,fma"))) void convert_tensor_avx2(const AVFrame* av_frame,
+                                                             float* tensor);
+#endif
+double validate_tensor(const AVFrame* av_frame, const float* tensor);
+void print_tensor_stats();
+void release_tensor_converter();
 void release();
 
 int main(int argc, const char** argv) {
@@ -43,24 +387,171 @@ int main(int argc, const char** argv) {
 
   if (argc < 2) {
     printf("Not enough arguments entered\n");
+    printf("usage: %s <input> [--mmap] [--read-ahead packets]\n", argv[0]);
+    printf("stream options: [--video index|lang|none] [--audio index|lang|none] "
+           "[--no-discard]\n");
+    printf("scale options: [--scaler graph|sws] [--scale-threads N] [--scale-bench]\n");
+    printf("tensor options: [--tensor] [--tensor-output file] [--tensor-simd scalar|sse4|avx2] "
+           "[--tensor-bench]\n");
+    printf("filter options: [--video-filter desc] [--filter-threads N] [--filter-workers] "
+           "[--filter-queue frames]\n");
+    printf("ladder options: [--ladder WxH,WxH,...] [--ladder-direct]\n");
+    printf("audio options: [--resampler graph|swr] [--audio-chunk samples] "
+           "[--resample-bench streams]\n");
+    return -1;
+  }
+
+  bool use_mmap = false;
+  StreamSelection selection;
+  selection.video = nullptr;
+  selection.audio = nullptr;
+  selection.discard = true;
+  int read_ahead = 0;
+  int scale_threads = 1;
+  const char* tensor_simd = nullptr;
+  const char* video_filter_desc = "null";
+  int filter_threads = 0;
+  bool filter_workers = false;
+  int filter_queue = 8;
+  const char* ladder = nullptr;
+  bool cascade = true;
+  int audio_chunk = 0;
+  for (int index = 2; index < argc; ++index) {
+    if (strcmp(argv[index], "--mmap") == 0) {
+      use_mmap = true;
+    } else if (strcmp(argv[index], "--video") == 0 && index + 1 < argc) {
+      selection.video = argv[++index];
+    } else if (strcmp(argv[index], "--audio") == 0 && index + 1 < argc) {
+      selection.audio = argv[++index];
+    } else if (strcmp(argv[index], "--no-discard") == 0) {
+      selection.discard = false;
+    } else if (strcmp(argv[index], "--read-ahead") == 0 && index + 1 < argc) {
+      read_ahead = atoi(argv[++index]);
+    } else if (strcmp(argv[index], "--scaler") == 0 && index + 1 < argc) {
+      video_scaler.enabled = strcmp(argv[++index], "sws") == 0;
+    } else if (strcmp(argv[index], "--scale-threads") == 0 && index + 1 < argc) {
+      scale_threads = atoi(argv[++index]);
+    } else if (strcmp(argv[index], "--scale-bench") == 0) {
+      video_scaler.enabled = true;
+      video_scaler.benchmark = true;
+    } else if (strcmp(argv[index], "--tensor") == 0) {
+      tensor_converter.enabled = true;
+    } else if (strcmp(argv[index], "--tensor-output") == 0 && index + 1 < argc) {
+      tensor_converter.enabled = true;
+      tensor_converter.output = argv[++index];
+    } else if (strcmp(argv[index], "--tensor-simd") == 0 && index + 1 < argc) {
+      tensor_simd = argv[++index];
+      if (parse_tensor_simd(tensor_simd) < 0) {
+        printf("Unknown tensor SIMD : %s\n", tensor_simd);
+        printf("usage: --tensor-simd scalar|sse4|avx2\n");
+        return -1;
+      }
+    } else if (strcmp(argv[index], "--tensor-bench") == 0) {
+      tensor_converter.enabled = true;
+      tensor_converter.benchmark = true;
+    } else if (strcmp(argv[index], "--video-filter") == 0 && index + 1 < argc) {
+      video_filter_desc = argv[++index];
+    } else if (strcmp(argv[index], "--filter-threads") == 0 && index + 1 < argc) {
+      filter_threads = atoi(argv[++index]);
+    } else if (strcmp(argv[index], "--filter-workers") == 0) {
+      filter_workers = true;
+    } else if (strcmp(argv[index], "--filter-queue") == 0 && index + 1 < argc) {
+      filter_workers = true;
+      filter_queue = atoi(argv[++index]);
+    } else if (strcmp(argv[index], "--ladder") == 0 && index + 1 < argc) {
+      ladder = argv[++index];
+    } else if (strcmp(argv[index], "--ladder-direct") == 0) {
+      cascade = false;
+    } else if (strcmp(argv[index], "--resampler") == 0 && index + 1 < argc) {
+      audio_resampler.enabled = strcmp(argv[++index], "swr") == 0;
+    } else if (strcmp(argv[index], "--audio-chunk") == 0 && index + 1 < argc) {
+      audio_chunk = atoi(argv[++index]);
+    } else if (strcmp(argv[index], "--resample-bench") == 0 && index + 1 < argc) {
+      resample_benchmark.streams = atoi(argv[++index]);
+    } else {
+      printf("Unknown option : %s\n", argv[index]);
+      return -1;
+    }
+  }
+
+  // 래더는 필터 그래프에서만 만들 수 있음
+  if (ladder && (video_scaler.enabled || tensor_converter.enabled)) {
+    printf("--ladder can't be used with --scaler sws, --scale-bench or --tensor\n");
+    return -1;
+  }
+
+  if (parse_ladder(ladder) < 0) {
+    printf("Invalid ladder : %s\n", ladder);
+    return -1;
+  }
+
+  if (open_input(argv[1], use_mmap, selection) < 0) {
+    release();
+    return -1;
+  }
+
+  if (input_file_ctx.v_index >= 0) {
+    plan_ladder(input_file_ctx.video_codec_ctx->width, input_file_ctx.video_codec_ctx->height,
+                cascade);
+  }
+
+  // 크기만 바꾸는 경우 swscale 경로를 사용할 수 있음 (벤치마크는 두 경로를 모두 준비)
+  // 텐서 변환은 크기 변경까지 직접 하므로 비디오 필터 그래프를 사용하지 않음
+  // 벤치마크는 두 경로가 같은 수의 스레드를 사용해야 비교할 수 있으므로 --scale-threads를 따름
+  bool use_graph = (!video_scaler.enabled || video_scaler.benchmark) && !tensor_converter.enabled;
+  int video_filter_threads = video_scaler.benchmark ? FFMAX(scale_threads, 1) : filter_threads;
+  if (input_file_ctx.v_index >= 0 && use_graph &&
+      init_video_filter(video_filter_desc, video_filter_threads) < 0) {
+    release();
     return -1;
   }
 
-  if (open_input(argv[1]) < 0) {
+  if (input_file_ctx.v_index >= 0 && video_scaler.enabled && !tensor_converter.enabled &&
+      init_video_scaler(scale_threads) < 0) {
     release();
     return -1;
   }
 
-  if (init_video_filter() < 0) {
+  if (input_file_ctx.v_index >= 0 && tensor_converter.enabled &&
+      init_tensor_converter(tensor_simd) < 0) {
     release();
     return -1;
   }
 
-  if (init_audio_filter() < 0) {
+  // 디코더의 frame_size는 0일 수 있으므로 그때는 1024 샘플씩 내보냄
+  if (input_file_ctx.a_index >= 0 && audio_chunk <= 0) {
+    audio_chunk = input_file_ctx.audio_codec_ctx->frame_size > 0
+                          ? input_file_ctx.audio_codec_ctx->frame_size
+                          : 1024;
+  }
+
+  if (input_file_ctx.a_index >= 0 && !audio_resampler.enabled &&
+      init_audio_filter(&audio_filter_ctx, filter_threads, audio_chunk) < 0) {
+    release();
+    return -1;
+  }
+
+  if (input_file_ctx.a_index >= 0 && audio_resampler.enabled &&
+      init_audio_resampler(&audio_resampler, audio_chunk) < 0) {
     release();
     return -1;
   }
 
+  // 필터 그래프마다 스레드를 따로 두면 디코딩, 비디오 필터, 오디오 필터가 동시에 진행됨
+  // (--scale-bench는 디코딩 스레드에서 필터 그래프를 직접 실행하므로 비디오 필터 스레드를 사용하지 않음)
+  if (filter_workers) {
+    if (video_filter_ctx.src_filter_ctx && !video_scaler.enabled &&
+        start_filter_worker(&video_filter_worker, "video", &video_filter_ctx, filter_queue) < 0) {
+      release();
+      return -1;
+    }
+    if (audio_filter_ctx.src_filter_ctx &&
+        start_filter_worker(&audio_filter_worker, "audio", &audio_filter_ctx, filter_queue) < 0) {
+      release();
+      return -1;
+    }
+  }
+
   AVFrame* decoded_frame = av_frame_alloc();
   if (!decoded_frame) {
     release();
@@ -74,65 +565,77 @@ int main(int argc, const char** argv) {
     return -1;
   }
 
+  // 디먹싱을 별도 스레드에서 미리 해두면 저장장치 지연이 디코딩을 멈추게 하지 않음
+  if (read_ahead > 0 && start_demux_thread(read_ahead) < 0) {
+    av_frame_free(&decoded_frame);
+    av_frame_free(&filtered_frame);
+    release();
+    return -1;
+  }
+
   AVPacket av_packet;
+  int64_t packet_count = 0;
+  int64_t dropped_count = 0;
+  int ret;
+
   while (true) {
-    int ret = av_read_frame(input_file_ctx.av_format_ctx, &av_packet);
+    ret = read_packet(&av_packet);
     if (ret == AVERROR_EOF) {
       printf("End of frame\n");
       break;
+    } else if (ret < 0) {
+      printf("Error occurred when reading packet\n");
+      break;
     }
+
+    ++packet_count;
+
+    // 선택하지 않은 스트림의 패킷은 디코딩하지 않음 (--no-discard를 사용한 경우에만 도달)
     if (av_packet.stream_index != input_file_ctx.v_index &&
         av_packet.stream_index != input_file_ctx.a_index) {
+      ++dropped_count;
       av_packet_unref(&av_packet);
       continue;
     }
 
     AVStream* av_stream = input_file_ctx.av_format_ctx->streams[av_packet.stream_index];
-    AVCodecContext** av_codec_ctx;
+    AVCodecContext* av_codec_ctx;
     if (av_packet.stream_index == input_file_ctx.v_index) {
-      av_codec_ctx = &(input_file_ctx.video_codec_ctx);
+      av_codec_ctx = input_file_ctx.video_codec_ctx;
     } else {
-      av_codec_ctx = &(input_file_ctx.audio_codec_ctx);
-    }
-
-    av_packet_rescale_ts(&av_packet, av_stream->time_base, (*av_codec_ctx)->time_base);
-
-    ret = decode_packet(av_codec_ctx, &av_packet, &decoded_frame);
-    if (ret >= 0) {
-      FilterContext* av_filter_ctx;
-      if (av_packet.stream_index == input_file_ctx.v_index) {
-        av_filter_ctx = &video_filter_ctx;
-        printf("[before] Video : resolution : %dx%d\n", decoded_frame->width,
-               decoded_frame->height);
-      } else {
-        av_filter_ctx = &audio_filter_ctx;
-        printf("[before] Audio : sample_rate : %d / channels : %d\n", decoded_frame->sample_rate,
-               decoded_frame->channels);
-      }
+      av_codec_ctx = input_file_ctx.audio_codec_ctx;
+    }
 
-      if (av_buffersrc_add_frame(av_filter_ctx->src_filter_ctx, decoded_frame) < 0) {
-        printf("Error occurred when putting frame into filter context\n");
-        break;
-      }
+    av_packet_rescale_ts(&av_packet, av_stream->time_base, av_codec_ctx->time_base);
 
-      while (true) {
-        if (av_buffersink_get_frame(av_filter_ctx->sink_filter_ctx, filtered_frame) < 0) {
-          break;
-        }
+    ret = decode_packet(av_codec_ctx, &av_packet, decoded_frame, filter_frame, filtered_frame);
+    av_packet_unref(&av_packet);
+    // 디코딩하지 못한 패킷은 decode_packet()이 건너뛰므로 음수면 더 진행할 수 없는 에러
+    if (ret < 0) {
+      break;
+    }
+  }
 
-        if (av_packet.stream_index == input_file_ctx.v_index) {
-          printf("[after] Video : resolution : %dx%d\n", filtered_frame->width,
-                 filtered_frame->height);
-        } else {
-          printf("[after] Audio : sample_rate : %d / channels : %d\n", filtered_frame->sample_rate,
-                 filtered_frame->channels);
-        }
+  // 파일을 끝까지 읽었으면 디코더와 필터 내부에 남아 있는 프레임을 모두 꺼냄
+  if (ret == AVERROR_EOF) {
+    ret = flush_decoders(decoded_frame, filter_frame, filtered_frame);
+  }
+  if (ret >= 0) {
+    ret = flush_filters(filtered_frame);
+  }
 
-        av_frame_unref(filtered_frame);
-      }
-      av_frame_unref(decoded_frame);
-    }
-    av_packet_unref(&av_packet);
+  print_read_stats(packet_count, dropped_count);
+  print_demux_stats();
+  print_video_scaler_stats();
+  print_tensor_stats();
+  print_filter_worker_stats(&video_filter_worker);
+  print_filter_worker_stats(&audio_filter_worker);
+  print_ladder_stats();
+  print_audio_resampler_stats();
+
+  // 디코딩이 끝난 후 모아둔 오디오 프레임으로 두 변환 경로를 비교
+  if (ret >= 0 && resample_benchmark.streams > 0) {
+    run_resample_benchmark(audio_chunk);
   }
 
   av_frame_free(&decoded_frame);
@@ -140,15 +643,29 @@ int main(int argc, const char** argv) {
 
   release();
 
-  return 0;
+  return ret < 0 ? -1 : 0;
 }
 
-int open_input(const char* filename) {
+int open_input(const char* filename, bool use_mmap, const StreamSelection& selection) {
   input_file_ctx.av_format_ctx = nullptr;
+  input_file_ctx.avio_ctx = nullptr;
   input_file_ctx.video_codec_ctx = nullptr;
   input_file_ctx.audio_codec_ctx = nullptr;
   input_file_ctx.v_index = input_file_ctx.a_index = -1;
 
+  // 기본 file 프로토콜 대신 mmap으로 매핑한 메모리에서 바로 읽는 AVIOContext를 사용
+  if (use_mmap) {
+    if (open_mapped_input(filename, &input_file_ctx.mapped_file, &input_file_ctx.avio_ctx) < 0) {
+      return -1;
+    }
+
+    input_file_ctx.av_format_ctx = avformat_alloc_context();
+    if (!input_file_ctx.av_format_ctx) {
+      return -1;
+    }
+    input_file_ctx.av_format_ctx->pb = input_file_ctx.avio_ctx;
+  }
+
   if (avformat_open_input(&(input_file_ctx.av_format_ctx), filename, nullptr, nullptr) < 0) {
     printf("Couldn't open input file %s\n", filename);
     return -1;
@@ -160,13 +677,16 @@ int open_input(const char* filename) {
   }
 
   for (int index = 0; index < input_file_ctx.av_format_ctx->nb_streams; ++index) {
-    AVCodecParameters* av_codec_params = input_file_ctx.av_format_ctx->streams[index]->codecpar;
-    if (av_codec_params->codec_type == AVMEDIA_TYPE_VIDEO && input_file_ctx.v_index < 0) {
+    AVStream* av_stream = input_file_ctx.av_format_ctx->streams[index];
+    AVCodecParameters* av_codec_params = av_stream->codecpar;
+    if (av_codec_params->codec_type == AVMEDIA_TYPE_VIDEO && input_file_ctx.v_index < 0 &&
+        match_stream(av_stream, selection.video)) {
       if (open_decoder(av_codec_params, &(input_file_ctx.video_codec_ctx)) < 0) {
         break;
       }
       input_file_ctx.v_index = index;
-    } else if (av_codec_params->codec_type == AVMEDIA_TYPE_AUDIO && input_file_ctx.a_index < 0) {
+    } else if (av_codec_params->codec_type == AVMEDIA_TYPE_AUDIO && input_file_ctx.a_index < 0 &&
+               match_stream(av_stream, selection.audio)) {
       if (open_decoder(av_codec_params, &(input_file_ctx.audio_codec_ctx)) < 0) {
         break;
       }
@@ -178,6 +698,8 @@ int open_input(const char* filename) {
     }
   }
 
+  discard_unused_streams(selection);
+
   return 0;
 }
 
@@ -207,28 +729,234 @@ int open_decoder(AVCodecParameters* av_codec_params, AVCodecContext** av_codec_c
   return 0;
 }
 
-int decode_packet(AVCodecContext** av_codec_ctx, AVPacket* av_packet, AVFrame** av_frame) {
-  int ret;
+// 패킷 하나를 디코딩하고 나오는 모든 프레임을 handle_frame으로 넘김
+// av_packet이 nullptr이면 디코더를 flush해서 내부에 남아 있는 프레임을 모두 꺼냄
+// 디코더는 다음 상태를 반복함
+// 1. 패킷을 보냄 (send) : 내부 버퍼가 가득 차면 EAGAIN을 반환하므로 프레임을 먼저 꺼낸 후 다시 보냄
+// 2. 프레임을 꺼냄 (receive) : 패킷 하나에서 프레임이 여러 개 나올 수 있으므로 EAGAIN이 나올 때까지 꺼냄
+// 3. 끝 (EOF) : flush한 후 모든 프레임을 꺼내면 AVERROR_EOF를 반환
+// 반환 값은 정상이면 0, flush가 끝나면 AVERROR_EOF, handle_frame이 실패하거나 메모리가 부족하면 음수
+// 코덱이 디코딩하지 못한 패킷이나 프레임은 건너뛰고 계속 진행하므로 에러로 반환하지 않음
+int decode_packet(AVCodecContext* av_codec_ctx, AVPacket* av_packet, AVFrame* av_frame,
+                  FrameHandler handle_frame, void* opaque) {
+  bool sent = false;
+  int error_count = 0;
 
-  ret = avcodec_send_packet(*av_codec_ctx, av_packet);
-  if (ret < 0) {
-    printf("Couldn't send AVPacket");
-    return ret;
+  while (true) {
+    if (!sent) {
+      int ret = avcodec_send_packet(av_codec_ctx, av_packet);
+      if (ret >= 0 || (ret == AVERROR_EOF && !av_packet)) {
+        // 이미 flush를 시작한 디코더에 다시 nullptr을 보내면 AVERROR_EOF가 나오지만 정상
+        sent = true;
+      } else if (ret == AVERROR(ENOMEM)) {
+        printf("Couldn't send AVPacket\n");
+        return ret;
+      } else if (ret != AVERROR(EAGAIN)) {
+        // 손상된 패킷은 건너뜀 (flush 중이면 더 꺼낼 프레임이 없는 것으로 봄)
+        printf("Couldn't send AVPacket, skipped\n");
+        return av_packet ? 0 : AVERROR_EOF;
+      }
+    }
+
+    int frame_count = 0;
+    int ret;
+    while (true) {
+      ret = avcodec_receive_frame(av_codec_ctx, av_frame);
+      if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF || ret == AVERROR(ENOMEM)) {
+        break;
+      }
+      ++frame_count;
+      if (ret < 0) {
+        // 디코딩 에러는 해당 프레임만 버리고 남은 프레임을 계속 꺼냄
+        // 에러가 계속 이어지면 이 패킷은 포기함 (flush 중이면 더 꺼낼 프레임이 없는 것으로 봄)
+        printf("Couldn't receive AVFrame, skipped\n");
+        if (++error_count >= max_decode_errors) {
+          printf("Too many decoding errors, packet skipped\n");
+          return av_packet ? 0 : AVERROR_EOF;
+        }
+        continue;
+      }
+      error_count = 0;
+
+      av_frame->pts = av_frame->best_effort_timestamp;
+      ret = handle_frame(av_codec_ctx, av_frame, opaque);
+      av_frame_unref(av_frame);
+      if (ret < 0) {
+        return ret;
+      }
+    }
+
+    if (ret == AVERROR_EOF) {
+      return sent ? AVERROR_EOF : AVERROR_BUG;
+    } else if (ret == AVERROR(ENOMEM)) {
+      printf("Couldn't receive AVFrame\n");
+      return ret;
+    }
+
+    if (sent) {
+      return 0;
+    }
+
+    // send와 receive가 모두 EAGAIN이면 디코더가 API 규칙을 어긴 것이므로 무한 반복하지 않음
+    if (frame_count == 0) {
+      printf("Decoder accepts neither packets nor returns frames\n");
+      return AVERROR_BUG;
+    }
   }
+}
 
-  ret = avcodec_receive_frame(*av_codec_ctx, *av_frame);
-  if (ret >= 0) {
-    (*av_frame)->pts = (*av_frame)->best_effort_timestamp;
+int flush_decoders(AVFrame* av_frame, FrameHandler handle_frame, void* opaque) {
+  AVCodecContext* av_codec_ctxs[] = {input_file_ctx.video_codec_ctx,
+                                     input_file_ctx.audio_codec_ctx};
+  for (AVCodecContext* av_codec_ctx : av_codec_ctxs) {
+    if (!av_codec_ctx) {
+      continue;
+    }
+
+    int ret = decode_packet(av_codec_ctx, nullptr, av_frame, handle_frame, opaque);
+    if (ret < 0 && ret != AVERROR_EOF) {
+      return ret;
+    }
   }
 
-  return ret;
+  return 0;
+}
+
+int filter_frame(AVCodecContext* av_codec_ctx, AVFrame* av_frame, void* opaque) {
+  AVFrame* filtered_frame = (AVFrame*) opaque;
+
+  FilterContext* av_filter_ctx;
+  if (av_codec_ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+    if (tensor_converter.enabled) {
+      return convert_tensor_frame(av_frame);
+    }
+    if (video_scaler.benchmark) {
+      return benchmark_video_frame(av_frame, filtered_frame);
+    }
+
+    av_filter_ctx = &video_filter_ctx;
+    printf("[before] Video : resolution : %dx%d\n", av_frame->width, av_frame->height);
+
+    if (video_scaler.enabled) {
+      int ret = scale_video_frame(av_frame, filtered_frame);
+      if (ret < 0) {
+        return ret;
+      }
+      printf("[after] Video : resolution : %dx%d\n", filtered_frame->width,
+             filtered_frame->height);
+      av_frame_unref(filtered_frame);
+      return 0;
+    }
+  } else {
+    av_filter_ctx = &audio_filter_ctx;
+    printf("[before] Audio : sample_rate : %d / channels : %d\n", av_frame->sample_rate,
+           av_frame->channels);
+
+    if (resample_benchmark.streams > 0 && capture_audio_frame(av_frame) < 0) {
+      return -1;
+    }
+    if (audio_resampler.enabled) {
+      return resample_audio_frame(&audio_resampler, av_frame, true);
+    }
+  }
+
+  FilterWorker* worker =
+          av_filter_ctx == &video_filter_ctx ? &video_filter_worker : &audio_filter_worker;
+  if (worker->running) {
+    return queue_filter_frame(worker, av_frame);
+  }
+
+  if (av_buffersrc_add_frame(av_filter_ctx->src_filter_ctx, av_frame) < 0) {
+    printf("Error occurred when putting frame into filter context\n");
+    return -1;
+  }
+
+  return drain_filter(av_filter_ctx, filtered_frame);
+}
+
+int drain_filter(FilterContext* av_filter_ctx, AVFrame* filtered_frame) {
+  if (av_filter_ctx != &video_filter_ctx) {
+    return drain_sink(av_filter_ctx->sink_filter_ctx, nullptr, filtered_frame);
+  }
+
+  // 필터 그래프는 여러 스레드에서 동시에 사용할 수 없으므로 래더의 버퍼 싱크를 차례대로 비움
+  // (scale 필터는 --filter-threads로 지정한 slice 스레드로 나눠서 처리)
+  for (Rendition& rendition : renditions) {
+    int ret = drain_sink(rendition.sink_filter_ctx, &rendition, filtered_frame);
+    if (ret < 0) {
+      return ret;
+    }
+  }
+
+  return 0;
+}
+
+int drain_sink(AVFilterContext* sink_filter_ctx, Rendition* rendition, AVFrame* filtered_frame) {
+  while (true) {
+    // 필터 그래프에 프레임이 더 필요하면 EAGAIN, 모두 꺼냈으면 AVERROR_EOF를 반환
+    int ret = av_buffersink_get_frame(sink_filter_ctx, filtered_frame);
+    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+      return 0;
+    } else if (ret < 0) {
+      printf("Error occurred when getting frame from filter context\n");
+      return ret;
+    }
+
+    if (rendition) {
+      ++rendition->frame_count;
+      printf("[after] Video : resolution : %dx%d\n", filtered_frame->width,
+             filtered_frame->height);
+    } else {
+      printf("[after] Audio : sample_rate : %d / channels : %d\n", filtered_frame->sample_rate,
+             filtered_frame->channels);
+    }
+
+    av_frame_unref(filtered_frame);
+  }
+}
+
+int flush_filters(AVFrame* filtered_frame) {
+  FilterContext* av_filter_ctxs[] = {&video_filter_ctx, &audio_filter_ctx};
+  for (FilterContext* av_filter_ctx : av_filter_ctxs) {
+    if (!av_filter_ctx->src_filter_ctx) {
+      continue;
+    }
+
+    // 필터 스레드를 사용하면 flush도 필터 스레드가 처리
+    FilterWorker* worker =
+            av_filter_ctx == &video_filter_ctx ? &video_filter_worker : &audio_filter_worker;
+    if (worker->running) {
+      int ret = finish_filter_worker(worker);
+      if (ret < 0) {
+        return ret;
+      }
+      continue;
+    }
+
+    // nullptr 프레임을 넣으면 필터 그래프가 버퍼링하고 있던 프레임을 내보냄
+    if (av_buffersrc_add_frame(av_filter_ctx->src_filter_ctx, nullptr) < 0) {
+      printf("Error occurred when flushing filter context\n");
+      return -1;
+    }
+
+    int ret = drain_filter(av_filter_ctx, filtered_frame);
+    if (ret < 0) {
+      return ret;
+    }
+  }
+
+
+  // swresample 경로는 SwrContext에 남은 샘플과 마지막 청크(chunk_size보다 짧을 수 있음)를 내보냄
+  if (audio_resampler.enabled) {
+    return resample_audio_frame(&audio_resampler, nullptr, true);
+  }
+  return 0;
 }
 
-int init_video_filter() {
+int init_video_filter(const char* filter_desc, int thread_count) {
   AVStream* av_stream = input_file_ctx.av_format_ctx->streams[input_file_ctx.v_index];
   AVCodecContext* av_codec_ctx = input_file_ctx.video_codec_ctx;
 
-  AVFilterContext* rescale_filter;
   AVFilterInOut* inputs;
   AVFilterInOut* outputs;
   char args[512];
@@ -242,7 +970,11 @@ int init_video_filter() {
     return -1;
   }
 
-  if (avfilter_graph_parse2(video_filter_ctx.av_filter_graph, "null", &inputs, &outputs) < 0) {
+  set_filter_threads(video_filter_ctx.av_filter_graph, thread_count);
+
+  // 입력과 출력이 하나씩인 필터 체인만 사용 가능 (예: yadif,hqdn3d)
+  if (avfilter_graph_parse2(video_filter_ctx.av_filter_graph, filter_desc, &inputs, &outputs) <
+      0) {
     printf("Failed to parse video filter graph\n");
     return -1;
   }
@@ -262,29 +994,57 @@ int init_video_filter() {
     return -1;
   }
 
-  if (avfilter_graph_create_filter(&video_filter_ctx.sink_filter_ctx,
-                                   avfilter_get_by_name("buffersink"), "out", nullptr, nullptr,
-                                   video_filter_ctx.av_filter_graph) < 0) {
-    printf("Failed to create video buffer sink\n");
-    return -1;
-  }
-
-  snprintf(args, sizeof(args), "%d:%d", dst_width, dst_height);
+  // 래더의 출력마다 scale 필터와 버퍼 싱크를 만듦
+  std::vector<AVFilterContext*> scale_filters(renditions.size());
+  for (int index = 0; index < (int) renditions.size(); ++index) {
+    Rendition& rendition = renditions[index];
+    char name[32];
+
+    snprintf(name, sizeof(name), "scale%d", index);
+    snprintf(args, sizeof(args), "%d:%d", rendition.width, rendition.height);
+    if (avfilter_graph_create_filter(&scale_filters[index], avfilter_get_by_name("scale"), name,
+                                     args, nullptr, video_filter_ctx.av_filter_graph) < 0) {
+      printf("Failed to create video scale filter\n");
+      return -1;
+    }
 
-  if (avfilter_graph_create_filter(&rescale_filter, avfilter_get_by_name("scale"), "scale", args,
-                                   nullptr, video_filter_ctx.av_filter_graph) < 0) {
-    printf("Failed to create video scale filter\n");
-    return -1;
+    snprintf(name, sizeof(name), "out%d", index);
+    if (avfilter_graph_create_filter(&rendition.sink_filter_ctx,
+                                     avfilter_get_by_name("buffersink"), name, nullptr, nullptr,
+                                     video_filter_ctx.av_filter_graph) < 0) {
+      printf("Failed to create video buffer sink\n");
+      return -1;
+    }
   }
+  video_filter_ctx.sink_filter_ctx = renditions[0].sink_filter_ctx;
 
-  if (avfilter_link(outputs->filter_ctx, 0, rescale_filter, 0) < 0) {
-    printf("Failed to link video format filter\n");
+  // 원본을 직접 줄이는 출력들은 필터 체인의 출력을 split 필터로 나눠서 받음
+  std::vector<AVFilterContext*> dst_filter_ctxs;
+  for (int index = 0; index < (int) renditions.size(); ++index) {
+    if (renditions[index].source < 0) {
+      dst_filter_ctxs.push_back(scale_filters[index]);
+    }
+  }
+  if (link_filter_outputs(video_filter_ctx.av_filter_graph, outputs->filter_ctx, dst_filter_ctxs,
+                          "split") < 0) {
     return -1;
   }
 
-  if (avfilter_link(rescale_filter, 0, video_filter_ctx.sink_filter_ctx, 0) < 0) {
-    printf("Failed to link video format filter\n");
-    return -1;
+  // 각 출력의 결과는 자신의 버퍼 싱크와 이 출력에서 다시 줄이는 더 작은 출력들이 나눠 받음
+  for (int index = 0; index < (int) renditions.size(); ++index) {
+    char name[32];
+    snprintf(name, sizeof(name), "split%d", index);
+
+    dst_filter_ctxs.assign(1, renditions[index].sink_filter_ctx);
+    for (int child = index + 1; child < (int) renditions.size(); ++child) {
+      if (renditions[child].source == index) {
+        dst_filter_ctxs.push_back(scale_filters[child]);
+      }
+    }
+    if (link_filter_outputs(video_filter_ctx.av_filter_graph, scale_filters[index],
+                            dst_filter_ctxs, name) < 0) {
+      return -1;
+    }
   }
 
   if (avfilter_graph_config(video_filter_ctx.av_filter_graph, nullptr) < 0) {
@@ -292,15 +1052,13 @@ int init_video_filter() {
     return -1;
   }
 
-  av_buffersink_set_frame_size(video_filter_ctx.sink_filter_ctx, av_codec_ctx->frame_size);
-
   avfilter_inout_free(&inputs);
   avfilter_inout_free(&outputs);
 
   return 1;
 }
 
-int init_audio_filter() {
+int init_audio_filter(FilterContext* av_filter_ctx, int thread_count, int chunk_size) {
   AVStream* av_stream = input_file_ctx.av_format_ctx->streams[input_file_ctx.a_index];
   AVCodecContext* av_codec_ctx = input_file_ctx.audio_codec_ctx;
 
@@ -309,48 +1067,55 @@ int init_audio_filter() {
   AVFilterInOut* outputs;
   char args[512];
 
-  audio_filter_ctx.av_filter_graph = nullptr;
-  audio_filter_ctx.src_filter_ctx = nullptr;
-  audio_filter_ctx.sink_filter_ctx = nullptr;
+  av_filter_ctx->av_filter_graph = nullptr;
+  av_filter_ctx->src_filter_ctx = nullptr;
+  av_filter_ctx->sink_filter_ctx = nullptr;
 
-  audio_filter_ctx.av_filter_graph = avfilter_graph_alloc();
-  if (!audio_filter_ctx.av_filter_graph) {
+  av_filter_ctx->av_filter_graph = avfilter_graph_alloc();
+  if (!av_filter_ctx->av_filter_graph) {
     return -1;
   }
 
-  if (avfilter_graph_parse2(audio_filter_ctx.av_filter_graph, "anull", &inputs, &outputs) < 0) {
+  set_filter_threads(av_filter_ctx->av_filter_graph, thread_count);
+
+  if (avfilter_graph_parse2(av_filter_ctx->av_filter_graph, "anull", &inputs, &outputs) < 0) {
     printf("Failed to parse audio filter graph\n");
     return -1;
   }
 
-  snprintf(args, sizeof(args), "time_base=%d/%d:sample_rate=%d:sample_fmt=%s:channel_layout=0x%llu",
+  uint64_t channel_layout = av_codec_ctx->channel_layout
+                                    ? av_codec_ctx->channel_layout
+                                    : av_get_default_channel_layout(av_codec_ctx->channels);
+  snprintf(args, sizeof(args),
+           "time_base=%d/%d:sample_rate=%d:sample_fmt=%s:channel_layout=0x%" PRIx64,
            av_stream->time_base.num, av_stream->time_base.den, av_codec_ctx->sample_rate,
-           av_get_sample_fmt_name(av_codec_ctx->sample_fmt), av_codec_ctx->channel_layout);
+           av_get_sample_fmt_name(av_codec_ctx->sample_fmt), channel_layout);
 
-  if (avfilter_graph_create_filter(&audio_filter_ctx.src_filter_ctx,
+  if (avfilter_graph_create_filter(&av_filter_ctx->src_filter_ctx,
                                    avfilter_get_by_name("abuffer"), "in", args, nullptr,
-                                   audio_filter_ctx.av_filter_graph) < 0) {
+                                   av_filter_ctx->av_filter_graph) < 0) {
     printf("Failed to create audio buffer source\n");
     return -1;
   }
 
-  if (avfilter_link(audio_filter_ctx.src_filter_ctx, 0, inputs->filter_ctx, 0) < 0) {
+  if (avfilter_link(av_filter_ctx->src_filter_ctx, 0, inputs->filter_ctx, 0) < 0) {
     printf("Failed to link audio buffer source\n");
     return -1;
   }
 
-  if (avfilter_graph_create_filter(&audio_filter_ctx.sink_filter_ctx,
+  if (avfilter_graph_create_filter(&av_filter_ctx->sink_filter_ctx,
                                    avfilter_get_by_name("abuffersink"), "out", nullptr, nullptr,
-                                   audio_filter_ctx.av_filter_graph) < 0) {
+                                   av_filter_ctx->av_filter_graph) < 0) {
     printf("Failed to create audio buffer sink\n");
     return -1;
   }
 
-  snprintf(args, sizeof(args), "sample_rates=%d:channel_layouts=0x%llu", dst_sample_rate,
-           dst_ch_layout);
+  // swresample 경로와 같은 결과가 나오도록 샘플 포맷도 지정
+  snprintf(args, sizeof(args), "sample_fmts=%s:sample_rates=%d:channel_layouts=0x%" PRIx64,
+           av_get_sample_fmt_name(dst_sample_fmt), dst_sample_rate, (uint64_t) dst_ch_layout);
 
   if (avfilter_graph_create_filter(&resample_filter, avfilter_get_by_name("aformat"), "aformat",
-                                   args, nullptr, audio_filter_ctx.av_filter_graph) < 0) {
+                                   args, nullptr, av_filter_ctx->av_filter_graph) < 0) {
     printf("Failed to create audio format filter\n");
     return -1;
   }
@@ -360,17 +1125,18 @@ int init_audio_filter() {
     return -1;
   }
 
-  if (avfilter_link(resample_filter, 0, audio_filter_ctx.sink_filter_ctx, 0) < 0) {
+  if (avfilter_link(resample_filter, 0, av_filter_ctx->sink_filter_ctx, 0) < 0) {
     printf("Failed to link audio format filter\n");
     return -1;
   }
 
-  if (avfilter_graph_config(audio_filter_ctx.av_filter_graph, nullptr) < 0) {
+  if (avfilter_graph_config(av_filter_ctx->av_filter_graph, nullptr) < 0) {
     printf("Failed to configure audio filter context\n");
     return -1;
   }
 
-  av_buffersink_set_frame_size(audio_filter_ctx.sink_filter_ctx, av_codec_ctx->frame_size);
+  // 버퍼 싱크가 chunk_size 샘플씩 잘라서 내보냄 (0이면 잘리지 않음)
+  av_buffersink_set_frame_size(av_filter_ctx->sink_filter_ctx, chunk_size);
 
   avfilter_inout_free(&inputs);
   avfilter_inout_free(&outputs);
@@ -378,24 +1144,1841 @@ int init_audio_filter() {
   return 1;
 }
 
-void release() {
-  if (input_file_ctx.av_format_ctx) {
-    avformat_close_input(&(input_file_ctx.av_format_ctx));
+int parse_ladder(const char* spec) {
+  renditions.clear();
+  if (!spec) {
+    renditions.push_back({dst_width, dst_height, -1, nullptr, 0});
+    return 0;
   }
 
-  if (input_file_ctx.video_codec_ctx) {
-    avcodec_close(input_file_ctx.video_codec_ctx);
+  // 쉼표로 구분한 WxH 목록 (예: 1920x1080,1280x720,854x480,640x360)
+  const char* cursor = spec;
+  while (*cursor) {
+    Rendition rendition = {0, 0, -1, nullptr, 0};
+    int length = 0;
+    if (sscanf(cursor, "%dx%d%n", &rendition.width, &rendition.height, &length) != 2 ||
+        rendition.width <= 0 || rendition.height <= 0) {
+      return -1;
+    }
+    renditions.push_back(rendition);
+
+    cursor += length;
+    if (*cursor == ',') {
+      ++cursor;
+    } else if (*cursor) {
+      return -1;
+    }
   }
 
-  if (input_file_ctx.audio_codec_ctx) {
-    avcodec_close(input_file_ctx.audio_codec_ctx);
+  if (renditions.empty()) {
+    return -1;
   }
 
-  if (video_filter_ctx.av_filter_graph) {
-    avfilter_graph_free(&(video_filter_ctx.av_filter_graph));
+  // 큰 출력부터 만들어야 작은 출력이 자신보다 큰 출력을 입력으로 사용할 수 있음
+  std::stable_sort(renditions.begin(), renditions.end(),
+                   [](const Rendition& a, const Rendition& b) {
+                     return (int64_t) a.width * a.height > (int64_t) b.width * b.height;
+                   });
+
+  return 0;
+}
+
+void plan_ladder(int src_width, int src_height, bool cascade) {
+  int64_t src_area = (int64_t) src_width * src_height;
+  for (int index = 0; index < (int) renditions.size(); ++index) {
+    Rendition& rendition = renditions[index];
+    rendition.source = -1;
+    if (!cascade) {
+      continue;
+    }
+
+    // scale 필터의 비용은 대부분 입력 크기에 비례하므로 원본보다 작으면서 가로, 세로 모두
+    // 이 출력 이상인 출력 중 가장 작은 것을 입력으로 사용 (없으면 원본을 직접 줄임)
+    for (int source = index - 1; source >= 0; --source) {
+      const Rendition& larger = renditions[source];
+      if (larger.width >= rendition.width && larger.height >= rendition.height &&
+          (int64_t) larger.width * larger.height < src_area) {
+        rendition.source = source;
+        break;
+      }
+    }
   }
 
-  if (audio_filter_ctx.av_filter_graph) {
-    avfilter_graph_free(&(audio_filter_ctx.av_filter_graph));
+  if (renditions.size() < 2) {
+    return;
+  }
+
+  for (const Rendition& rendition : renditions) {
+    if (rendition.source < 0) {
+      printf("ladder : %dx%d <- input %dx%d\n", rendition.width, rendition.height, src_width,
+             src_height);
+    } else {
+      printf("ladder : %dx%d <- %dx%d\n", rendition.width, rendition.height,
+             renditions[rendition.source].width, renditions[rendition.source].height);
+    }
+  }
+}
+
+int link_filter_outputs(AVFilterGraph* av_filter_graph, AVFilterContext* src_filter_ctx,
+                        const std::vector<AVFilterContext*>& dst_filter_ctxs, const char* name) {
+  if (dst_filter_ctxs.size() == 1) {
+    if (avfilter_link(src_filter_ctx, 0, dst_filter_ctxs[0], 0) < 0) {
+      printf("Failed to link video scale filter\n");
+      return -1;
+    }
+    return 0;
+  }
+
+  // split 필터는 프레임을 복사하지 않고 참조만 늘려서 모든 출력에 전달
+  AVFilterContext* split_filter;
+  char args[16];
+  snprintf(args, sizeof(args), "%d", (int) dst_filter_ctxs.size());
+  if (avfilter_graph_create_filter(&split_filter, avfilter_get_by_name("split"), name, args,
+                                   nullptr, av_filter_graph) < 0) {
+    printf("Failed to create video split filter\n");
+    return -1;
+  }
+
+  if (avfilter_link(src_filter_ctx, 0, split_filter, 0) < 0) {
+    printf("Failed to link video split filter\n");
+    return -1;
+  }
+
+  for (int index = 0; index < (int) dst_filter_ctxs.size(); ++index) {
+    if (avfilter_link(split_filter, index, dst_filter_ctxs[index], 0) < 0) {
+      printf("Failed to link video split filter\n");
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+void print_ladder_stats() {
+  if (renditions.size() < 2 || !video_filter_ctx.src_filter_ctx) {
+    return;
   }
+
+  for (const Rendition& rendition : renditions) {
+    printf("rendition %dx%d : %lld frames\n", rendition.width, rendition.height,
+           (long long) rendition.frame_count);
+  }
+}
+
+void set_filter_threads(AVFilterGraph* av_filter_graph, int thread_count) {
+  // slice 스레딩을 지원하는 필터(yadif, scale 등)는 프레임 하나를 여러 스레드가 나눠서 처리
+  // 0이면 CPU 코어 수만큼 사용하고 1이면 스레드를 사용하지 않음
+  av_filter_graph->nb_threads = FFMAX(thread_count, 0);
+  av_filter_graph->thread_type = thread_count == 1 ? 0 : AVFILTER_THREAD_SLICE;
+}
+
+int start_filter_worker(FilterWorker* worker, const char* name, FilterContext* av_filter_ctx,
+                        int queue_size) {
+  worker->name = name;
+  worker->filter_ctx = av_filter_ctx;
+  worker->capacity = FFMAX(queue_size, 1);
+  worker->finished = false;
+  worker->stop = false;
+  worker->error = 0;
+  worker->peak_depth = 0;
+  worker->depth_sum = worker->queued_count = worker->producer_waits = 0;
+  worker->frame_count = 0;
+  worker->latency_sum = worker->latency_max = worker->process_time = 0;
+  worker->thread = std::thread(filter_worker_loop, worker);
+  worker->running = true;
+
+  return 0;
+}
+
+void filter_worker_loop(FilterWorker* worker) {
+  // 결과 프레임은 필터 스레드마다 따로 사용
+  AVFrame* filtered_frame = av_frame_alloc();
+  int ret = filtered_frame ? 0 : AVERROR(ENOMEM);
+
+  while (ret >= 0) {
+    std::unique_lock<std::mutex> lock(worker->mutex);
+    worker->not_empty.wait(lock, [&]() { return worker->stop || !worker->frames.empty(); });
+    if (worker->stop) {
+      break;
+    }
+
+    QueuedFrame queued = worker->frames.front();
+    worker->frames.pop_front();
+    lock.unlock();
+    worker->not_full.notify_one();
+
+    // nullptr 프레임을 넣으면 필터 그래프가 버퍼링하고 있던 프레임을 내보냄
+    bool flush = !queued.av_frame;
+    int64_t start_time = av_gettime_relative();
+    ret = av_buffersrc_add_frame(worker->filter_ctx->src_filter_ctx, queued.av_frame);
+    if (ret < 0) {
+      printf("Error occurred when putting frame into %s filter context\n", worker->name);
+    } else {
+      ret = drain_filter(worker->filter_ctx, filtered_frame);
+    }
+    av_frame_free(&queued.av_frame);
+    int64_t end_time = av_gettime_relative();
+
+    lock.lock();
+    if (!flush) {
+      ++worker->frame_count;
+    }
+    worker->latency_sum += end_time - queued.queued_time;
+    worker->latency_max = FFMAX(worker->latency_max, end_time - queued.queued_time);
+    worker->process_time += end_time - start_time;
+    lock.unlock();
+
+    if (flush) {
+      break;
+    }
+  }
+
+  av_frame_free(&filtered_frame);
+
+  std::lock_guard<std::mutex> lock(worker->mutex);
+  worker->finished = true;
+  worker->error = ret;
+  worker->not_full.notify_all();
+}
+
+int queue_filter_frame(FilterWorker* worker, AVFrame* av_frame) {
+  // 디코더가 다음 프레임에 같은 AVFrame 구조체를 사용하므로 참조만 새 프레임으로 옮김
+  AVFrame* queued_frame = nullptr;
+  if (av_frame) {
+    queued_frame = av_frame_alloc();
+    if (!queued_frame) {
+      return AVERROR(ENOMEM);
+    }
+    av_frame_move_ref(queued_frame, av_frame);
+  }
+
+  std::unique_lock<std::mutex> lock(worker->mutex);
+  if (worker->frames.size() >= worker->capacity && !worker->finished) {
+    ++worker->producer_waits;
+    worker->not_full.wait(
+            lock, [&]() { return worker->finished || worker->frames.size() < worker->capacity; });
+  }
+
+  // 필터 스레드가 오류로 끝났으면 더 이상 프레임을 받지 않음
+  if (worker->finished) {
+    int ret = worker->error < 0 ? worker->error : AVERROR_EOF;
+    lock.unlock();
+    av_frame_free(&queued_frame);
+    return ret;
+  }
+
+  worker->frames.push_back({queued_frame, av_gettime_relative()});
+  worker->peak_depth = FFMAX(worker->peak_depth, worker->frames.size());
+  worker->depth_sum += worker->frames.size();
+  ++worker->queued_count;
+
+  lock.unlock();
+  worker->not_empty.notify_one();
+
+  return 0;
+}
+
+int finish_filter_worker(FilterWorker* worker) {
+  int ret = queue_filter_frame(worker, nullptr);
+  worker->thread.join();
+  worker->running = false;
+
+  return ret < 0 ? ret : worker->error;
+}
+
+void stop_filter_worker(FilterWorker* worker) {
+  if (!worker->running) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    worker->stop = true;
+  }
+  worker->not_empty.notify_all();
+  worker->thread.join();
+  worker->running = false;
+
+  for (QueuedFrame& queued : worker->frames) {
+    av_frame_free(&queued.av_frame);
+  }
+  worker->frames.clear();
+}
+
+void print_filter_worker_stats(FilterWorker* worker) {
+  if (!worker->filter_ctx) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(worker->mutex);
+  if (worker->frame_count == 0) {
+    return;
+  }
+
+  printf("%s filter : %lld frames, latency avg %.1f us / max %lld us, processing %.1f us/frame\n",
+         worker->name, (long long) worker->frame_count,
+         (double) worker->latency_sum / worker->frame_count, (long long) worker->latency_max,
+         (double) worker->process_time / worker->frame_count);
+  printf("%s filter queue : capacity %zu, depth avg %.1f / peak %zu, producer waits %llu\n",
+         worker->name, worker->capacity,
+         worker->queued_count > 0 ? (double) worker->depth_sum / worker->queued_count : 0.0,
+         worker->peak_depth, (unsigned long long) worker->producer_waits);
+}
+
+int init_audio_resampler(AudioResampler* resampler, int chunk_size) {
+  resampler->swr_ctx = nullptr;
+  resampler->src_format = AV_SAMPLE_FMT_NONE;
+  resampler->src_sample_rate = 0;
+  resampler->src_channel_layout = 0;
+  resampler->chunk_size = chunk_size;
+  resampler->planes = nullptr;
+  resampler->plane_count = av_sample_fmt_is_planar(dst_sample_fmt)
+                                   ? av_get_channel_layout_nb_channels(dst_ch_layout)
+                                   : 1;
+  resampler->sample_bytes = av_get_bytes_per_sample(dst_sample_fmt) *
+                            (av_sample_fmt_is_planar(dst_sample_fmt)
+                                     ? 1
+                                     : av_get_channel_layout_nb_channels(dst_ch_layout));
+  resampler->capacity = 0;
+  resampler->read_pos = resampler->write_pos = resampler->count = 0;
+  resampler->chunk_count = resampler->sample_count = resampler->convert_time = 0;
+
+  resampler->chunk_frame = av_frame_alloc();
+  if (!resampler->chunk_frame) {
+    return -1;
+  }
+
+  return 0;
+}
+
+int configure_audio_resampler(AudioResampler* resampler, const AVFrame* src_frame) {
+  uint64_t channel_layout = src_frame->channel_layout
+                                    ? src_frame->channel_layout
+                                    : av_get_default_channel_layout(src_frame->channels);
+  if (resampler->swr_ctx && src_frame->format == resampler->src_format &&
+      src_frame->sample_rate == resampler->src_sample_rate &&
+      channel_layout == resampler->src_channel_layout) {
+    return 0;
+  }
+
+  // 입력 포맷이 바뀌면 SwrContext만 새로 만들고 링 버퍼에 변환해둔 샘플은 그대로 사용
+  swr_free(&resampler->swr_ctx);
+  resampler->swr_ctx = swr_alloc_set_opts(nullptr, dst_ch_layout, dst_sample_fmt, dst_sample_rate,
+                                          channel_layout, (AVSampleFormat) src_frame->format,
+                                          src_frame->sample_rate, 0, nullptr);
+  if (!resampler->swr_ctx || swr_init(resampler->swr_ctx) < 0) {
+    printf("Failed to create audio resampler\n");
+    return -1;
+  }
+
+  resampler->src_format = src_frame->format;
+  resampler->src_sample_rate = src_frame->sample_rate;
+  resampler->src_channel_layout = channel_layout;
+
+  // 프레임 하나를 변환한 결과와 다 채우지 못한 청크 하나가 함께 들어가는 크기
+  // (더 큰 프레임이 오면 링 버퍼에 들어가지 않는 샘플은 SwrContext가 보관했다가 다음에 꺼냄)
+  int max_samples = swr_get_out_samples(resampler->swr_ctx, src_frame->nb_samples);
+  int capacity = resampler->chunk_size *
+                 ((max_samples + 2 * resampler->chunk_size - 1) / resampler->chunk_size);
+  if (resampler->planes && (capacity <= resampler->capacity || resampler->count > 0)) {
+    return 0;
+  }
+
+  if (resampler->planes) {
+    av_freep(&resampler->planes[0]);
+    av_freep(&resampler->planes);
+  }
+  if (av_samples_alloc_array_and_samples(&resampler->planes, nullptr,
+                                         av_get_channel_layout_nb_channels(dst_ch_layout),
+                                         capacity, dst_sample_fmt, 0) < 0) {
+    printf("Couldn't allocate audio ring buffer\n");
+    return -1;
+  }
+  resampler->capacity = capacity;
+  resampler->read_pos = resampler->write_pos = 0;
+
+  if (resampler != &audio_resampler) {
+    return 0;
+  }
+  printf("swr resampler : %s %d Hz -> %s %d Hz, %d sample chunks, ring %d samples\n",
+         av_get_sample_fmt_name((AVSampleFormat) src_frame->format), src_frame->sample_rate,
+         av_get_sample_fmt_name(dst_sample_fmt), dst_sample_rate, resampler->chunk_size,
+         capacity);
+
+  return 0;
+}
+
+int resample_audio_frame(AudioResampler* resampler, const AVFrame* src_frame, bool verbose) {
+  if (src_frame) {
+    if (configure_audio_resampler(resampler, src_frame) < 0) {
+      return -1;
+    }
+  } else if (!resampler->swr_ctx) {
+    return 0;
+  }
+
+  int64_t start_time = av_gettime_relative();
+
+  // 입력이 nullptr이면 SwrContext 내부의 지연 샘플을 모두 내보냄
+  const uint8_t** input = src_frame ? (const uint8_t**) src_frame->extended_data : nullptr;
+  int input_count = src_frame ? src_frame->nb_samples : 0;
+  while (true) {
+    // 링 버퍼의 끝이나 아직 꺼내지 않은 샘플 앞까지만 연속해서 쓸 수 있음
+    int space = FFMIN(resampler->capacity - resampler->write_pos,
+                      resampler->capacity - resampler->count);
+    uint8_t* output[AV_NUM_DATA_POINTERS];
+    for (int plane = 0; plane < resampler->plane_count; ++plane) {
+      output[plane] = resampler->planes[plane] + resampler->write_pos * resampler->sample_bytes;
+    }
+
+    int ret = swr_convert(resampler->swr_ctx, output, space, input, input_count);
+    if (ret < 0) {
+      printf("Error occurred when resampling audio\n");
+      return ret;
+    }
+    // 입력은 한 번만 넘기고 이후에는 SwrContext가 보관한 샘플만 꺼냄
+    input_count = 0;
+
+    resampler->write_pos = (resampler->write_pos + ret) % resampler->capacity;
+    resampler->count += ret;
+    while (resampler->count >= resampler->chunk_size) {
+      emit_audio_chunk(resampler, resampler->chunk_size, verbose);
+    }
+
+    if (ret < space) {
+      break;
+    }
+  }
+
+  // 마지막 청크는 chunk_size보다 짧을 수 있음
+  if (!src_frame && resampler->count > 0) {
+    emit_audio_chunk(resampler, resampler->count, verbose);
+  }
+
+  resampler->convert_time += av_gettime_relative() - start_time;
+
+  return 0;
+}
+
+void emit_audio_chunk(AudioResampler* resampler, int nb_samples, bool verbose) {
+  // 청크 데이터는 복사하지 않고 링 버퍼를 가리킴
+  AVFrame* chunk_frame = resampler->chunk_frame;
+  for (int plane = 0; plane < resampler->plane_count; ++plane) {
+    chunk_frame->data[plane] =
+            resampler->planes[plane] + resampler->read_pos * resampler->sample_bytes;
+  }
+  chunk_frame->extended_data = chunk_frame->data;
+  chunk_frame->nb_samples = nb_samples;
+  chunk_frame->format = dst_sample_fmt;
+  chunk_frame->sample_rate = dst_sample_rate;
+  chunk_frame->channel_layout = dst_ch_layout;
+  chunk_frame->channels = av_get_channel_layout_nb_channels(dst_ch_layout);
+  // 타임 베이스는 1 / dst_sample_rate
+  chunk_frame->pts = resampler->sample_count;
+
+  resampler->read_pos = (resampler->read_pos + nb_samples) % resampler->capacity;
+  resampler->count -= nb_samples;
+  ++resampler->chunk_count;
+  resampler->sample_count += nb_samples;
+
+  if (verbose) {
+    printf("[after] Audio : sample_rate : %d / channels : %d\n", chunk_frame->sample_rate,
+           chunk_frame->channels);
+  }
+}
+
+void print_audio_resampler_stats() {
+  if (!audio_resampler.enabled || audio_resampler.chunk_count == 0) {
+    return;
+  }
+
+  printf("swr resampler : %lld chunks, %lld samples, %.1f Msamples/s\n",
+         (long long) audio_resampler.chunk_count, (long long) audio_resampler.sample_count,
+         audio_resampler.convert_time > 0
+                 ? (double) audio_resampler.sample_count / audio_resampler.convert_time
+                 : 0.0);
+}
+
+void release_audio_resampler(AudioResampler* resampler) {
+  swr_free(&resampler->swr_ctx);
+  if (resampler->planes) {
+    av_freep(&resampler->planes[0]);
+    av_freep(&resampler->planes);
+  }
+  // 청크 프레임의 data는 링 버퍼를 가리키므로 해제하지 않음
+  av_frame_free(&resampler->chunk_frame);
+}
+
+int capture_audio_frame(const AVFrame* av_frame) {
+  AVFrame* captured_frame = av_frame_clone(av_frame);
+  if (!captured_frame) {
+    return -1;
+  }
+  resample_benchmark.frames.push_back(captured_frame);
+
+  return 0;
+}
+
+void run_resample_benchmark(int chunk_size) {
+  if (resample_benchmark.frames.empty()) {
+    return;
+  }
+
+  // 스트림마다 변환기를 따로 만들고 같은 프레임들을 동시에 변환
+  double throughput[2];
+  const char* names[2] = {"graph", "swr"};
+  for (int path = 0; path < 2; ++path) {
+    std::vector<ResampleResult> results(resample_benchmark.streams);
+    std::vector<std::thread> threads;
+
+    int64_t start_time = av_gettime_relative();
+    for (ResampleResult& result : results) {
+      threads.emplace_back(resample_benchmark_loop, path == 0, chunk_size, &result);
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+    int64_t elapsed = av_gettime_relative() - start_time;
+
+    ResampleResult total = {0, 0, 0, 0, 0};
+    for (const ResampleResult& result : results) {
+      total.sample_count += result.sample_count;
+      total.chunk_count += result.chunk_count;
+      total.latency_sum += result.latency_sum;
+      total.latency_max = FFMAX(total.latency_max, result.latency_max);
+      total.error = total.error < 0 ? total.error : result.error;
+    }
+    if (total.error < 0) {
+      printf("resample bench %s : failed\n", names[path]);
+      return;
+    }
+
+    throughput[path] = elapsed > 0 ? (double) total.sample_count / elapsed : 0.0;
+    printf("resample bench %s : %d streams, %.1f Msamples/s, chunk latency avg %.1f us / max "
+           "%lld us\n",
+           names[path], resample_benchmark.streams, throughput[path],
+           total.chunk_count > 0 ? (double) total.latency_sum / total.chunk_count : 0.0,
+           (long long) total.latency_max);
+  }
+
+  printf("speedup : %.2fx\n", throughput[0] > 0 ? throughput[1] / throughput[0] : 0.0);
+}
+
+void resample_benchmark_loop(bool use_graph, int chunk_size, ResampleResult* result) {
+  result->sample_count = result->chunk_count = 0;
+  result->latency_sum = result->latency_max = 0;
+  result->error = 0;
+
+  FilterContext av_filter_ctx = {nullptr, nullptr, nullptr};
+  AudioResampler resampler;
+  AVFrame* filtered_frame = av_frame_alloc();
+  int ret = filtered_frame ? 0 : AVERROR(ENOMEM);
+  if (ret >= 0) {
+    ret = use_graph ? init_audio_filter(&av_filter_ctx, 1, chunk_size)
+                    : init_audio_resampler(&resampler, chunk_size);
+  }
+
+  // 마지막에 nullptr을 넣어서 남은 샘플까지 모두 꺼냄
+  for (size_t index = 0; ret >= 0 && index <= resample_benchmark.frames.size(); ++index) {
+    AVFrame* av_frame =
+            index < resample_benchmark.frames.size() ? resample_benchmark.frames[index] : nullptr;
+    int64_t chunk_count = 0;
+    int64_t start_time = av_gettime_relative();
+
+    if (use_graph) {
+      // 같은 프레임을 여러 스레드가 사용하므로 참조를 유지한 채로 넣음
+      ret = av_buffersrc_add_frame_flags(av_filter_ctx.src_filter_ctx, av_frame,
+                                         AV_BUFFERSRC_FLAG_KEEP_REF);
+      while (ret >= 0) {
+        ret = av_buffersink_get_frame(av_filter_ctx.sink_filter_ctx, filtered_frame);
+        if (ret >= 0) {
+          ++chunk_count;
+          result->sample_count += filtered_frame->nb_samples;
+          av_frame_unref(filtered_frame);
+        }
+      }
+      if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+        ret = 0;
+      }
+    } else {
+      int64_t previous_count = resampler.chunk_count;
+      int64_t previous_samples = resampler.sample_count;
+      ret = resample_audio_frame(&resampler, av_frame, false);
+      chunk_count = resampler.chunk_count - previous_count;
+      result->sample_count += resampler.sample_count - previous_samples;
+    }
+
+    int64_t latency = av_gettime_relative() - start_time;
+    if (chunk_count > 0) {
+      result->chunk_count += chunk_count;
+      result->latency_sum += latency * chunk_count;
+      result->latency_max = FFMAX(result->latency_max, latency);
+    }
+  }
+  result->error = ret < 0 ? ret : 0;
+
+  if (use_graph) {
+    avfilter_graph_free(&av_filter_ctx.av_filter_graph);
+  } else if (filtered_frame) {
+    release_audio_resampler(&resampler);
+  }
+  av_frame_free(&filtered_frame);
+}
+
+void release_resample_benchmark() {
+  for (AVFrame*& av_frame : resample_benchmark.frames) {
+    av_frame_free(&av_frame);
+  }
+  resample_benchmark.frames.clear();
+}
+
+int init_video_scaler(int thread_count) {
+  video_scaler.thread_count = FFMAX(thread_count, 1);
+  video_scaler.src_format = AV_PIX_FMT_NONE;
+  video_scaler.src_width = 0;
+  video_scaler.src_height = 0;
+  video_scaler.buffer_pool = nullptr;
+  video_scaler.generation = 0;
+  video_scaler.pending = 0;
+  video_scaler.stop = false;
+  video_scaler.frame_count = video_scaler.scale_time = 0;
+  video_scaler.graph_count = video_scaler.graph_time = 0;
+
+  // 스레드는 미리 만들어두고 프레임마다 깨우기만 함
+  for (int index = 1; index < video_scaler.thread_count; ++index) {
+    video_scaler.workers.push_back(std::thread(video_scaler_loop, index));
+  }
+  return 0;
+}
+
+int configure_video_scaler(const AVFrame* src_frame) {
+  if (src_frame->format == video_scaler.src_format && src_frame->width == video_scaler.src_width &&
+      src_frame->height == video_scaler.src_height) {
+    return 0;
+  }
+
+  // 필터 그래프의 scale 필터처럼 픽셀 포맷은 그대로 두고 크기만 바꿈
+  AVPixelFormat format = (AVPixelFormat) src_frame->format;
+  const AVPixFmtDescriptor* descriptor = av_pix_fmt_desc_get(format);
+  if (!descriptor || (descriptor->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+    printf("Couldn't scale pixel format %s\n", av_get_pix_fmt_name(format));
+    return -1;
+  }
+
+  // slice 경계가 원본과 결과에서 모두 정수 행이 되도록 높이의 최대공약수로 나눈 단위를 사용
+  // 크로마가 세로로 줄어든 포맷은 경계가 크로마 행과도 맞아야 함
+  // slice 경계의 필터 탭은 slice 안의 행만 사용하므로 비트 단위로 같은 결과가 필요하면 스레드 1개를 사용
+  int units = (int) av_gcd(src_frame->height, dst_height);
+  int src_unit = src_frame->height / units;
+  int dst_unit = dst_height / units;
+  int chroma_rows = 1 << descriptor->log2_chroma_h;
+  int multiple = 1;
+  while ((src_unit * multiple) % chroma_rows || (dst_unit * multiple) % chroma_rows) {
+    ++multiple;
+  }
+  units /= multiple;
+
+  // 팔레트 포맷은 plane 구조가 달라서 나누지 않고, 너무 얇은 slice는 경계의 비용이 더 큼
+  int slice_count = FFMIN(video_scaler.thread_count, FFMIN(units, dst_height / 16));
+  if (descriptor->flags & AV_PIX_FMT_FLAG_PAL) {
+    slice_count = 1;
+  }
+  slice_count = FFMAX(slice_count, 1);
+
+  std::vector<ScaleSlice> slices(slice_count);
+  for (int index = 0; index < slice_count; ++index) {
+    ScaleSlice& slice = slices[index];
+    int64_t first_unit = (int64_t) units * index / slice_count;
+    int64_t last_unit = (int64_t) units * (index + 1) / slice_count;
+    slice.src_y = (int) (first_unit * src_unit * multiple);
+    slice.dst_y = (int) (first_unit * dst_unit * multiple);
+    slice.src_height = index + 1 < slice_count
+                               ? (int) (last_unit * src_unit * multiple) - slice.src_y
+                               : src_frame->height - slice.src_y;
+    slice.dst_height = index + 1 < slice_count
+                               ? (int) (last_unit * dst_unit * multiple) - slice.dst_y
+                               : dst_height - slice.dst_y;
+
+    // 같은 크기의 slice를 다시 설정하는 경우 기존 SwsContext를 그대로 사용
+    SwsContext* cached = index < (int) video_scaler.slices.size()
+                                 ? video_scaler.slices[index].sws_ctx
+                                 : nullptr;
+    slice.sws_ctx = sws_getCachedContext(cached, src_frame->width, slice.src_height, format,
+                                         dst_width, slice.dst_height, format, SWS_BILINEAR,
+                                         nullptr, nullptr, nullptr);
+    if (index < (int) video_scaler.slices.size()) {
+      video_scaler.slices[index].sws_ctx = nullptr;
+    }
+    if (!slice.sws_ctx) {
+      printf("Couldn't create SwsContext\n");
+      for (ScaleSlice& created : slices) {
+        sws_freeContext(created.sws_ctx);
+      }
+      return -1;
+    }
+  }
+  for (ScaleSlice& old_slice : video_scaler.slices) {
+    sws_freeContext(old_slice.sws_ctx);
+  }
+  video_scaler.slices = slices;
+
+  // 결과 프레임의 모든 plane을 버퍼 하나에 담고 줄 간격을 64 byte 단위로 맞춤
+  // ptr에 nullptr을 넘기면 data에는 버퍼 시작 위치부터 각 plane까지의 거리가 들어감
+  if (av_image_fill_linesizes(video_scaler.linesizes, format, dst_width) < 0) {
+    return -1;
+  }
+  for (int plane = 0; plane < 4; ++plane) {
+    video_scaler.linesizes[plane] = FFALIGN(video_scaler.linesizes[plane], frame_alignment);
+  }
+  uint8_t* data[4];
+  int size = av_image_fill_pointers(data, format, dst_height, nullptr, video_scaler.linesizes);
+  if (size < 0) {
+    return -1;
+  }
+  for (int plane = 0; plane < 4; ++plane) {
+    video_scaler.offsets[plane] = (size_t) (uintptr_t) data[plane];
+  }
+
+  // 이전 풀의 버퍼를 사용하는 프레임이 남아 있어도 av_buffer_pool_uninit()은 안전함
+  av_buffer_pool_uninit(&video_scaler.buffer_pool);
+  video_scaler.buffer_pool =
+          av_buffer_pool_init2(size, nullptr, allocate_scaler_buffer, nullptr);
+  if (!video_scaler.buffer_pool) {
+    return AVERROR(ENOMEM);
+  }
+
+  video_scaler.src_format = src_frame->format;
+  video_scaler.src_width = src_frame->width;
+  video_scaler.src_height = src_frame->height;
+  printf("sws scaler : %dx%d -> %dx%d %s, %d slices\n", src_frame->width, src_frame->height,
+         dst_width, dst_height, av_get_pix_fmt_name(format), slice_count);
+  return 0;
+}
+
+int scale_video_frame(const AVFrame* src_frame, AVFrame* dst_frame) {
+  int64_t start_time = av_gettime_relative();
+  int ret = configure_video_scaler(src_frame);
+  if (ret < 0) {
+    return ret;
+  }
+
+  dst_frame->buf[0] = av_buffer_pool_get(video_scaler.buffer_pool);
+  if (!dst_frame->buf[0]) {
+    return AVERROR(ENOMEM);
+  }
+  for (int plane = 0; plane < 4; ++plane) {
+    dst_frame->linesize[plane] = video_scaler.linesizes[plane];
+    dst_frame->data[plane] = video_scaler.linesizes[plane]
+                                     ? dst_frame->buf[0]->data + video_scaler.offsets[plane]
+                                     : nullptr;
+  }
+  dst_frame->extended_data = dst_frame->data;
+  dst_frame->format = src_frame->format;
+  dst_frame->width = dst_width;
+  dst_frame->height = dst_height;
+  av_frame_copy_props(dst_frame, src_frame);
+
+  // scale 필터와 같이 화면 비율이 유지되도록 픽셀 비율을 바꿈
+  if (src_frame->sample_aspect_ratio.num) {
+    dst_frame->sample_aspect_ratio =
+            av_mul_q(av_make_q(dst_height * src_frame->width, dst_width * src_frame->height),
+                     src_frame->sample_aspect_ratio);
+  }
+
+  // slice는 스레드 번호 % 스레드 수로 나누어 맡고, 모든 스레드가 끝나야 반환
+  bool threaded = video_scaler.slices.size() > 1 && !video_scaler.workers.empty();
+  if (threaded) {
+    std::lock_guard<std::mutex> lock(video_scaler.mutex);
+    video_scaler.src_frame = src_frame;
+    video_scaler.dst_frame = dst_frame;
+    video_scaler.pending = (int) video_scaler.workers.size();
+    ++video_scaler.generation;
+    video_scaler.start.notify_all();
+  }
+
+  int step = threaded ? video_scaler.thread_count : 1;
+  for (size_t index = 0; index < video_scaler.slices.size(); index += step) {
+    scale_slice(video_scaler.slices[index], src_frame, dst_frame);
+  }
+
+  if (threaded) {
+    std::unique_lock<std::mutex> lock(video_scaler.mutex);
+    video_scaler.done.wait(lock, []() { return video_scaler.pending == 0; });
+  }
+
+  ++video_scaler.frame_count;
+  video_scaler.scale_time += av_gettime_relative() - start_time;
+  return 0;
+}
+
+void scale_slice(const ScaleSlice& slice, const AVFrame* src_frame, AVFrame* dst_frame) {
+  const AVPixFmtDescriptor* descriptor = av_pix_fmt_desc_get((AVPixelFormat) src_frame->format);
+  const uint8_t* src_data[4] = {nullptr};
+  uint8_t* dst_data[4] = {nullptr};
+
+  // 크로마 plane(1, 2)은 세로로 줄어든 만큼 시작 행도 줄어듦
+  for (int plane = 0; plane < 4; ++plane) {
+    int shift = (plane == 1 || plane == 2) ? descriptor->log2_chroma_h : 0;
+    if (src_frame->data[plane]) {
+      src_data[plane] = src_frame->data[plane] +
+                        (ptrdiff_t) (slice.src_y >> shift) * src_frame->linesize[plane];
+    }
+    if (dst_frame->data[plane]) {
+      dst_data[plane] = dst_frame->data[plane] +
+                        (ptrdiff_t) (slice.dst_y >> shift) * dst_frame->linesize[plane];
+    }
+  }
+
+  // 팔레트 포맷의 두 번째 plane은 팔레트이므로 행을 옮기지 않음
+  if (descriptor->flags & AV_PIX_FMT_FLAG_PAL) {
+    src_data[1] = src_frame->data[1];
+  }
+
+  sws_scale(slice.sws_ctx, src_data, src_frame->linesize, 0, slice.src_height, dst_data,
+            dst_frame->linesize);
+}
+
+void video_scaler_loop(int thread_index) {
+  uint64_t generation = 0;
+  while (true) {
+    std::unique_lock<std::mutex> lock(video_scaler.mutex);
+    video_scaler.start.wait(
+            lock, [&]() { return video_scaler.stop || video_scaler.generation != generation; });
+    if (video_scaler.stop) {
+      return;
+    }
+    generation = video_scaler.generation;
+    const AVFrame* src_frame = video_scaler.src_frame;
+    AVFrame* dst_frame = video_scaler.dst_frame;
+    lock.unlock();
+
+    for (size_t index = thread_index; index < video_scaler.slices.size();
+         index += video_scaler.thread_count) {
+      scale_slice(video_scaler.slices[index], src_frame, dst_frame);
+    }
+
+    lock.lock();
+    if (--video_scaler.pending == 0) {
+      video_scaler.done.notify_one();
+    }
+  }
+}
+
+int benchmark_video_frame(AVFrame* av_frame, AVFrame* filtered_frame) {
+  // 같은 프레임을 필터 그래프와 swscale 경로에 모두 통과시켜서 걸린 시간을 비교 (출력은 하지 않음)
+  int64_t start_time = av_gettime_relative();
+  if (av_buffersrc_add_frame_flags(video_filter_ctx.src_filter_ctx, av_frame,
+                                   AV_BUFFERSRC_FLAG_KEEP_REF) < 0) {
+    printf("Error occurred when putting frame into filter context\n");
+    return -1;
+  }
+  int ret;
+  while ((ret = av_buffersink_get_frame(video_filter_ctx.sink_filter_ctx, filtered_frame)) >= 0) {
+    ++video_scaler.graph_count;
+    av_frame_unref(filtered_frame);
+  }
+  if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+    printf("Error occurred when getting frame from filter context\n");
+    return ret;
+  }
+  video_scaler.graph_time += av_gettime_relative() - start_time;
+
+  ret = scale_video_frame(av_frame, filtered_frame);
+  av_frame_unref(filtered_frame);
+  return ret;
+}
+
+AVBufferRef* allocate_scaler_buffer(void* opaque, int size) {
+  void* data = nullptr;
+  if (posix_memalign(&data, frame_alignment, size) != 0) {
+    return nullptr;
+  }
+
+  AVBufferRef* buffer = av_buffer_create((uint8_t*) data, size, free_scaler_buffer, nullptr, 0);
+  if (!buffer) {
+    free(data);
+  }
+  return buffer;
+}
+
+void free_scaler_buffer(void* opaque, uint8_t* data) {
+  free(data);
+}
+
+void print_video_scaler_stats() {
+  if (!video_scaler.enabled || video_scaler.frame_count == 0) {
+    return;
+  }
+
+  printf("sws scaler : %lld frames, %.1f us/frame, %d threads\n",
+         (long long) video_scaler.frame_count,
+         (double) video_scaler.scale_time / video_scaler.frame_count, video_scaler.thread_count);
+  if (video_scaler.benchmark && video_scaler.graph_count > 0) {
+    double graph_per_frame = (double) video_scaler.graph_time / video_scaler.graph_count;
+    double scale_per_frame = (double) video_scaler.scale_time / video_scaler.frame_count;
+    printf("filter graph : %lld frames, %.1f us/frame, %d threads\n",
+           (long long) video_scaler.graph_count, graph_per_frame,
+           FFMAX(video_filter_ctx.av_filter_graph->nb_threads, 1));
+    printf("speedup : %.2fx\n", scale_per_frame > 0 ? graph_per_frame / scale_per_frame : 0.0);
+  }
+}
+
+void release_video_scaler() {
+  {
+    std::lock_guard<std::mutex> lock(video_scaler.mutex);
+    video_scaler.stop = true;
+  }
+  video_scaler.start.notify_all();
+  for (std::thread& worker : video_scaler.workers) {
+    worker.join();
+  }
+  video_scaler.workers.clear();
+
+  for (ScaleSlice& slice : video_scaler.slices) {
+    sws_freeContext(slice.sws_ctx);
+  }
+  video_scaler.slices.clear();
+
+  av_buffer_pool_uninit(&video_scaler.buffer_pool);
+}
+
+int parse_tensor_simd(const char* name) {
+  if (strcmp(name, "scalar") == 0) {
+    return TENSOR_SCALAR;
+  } else if (strcmp(name, "sse4") == 0) {
+    return TENSOR_SSE4;
+  } else if (strcmp(name, "avx2") == 0) {
+    return TENSOR_AVX2;
+  }
+  return -1;
+}
+
+int init_tensor_converter(const char* simd_name) {
+  // 지정하지 않으면 CPU가 지원하는 가장 넓은 명령어 집합을 사용
+  tensor_converter.simd = TENSOR_SCALAR;
+#ifdef TENSOR_X86
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    tensor_converter.simd = TENSOR_AVX2;
+  } else if (__builtin_cpu_supports("sse4.1")) {
+    tensor_converter.simd = TENSOR_SSE4;
+  }
+#endif
+  if (simd_name) {
+    int requested = parse_tensor_simd(simd_name);
+    if (requested > tensor_converter.simd) {
+      printf("%s is not supported on this CPU\n", simd_name);
+      return -1;
+    }
+    tensor_converter.simd = requested;
+  }
+
+  tensor_converter.src_format = AV_PIX_FMT_NONE;
+  tensor_converter.luma_row = nullptr;
+  tensor_converter.chroma_rows[0] = tensor_converter.chroma_rows[1] = nullptr;
+  tensor_converter.validated_count = 0;
+  for (int simd = 0; simd < TENSOR_SIMD_COUNT; ++simd) {
+    tensor_converter.frame_count[simd] = 0;
+    tensor_converter.convert_time[simd] = 0;
+    tensor_converter.max_error[simd] = 0;
+  }
+
+  // 텐서 하나는 3 x dst_height x dst_width 크기의 연속된 float 배열
+  size_t tensor_size = sizeof(float) * 3 * dst_width * dst_height;
+  void* tensor = nullptr;
+  if (posix_memalign(&tensor, frame_alignment, tensor_size) != 0) {
+    return AVERROR(ENOMEM);
+  }
+  tensor_converter.tensor = (float*) tensor;
+
+  // 텐서 파일은 프레임마다 텐서 하나를 그대로 이어서 씀
+  if (tensor_converter.output) {
+    tensor_converter.file = fopen(tensor_converter.output, "wb");
+    if (!tensor_converter.file) {
+      printf("Couldn't open tensor output %s\n", tensor_converter.output);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int configure_tensor_converter(const AVFrame* av_frame) {
+  if (av_frame->format == tensor_converter.src_format &&
+      av_frame->width == tensor_converter.src_width &&
+      av_frame->height == tensor_converter.src_height) {
+    return 0;
+  }
+
+  if (av_frame->format != AV_PIX_FMT_YUV420P && av_frame->format != AV_PIX_FMT_YUVJ420P &&
+      av_frame->format != AV_PIX_FMT_NV12) {
+    printf("Tensor conversion supports yuv420p and nv12 only (%s)\n",
+           av_get_pix_fmt_name((AVPixelFormat) av_frame->format));
+    return -1;
+  }
+
+  int chroma_width = (av_frame->width + 1) / 2;
+  int chroma_height = (av_frame->height + 1) / 2;
+  compute_tensor_taps(av_frame->width, dst_width, &tensor_converter.x_index,
+                      &tensor_converter.x_weight);
+  compute_tensor_taps(chroma_width, dst_width, &tensor_converter.chroma_x_index,
+                      &tensor_converter.chroma_x_weight);
+  compute_tensor_taps(av_frame->height, dst_height, &tensor_converter.y_index,
+                      &tensor_converter.y_weight);
+  compute_tensor_taps(chroma_height, dst_height, &tensor_converter.chroma_y_index,
+                      &tensor_converter.chroma_y_weight);
+
+  // 임시 행은 SIMD로 끝까지 읽을 수 있도록 여유를 두고, 오른쪽 끝의 다음 값은 마지막 값을 복사해서 채움
+  free(tensor_converter.luma_row);
+  free(tensor_converter.chroma_rows[0]);
+  free(tensor_converter.chroma_rows[1]);
+  void* rows[3] = {nullptr, nullptr, nullptr};
+  int row_sizes[3] = {av_frame->width, chroma_width * 2, chroma_width * 2};
+  for (int index = 0; index < 3; ++index) {
+    if (posix_memalign(&rows[index], frame_alignment, sizeof(float) * (row_sizes[index] + 16)) !=
+        0) {
+      rows[index] = nullptr;
+    }
+  }
+  tensor_converter.luma_row = (float*) rows[0];
+  tensor_converter.chroma_rows[0] = (float*) rows[1];
+  tensor_converter.chroma_rows[1] = (float*) rows[2];
+  if (!rows[0] || !rows[1] || !rows[2]) {
+    return AVERROR(ENOMEM);
+  }
+
+  // 색 공간은 BT.709와 BT.601(그 외 모두)을, 범위는 full(JPEG)과 limited(MPEG)를 구분
+  bool bt709 = av_frame->colorspace == AVCOL_SPC_BT709;
+  bool full_range = av_frame->color_range == AVCOL_RANGE_JPEG ||
+                    av_frame->format == AV_PIX_FMT_YUVJ420P;
+  double kr = bt709 ? 0.2126 : 0.299;
+  double kb = bt709 ? 0.0722 : 0.114;
+  double kg = 1 - kr - kb;
+  double chroma_scale = full_range ? 1.0 : 255.0 / 224.0;
+  tensor_converter.y_offset = full_range ? 0.0f : 16.0f;
+  tensor_converter.y_scale = full_range ? 1.0f : (float) (255.0 / 219.0);
+  tensor_converter.u_coef[0] = 0.0f;
+  tensor_converter.u_coef[1] = (float) (-2 * (1 - kb) * kb / kg * chroma_scale);
+  tensor_converter.u_coef[2] = (float) (2 * (1 - kb) * chroma_scale);
+  tensor_converter.v_coef[0] = (float) (2 * (1 - kr) * chroma_scale);
+  tensor_converter.v_coef[1] = (float) (-2 * (1 - kr) * kr / kg * chroma_scale);
+  tensor_converter.v_coef[2] = 0.0f;
+  for (int channel = 0; channel < 3; ++channel) {
+    tensor_converter.scale[channel] = 1.0f / (255.0f * tensor_std[channel]);
+    tensor_converter.bias[channel] = -tensor_mean[channel] / tensor_std[channel];
+  }
+
+  tensor_converter.validate_next = true;
+  tensor_converter.src_format = av_frame->format;
+  tensor_converter.src_width = av_frame->width;
+  tensor_converter.src_height = av_frame->height;
+  printf("tensor : %dx%d %s -> 1x3x%dx%d float32, %s, %s range\n", av_frame->width,
+         av_frame->height, av_get_pix_fmt_name((AVPixelFormat) av_frame->format), dst_height,
+         dst_width, bt709 ? "bt709" : "bt601", full_range ? "full" : "limited");
+  return 0;
+}
+
+// 출력 위치마다 bilinear 보간에 사용할 원본 위치(index, index + 1)와 index + 1의 가중치를 계산
+// 픽셀 중심을 맞추는 좌표 변환 (src = (dst + 0.5) * src_size / dst_size - 0.5)
+void compute_tensor_taps(int src_size, int dst_size, std::vector<int>* index,
+                         std::vector<float>* weight) {
+  index->resize(dst_size);
+  weight->resize(dst_size);
+  for (int position = 0; position < dst_size; ++position) {
+    double source = (position + 0.5) * src_size / dst_size - 0.5;
+    source = FFMIN(FFMAX(source, 0.0), (double) (src_size - 1));
+    int first = (int) source;
+    (*index)[position] = first;
+    (*weight)[position] = (float) (source - first);
+  }
+}
+
+int convert_tensor_frame(AVFrame* av_frame) {
+  int ret = configure_tensor_converter(av_frame);
+  if (ret < 0) {
+    return ret;
+  }
+
+  // 벤치마크는 사용할 수 있는 모든 명령어 집합으로 같은 프레임을 변환
+  // 참조 구현은 느리므로 설정이 바뀐 후 첫 프레임과 100 프레임마다 비교 (--tensor-bench가 아니어도 비교)
+  bool validate = tensor_converter.validate_next ||
+                  tensor_converter.frame_count[tensor_converter.simd] % 100 == 0;
+  tensor_converter.validate_next = false;
+  int first_simd = tensor_converter.benchmark ? TENSOR_SCALAR : tensor_converter.simd;
+  for (int simd = first_simd; simd <= tensor_converter.simd; ++simd) {
+    int64_t start_time = av_gettime_relative();
+    run_tensor_kernel(simd, av_frame, tensor_converter.tensor);
+    tensor_converter.convert_time[simd] += av_gettime_relative() - start_time;
+    ++tensor_converter.frame_count[simd];
+
+    if (validate) {
+      double error = validate_tensor(av_frame, tensor_converter.tensor);
+      tensor_converter.max_error[simd] = FFMAX(tensor_converter.max_error[simd], error);
+      ++tensor_converter.validated_count;
+      if (error > tensor_tolerance) {
+        printf("Tensor mismatch (%s) : max error %g\n",
+               simd == TENSOR_AVX2 ? "avx2" : simd == TENSOR_SSE4 ? "sse4" : "scalar", error);
+        return -1;
+      }
+    }
+  }
+
+  if (tensor_converter.file) {
+    size_t count = (size_t) 3 * dst_width * dst_height;
+    if (fwrite(tensor_converter.tensor, sizeof(float), count, tensor_converter.file) != count) {
+      printf("Couldn't write tensor\n");
+      return -1;
+    }
+  }
+
+  if (!tensor_converter.benchmark) {
+    printf("[after] Tensor : 1x3x%dx%d float32\n", dst_height, dst_width);
+  }
+  return 0;
+}
+
+void run_tensor_kernel(int simd, const AVFrame* av_frame, float* tensor) {
+  bool nv12 = av_frame->format == AV_PIX_FMT_NV12;
+#ifdef TENSOR_X86
+  if (simd == TENSOR_AVX2) {
+    nv12 ? convert_tensor_avx2<AV_PIX_FMT_NV12>(av_frame, tensor)
+         : convert_tensor_avx2<AV_PIX_FMT_YUV420P>(av_frame, tensor);
+    return;
+  } else if (simd == TENSOR_SSE4) {
+    nv12 ? convert_tensor_sse4<AV_PIX_FMT_NV12>(av_frame, tensor)
+         : convert_tensor_sse4<AV_PIX_FMT_YUV420P>(av_frame, tensor);
+    return;
+  }
+#endif
+  nv12 ? convert_tensor_scalar<AV_PIX_FMT_NV12>(av_frame, tensor)
+       : convert_tensor_scalar<AV_PIX_FMT_YUV420P>(av_frame, tensor);
+}
+
+// 입력 포맷별 chroma 구성 (컴파일 시점에 정해지므로 행 처리 코드에 분기가 없음)
+// yuv420p는 U, V가 각각의 plane에, nv12는 U, V가 번갈아 있는 plane 하나에 있음
+template <int Format>
+struct TensorFormat;
+
+template <>
+struct TensorFormat<AV_PIX_FMT_YUV420P> {
+  static const int chroma_planes = 2;
+  static const int chroma_step = 1;
+};
+
+template <>
+struct TensorFormat<AV_PIX_FMT_NV12> {
+  static const int chroma_planes = 1;
+  static const int chroma_step = 2;
+};
+
+// 두 행을 세로로 보간해서 float 행으로 만들고 오른쪽 끝 다음 값을 채움 (step은 한 픽셀의 값 수)
+inline void blend_tensor_rows_scalar(const uint8_t* top, const uint8_t* bottom, float weight,
+                                     int count, int step, float* row) {
+  for (int index = 0; index < count; ++index) {
+    row[index] = top[index] + (bottom[index] - top[index]) * weight;
+  }
+  for (int index = 0; index < step; ++index) {
+    row[count + index] = row[count - step + index];
+  }
+}
+
+// 세로 보간한 행에서 출력 위치 x의 Y, U, V를 가로로 보간한 후 정규화한 R, G, B를 씀
+template <int Format>
+inline void convert_tensor_pixel(int x, const float* u_row, const float* v_row, float* output,
+                                 size_t plane_size) {
+  const TensorConverter& converter = tensor_converter;
+  const int step = TensorFormat<Format>::chroma_step;
+  int luma_index = converter.x_index[x];
+  int chroma_index = converter.chroma_x_index[x] * step;
+  float luma_weight = converter.x_weight[x];
+  float chroma_weight = converter.chroma_x_weight[x];
+
+  float y = converter.luma_row[luma_index] +
+            (converter.luma_row[luma_index + 1] - converter.luma_row[luma_index]) * luma_weight;
+  float u = u_row[chroma_index] +
+            (u_row[chroma_index + step] - u_row[chroma_index]) * chroma_weight;
+  float v = v_row[chroma_index] +
+            (v_row[chroma_index + step] - v_row[chroma_index]) * chroma_weight;
+
+  y = (y - converter.y_offset) * converter.y_scale;
+  u -= 128.0f;
+  v -= 128.0f;
+  for (int channel = 0; channel < 3; ++channel) {
+    float value = y + converter.u_coef[channel] * u + converter.v_coef[channel] * v;
+    value = FFMIN(FFMAX(value, 0.0f), 255.0f);
+    output[channel * plane_size + x] = value * converter.scale[channel] + converter.bias[channel];
+  }
+}
+
+// 출력 행 하나의 세로 보간 (모든 구현이 같은 임시 행을 만듦)
+template <int Format>
+inline void blend_tensor_row(const AVFrame* av_frame, int dst_y,
+                             void (*blend)(const uint8_t*, const uint8_t*, float, int, int,
+                                           float*)) {
+  const TensorConverter& converter = tensor_converter;
+  int luma_top = converter.y_index[dst_y];
+  int luma_bottom = FFMIN(luma_top + 1, av_frame->height - 1);
+  blend(av_frame->data[0] + (ptrdiff_t) luma_top * av_frame->linesize[0],
+        av_frame->data[0] + (ptrdiff_t) luma_bottom * av_frame->linesize[0],
+        converter.y_weight[dst_y], av_frame->width, 1, converter.luma_row);
+
+  int chroma_width = (av_frame->width + 1) / 2;
+  int chroma_top = converter.chroma_y_index[dst_y];
+  int chroma_bottom = FFMIN(chroma_top + 1, (av_frame->height + 1) / 2 - 1);
+  for (int plane = 0; plane < TensorFormat<Format>::chroma_planes; ++plane) {
+    const uint8_t* data = av_frame->data[plane + 1];
+    int linesize = av_frame->linesize[plane + 1];
+    blend(data + (ptrdiff_t) chroma_top * linesize, data + (ptrdiff_t) chroma_bottom * linesize,
+          converter.chroma_y_weight[dst_y], chroma_width * TensorFormat<Format>::chroma_step,
+          TensorFormat<Format>::chroma_step, converter.chroma_rows[plane]);
+  }
+}
+
+template <int Format>
+void convert_tensor_scalar(const AVFrame* av_frame, float* tensor) {
+  const TensorConverter& converter = tensor_converter;
+  size_t plane_size = (size_t) dst_width * dst_height;
+  const float* u_row = converter.chroma_rows[0];
+  const float* v_row = TensorFormat<Format>::chroma_planes == 2 ? converter.chroma_rows[1]
+                                                                : converter.chroma_rows[0] + 1;
+
+  for (int dst_y = 0; dst_y < dst_height; ++dst_y) {
+    blend_tensor_row<Format>(av_frame, dst_y, blend_tensor_rows_scalar);
+    float* output = tensor + (size_t) dst_y * dst_width;
+    for (int x = 0; x < dst_width; ++x) {
+      convert_tensor_pixel<Format>(x, u_row, v_row, output, plane_size);
+    }
+  }
+}
+
+#ifdef TENSOR_X86
+__attribute__((target("sse4.1"))) void blend_tensor_rows_sse4(const uint8_t* top,
+                                                              const uint8_t* bottom, float weight,
+                                                              int count, int step, float* row) {
+  __m128 weights = _mm_set1_ps(weight);
+  int index = 0;
+  for (; index + 4 <= count; index += 4) {
+    int top_bytes, bottom_bytes;
+    memcpy(&top_bytes, top + index, 4);
+    memcpy(&bottom_bytes, bottom + index, 4);
+    __m128 top_values = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(top_bytes)));
+    __m128 bottom_values = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(bottom_bytes)));
+    _mm_storeu_ps(row + index,
+                  _mm_add_ps(top_values,
+                             _mm_mul_ps(_mm_sub_ps(bottom_values, top_values), weights)));
+  }
+  for (; index < count; ++index) {
+    row[index] = top[index] + (bottom[index] - top[index]) * weight;
+  }
+  for (index = 0; index < step; ++index) {
+    row[count + index] = row[count - step + index];
+  }
+}
+
+// SSE4에는 gather가 없으므로 4개 위치의 값을 직접 모은 후 보간과 색 변환을 4픽셀씩 함께 계산
+template <int Format>
+__attribute__((target("sse4.1"))) void convert_tensor_sse4(const AVFrame* av_frame,
+                                                           float* tensor) {
+  const TensorConverter& converter = tensor_converter;
+  const int step = TensorFormat<Format>::chroma_step;
+  size_t plane_size = (size_t) dst_width * dst_height;
+  const float* luma_row = converter.luma_row;
+  const float* u_row = converter.chroma_rows[0];
+  const float* v_row = TensorFormat<Format>::chroma_planes == 2 ? converter.chroma_rows[1]
+                                                                : converter.chroma_rows[0] + 1;
+  const __m128 y_offset = _mm_set1_ps(converter.y_offset);
+  const __m128 y_scale = _mm_set1_ps(converter.y_scale);
+  const __m128 chroma_offset = _mm_set1_ps(128.0f);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 max_value = _mm_set1_ps(255.0f);
+
+  for (int dst_y = 0; dst_y < dst_height; ++dst_y) {
+    blend_tensor_row<Format>(av_frame, dst_y, blend_tensor_rows_sse4);
+    float* output = tensor + (size_t) dst_y * dst_width;
+
+    int x = 0;
+    for (; x + 4 <= dst_width; x += 4) {
+      const int* luma_index = &converter.x_index[x];
+      const int* chroma_index = &converter.chroma_x_index[x];
+      __m128 y0 = _mm_setr_ps(luma_row[luma_index[0]], luma_row[luma_index[1]],
+                              luma_row[luma_index[2]], luma_row[luma_index[3]]);
+      __m128 y1 = _mm_setr_ps(luma_row[luma_index[0] + 1], luma_row[luma_index[1] + 1],
+                              luma_row[luma_index[2] + 1], luma_row[luma_index[3] + 1]);
+      __m128 u0 = _mm_setr_ps(u_row[chroma_index[0] * step], u_row[chroma_index[1] * step],
+                              u_row[chroma_index[2] * step], u_row[chroma_index[3] * step]);
+      __m128 u1 = _mm_setr_ps(u_row[(chroma_index[0] + 1) * step],
+                              u_row[(chroma_index[1] + 1) * step],
+                              u_row[(chroma_index[2] + 1) * step],
+                              u_row[(chroma_index[3] + 1) * step]);
+      __m128 v0 = _mm_setr_ps(v_row[chroma_index[0] * step], v_row[chroma_index[1] * step],
+                              v_row[chroma_index[2] * step], v_row[chroma_index[3] * step]);
+      __m128 v1 = _mm_setr_ps(v_row[(chroma_index[0] + 1) * step],
+                              v_row[(chroma_index[1] + 1) * step],
+                              v_row[(chroma_index[2] + 1) * step],
+                              v_row[(chroma_index[3] + 1) * step]);
+      __m128 luma_weight = _mm_loadu_ps(&converter.x_weight[x]);
+      __m128 chroma_weight = _mm_loadu_ps(&converter.chroma_x_weight[x]);
+
+      __m128 y = _mm_add_ps(y0, _mm_mul_ps(_mm_sub_ps(y1, y0), luma_weight));
+      __m128 u = _mm_add_ps(u0, _mm_mul_ps(_mm_sub_ps(u1, u0), chroma_weight));
+      __m128 v = _mm_add_ps(v0, _mm_mul_ps(_mm_sub_ps(v1, v0), chroma_weight));
+      y = _mm_mul_ps(_mm_sub_ps(y, y_offset), y_scale);
+      u = _mm_sub_ps(u, chroma_offset);
+      v = _mm_sub_ps(v, chroma_offset);
+
+      for (int channel = 0; channel < 3; ++channel) {
+        __m128 value =
+                _mm_add_ps(y, _mm_add_ps(_mm_mul_ps(u, _mm_set1_ps(converter.u_coef[channel])),
+                                         _mm_mul_ps(v, _mm_set1_ps(converter.v_coef[channel]))));
+        value = _mm_min_ps(_mm_max_ps(value, zero), max_value);
+        value = _mm_add_ps(_mm_mul_ps(value, _mm_set1_ps(converter.scale[channel])),
+                           _mm_set1_ps(converter.bias[channel]));
+        _mm_storeu_ps(output + channel * plane_size + x, value);
+      }
+    }
+    for (; x < dst_width; ++x) {
+      convert_tensor_pixel<Format>(x, u_row, v_row, output, plane_size);
+    }
+  }
+}
+
+__attribute__((target("avx2,fma"))) void blend_tensor_rows_avx2(const uint8_t* top,
+                                                                const uint8_t* bottom,
+                                                                float weight, int count, int step,
+                                                                float* row) {
+  __m256 weights = _mm256_set1_ps(weight);
+  int index = 0;
+  for (; index + 8 <= count; index += 8) {
+    __m256 top_values = _mm256_cvtepi32_ps(
+            _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) (top + index))));
+    __m256 bottom_values = _mm256_cvtepi32_ps(
+            _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) (bottom + index))));
+    _mm256_storeu_ps(row + index,
+                     _mm256_fmadd_ps(_mm256_sub_ps(bottom_values, top_values), weights,
+                                     top_values));
+  }
+  for (; index < count; ++index) {
+    row[index] = top[index] + (bottom[index] - top[index]) * weight;
+  }
+  for (index = 0; index < step; ++index) {
+    row[count + index] = row[count - step + index];
+  }
+}
+
+// AVX2는 gather로 8개 위치의 값을 한 번에 모으고 FMA로 보간과 정규화를 계산
+template <int Format>
+__attribute__((target("avx2,fma"))) void convert_tensor_avx2(const AVFrame* av_frame,
+                                                             float* tensor) {
+  const TensorConverter& converter = tensor_converter;
+  const int step = TensorFormat<Format>::chroma_step;
+  size_t plane_size = (size_t) dst_width * dst_height;
+  const float* luma_row = converter.luma_row;
+  const float* u_row = converter.chroma_rows[0];
+  const float* v_row = TensorFormat<Format>::chroma_planes == 2 ? converter.chroma_rows[1]
+                                                                : converter.chroma_rows[0] + 1;
+  const __m256 y_offset = _mm256_set1_ps(converter.y_offset);
+  const __m256 y_scale = _mm256_set1_ps(converter.y_scale);
+  const __m256 chroma_offset = _mm256_set1_ps(128.0f);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 max_value = _mm256_set1_ps(255.0f);
+  __m256 u_coef[3], v_coef[3], scale[3], bias[3];
+  for (int channel = 0; channel < 3; ++channel) {
+    u_coef[channel] = _mm256_set1_ps(converter.u_coef[channel]);
+    v_coef[channel] = _mm256_set1_ps(converter.v_coef[channel]);
+    scale[channel] = _mm256_set1_ps(converter.scale[channel]);
+    bias[channel] = _mm256_set1_ps(converter.bias[channel]);
+  }
+
+  for (int dst_y = 0; dst_y < dst_height; ++dst_y) {
+    blend_tensor_row<Format>(av_frame, dst_y, blend_tensor_rows_avx2);
+    float* output = tensor + (size_t) dst_y * dst_width;
+
+    int x = 0;
+    for (; x + 8 <= dst_width; x += 8) {
+      __m256i luma_index = _mm256_loadu_si256((const __m256i*) &converter.x_index[x]);
+      __m256i chroma_index = _mm256_loadu_si256((const __m256i*) &converter.chroma_x_index[x]);
+      if (step == 2) {
+        chroma_index = _mm256_slli_epi32(chroma_index, 1);
+      }
+
+      __m256 y0 = _mm256_i32gather_ps(luma_row, luma_index, 4);
+      __m256 y1 = _mm256_i32gather_ps(luma_row + 1, luma_index, 4);
+      __m256 u0 = _mm256_i32gather_ps(u_row, chroma_index, 4);
+      __m256 u1 = _mm256_i32gather_ps(u_row + step, chroma_index, 4);
+      __m256 v0 = _mm256_i32gather_ps(v_row, chroma_index, 4);
+      __m256 v1 = _mm256_i32gather_ps(v_row + step, chroma_index, 4);
+      __m256 luma_weight = _mm256_loadu_ps(&converter.x_weight[x]);
+      __m256 chroma_weight = _mm256_loadu_ps(&converter.chroma_x_weight[x]);
+
+      __m256 y = _mm256_fmadd_ps(_mm256_sub_ps(y1, y0), luma_weight, y0);
+      __m256 u = _mm256_fmadd_ps(_mm256_sub_ps(u1, u0), chroma_weight, u0);
+      __m256 v = _mm256_fmadd_ps(_mm256_sub_ps(v1, v0), chroma_weight, v0);
+      y = _mm256_mul_ps(_mm256_sub_ps(y, y_offset), y_scale);
+      u = _mm256_sub_ps(u, chroma_offset);
+      v = _mm256_sub_ps(v, chroma_offset);
+
+      for (int channel = 0; channel < 3; ++channel) {
+        __m256 value = _mm256_fmadd_ps(u, u_coef[channel], _mm256_fmadd_ps(v, v_coef[channel], y));
+        value = _mm256_min_ps(_mm256_max_ps(value, zero), max_value);
+        _mm256_storeu_ps(output + channel * plane_size + x,
+                         _mm256_fmadd_ps(value, scale[channel], bias[channel]));
+      }
+    }
+    for (; x < dst_width; ++x) {
+      convert_tensor_pixel<Format>(x, u_row, v_row, output, plane_size);
+    }
+  }
+}
+#endif
+
+// 임시 행이나 SIMD 없이 픽셀마다 네 점을 직접 보간하는 참조 구현 (double로 계산)과 비교해서 최대 오차를 반환
+// 색 변환은 변환기가 계산한 계수를 사용하지 않고 BT.601/BT.709 규격의 변환 행렬을 그대로 사용
+double validate_tensor(const AVFrame* av_frame, const float* tensor) {
+  // [BT.601, BT.709][limited, full][R, G, B][Y, U, V]
+  // limited range는 Y에서 16을 뺀 후 곱하며 계수에 범위 확장(255/219, 255/224)이 포함되어 있음
+  static const double matrices[2][2][3][3] = {
+          {{{1.164384, 0.0, 1.596027}, {1.164384, -0.391762, -0.812968}, {1.164384, 2.017232, 0.0}},
+           {{1.0, 0.0, 1.402}, {1.0, -0.344136, -0.714136}, {1.0, 1.772, 0.0}}},
+          {{{1.164384, 0.0, 1.792741}, {1.164384, -0.213249, -0.532909}, {1.164384, 2.112402, 0.0}},
+           {{1.0, 0.0, 1.5748}, {1.0, -0.187324, -0.468124}, {1.0, 1.8556, 0.0}}},
+  };
+  bool bt709 = av_frame->colorspace == AVCOL_SPC_BT709;
+  bool full_range = av_frame->color_range == AVCOL_RANGE_JPEG ||
+                    av_frame->format == AV_PIX_FMT_YUVJ420P;
+  const double(*matrix)[3] = matrices[bt709][full_range];
+  double y_offset = full_range ? 0.0 : 16.0;
+
+  bool nv12 = av_frame->format == AV_PIX_FMT_NV12;
+  int chroma_width = (av_frame->width + 1) / 2;
+  int chroma_height = (av_frame->height + 1) / 2;
+  size_t plane_size = (size_t) dst_width * dst_height;
+
+  auto sample = [](const uint8_t* data, int linesize, int step, int width, int height, double x,
+                   double y) {
+    x = FFMIN(FFMAX(x, 0.0), (double) (width - 1));
+    y = FFMIN(FFMAX(y, 0.0), (double) (height - 1));
+    int x0 = (int) x, y0 = (int) y;
+    int x1 = FFMIN(x0 + 1, width - 1), y1 = FFMIN(y0 + 1, height - 1);
+    double wx = x - x0, wy = y - y0;
+    double top = data[y0 * linesize + x0 * step] * (1 - wx) + data[y0 * linesize + x1 * step] * wx;
+    double bottom =
+            data[y1 * linesize + x0 * step] * (1 - wx) + data[y1 * linesize + x1 * step] * wx;
+    return top * (1 - wy) + bottom * wy;
+  };
+
+  double max_error = 0;
+  for (int dst_y = 0; dst_y < dst_height; ++dst_y) {
+    for (int x = 0; x < dst_width; ++x) {
+      double luma_x = (x + 0.5) * av_frame->width / dst_width - 0.5;
+      double luma_y = (dst_y + 0.5) * av_frame->height / dst_height - 0.5;
+      double chroma_x = (x + 0.5) * chroma_width / dst_width - 0.5;
+      double chroma_y = (dst_y + 0.5) * chroma_height / dst_height - 0.5;
+
+      double y = sample(av_frame->data[0], av_frame->linesize[0], 1, av_frame->width,
+                        av_frame->height, luma_x, luma_y);
+      double u = nv12 ? sample(av_frame->data[1], av_frame->linesize[1], 2, chroma_width,
+                               chroma_height, chroma_x, chroma_y)
+                      : sample(av_frame->data[1], av_frame->linesize[1], 1, chroma_width,
+                               chroma_height, chroma_x, chroma_y);
+      double v = nv12 ? sample(av_frame->data[1] + 1, av_frame->linesize[1], 2, chroma_width,
+                               chroma_height, chroma_x, chroma_y)
+                      : sample(av_frame->data[2], av_frame->linesize[2], 1, chroma_width,
+                               chroma_height, chroma_x, chroma_y);
+
+      for (int channel = 0; channel < 3; ++channel) {
+        double value = matrix[channel][0] * (y - y_offset) + matrix[channel][1] * (u - 128) +
+                       matrix[channel][2] * (v - 128);
+        value = FFMIN(FFMAX(value, 0.0), 255.0);
+        double expected = (value / 255.0 - tensor_mean[channel]) / tensor_std[channel];
+        double actual = tensor[channel * plane_size + (size_t) dst_y * dst_width + x];
+        max_error = FFMAX(max_error, fabs(expected - actual));
+      }
+    }
+  }
+  return max_error;
+}
+
+void print_tensor_stats() {
+  if (!tensor_converter.enabled) {
+    return;
+  }
+
+  const char* names[TENSOR_SIMD_COUNT] = {"scalar", "sse4", "avx2"};
+  for (int simd = 0; simd < TENSOR_SIMD_COUNT; ++simd) {
+    int64_t frame_count = tensor_converter.frame_count[simd];
+    if (frame_count == 0) {
+      continue;
+    }
+    double elapsed = tensor_converter.convert_time[simd] / 1000000.0;
+    printf("tensor %-6s : %lld frames, %.1f frames/sec, %.1f us/frame", names[simd],
+           (long long) frame_count, elapsed > 0 ? frame_count / elapsed : 0.0,
+           (double) tensor_converter.convert_time[simd] / frame_count);
+    printf(", max error %.2g\n", tensor_converter.max_error[simd]);
+  }
+  if (tensor_converter.validated_count > 0) {
+    printf("tensor validation : %lld comparisons with the reference, tolerance %g\n",
+           (long long) tensor_converter.validated_count, tensor_tolerance);
+  }
+}
+
+void release_tensor_converter() {
+  if (tensor_converter.file) {
+    fclose(tensor_converter.file);
+    tensor_converter.file = nullptr;
+  }
+  free(tensor_converter.tensor);
+  free(tensor_converter.luma_row);
+  free(tensor_converter.chroma_rows[0]);
+  free(tensor_converter.chroma_rows[1]);
+  tensor_converter.tensor = tensor_converter.luma_row = nullptr;
+  tensor_converter.chroma_rows[0] = tensor_converter.chroma_rows[1] = nullptr;
+}
+
+bool match_stream(AVStream* av_stream, const char* spec) {
+  if (!spec) {
+    return true;
+  }
+
+  if (strcmp(spec, "none") == 0) {
+    return false;
+  }
+
+  if (spec[0] >= '0' && spec[0] <= '9') {
+    return av_stream->index == atoi(spec);
+  }
+
+  AVDictionaryEntry* language = av_dict_get(av_stream->metadata, "language", nullptr, 0);
+  return language && strcmp(language->value, spec) == 0;
+}
+
+void discard_unused_streams(const StreamSelection& selection) {
+  if (!selection.discard) {
+    return;
+  }
+
+  // AVDISCARD_ALL로 지정한 스트림은 디먹서가 패킷을 만들지 않으므로
+  // av_read_frame() 함수가 해당 패킷을 할당하거나 복사하지 않음
+  for (int index = 0; index < input_file_ctx.av_format_ctx->nb_streams; ++index) {
+    if (index != input_file_ctx.v_index && index != input_file_ctx.a_index) {
+      input_file_ctx.av_format_ctx->streams[index]->discard = AVDISCARD_ALL;
+    }
+  }
+}
+
+void print_read_stats(int64_t packet_count, int64_t dropped_count) {
+  AVIOContext* pb = input_file_ctx.av_format_ctx->pb;
+  printf("packets read : %lld (dropped %lld), bytes read : %lld\n", (long long) packet_count,
+         (long long) dropped_count, pb ? (long long) pb->bytes_read : -1LL);
+}
+
+int open_mapped_input(const char* filename, MappedFile* mapped_file, AVIOContext** avio_ctx) {
+  mapped_file->data = nullptr;
+  mapped_file->size = 0;
+  mapped_file->pos = 0;
+
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    printf("Couldn't open input file %s\n", filename);
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+    printf("Couldn't map empty or unknown size file %s\n", filename);
+    close(fd);
+    return -1;
+  }
+
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    printf("Couldn't map input file %s\n", filename);
+    return -1;
+  }
+
+  // 대부분 앞에서부터 순서대로 읽으므로 커널이 미리 읽어두도록 알림
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+  madvise(data, st.st_size, MADV_WILLNEED);
+
+  mapped_file->data = (uint8_t*) data;
+  mapped_file->size = st.st_size;
+
+  // AVIOContext 내부 버퍼는 av_malloc()으로 할당해야 하며 해제도 직접 해야 함
+  const int buffer_size = 32 * 1024;
+  uint8_t* buffer = (uint8_t*) av_malloc(buffer_size);
+  if (!buffer) {
+    return -1;
+  }
+
+  *avio_ctx = avio_alloc_context(buffer, buffer_size, 0, mapped_file, read_mapped_file, nullptr,
+                                 seek_mapped_file);
+  if (!*avio_ctx) {
+    av_free(buffer);
+    printf("Couldn't create AVIOContext\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+int read_mapped_file(void* opaque, uint8_t* buf, int buf_size) {
+  MappedFile* mapped_file = (MappedFile*) opaque;
+
+  int64_t remaining = mapped_file->size - mapped_file->pos;
+  if (remaining <= 0) {
+    return AVERROR_EOF;
+  }
+
+  // read() 시스템 콜 없이 매핑된 메모리에서 바로 복사
+  int size = (int) FFMIN((int64_t) buf_size, remaining);
+  memcpy(buf, mapped_file->data + mapped_file->pos, size);
+  mapped_file->pos += size;
+
+  return size;
+}
+
+int64_t seek_mapped_file(void* opaque, int64_t offset, int whence) {
+  MappedFile* mapped_file = (MappedFile*) opaque;
+
+  // AVSEEK_SIZE는 위치를 바꾸지 않고 파일 크기만 요청하는 경우
+  if (whence & AVSEEK_SIZE) {
+    return mapped_file->size;
+  }
+
+  int64_t pos;
+  switch (whence & ~AVSEEK_FORCE) {
+    case SEEK_SET:
+      pos = offset;
+      break;
+    case SEEK_CUR:
+      pos = mapped_file->pos + offset;
+      break;
+    case SEEK_END:
+      pos = mapped_file->size + offset;
+      break;
+    default:
+      return AVERROR(EINVAL);
+  }
+
+  if (pos < 0 || pos > mapped_file->size) {
+    return AVERROR(EINVAL);
+  }
+
+  // 임의 위치로 이동한 경우 이동한 위치부터 미리 읽어두도록 알림
+  if (pos != mapped_file->pos && pos < mapped_file->size) {
+    int64_t page_size = sysconf(_SC_PAGESIZE);
+    int64_t start = pos / page_size * page_size;
+    madvise(mapped_file->data + start, FFMIN(mapped_file->size - start, (int64_t) 4 << 20),
+            MADV_WILLNEED);
+  }
+
+  mapped_file->pos = pos;
+  return pos;
+}
+
+void close_mapped_input(MappedFile* mapped_file, AVIOContext** avio_ctx) {
+  if (*avio_ctx) {
+    av_freep(&(*avio_ctx)->buffer);
+    avio_context_free(avio_ctx);
+  }
+
+  if (mapped_file->data) {
+    munmap(mapped_file->data, mapped_file->size);
+    mapped_file->data = nullptr;
+  }
+}
+
+int start_demux_thread(int queue_size) {
+  AVFormatContext* av_format_ctx = input_file_ctx.av_format_ctx;
+
+  demux_thread.queues.resize(av_format_ctx->nb_streams);
+  for (int index = 0; index < av_format_ctx->nb_streams; ++index) {
+    PacketQueue& queue = demux_thread.queues[index];
+    queue.head = queue.count = queue.high_watermark = 0;
+    queue.producer_stalls = 0;
+
+    if (index != input_file_ctx.v_index && index != input_file_ctx.a_index) {
+      continue;
+    }
+
+    // 디코딩 루프에서 패킷을 주고받을 때 메모리를 할당하지 않도록 큐의 패킷을 미리 할당
+    queue.packets.resize(queue_size, nullptr);
+    queue.sequences.resize(queue_size, 0);
+    for (AVPacket*& av_packet : queue.packets) {
+      av_packet = av_packet_alloc();
+      if (!av_packet) {
+        printf("Couldn't allocate packet queue\n");
+        return -1;
+      }
+    }
+  }
+
+  demux_thread.next_sequence = 0;
+  demux_thread.consumer_stalls = 0;
+  demux_thread.finished = false;
+  demux_thread.stop = false;
+  demux_thread.error = 0;
+  demux_thread.thread = std::thread(demux_loop);
+  demux_thread.running = true;
+
+  return 0;
+}
+
+void demux_loop() {
+  AVPacket* av_packet = av_packet_alloc();
+  int ret = av_packet ? 0 : AVERROR(ENOMEM);
+
+  while (ret >= 0) {
+    ret = av_read_frame(input_file_ctx.av_format_ctx, av_packet);
+    if (ret < 0) {
+      break;
+    }
+
+    // 디코딩하지 않는 스트림의 패킷은 큐에 넣지 않음
+    if (av_packet->stream_index >= (int) demux_thread.queues.size() ||
+        demux_thread.queues[av_packet->stream_index].packets.empty()) {
+      av_packet_unref(av_packet);
+      continue;
+    }
+
+    PacketQueue& queue = demux_thread.queues[av_packet->stream_index];
+    std::unique_lock<std::mutex> lock(demux_thread.mutex);
+    if (queue.count == queue.packets.size()) {
+      ++queue.producer_stalls;
+      demux_thread.not_full.wait(
+              lock, [&]() { return demux_thread.stop || queue.count < queue.packets.size(); });
+    }
+
+    if (demux_thread.stop) {
+      av_packet_unref(av_packet);
+      break;
+    }
+
+    // 패킷 데이터는 복사하지 않고 참조만 미리 할당한 패킷으로 옮김
+    size_t slot = (queue.head + queue.count) % queue.packets.size();
+    av_packet_move_ref(queue.packets[slot], av_packet);
+    queue.sequences[slot] = demux_thread.next_sequence++;
+    ++queue.count;
+    queue.high_watermark = FFMAX(queue.high_watermark, queue.count);
+
+    lock.unlock();
+    demux_thread.not_empty.notify_one();
+  }
+
+  av_packet_free(&av_packet);
+
+  std::lock_guard<std::mutex> lock(demux_thread.mutex);
+  demux_thread.finished = true;
+  demux_thread.error = ret == AVERROR_EOF ? 0 : ret;
+  demux_thread.not_empty.notify_one();
+}
+
+int read_packet(AVPacket* av_packet) {
+  // 디먹싱 스레드를 사용하지 않으면 av_read_frame() 함수와 동일하게 동작
+  if (!demux_thread.running) {
+    return av_read_frame(input_file_ctx.av_format_ctx, av_packet);
+  }
+
+  std::unique_lock<std::mutex> lock(demux_thread.mutex);
+  while (true) {
+    // 스트림별 큐 중 가장 먼저 디먹싱한 패킷을 꺼내서 원래 순서를 유지
+    PacketQueue* oldest = nullptr;
+    for (PacketQueue& queue : demux_thread.queues) {
+      if (queue.count > 0 &&
+          (!oldest || queue.sequences[queue.head] < oldest->sequences[oldest->head])) {
+        oldest = &queue;
+      }
+    }
+
+    if (oldest) {
+      av_packet_move_ref(av_packet, oldest->packets[oldest->head]);
+      oldest->head = (oldest->head + 1) % oldest->packets.size();
+      --oldest->count;
+
+      lock.unlock();
+      demux_thread.not_full.notify_one();
+      return 0;
+    }
+
+    if (demux_thread.finished) {
+      return demux_thread.error < 0 ? demux_thread.error : AVERROR_EOF;
+    }
+
+    ++demux_thread.consumer_stalls;
+    demux_thread.not_empty.wait(lock);
+  }
+}
+
+void stop_demux_thread() {
+  if (!demux_thread.running) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(demux_thread.mutex);
+    demux_thread.stop = true;
+  }
+  demux_thread.not_full.notify_all();
+  demux_thread.thread.join();
+  demux_thread.running = false;
+
+  for (PacketQueue& queue : demux_thread.queues) {
+    for (AVPacket*& av_packet : queue.packets) {
+      av_packet_free(&av_packet);
+    }
+    queue.packets.clear();
+  }
+}
+
+void print_demux_stats() {
+  if (!demux_thread.running) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(demux_thread.mutex);
+  for (int index = 0; index < (int) demux_thread.queues.size(); ++index) {
+    const PacketQueue& queue = demux_thread.queues[index];
+    if (queue.packets.empty()) {
+      continue;
+    }
+    printf("read-ahead stream %d : capacity %zu, high watermark %zu, producer stalls %llu\n",
+           index, queue.packets.size(), queue.high_watermark,
+           (unsigned long long) queue.producer_stalls);
+  }
+  printf("read-ahead consumer stalls : %llu\n", (unsigned long long) demux_thread.consumer_stalls);
+}
+
+void release() {
+  // 필터 스레드가 필터 그래프를 사용하고 있으므로 그래프를 해제하기 전에 종료
+  stop_filter_worker(&video_filter_worker);
+  stop_filter_worker(&audio_filter_worker);
+
+  // 디먹싱 스레드가 AVFormatContext 구조체를 사용하고 있으므로 먼저 종료
+  stop_demux_thread();
+
+  if (input_file_ctx.av_format_ctx) {
+    avformat_close_input(&(input_file_ctx.av_format_ctx));
+  }
+
+  // 직접 생성한 AVIOContext는 avformat_close_input() 함수가 해제하지 않음
+  close_mapped_input(&input_file_ctx.mapped_file, &input_file_ctx.avio_ctx);
+
+  if (input_file_ctx.video_codec_ctx) {
+    avcodec_close(input_file_ctx.video_codec_ctx);
+  }
+
+  if (input_file_ctx.audio_codec_ctx) {
+    avcodec_close(input_file_ctx.audio_codec_ctx);
+  }
+
+  if (video_filter_ctx.av_filter_graph) {
+    avfilter_graph_free(&(video_filter_ctx.av_filter_graph));
+  }
+
+  if (audio_filter_ctx.av_filter_graph) {
+    avfilter_graph_free(&(audio_filter_ctx.av_filter_graph));
+  }
+
+  release_video_scaler();
+  release_tensor_converter();
+  release_audio_resampler(&audio_resampler);
+  release_resample_benchmark();
 }
\ No newline at end of file
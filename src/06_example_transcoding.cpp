@@ -0,0 +1,1622 @@
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+#include <libavformat/avformat.h>
+#include <libavutil/avutil.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/common.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+}
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct FileContext {
+  AVFormatContext* av_format_ctx;
+  int v_index;
+  int a_index;
+};
+
+// 명령행에서 지정한 스트림 선택 조건
+// nullptr이면 해당 타입의 첫 번째 스트림, "none"이면 사용하지 않음,
+// 숫자면 스트림 인덱스, 그 외에는 language 메타데이터(예: eng, kor)로 선택
+struct StreamSelection {
+  const char* video;
+  const char* audio;
+};
+
+struct TranscodeOptions {
+  StreamSelection selection;
+  const char* video_codec;
+  const char* audio_codec;
+  // 비디오 필터 체인 (입력과 출력이 하나씩, 예: yadif,scale=1280:720)
+  const char* video_filter;
+  // 비트레이트 (0이면 인코더 기본값)
+  int64_t video_bit_rate;
+  int64_t audio_bit_rate;
+  // 인코더 스레드 수 (0이면 CPU 코어 수)와 FF_THREAD_FRAME/FF_THREAD_SLICE 조합
+  int encoder_threads;
+  int encoder_thread_type;
+  // 단계 사이 큐의 크기 (패킷 또는 프레임 수)
+  int queue_size;
+};
+
+struct FilterContext {
+  AVFilterGraph* av_filter_graph;
+  AVFilterContext* src_filter_ctx;
+  AVFilterContext* sink_filter_ctx;
+};
+
+// 파이프라인 단계 사이의 큐에 들어가는 항목과 큐에 넣은 시각 (마이크로초)
+// av_packet과 av_frame이 모두 nullptr이면 스트림의 끝
+struct QueueItem {
+  AVPacket* av_packet;
+  AVFrame* av_frame;
+  int64_t queued_time;
+};
+
+// 단계 사이의 크기 제한이 있는 큐
+// 뒤 단계가 느리면 큐가 가득 차서 앞 단계가 기다리므로 인코더나 먹서의 속도가 디먹싱까지 전달됨 (backpressure)
+struct StageQueue {
+  std::mutex mutex;
+  std::condition_variable not_empty;
+  std::condition_variable not_full;
+  std::deque<QueueItem> items;
+  int64_t capacity;
+  // 메트릭 내보내기 스레드가 잠금 없이 읽을 수 있도록 atomic으로 둠 (쓰기는 mutex 안에서만)
+  std::atomic<int64_t> depth;
+  std::atomic<int64_t> peak_depth;
+  std::atomic<int64_t> producer_waits;
+};
+
+// 지연 시간 히스토그램의 버킷 구성
+// HDR 히스토그램처럼 2의 거듭제곱 구간마다 16개의 선형 버킷을 두어 상대 오차가 약 6% 이내이고,
+// 16 마이크로초 미만은 1 마이크로초 단위로 기록 (최대 2^36 마이크로초, 약 19시간)
+const int histogram_sub_bits = 4;
+const int histogram_sub_count = 1 << histogram_sub_bits;
+const int histogram_max_bits = 36;
+const int histogram_bucket_count =
+        histogram_sub_count * (histogram_max_bits - histogram_sub_bits + 1);
+
+struct LatencyHistogram {
+  std::atomic<int64_t> buckets[histogram_bucket_count];
+  std::atomic<int64_t> count;
+  std::atomic<int64_t> sum;
+  std::atomic<int64_t> max;
+};
+
+// 단계별 처리 통계
+// 단계마다 스레드가 하나이고 그 스레드만 값을 바꾸므로 lock이나 read-modify-write 없이
+// relaxed load/store만으로 갱신하고, 메트릭 내보내기 스레드는 언제든지 잠금 없이 읽을 수 있음
+// latency는 항목을 큐에 넣은 후 그 항목의 처리가 끝날 때까지의 시간 (큐에서 기다린 시간 포함, 마이크로초)
+// busy_time과 latency에는 다음 단계의 큐가 가득 차서 기다린 시간을 넣지 않고 blocked_time으로 따로 셈
+// 이웃한 단계의 통계와 캐시 라인을 공유하지 않도록 정렬
+struct alignas(64) StageStats {
+  const char* stage;
+  const char* stream;
+  LatencyHistogram latency;
+  std::atomic<int64_t> output_count;
+  std::atomic<int64_t> byte_count;
+  // 코덱이나 필터 그래프가 EAGAIN을 반환한 횟수 (입력이 더 필요하거나 출력을 먼저 꺼내야 하는 경우)
+  std::atomic<int64_t> again_count;
+  std::atomic<int64_t> busy_time;
+  std::atomic<int64_t> blocked_time;
+  // 처리 중인 항목에서 다음 단계의 큐를 기다린 시간 (단계 스레드만 사용하며 update_stats()에서 비움)
+  int64_t item_blocked_time;
+};
+
+// 지연 시간의 분위수 등 한 시점에 읽은 히스토그램의 요약
+struct LatencySummary {
+  int64_t count;
+  int64_t sum;
+  int64_t max;
+  int64_t p50;
+  int64_t p90;
+  int64_t p99;
+  int64_t p999;
+};
+
+// 단계의 통계와 그 단계가 항목을 꺼내는 큐 (디먹싱 단계는 큐가 없음)
+struct StageEntry {
+  StageStats* stats;
+  StageQueue* queue;
+};
+
+// 메트릭을 주기적으로 파일에 쓰는 스레드
+// Prometheus node_exporter의 textfile collector 등이 쓰는 중인 파일을 읽지 않도록 임시 파일에 쓴 후 이름을 바꿈
+struct MetricsExporter {
+  const char* path;
+  bool json;
+  int interval_ms;
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool stop;
+  int64_t start_time;
+};
+
+// 스트림 하나의 디코딩 -> 필터 -> 인코딩 단계
+// 단계마다 스레드가 하나씩 있고 앞 단계와는 큐로 연결됨
+struct StreamPipeline {
+  const char* name;
+  int in_index;
+  int out_index;
+  AVCodecContext* decoder_ctx;
+  AVCodecContext* encoder_ctx;
+  FilterContext filter_ctx;
+  StageQueue packets;
+  StageQueue decoded_frames;
+  StageQueue filtered_frames;
+  std::thread decode_thread;
+  std::thread filter_thread;
+  std::thread encode_thread;
+  StageStats decode_stats;
+  StageStats filter_stats;
+  StageStats encode_stats;
+};
+
+// 디코딩한 프레임을 처리하는 함수 (0 이상을 반환하면 계속 디코딩)
+typedef int (*FrameHandler)(AVCodecContext* av_codec_ctx, AVFrame* av_frame, void* opaque);
+
+FileContext input_file_ctx;
+FileContext output_file_ctx;
+StreamPipeline video_pipeline, audio_pipeline;
+// 사용하는 스트림의 파이프라인
+std::vector<StreamPipeline*> pipelines;
+// 인코더들이 만든 패킷을 먹서 스레드로 넘기는 큐
+StageQueue mux_queue;
+StageStats demux_stats, mux_stats;
+// 현재 스레드가 실행하는 단계의 통계 (decode_packet()처럼 단계를 모르는 함수에서 EAGAIN을 셀 때 사용)
+thread_local StageStats* thread_stats = nullptr;
+MetricsExporter metrics_exporter;
+// 어느 단계에서든 에러가 나면 모든 단계를 멈춤
+std::atomic<bool> aborted;
+std::atomic<int> pipeline_error;
+// 디코더가 같은 에러를 계속 반환할 때 무한 반복하지 않도록 연속으로 건너뛰는 프레임 수를 제한
+const int max_decode_errors = 16;
+
+int open_input(const char* filename, const StreamSelection& selection);
+bool match_stream(AVStream* av_stream, const char* spec);
+int open_decoder(AVStream* av_stream, AVCodecContext** av_codec_ctx);
+int parse_thread_type(const char* name);
+int init_video_pipeline(const TranscodeOptions& options);
+int init_audio_pipeline(const TranscodeOptions& options);
+int init_video_filter(StreamPipeline* pipeline, const char* filter_desc,
+                      AVPixelFormat pix_fmt);
+int init_audio_filter(StreamPipeline* pipeline);
+int open_encoder(StreamPipeline* pipeline, const TranscodeOptions& options);
+int create_output(const char* filename);
+void init_queue(StageQueue* queue, int capacity);
+int push_item(StageQueue* queue, AVPacket* av_packet, AVFrame* av_frame);
+int pop_item(StageQueue* queue, QueueItem* item);
+void free_queue(StageQueue* queue);
+void init_stats(StageStats* stats, const char* stage, const char* stream);
+void update_stats(StageStats* stats, const QueueItem& item, int64_t start_time);
+void add_counter(std::atomic<int64_t>* counter, int64_t value);
+void count_again();
+void count_blocked(int64_t wait_time);
+int histogram_index(int64_t value);
+int64_t histogram_upper_bound(int index);
+void record_latency(LatencyHistogram* histogram, int64_t value);
+void summarize_latency(const LatencyHistogram& histogram, LatencySummary* summary);
+std::vector<StageEntry> list_stages();
+int start_metrics_exporter(const char* path, const char* format, int interval_ms);
+void metrics_exporter_loop();
+void stop_metrics_exporter();
+int write_metrics();
+std::string format_prometheus();
+std::string format_metrics_json();
+void abort_pipeline(int error);
+int run_pipeline();
+void demux_loop();
+void decode_loop(StreamPipeline* pipeline);
+int queue_decoded_frame(AVCodecContext* av_codec_ctx, AVFrame* av_frame, void* opaque);
+int decode_packet(AVCodecContext* av_codec_ctx, AVPacket* av_packet, AVFrame* av_frame,
+                  FrameHandler handle_frame, void* opaque);
+void filter_loop(StreamPipeline* pipeline);
+void encode_loop(StreamPipeline* pipeline);
+int encode_frame(StreamPipeline* pipeline, AVFrame* av_frame);
+void mux_loop();
+void print_stage_stats(const StageStats& stats, const StageQueue* queue, double elapsed);
+void release();
+
+int main(int argc, const char** argv) {
+  av_log_set_level(AV_LOG_INFO);
+
+  if (argc < 3) {
+    printf("Not enough arguments entered\n");
+    printf("usage: %s <input> <output>\n", argv[0]);
+    printf("stream options: [--video index|lang|none] [--audio index|lang|none]\n");
+    printf("codec options: [--video-codec name] [--audio-codec name] [--video-bitrate kbps] "
+           "[--audio-bitrate kbps]\n");
+    printf("filter options: [--video-filter desc]\n");
+    printf("pipeline options: [--encoder-threads N] [--encoder-thread-type frame|slice|both] "
+           "[--queue-size N]\n");
+    printf("metrics options: [--metrics file] [--metrics-format prom|json] "
+           "[--metrics-interval ms]\n");
+    return -1;
+  }
+
+  TranscodeOptions options;
+  options.selection.video = nullptr;
+  options.selection.audio = nullptr;
+  options.video_codec = "mpeg4";
+  options.audio_codec = "aac";
+  options.video_filter = "null";
+  options.video_bit_rate = 0;
+  options.audio_bit_rate = 0;
+  options.encoder_threads = 0;
+  options.encoder_thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+  options.queue_size = 8;
+
+  const char* metrics_path = nullptr;
+  const char* metrics_format = "prom";
+  int metrics_interval = 1000;
+
+  for (int index = 3; index < argc; ++index) {
+    if (strcmp(argv[index], "--video") == 0 && index + 1 < argc) {
+      options.selection.video = argv[++index];
+    } else if (strcmp(argv[index], "--audio") == 0 && index + 1 < argc) {
+      options.selection.audio = argv[++index];
+    } else if (strcmp(argv[index], "--video-codec") == 0 && index + 1 < argc) {
+      options.video_codec = argv[++index];
+    } else if (strcmp(argv[index], "--audio-codec") == 0 && index + 1 < argc) {
+      options.audio_codec = argv[++index];
+    } else if (strcmp(argv[index], "--video-bitrate") == 0 && index + 1 < argc) {
+      options.video_bit_rate = (int64_t) atoi(argv[++index]) * 1000;
+    } else if (strcmp(argv[index], "--audio-bitrate") == 0 && index + 1 < argc) {
+      options.audio_bit_rate = (int64_t) atoi(argv[++index]) * 1000;
+    } else if (strcmp(argv[index], "--video-filter") == 0 && index + 1 < argc) {
+      options.video_filter = argv[++index];
+    } else if (strcmp(argv[index], "--encoder-threads") == 0 && index + 1 < argc) {
+      options.encoder_threads = atoi(argv[++index]);
+    } else if (strcmp(argv[index], "--encoder-thread-type") == 0 && index + 1 < argc) {
+      options.encoder_thread_type = parse_thread_type(argv[++index]);
+      if (options.encoder_thread_type < 0) {
+        printf("Unknown thread type : %s\n", argv[index]);
+        return -1;
+      }
+    } else if (strcmp(argv[index], "--queue-size") == 0 && index + 1 < argc) {
+      options.queue_size = atoi(argv[++index]);
+    } else if (strcmp(argv[index], "--metrics") == 0 && index + 1 < argc) {
+      metrics_path = argv[++index];
+    } else if (strcmp(argv[index], "--metrics-format") == 0 && index + 1 < argc) {
+      metrics_format = argv[++index];
+    } else if (strcmp(argv[index], "--metrics-interval") == 0 && index + 1 < argc) {
+      metrics_interval = atoi(argv[++index]);
+    } else {
+      printf("Unknown option : %s\n", argv[index]);
+      return -1;
+    }
+  }
+
+  if (open_input(argv[1], options.selection) < 0) {
+    release();
+    return -1;
+  }
+
+  // 인코더에 AV_CODEC_FLAG_GLOBAL_HEADER가 필요한지 알 수 있도록 출력 포맷을 먼저 결정
+  if (avformat_alloc_output_context2(&output_file_ctx.av_format_ctx, nullptr, nullptr, argv[2]) <
+      0) {
+    printf("Couldn't create output AVFormatContext\n");
+    release();
+    return -1;
+  }
+
+  if (input_file_ctx.v_index >= 0 && init_video_pipeline(options) < 0) {
+    release();
+    return -1;
+  }
+
+  if (input_file_ctx.a_index >= 0 && init_audio_pipeline(options) < 0) {
+    release();
+    return -1;
+  }
+
+  // 인코더를 모두 연 후에야 출력 스트림의 코덱 정보를 알 수 있으므로 마지막에 헤더를 씀
+  if (create_output(argv[2]) < 0) {
+    release();
+    return -1;
+  }
+
+  // 파일에 대한 정보를 출력
+  av_dump_format(output_file_ctx.av_format_ctx, 0, argv[2], 1);
+
+  init_queue(&mux_queue, options.queue_size * (int) pipelines.size());
+  init_stats(&demux_stats, "demux", "all");
+  init_stats(&mux_stats, "mux", "all");
+  for (StreamPipeline* pipeline : pipelines) {
+    init_queue(&pipeline->packets, options.queue_size);
+    init_queue(&pipeline->decoded_frames, options.queue_size);
+    init_queue(&pipeline->filtered_frames, options.queue_size);
+    init_stats(&pipeline->decode_stats, "decode", pipeline->name);
+    init_stats(&pipeline->filter_stats, "filter", pipeline->name);
+    init_stats(&pipeline->encode_stats, "encode", pipeline->name);
+  }
+
+  if (metrics_path && start_metrics_exporter(metrics_path, metrics_format, metrics_interval) < 0) {
+    release();
+    return -1;
+  }
+
+  int64_t start_time = av_gettime_relative();
+  int ret = run_pipeline();
+  double elapsed = (av_gettime_relative() - start_time) / 1000000.0;
+
+  // AVPacket 구조체를 쓰는 시점에 정리하지 못한 정보들을 출력 미디어 파일에 씀
+  if (ret >= 0 && av_write_trailer(output_file_ctx.av_format_ctx) < 0) {
+    printf("Failed writing trailer into output file\n");
+    ret = -1;
+  }
+
+  stop_metrics_exporter();
+
+  for (const StageEntry& entry : list_stages()) {
+    print_stage_stats(*entry.stats, entry.queue, elapsed);
+  }
+  if (input_file_ctx.v_index >= 0) {
+    int64_t frame_count = video_pipeline.encode_stats.latency.count;
+    printf("transcoded %lld video frames in %.2f s (%.1f fps)\n", (long long) frame_count,
+           elapsed, elapsed > 0 ? frame_count / elapsed : 0.0);
+  }
+
+  release();
+
+  return ret < 0 ? -1 : 0;
+}
+
+int open_input(const char* filename, const StreamSelection& selection) {
+  input_file_ctx.av_format_ctx = nullptr;
+  input_file_ctx.v_index = input_file_ctx.a_index = -1;
+
+  if (avformat_open_input(&(input_file_ctx.av_format_ctx), filename, nullptr, nullptr) < 0) {
+    printf("Couldn't open input file %s\n", filename);
+    return -1;
+  }
+
+  if (avformat_find_stream_info(input_file_ctx.av_format_ctx, nullptr) < 0) {
+    printf("Failed to retrieve input stream information\n");
+    return -1;
+  }
+
+  for (int index = 0; index < input_file_ctx.av_format_ctx->nb_streams; ++index) {
+    AVStream* av_stream = input_file_ctx.av_format_ctx->streams[index];
+    AVMediaType codec_type = av_stream->codecpar->codec_type;
+    if (codec_type == AVMEDIA_TYPE_VIDEO && input_file_ctx.v_index < 0 &&
+        match_stream(av_stream, selection.video)) {
+      if (open_decoder(av_stream, &video_pipeline.decoder_ctx) < 0) {
+        return -1;
+      }
+      input_file_ctx.v_index = index;
+    } else if (codec_type == AVMEDIA_TYPE_AUDIO && input_file_ctx.a_index < 0 &&
+               match_stream(av_stream, selection.audio)) {
+      if (open_decoder(av_stream, &audio_pipeline.decoder_ctx) < 0) {
+        return -1;
+      }
+      input_file_ctx.a_index = index;
+    }
+  }
+
+  if (input_file_ctx.v_index < 0 && input_file_ctx.a_index < 0) {
+    printf("Failed to retrieve input stream information\n");
+    return -1;
+  }
+
+  // 사용하지 않는 스트림은 디먹서가 패킷을 만들지 않도록 버림
+  for (int index = 0; index < input_file_ctx.av_format_ctx->nb_streams; ++index) {
+    if (index != input_file_ctx.v_index && index != input_file_ctx.a_index) {
+      input_file_ctx.av_format_ctx->streams[index]->discard = AVDISCARD_ALL;
+    }
+  }
+
+  return 0;
+}
+
+bool match_stream(AVStream* av_stream, const char* spec) {
+  if (!spec) {
+    return true;
+  }
+
+  if (strcmp(spec, "none") == 0) {
+    return false;
+  }
+
+  if (spec[0] >= '0' && spec[0] <= '9') {
+    return av_stream->index == atoi(spec);
+  }
+
+  AVDictionaryEntry* language = av_dict_get(av_stream->metadata, "language", nullptr, 0);
+  return language && strcmp(language->value, spec) == 0;
+}
+
+int open_decoder(AVStream* av_stream, AVCodecContext** av_codec_ctx) {
+  AVCodec* av_decoder = avcodec_find_decoder(av_stream->codecpar->codec_id);
+  if (!av_decoder) {
+    printf("Couldn't find AVCodec\n");
+    return -1;
+  }
+
+  *av_codec_ctx = avcodec_alloc_context3(av_decoder);
+  if (!*av_codec_ctx) {
+    printf("Couldn't create AVCodecContext\n");
+    return -1;
+  }
+
+  if (avcodec_parameters_to_context(*av_codec_ctx, av_stream->codecpar) < 0) {
+    printf("Couldn't initialize AVCodecContext\n");
+    return -1;
+  }
+
+  // 패킷의 타임스탬프를 변환하지 않으므로 디코딩한 프레임의 PTS는 스트림의 타임 베이스를 따름
+  (*av_codec_ctx)->pkt_timebase = av_stream->time_base;
+  (*av_codec_ctx)->framerate =
+          av_guess_frame_rate(input_file_ctx.av_format_ctx, av_stream, nullptr);
+
+  if (avcodec_open2(*av_codec_ctx, av_decoder, nullptr) < 0) {
+    printf("Couldn't open codec\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+int parse_thread_type(const char* name) {
+  if (strcmp(name, "frame") == 0) {
+    return FF_THREAD_FRAME;
+  } else if (strcmp(name, "slice") == 0) {
+    return FF_THREAD_SLICE;
+  } else if (strcmp(name, "both") == 0) {
+    return FF_THREAD_FRAME | FF_THREAD_SLICE;
+  }
+  return -1;
+}
+
+int init_video_pipeline(const TranscodeOptions& options) {
+  StreamPipeline* pipeline = &video_pipeline;
+  pipeline->name = "video";
+  pipeline->in_index = input_file_ctx.v_index;
+
+  AVCodec* av_encoder = avcodec_find_encoder_by_name(options.video_codec);
+  if (!av_encoder || av_encoder->type != AVMEDIA_TYPE_VIDEO) {
+    printf("Couldn't find video encoder %s\n", options.video_codec);
+    return -1;
+  }
+
+  // 인코더가 지원하는 픽셀 포맷 중 디코딩한 포맷에서 손실이 가장 적은 것으로 변환
+  AVPixelFormat pix_fmt = pipeline->decoder_ctx->pix_fmt;
+  if (av_encoder->pix_fmts) {
+    pix_fmt = avcodec_find_best_pix_fmt_of_list(av_encoder->pix_fmts, pix_fmt, 0, nullptr);
+  }
+
+  // 인코더의 해상도와 타임 베이스는 필터 그래프의 출력을 따르므로 그래프를 먼저 만듦
+  if (init_video_filter(pipeline, options.video_filter, pix_fmt) < 0) {
+    return -1;
+  }
+
+  pipeline->encoder_ctx = avcodec_alloc_context3(av_encoder);
+  if (!pipeline->encoder_ctx) {
+    printf("Couldn't create AVCodecContext\n");
+    return -1;
+  }
+
+  AVCodecContext* encoder_ctx = pipeline->encoder_ctx;
+  AVFilterContext* sink_filter_ctx = pipeline->filter_ctx.sink_filter_ctx;
+  AVRational frame_rate = av_buffersink_get_frame_rate(sink_filter_ctx);
+  encoder_ctx->width = av_buffersink_get_w(sink_filter_ctx);
+  encoder_ctx->height = av_buffersink_get_h(sink_filter_ctx);
+  encoder_ctx->pix_fmt = (AVPixelFormat) av_buffersink_get_format(sink_filter_ctx);
+  encoder_ctx->sample_aspect_ratio = av_buffersink_get_sample_aspect_ratio(sink_filter_ctx);
+  // MPEG-4처럼 타임 베이스의 분모에 제한이 있는 코덱이 있으므로 가능하면 프레임 레이트를 사용
+  encoder_ctx->time_base = frame_rate.num > 0 && frame_rate.den > 0
+                                   ? av_inv_q(frame_rate)
+                                   : av_buffersink_get_time_base(sink_filter_ctx);
+  encoder_ctx->framerate = frame_rate;
+  if (options.video_bit_rate > 0) {
+    encoder_ctx->bit_rate = options.video_bit_rate;
+  }
+
+  return open_encoder(pipeline, options);
+}
+
+int init_audio_pipeline(const TranscodeOptions& options) {
+  StreamPipeline* pipeline = &audio_pipeline;
+  pipeline->name = "audio";
+  pipeline->in_index = input_file_ctx.a_index;
+
+  AVCodec* av_encoder = avcodec_find_encoder_by_name(options.audio_codec);
+  if (!av_encoder || av_encoder->type != AVMEDIA_TYPE_AUDIO) {
+    printf("Couldn't find audio encoder %s\n", options.audio_codec);
+    return -1;
+  }
+
+  pipeline->encoder_ctx = avcodec_alloc_context3(av_encoder);
+  if (!pipeline->encoder_ctx) {
+    printf("Couldn't create AVCodecContext\n");
+    return -1;
+  }
+
+  // 인코더가 지원하는 포맷 중 첫 번째를 사용하고 샘플레이트는 지원하면 원본을 유지
+  AVCodecContext* decoder_ctx = pipeline->decoder_ctx;
+  AVCodecContext* encoder_ctx = pipeline->encoder_ctx;
+  encoder_ctx->sample_fmt = av_encoder->sample_fmts ? av_encoder->sample_fmts[0]
+                                                    : decoder_ctx->sample_fmt;
+  encoder_ctx->sample_rate = decoder_ctx->sample_rate;
+  if (av_encoder->supported_samplerates) {
+    encoder_ctx->sample_rate = av_encoder->supported_samplerates[0];
+    for (const int* rate = av_encoder->supported_samplerates; *rate; ++rate) {
+      if (*rate == decoder_ctx->sample_rate) {
+        encoder_ctx->sample_rate = *rate;
+        break;
+      }
+    }
+  }
+  encoder_ctx->channel_layout = decoder_ctx->channel_layout
+                                        ? decoder_ctx->channel_layout
+                                        : av_get_default_channel_layout(decoder_ctx->channels);
+  encoder_ctx->channels = av_get_channel_layout_nb_channels(encoder_ctx->channel_layout);
+  encoder_ctx->time_base = av_make_q(1, encoder_ctx->sample_rate);
+  if (options.audio_bit_rate > 0) {
+    encoder_ctx->bit_rate = options.audio_bit_rate;
+  }
+
+  // 오디오는 인코더의 frame_size를 알아야 필터 그래프가 그 크기로 잘라서 내보낼 수 있으므로 인코더를 먼저 엶
+  if (open_encoder(pipeline, options) < 0) {
+    return -1;
+  }
+
+  return init_audio_filter(pipeline);
+}
+
+int init_video_filter(StreamPipeline* pipeline, const char* filter_desc,
+                      AVPixelFormat pix_fmt) {
+  AVStream* av_stream = input_file_ctx.av_format_ctx->streams[pipeline->in_index];
+  AVCodecContext* decoder_ctx = pipeline->decoder_ctx;
+  FilterContext* filter_ctx = &pipeline->filter_ctx;
+
+  AVFilterContext* format_filter;
+  AVFilterInOut* inputs;
+  AVFilterInOut* outputs;
+  char args[512];
+
+  filter_ctx->av_filter_graph = avfilter_graph_alloc();
+  if (!filter_ctx->av_filter_graph) {
+    return -1;
+  }
+
+  if (avfilter_graph_parse2(filter_ctx->av_filter_graph, filter_desc, &inputs, &outputs) < 0) {
+    printf("Failed to parse video filter graph\n");
+    return -1;
+  }
+
+  snprintf(args, sizeof(args),
+           "time_base=%d/%d:video_size=%dx%d:pix_fmt=%d:pixel_aspect=%d/%d:frame_rate=%d/%d",
+           av_stream->time_base.num, av_stream->time_base.den, decoder_ctx->width,
+           decoder_ctx->height, decoder_ctx->pix_fmt, decoder_ctx->sample_aspect_ratio.num,
+           FFMAX(decoder_ctx->sample_aspect_ratio.den, 1), decoder_ctx->framerate.num,
+           FFMAX(decoder_ctx->framerate.den, 1));
+  if (avfilter_graph_create_filter(&filter_ctx->src_filter_ctx, avfilter_get_by_name("buffer"),
+                                   "in", args, nullptr, filter_ctx->av_filter_graph) < 0) {
+    printf("Failed to create video buffer source\n");
+    return -1;
+  }
+
+  if (avfilter_link(filter_ctx->src_filter_ctx, 0, inputs->filter_ctx, 0) < 0) {
+    printf("Failed to link video buffer source\n");
+    return -1;
+  }
+
+  // 필터 체인 뒤에서 인코더가 받을 수 있는 픽셀 포맷으로 변환
+  if (avfilter_graph_create_filter(&format_filter, avfilter_get_by_name("format"), "format",
+                                   av_get_pix_fmt_name(pix_fmt), nullptr,
+                                   filter_ctx->av_filter_graph) < 0) {
+    printf("Failed to create video format filter\n");
+    return -1;
+  }
+
+  if (avfilter_graph_create_filter(&filter_ctx->sink_filter_ctx,
+                                   avfilter_get_by_name("buffersink"), "out", nullptr, nullptr,
+                                   filter_ctx->av_filter_graph) < 0) {
+    printf("Failed to create video buffer sink\n");
+    return -1;
+  }
+
+  if (avfilter_link(outputs->filter_ctx, 0, format_filter, 0) < 0 ||
+      avfilter_link(format_filter, 0, filter_ctx->sink_filter_ctx, 0) < 0) {
+    printf("Failed to link video format filter\n");
+    return -1;
+  }
+
+  if (avfilter_graph_config(filter_ctx->av_filter_graph, nullptr) < 0) {
+    printf("Failed to configure video filter context\n");
+    return -1;
+  }
+
+  avfilter_inout_free(&inputs);
+  avfilter_inout_free(&outputs);
+
+  return 0;
+}
+
+int init_audio_filter(StreamPipeline* pipeline) {
+  AVStream* av_stream = input_file_ctx.av_format_ctx->streams[pipeline->in_index];
+  AVCodecContext* decoder_ctx = pipeline->decoder_ctx;
+  AVCodecContext* encoder_ctx = pipeline->encoder_ctx;
+  FilterContext* filter_ctx = &pipeline->filter_ctx;
+
+  AVFilterContext* format_filter;
+  char args[512];
+
+  filter_ctx->av_filter_graph = avfilter_graph_alloc();
+  if (!filter_ctx->av_filter_graph) {
+    return -1;
+  }
+
+  uint64_t channel_layout = decoder_ctx->channel_layout
+                                    ? decoder_ctx->channel_layout
+                                    : av_get_default_channel_layout(decoder_ctx->channels);
+  snprintf(args, sizeof(args),
+           "time_base=%d/%d:sample_rate=%d:sample_fmt=%s:channel_layout=0x%" PRIx64,
+           av_stream->time_base.num, av_stream->time_base.den, decoder_ctx->sample_rate,
+           av_get_sample_fmt_name(decoder_ctx->sample_fmt), channel_layout);
+  if (avfilter_graph_create_filter(&filter_ctx->src_filter_ctx, avfilter_get_by_name("abuffer"),
+                                   "in", args, nullptr, filter_ctx->av_filter_graph) < 0) {
+    printf("Failed to create audio buffer source\n");
+    return -1;
+  }
+
+  // 인코더가 받을 수 있는 샘플 포맷, 샘플레이트, 채널 레이아웃으로 변환
+  snprintf(args, sizeof(args), "sample_fmts=%s:sample_rates=%d:channel_layouts=0x%" PRIx64,
+           av_get_sample_fmt_name(encoder_ctx->sample_fmt), encoder_ctx->sample_rate,
+           encoder_ctx->channel_layout);
+  if (avfilter_graph_create_filter(&format_filter, avfilter_get_by_name("aformat"), "aformat",
+                                   args, nullptr, filter_ctx->av_filter_graph) < 0) {
+    printf("Failed to create audio format filter\n");
+    return -1;
+  }
+
+  if (avfilter_graph_create_filter(&filter_ctx->sink_filter_ctx,
+                                   avfilter_get_by_name("abuffersink"), "out", nullptr, nullptr,
+                                   filter_ctx->av_filter_graph) < 0) {
+    printf("Failed to create audio buffer sink\n");
+    return -1;
+  }
+
+  if (avfilter_link(filter_ctx->src_filter_ctx, 0, format_filter, 0) < 0 ||
+      avfilter_link(format_filter, 0, filter_ctx->sink_filter_ctx, 0) < 0) {
+    printf("Failed to link audio format filter\n");
+    return -1;
+  }
+
+  if (avfilter_graph_config(filter_ctx->av_filter_graph, nullptr) < 0) {
+    printf("Failed to configure audio filter context\n");
+    return -1;
+  }
+
+  // AAC처럼 프레임마다 정해진 샘플 수만 받는 인코더에 맞춰서 잘라서 내보냄
+  if (!(encoder_ctx->codec->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE) &&
+      encoder_ctx->frame_size > 0) {
+    av_buffersink_set_frame_size(filter_ctx->sink_filter_ctx, encoder_ctx->frame_size);
+  }
+
+  return 0;
+}
+
+int open_encoder(StreamPipeline* pipeline, const TranscodeOptions& options) {
+  AVCodecContext* encoder_ctx = pipeline->encoder_ctx;
+
+  // FF_THREAD_FRAME은 여러 프레임을 동시에 인코딩해서 처리량이 높지만 스레드 수만큼 지연이 생기고,
+  // FF_THREAD_SLICE는 한 프레임을 나누어 인코딩함 (인코더가 지원하지 않는 방식은 무시됨)
+  encoder_ctx->thread_count = options.encoder_threads;
+  encoder_ctx->thread_type = options.encoder_thread_type;
+
+  // MP4처럼 코덱 설정을 컨테이너 헤더에 저장하는 포맷은 extradata가 필요함
+  if (output_file_ctx.av_format_ctx &&
+      (output_file_ctx.av_format_ctx->oformat->flags & AVFMT_GLOBALHEADER)) {
+    encoder_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+  }
+
+  if (avcodec_open2(encoder_ctx, encoder_ctx->codec, nullptr) < 0) {
+    printf("Couldn't open %s encoder %s\n", pipeline->name, encoder_ctx->codec->name);
+    return -1;
+  }
+
+  printf("%s encoder : %s, threads %d, thread_type %d\n", pipeline->name,
+         encoder_ctx->codec->name, encoder_ctx->thread_count, encoder_ctx->active_thread_type);
+
+  pipelines.push_back(pipeline);
+  return 0;
+}
+
+int create_output(const char* filename) {
+  output_file_ctx.v_index = output_file_ctx.a_index = -1;
+
+  for (StreamPipeline* pipeline : pipelines) {
+    // 새로운 스트림을 생성하고 인코더의 설정을 복사
+    AVStream* out_stream = avformat_new_stream(output_file_ctx.av_format_ctx, nullptr);
+    if (!out_stream) {
+      printf("Failed to allocate output stream\n");
+      return -1;
+    }
+
+    if (avcodec_parameters_from_context(out_stream->codecpar, pipeline->encoder_ctx) < 0) {
+      printf("Error occurred while copying AVCodecParameters\n");
+      return -1;
+    }
+    // 먹서가 헤더를 쓸 때 더 알맞은 값으로 바꿀 수 있음
+    out_stream->time_base = pipeline->encoder_ctx->time_base;
+    pipeline->out_index = out_stream->index;
+
+    if (pipeline == &video_pipeline) {
+      output_file_ctx.v_index = out_stream->index;
+    } else {
+      output_file_ctx.a_index = out_stream->index;
+    }
+  }
+
+  // avio_open() 함수는 fopen() 함수처럼 아무것도 쓰이지 않은 빈 파일을 생성할 때 사용
+  if (!(output_file_ctx.av_format_ctx->oformat->flags & AVFMT_NOFILE)) {
+    if (avio_open(&output_file_ctx.av_format_ctx->pb, filename, AVIO_FLAG_WRITE) < 0) {
+      printf("Failed to create output file\n");
+      return -1;
+    }
+  }
+
+  if (avformat_write_header(output_file_ctx.av_format_ctx, nullptr) < 0) {
+    printf("Failed writing header into output file\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+void init_queue(StageQueue* queue, int capacity) {
+  queue->capacity = FFMAX(capacity, 1);
+  queue->depth = 0;
+  queue->peak_depth = 0;
+  queue->producer_waits = 0;
+}
+
+int push_item(StageQueue* queue, AVPacket* av_packet, AVFrame* av_frame) {
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  if ((int64_t) queue->items.size() >= queue->capacity && !aborted) {
+    add_counter(&queue->producer_waits, 1);
+    int64_t wait_start = av_gettime_relative();
+    queue->not_full.wait(
+            lock, [&]() { return aborted || (int64_t) queue->items.size() < queue->capacity; });
+    count_blocked(av_gettime_relative() - wait_start);
+  }
+
+  // 다른 단계에서 에러가 나서 멈춘 경우 넘기려던 항목은 여기서 해제
+  if (aborted) {
+    lock.unlock();
+    av_packet_free(&av_packet);
+    av_frame_free(&av_frame);
+    return AVERROR_EXIT;
+  }
+
+  queue->items.push_back({av_packet, av_frame, av_gettime_relative()});
+  int64_t depth = (int64_t) queue->items.size();
+  queue->depth.store(depth, std::memory_order_relaxed);
+  if (depth > queue->peak_depth.load(std::memory_order_relaxed)) {
+    queue->peak_depth.store(depth, std::memory_order_relaxed);
+  }
+
+  lock.unlock();
+  queue->not_empty.notify_one();
+
+  return 0;
+}
+
+int pop_item(StageQueue* queue, QueueItem* item) {
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  queue->not_empty.wait(lock, [&]() { return aborted || !queue->items.empty(); });
+  if (aborted) {
+    return AVERROR_EXIT;
+  }
+
+  *item = queue->items.front();
+  queue->items.pop_front();
+  queue->depth.store((int64_t) queue->items.size(), std::memory_order_relaxed);
+
+  lock.unlock();
+  queue->not_full.notify_one();
+
+  return 0;
+}
+
+void free_queue(StageQueue* queue) {
+  for (QueueItem& item : queue->items) {
+    av_packet_free(&item.av_packet);
+    av_frame_free(&item.av_frame);
+  }
+  queue->items.clear();
+}
+
+void init_stats(StageStats* stats, const char* stage, const char* stream) {
+  stats->stage = stage;
+  stats->stream = stream;
+  for (std::atomic<int64_t>& bucket : stats->latency.buckets) {
+    bucket = 0;
+  }
+  stats->latency.count = stats->latency.sum = stats->latency.max = 0;
+  stats->output_count = stats->byte_count = stats->again_count = 0;
+  stats->busy_time = stats->blocked_time = 0;
+  stats->item_blocked_time = 0;
+}
+
+void update_stats(StageStats* stats, const QueueItem& item, int64_t start_time) {
+  // 다음 단계의 큐를 기다린 시간은 이 단계의 작업이 아니므로 뺌
+  int64_t end_time = av_gettime_relative() - stats->item_blocked_time;
+  stats->item_blocked_time = 0;
+  add_counter(&stats->busy_time, end_time - start_time);
+  if (item.av_packet || item.av_frame) {
+    record_latency(&stats->latency, end_time - item.queued_time);
+  }
+}
+
+// 값을 바꾸는 스레드가 하나뿐일 때만 사용 (lock 접두사가 붙는 fetch_add보다 가벼움)
+void add_counter(std::atomic<int64_t>* counter, int64_t value) {
+  counter->store(counter->load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+void count_again() {
+  if (thread_stats) {
+    add_counter(&thread_stats->again_count, 1);
+  }
+}
+
+void count_blocked(int64_t wait_time) {
+  if (thread_stats) {
+    add_counter(&thread_stats->blocked_time, wait_time);
+    thread_stats->item_blocked_time += wait_time;
+  }
+}
+
+int histogram_index(int64_t value) {
+  if (value < histogram_sub_count) {
+    return (int) FFMAX(value, 0);
+  }
+
+  // 가장 높은 비트의 위치로 구간을 정하고, 그 아래 histogram_sub_bits개의 비트로 구간 안의 버킷을 정함
+  int exponent = FFMIN(63 - __builtin_clzll((uint64_t) value), histogram_max_bits - 1);
+  if (value >= (int64_t) 1 << histogram_max_bits) {
+    return histogram_bucket_count - 1;
+  }
+  int shift = exponent - histogram_sub_bits;
+  return (shift + 1) * histogram_sub_count + (int) ((value >> shift) & (histogram_sub_count - 1));
+}
+
+int64_t histogram_upper_bound(int index) {
+  if (index < histogram_sub_count) {
+    return index;
+  }
+
+  int shift = index / histogram_sub_count - 1;
+  int64_t lower = (int64_t) (histogram_sub_count + index % histogram_sub_count) << shift;
+  return lower + ((int64_t) 1 << shift) - 1;
+}
+
+void record_latency(LatencyHistogram* histogram, int64_t value) {
+  value = FFMAX(value, 0);
+  add_counter(&histogram->buckets[histogram_index(value)], 1);
+  add_counter(&histogram->count, 1);
+  add_counter(&histogram->sum, value);
+  if (value > histogram->max.load(std::memory_order_relaxed)) {
+    histogram->max.store(value, std::memory_order_relaxed);
+  }
+}
+
+void summarize_latency(const LatencyHistogram& histogram, LatencySummary* summary) {
+  // 기록 중인 히스토그램을 읽으므로 count 대신 읽은 버킷의 합을 기준으로 분위수를 계산
+  int64_t buckets[histogram_bucket_count];
+  int64_t total = 0;
+  for (int index = 0; index < histogram_bucket_count; ++index) {
+    buckets[index] = histogram.buckets[index].load(std::memory_order_relaxed);
+    total += buckets[index];
+  }
+  summary->count = total;
+  summary->sum = histogram.sum.load(std::memory_order_relaxed);
+  summary->max = histogram.max.load(std::memory_order_relaxed);
+
+  // 분위수는 그 순위의 값이 들어 있는 버킷의 상한 (최댓값보다 크게 보고하지 않음)
+  const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+  int64_t* values[] = {&summary->p50, &summary->p90, &summary->p99, &summary->p999};
+  int64_t cumulative = 0;
+  int index = 0;
+  for (int quantile = 0; quantile < 4; ++quantile) {
+    int64_t rank = (int64_t) (quantiles[quantile] * total + 0.5);
+    rank = FFMAX(rank, 1);
+    while (index < histogram_bucket_count - 1 && cumulative + buckets[index] < rank) {
+      cumulative += buckets[index++];
+    }
+    *values[quantile] = total > 0 ? FFMIN(histogram_upper_bound(index), summary->max) : 0;
+  }
+}
+
+std::vector<StageEntry> list_stages() {
+  std::vector<StageEntry> stages = {{&demux_stats, nullptr}};
+  for (StreamPipeline* pipeline : pipelines) {
+    stages.push_back({&pipeline->decode_stats, &pipeline->packets});
+    stages.push_back({&pipeline->filter_stats, &pipeline->decoded_frames});
+    stages.push_back({&pipeline->encode_stats, &pipeline->filtered_frames});
+  }
+  stages.push_back({&mux_stats, &mux_queue});
+  return stages;
+}
+
+int start_metrics_exporter(const char* path, const char* format, int interval_ms) {
+  if (strcmp(format, "prom") != 0 && strcmp(format, "json") != 0) {
+    printf("Unknown metrics format : %s\n", format);
+    return -1;
+  }
+
+  metrics_exporter.path = path;
+  metrics_exporter.json = strcmp(format, "json") == 0;
+  metrics_exporter.interval_ms = FFMAX(interval_ms, 10);
+  metrics_exporter.stop = false;
+  metrics_exporter.start_time = av_gettime_relative();
+
+  // 시작하자마자 한 번 써서 경로에 쓸 수 없으면 트랜스코딩을 시작하기 전에 알림
+  if (write_metrics() < 0) {
+    metrics_exporter.path = nullptr;
+    return -1;
+  }
+
+  metrics_exporter.thread = std::thread(metrics_exporter_loop);
+  return 0;
+}
+
+void metrics_exporter_loop() {
+  std::unique_lock<std::mutex> lock(metrics_exporter.mutex);
+  while (true) {
+    metrics_exporter.wake.wait_for(lock, std::chrono::milliseconds(metrics_exporter.interval_ms),
+                                   []() { return metrics_exporter.stop; });
+    if (metrics_exporter.stop) {
+      break;
+    }
+
+    lock.unlock();
+    write_metrics();
+    lock.lock();
+  }
+}
+
+void stop_metrics_exporter() {
+  if (!metrics_exporter.thread.joinable()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(metrics_exporter.mutex);
+    metrics_exporter.stop = true;
+  }
+  metrics_exporter.wake.notify_one();
+  metrics_exporter.thread.join();
+
+  // 모든 단계가 끝난 후의 최종 값
+  write_metrics();
+}
+
+int write_metrics() {
+  std::string text = metrics_exporter.json ? format_metrics_json() : format_prometheus();
+  std::string temp_path = std::string(metrics_exporter.path) + ".tmp";
+
+  FILE* file = fopen(temp_path.c_str(), "w");
+  if (!file) {
+    printf("Failed to create %s\n", temp_path.c_str());
+    return -1;
+  }
+  bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+  if (fclose(file) != 0 || !written || rename(temp_path.c_str(), metrics_exporter.path) != 0) {
+    printf("Failed to write %s\n", metrics_exporter.path);
+    remove(temp_path.c_str());
+    return -1;
+  }
+
+  return 0;
+}
+
+std::string format_prometheus() {
+  std::vector<StageEntry> stages = list_stages();
+  std::string text;
+  char buffer[256];
+
+  text += "# HELP transcode_stage_latency_microseconds Time from queueing an item to finishing "
+          "it in a stage, excluding time blocked on the next stage\n";
+  text += "# TYPE transcode_stage_latency_microseconds summary\n";
+  for (const StageEntry& entry : stages) {
+    LatencySummary summary;
+    summarize_latency(entry.stats->latency, &summary);
+    const char* quantile_names[] = {"0.5", "0.9", "0.99", "0.999"};
+    int64_t quantile_values[] = {summary.p50, summary.p90, summary.p99, summary.p999};
+    for (int quantile = 0; quantile < 4; ++quantile) {
+      snprintf(buffer, sizeof(buffer),
+               "transcode_stage_latency_microseconds{stage=\"%s\",stream=\"%s\","
+               "quantile=\"%s\"} %lld\n",
+               entry.stats->stage, entry.stats->stream, quantile_names[quantile],
+               (long long) quantile_values[quantile]);
+      text += buffer;
+    }
+    snprintf(buffer, sizeof(buffer),
+             "transcode_stage_latency_microseconds_sum{stage=\"%s\",stream=\"%s\"} %lld\n"
+             "transcode_stage_latency_microseconds_count{stage=\"%s\",stream=\"%s\"} %lld\n",
+             entry.stats->stage, entry.stats->stream, (long long) summary.sum,
+             entry.stats->stage, entry.stats->stream, (long long) summary.count);
+    text += buffer;
+  }
+
+  struct Counter {
+    const char* name;
+    const char* type;
+    const char* help;
+    std::atomic<int64_t> StageStats::*field;
+  };
+  const Counter counters[] = {
+          {"transcode_stage_outputs_total", "counter", "Packets or frames produced by a stage",
+           &StageStats::output_count},
+          {"transcode_stage_bytes_total", "counter", "Packet bytes read or written by a stage",
+           &StageStats::byte_count},
+          {"transcode_stage_again_total", "counter", "EAGAIN returned by a codec or filter graph",
+           &StageStats::again_count},
+          {"transcode_stage_busy_microseconds_total", "counter", "Time a stage spent working",
+           &StageStats::busy_time},
+          {"transcode_stage_blocked_microseconds_total", "counter",
+           "Time a stage spent blocked on a full output queue", &StageStats::blocked_time},
+  };
+  for (const Counter& counter : counters) {
+    snprintf(buffer, sizeof(buffer), "# HELP %s %s\n# TYPE %s %s\n", counter.name, counter.help,
+             counter.name, counter.type);
+    text += buffer;
+    for (const StageEntry& entry : stages) {
+      snprintf(buffer, sizeof(buffer), "%s{stage=\"%s\",stream=\"%s\"} %lld\n", counter.name,
+               entry.stats->stage, entry.stats->stream,
+               (long long) (entry.stats->*counter.field).load(std::memory_order_relaxed));
+      text += buffer;
+    }
+  }
+
+  struct QueueMetric {
+    const char* name;
+    const char* type;
+    const char* help;
+    std::atomic<int64_t> StageQueue::*field;
+  };
+  const QueueMetric queue_metrics[] = {
+          {"transcode_queue_depth", "gauge", "Items waiting in the input queue of a stage",
+           &StageQueue::depth},
+          {"transcode_queue_peak_depth", "gauge", "Largest input queue depth seen so far",
+           &StageQueue::peak_depth},
+          {"transcode_queue_producer_waits_total", "counter",
+           "Times the previous stage blocked on a full input queue", &StageQueue::producer_waits},
+  };
+  for (const QueueMetric& metric : queue_metrics) {
+    snprintf(buffer, sizeof(buffer), "# HELP %s %s\n# TYPE %s %s\n", metric.name, metric.help,
+             metric.name, metric.type);
+    text += buffer;
+    for (const StageEntry& entry : stages) {
+      if (!entry.queue) {
+        continue;
+      }
+      snprintf(buffer, sizeof(buffer), "%s{stage=\"%s\",stream=\"%s\"} %lld\n", metric.name,
+               entry.stats->stage, entry.stats->stream,
+               (long long) (entry.queue->*metric.field).load(std::memory_order_relaxed));
+      text += buffer;
+    }
+  }
+
+  snprintf(buffer, sizeof(buffer),
+           "# HELP transcode_uptime_seconds Time since the pipeline started\n"
+           "# TYPE transcode_uptime_seconds gauge\n"
+           "transcode_uptime_seconds %.3f\n",
+           (av_gettime_relative() - metrics_exporter.start_time) / 1000000.0);
+  text += buffer;
+
+  return text;
+}
+
+std::string format_metrics_json() {
+  std::vector<StageEntry> stages = list_stages();
+  std::string text;
+  char buffer[512];
+
+  snprintf(buffer, sizeof(buffer), "{\"uptime_seconds\":%.3f,\"stages\":[",
+           (av_gettime_relative() - metrics_exporter.start_time) / 1000000.0);
+  text += buffer;
+  for (size_t index = 0; index < stages.size(); ++index) {
+    const StageStats* stats = stages[index].stats;
+    const StageQueue* queue = stages[index].queue;
+    LatencySummary summary;
+    summarize_latency(stats->latency, &summary);
+
+    snprintf(buffer, sizeof(buffer),
+             "%s\n  {\"stage\":\"%s\",\"stream\":\"%s\",\"outputs\":%lld,\"bytes\":%lld,"
+             "\"again\":%lld,\"busy_us\":%lld,\"blocked_us\":%lld,"
+             "\"latency_us\":{\"count\":%lld,\"sum\":%lld,"
+             "\"max\":%lld,\"p50\":%lld,\"p90\":%lld,\"p99\":%lld,\"p999\":%lld}",
+             index > 0 ? "," : "", stats->stage, stats->stream,
+             (long long) stats->output_count.load(std::memory_order_relaxed),
+             (long long) stats->byte_count.load(std::memory_order_relaxed),
+             (long long) stats->again_count.load(std::memory_order_relaxed),
+             (long long) stats->busy_time.load(std::memory_order_relaxed),
+             (long long) stats->blocked_time.load(std::memory_order_relaxed),
+             (long long) summary.count, (long long) summary.sum, (long long) summary.max,
+             (long long) summary.p50, (long long) summary.p90, (long long) summary.p99,
+             (long long) summary.p999);
+    text += buffer;
+    if (queue) {
+      snprintf(buffer, sizeof(buffer),
+               ",\"queue\":{\"depth\":%lld,\"peak\":%lld,\"capacity\":%lld,"
+               "\"producer_waits\":%lld}",
+               (long long) queue->depth.load(std::memory_order_relaxed),
+               (long long) queue->peak_depth.load(std::memory_order_relaxed),
+               (long long) queue->capacity,
+               (long long) queue->producer_waits.load(std::memory_order_relaxed));
+      text += buffer;
+    }
+    text += "}";
+  }
+  text += "\n]}\n";
+
+  return text;
+}
+
+void abort_pipeline(int error) {
+  int expected = 0;
+  pipeline_error.compare_exchange_strong(expected, error);
+
+  // 기다리고 있는 단계가 깨어나서 멈출 수 있도록 모든 큐에 알림
+  std::vector<StageQueue*> queues = {&mux_queue};
+  for (StreamPipeline* pipeline : pipelines) {
+    queues.push_back(&pipeline->packets);
+    queues.push_back(&pipeline->decoded_frames);
+    queues.push_back(&pipeline->filtered_frames);
+  }
+  for (StageQueue* queue : queues) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    aborted = true;
+    queue->not_empty.notify_all();
+    queue->not_full.notify_all();
+  }
+}
+
+int run_pipeline() {
+  aborted = false;
+  pipeline_error = 0;
+
+  // 디먹싱 -> (스트림마다) 디코딩 -> 필터 -> 인코딩 -> 먹싱이 모두 동시에 진행됨
+  std::thread demux_thread(demux_loop);
+  for (StreamPipeline* pipeline : pipelines) {
+    pipeline->decode_thread = std::thread(decode_loop, pipeline);
+    pipeline->filter_thread = std::thread(filter_loop, pipeline);
+    pipeline->encode_thread = std::thread(encode_loop, pipeline);
+  }
+  std::thread mux_thread(mux_loop);
+
+  demux_thread.join();
+  for (StreamPipeline* pipeline : pipelines) {
+    pipeline->decode_thread.join();
+    pipeline->filter_thread.join();
+    pipeline->encode_thread.join();
+  }
+  mux_thread.join();
+
+  return pipeline_error;
+}
+
+void demux_loop() {
+  thread_stats = &demux_stats;
+  int ret = 0;
+  while (ret >= 0) {
+    AVPacket* av_packet = av_packet_alloc();
+    if (!av_packet) {
+      ret = AVERROR(ENOMEM);
+      break;
+    }
+
+    int64_t start_time = av_gettime_relative();
+    ret = av_read_frame(input_file_ctx.av_format_ctx, av_packet);
+    if (ret < 0) {
+      av_packet_free(&av_packet);
+      break;
+    }
+
+    StreamPipeline* pipeline = nullptr;
+    for (StreamPipeline* candidate : pipelines) {
+      if (candidate->in_index == av_packet->stream_index) {
+        pipeline = candidate;
+      }
+    }
+    if (!pipeline) {
+      av_packet_free(&av_packet);
+      continue;
+    }
+
+    QueueItem item = {av_packet, nullptr, start_time};
+    add_counter(&demux_stats.output_count, 1);
+    add_counter(&demux_stats.byte_count, av_packet->size);
+    ret = push_item(&pipeline->packets, av_packet, nullptr);
+    update_stats(&demux_stats, item, start_time);
+  }
+
+  if (ret != AVERROR_EOF) {
+    if (ret != AVERROR_EXIT) {
+      printf("Error occurred when reading packet\n");
+    }
+    abort_pipeline(ret);
+    return;
+  }
+
+  // 모든 스트림에 끝을 알림
+  for (StreamPipeline* pipeline : pipelines) {
+    push_item(&pipeline->packets, nullptr, nullptr);
+  }
+}
+
+void decode_loop(StreamPipeline* pipeline) {
+  thread_stats = &pipeline->decode_stats;
+  AVFrame* av_frame = av_frame_alloc();
+  int ret = av_frame ? 0 : AVERROR(ENOMEM);
+
+  while (ret >= 0) {
+    QueueItem item;
+    ret = pop_item(&pipeline->packets, &item);
+    if (ret < 0) {
+      break;
+    }
+
+    // 패킷이 nullptr이면 디코더를 flush해서 남아 있는 프레임을 모두 꺼냄
+    int64_t start_time = av_gettime_relative();
+    if (item.av_packet) {
+      add_counter(&pipeline->decode_stats.byte_count, item.av_packet->size);
+    }
+    ret = decode_packet(pipeline->decoder_ctx, item.av_packet, av_frame, queue_decoded_frame,
+                        pipeline);
+    update_stats(&pipeline->decode_stats, item, start_time);
+
+    bool finished = !item.av_packet;
+    av_packet_free(&item.av_packet);
+    if (finished) {
+      ret = ret == AVERROR_EOF ? push_item(&pipeline->decoded_frames, nullptr, nullptr) : ret;
+      break;
+    }
+  }
+
+  av_frame_free(&av_frame);
+  if (ret < 0 && ret != AVERROR_EOF) {
+    abort_pipeline(ret);
+  }
+}
+
+int queue_decoded_frame(AVCodecContext* av_codec_ctx, AVFrame* av_frame, void* opaque) {
+  StreamPipeline* pipeline = (StreamPipeline*) opaque;
+
+  // 디코더가 다음 프레임에 같은 AVFrame 구조체를 사용하므로 참조만 새 프레임으로 옮김
+  AVFrame* decoded_frame = av_frame_alloc();
+  if (!decoded_frame) {
+    return AVERROR(ENOMEM);
+  }
+  av_frame_move_ref(decoded_frame, av_frame);
+
+  add_counter(&pipeline->decode_stats.output_count, 1);
+  return push_item(&pipeline->decoded_frames, nullptr, decoded_frame);
+}
+
+// 패킷 하나를 디코딩하고 나오는 모든 프레임을 handle_frame으로 넘김
+// av_packet이 nullptr이면 디코더를 flush해서 내부에 남아 있는 프레임을 모두 꺼냄
+// 반환 값은 정상이면 0, flush가 끝나면 AVERROR_EOF, handle_frame이 실패하거나 메모리가 부족하면 음수
+// 코덱이 디코딩하지 못한 패킷이나 프레임은 건너뛰고 계속 진행하므로 에러로 반환하지 않음
+int decode_packet(AVCodecContext* av_codec_ctx, AVPacket* av_packet, AVFrame* av_frame,
+                  FrameHandler handle_frame, void* opaque) {
+  bool sent = false;
+  int error_count = 0;
+
+  while (true) {
+    if (!sent) {
+      int ret = avcodec_send_packet(av_codec_ctx, av_packet);
+      if (ret >= 0 || (ret == AVERROR_EOF && !av_packet)) {
+        // 이미 flush를 시작한 디코더에 다시 nullptr을 보내면 AVERROR_EOF가 나오지만 정상
+        sent = true;
+      } else if (ret == AVERROR(ENOMEM)) {
+        printf("Couldn't send AVPacket\n");
+        return ret;
+      } else if (ret != AVERROR(EAGAIN)) {
+        // 손상된 패킷은 건너뜀 (flush 중이면 더 꺼낼 프레임이 없는 것으로 봄)
+        printf("Couldn't send AVPacket, skipped\n");
+        return av_packet ? 0 : AVERROR_EOF;
+      } else {
+        count_again();
+      }
+    }
+
+    int frame_count = 0;
+    int ret;
+    while (true) {
+      ret = avcodec_receive_frame(av_codec_ctx, av_frame);
+      if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF || ret == AVERROR(ENOMEM)) {
+        break;
+      }
+      ++frame_count;
+      if (ret < 0) {
+        // 디코딩 에러는 해당 프레임만 버리고 남은 프레임을 계속 꺼냄
+        // 에러가 계속 이어지면 이 패킷은 포기함 (flush 중이면 더 꺼낼 프레임이 없는 것으로 봄)
+        printf("Couldn't receive AVFrame, skipped\n");
+        if (++error_count >= max_decode_errors) {
+          printf("Too many decoding errors, packet skipped\n");
+          return av_packet ? 0 : AVERROR_EOF;
+        }
+        continue;
+      }
+      error_count = 0;
+
+      av_frame->pts = av_frame->best_effort_timestamp;
+      ret = handle_frame(av_codec_ctx, av_frame, opaque);
+      av_frame_unref(av_frame);
+      if (ret < 0) {
+        return ret;
+      }
+    }
+
+    if (ret == AVERROR_EOF) {
+      return sent ? AVERROR_EOF : AVERROR_BUG;
+    } else if (ret == AVERROR(ENOMEM)) {
+      printf("Couldn't receive AVFrame\n");
+      return ret;
+    }
+
+    count_again();
+    if (sent) {
+      return 0;
+    }
+
+    // send와 receive가 모두 EAGAIN이면 디코더가 API 규칙을 어긴 것이므로 무한 반복하지 않음
+    if (frame_count == 0) {
+      printf("Decoder accepts neither packets nor returns frames\n");
+      return AVERROR_BUG;
+    }
+  }
+}
+
+void filter_loop(StreamPipeline* pipeline) {
+  thread_stats = &pipeline->filter_stats;
+  FilterContext* filter_ctx = &pipeline->filter_ctx;
+  int ret = 0;
+
+  while (ret >= 0) {
+    QueueItem item;
+    ret = pop_item(&pipeline->decoded_frames, &item);
+    if (ret < 0) {
+      break;
+    }
+
+    // nullptr 프레임을 넣으면 필터 그래프가 버퍼링하고 있던 프레임을 내보냄
+    bool finished = !item.av_frame;
+    int64_t start_time = av_gettime_relative();
+    ret = av_buffersrc_add_frame(filter_ctx->src_filter_ctx, item.av_frame);
+    if (ret < 0) {
+      av_frame_free(&item.av_frame);
+      printf("Error occurred when putting frame into %s filter context\n", pipeline->name);
+      break;
+    }
+
+    while (ret >= 0) {
+      AVFrame* filtered_frame = av_frame_alloc();
+      if (!filtered_frame) {
+        ret = AVERROR(ENOMEM);
+        break;
+      }
+
+      ret = av_buffersink_get_frame(filter_ctx->sink_filter_ctx, filtered_frame);
+      if (ret < 0) {
+        av_frame_free(&filtered_frame);
+        break;
+      }
+
+      add_counter(&pipeline->filter_stats.output_count, 1);
+      ret = push_item(&pipeline->filtered_frames, nullptr, filtered_frame);
+    }
+    update_stats(&pipeline->filter_stats, item, start_time);
+    av_frame_free(&item.av_frame);
+
+    // 필터 그래프에 프레임이 더 필요하면 EAGAIN, 모두 꺼냈으면 AVERROR_EOF를 반환
+    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+      if (ret == AVERROR(EAGAIN)) {
+        count_again();
+      }
+      ret = 0;
+    } else if (ret < 0 && ret != AVERROR_EXIT) {
+      printf("Error occurred when getting frame from %s filter context\n", pipeline->name);
+    }
+
+    if (finished) {
+      ret = ret >= 0 ? push_item(&pipeline->filtered_frames, nullptr, nullptr) : ret;
+      break;
+    }
+  }
+
+  if (ret < 0) {
+    abort_pipeline(ret);
+  }
+}
+
+void encode_loop(StreamPipeline* pipeline) {
+  thread_stats = &pipeline->encode_stats;
+  AVRational sink_time_base = av_buffersink_get_time_base(pipeline->filter_ctx.sink_filter_ctx);
+  int ret = 0;
+
+  while (ret >= 0) {
+    QueueItem item;
+    ret = pop_item(&pipeline->filtered_frames, &item);
+    if (ret < 0) {
+      break;
+    }
+
+    int64_t start_time = av_gettime_relative();
+    if (item.av_frame) {
+      // 필터 그래프의 타임 베이스를 인코더의 타임 베이스로 바꾸고,
+      // 디코더가 정한 프레임 타입은 무시하고 인코더가 GOP 구조를 직접 결정하도록 함
+      item.av_frame->pts = av_rescale_q(item.av_frame->pts, sink_time_base,
+                                        pipeline->encoder_ctx->time_base);
+      item.av_frame->pict_type = AV_PICTURE_TYPE_NONE;
+    }
+
+    // 프레임이 nullptr이면 인코더를 flush해서 남아 있는 패킷을 모두 꺼냄
+    ret = encode_frame(pipeline, item.av_frame);
+    update_stats(&pipeline->encode_stats, item, start_time);
+
+    bool finished = !item.av_frame;
+    av_frame_free(&item.av_frame);
+    if (finished) {
+      ret = ret == AVERROR_EOF ? push_item(&mux_queue, nullptr, nullptr) : ret;
+      break;
+    }
+  }
+
+  if (ret < 0 && ret != AVERROR_EOF) {
+    abort_pipeline(ret);
+  }
+}
+
+// 디코딩과 반대로 프레임을 보내고 패킷을 꺼냄
+// 반환 값은 정상이면 0, flush가 끝나면 AVERROR_EOF, 에러가 발생하면 음수
+int encode_frame(StreamPipeline* pipeline, AVFrame* av_frame) {
+  AVCodecContext* encoder_ctx = pipeline->encoder_ctx;
+
+  int ret = avcodec_send_frame(encoder_ctx, av_frame);
+  if (ret < 0 && !(ret == AVERROR_EOF && !av_frame)) {
+    printf("Couldn't send AVFrame to %s encoder\n", pipeline->name);
+    return ret;
+  }
+
+  while (true) {
+    AVPacket* av_packet = av_packet_alloc();
+    if (!av_packet) {
+      return AVERROR(ENOMEM);
+    }
+
+    ret = avcodec_receive_packet(encoder_ctx, av_packet);
+    if (ret < 0) {
+      av_packet_free(&av_packet);
+      if (ret == AVERROR(EAGAIN)) {
+        count_again();
+        return 0;
+      } else if (ret != AVERROR_EOF) {
+        printf("Couldn't receive AVPacket from %s encoder\n", pipeline->name);
+      }
+      return ret;
+    }
+
+    // 인코더의 타임 베이스를 출력 스트림의 타임 베이스로 변환
+    AVStream* out_stream = output_file_ctx.av_format_ctx->streams[pipeline->out_index];
+    av_packet_rescale_ts(av_packet, encoder_ctx->time_base, out_stream->time_base);
+    av_packet->stream_index = pipeline->out_index;
+
+    add_counter(&pipeline->encode_stats.output_count, 1);
+    add_counter(&pipeline->encode_stats.byte_count, av_packet->size);
+    ret = push_item(&mux_queue, av_packet, nullptr);
+    if (ret < 0) {
+      return ret;
+    }
+  }
+}
+
+void mux_loop() {
+  thread_stats = &mux_stats;
+  // 모든 인코더가 끝을 알릴 때까지 패킷을 씀
+  int remaining = (int) pipelines.size();
+  int ret = 0;
+
+  while (ret >= 0 && remaining > 0) {
+    QueueItem item;
+    ret = pop_item(&mux_queue, &item);
+    if (ret < 0) {
+      break;
+    }
+
+    if (!item.av_packet) {
+      --remaining;
+      continue;
+    }
+
+    // 스트림 사이의 DTS 순서는 av_interleaved_write_frame() 함수가 맞춰서 씀
+    int64_t start_time = av_gettime_relative();
+    add_counter(&mux_stats.output_count, 1);
+    add_counter(&mux_stats.byte_count, item.av_packet->size);
+    ret = av_interleaved_write_frame(output_file_ctx.av_format_ctx, item.av_packet);
+    if (ret < 0) {
+      printf("Error occurred when writing packet into file\n");
+    }
+    update_stats(&mux_stats, item, start_time);
+    av_packet_free(&item.av_packet);
+  }
+
+  if (ret < 0) {
+    abort_pipeline(ret);
+  }
+}
+
+void print_stage_stats(const StageStats& stats, const StageQueue* queue, double elapsed) {
+  LatencySummary summary;
+  summarize_latency(stats.latency, &summary);
+  if (summary.count == 0) {
+    return;
+  }
+
+  printf("%-6s %-6s : %lld in / %lld out, %.1f items/s, latency avg %.1f / p50 %lld / p99 %lld / "
+         "max %lld us, busy %.0f%%, blocked %.0f%%, EAGAIN %lld",
+         stats.stream, stats.stage, (long long) summary.count, (long long) stats.output_count,
+         elapsed > 0 ? summary.count / elapsed : 0.0, (double) summary.sum / summary.count,
+         (long long) summary.p50, (long long) summary.p99, (long long) summary.max,
+         elapsed > 0 ? stats.busy_time / (elapsed * 10000.0) : 0.0,
+         elapsed > 0 ? stats.blocked_time / (elapsed * 10000.0) : 0.0,
+         (long long) stats.again_count);
+  if (queue) {
+    printf(", queue peak %lld/%lld, producer waits %lld", (long long) queue->peak_depth,
+           (long long) queue->capacity, (long long) queue->producer_waits);
+  }
+  printf("\n");
+}
+
+void release() {
+  for (StreamPipeline* pipeline : pipelines) {
+    free_queue(&pipeline->packets);
+    free_queue(&pipeline->decoded_frames);
+    free_queue(&pipeline->filtered_frames);
+  }
+  free_queue(&mux_queue);
+
+  StreamPipeline* all_pipelines[] = {&video_pipeline, &audio_pipeline};
+  for (StreamPipeline* pipeline : all_pipelines) {
+    avcodec_free_context(&pipeline->decoder_ctx);
+    avcodec_free_context(&pipeline->encoder_ctx);
+    if (pipeline->filter_ctx.av_filter_graph) {
+      avfilter_graph_free(&pipeline->filter_ctx.av_filter_graph);
+    }
+  }
+
+  if (input_file_ctx.av_format_ctx) {
+    avformat_close_input(&input_file_ctx.av_format_ctx);
+  }
+
+  if (!output_file_ctx.av_format_ctx) {
+    return;
+  }
+
+  if (!(output_file_ctx.av_format_ctx->oformat->flags & AVFMT_NOFILE)) {
+    avio_closep(&output_file_ctx.av_format_ctx->pb);
+  }
+  // AVFormatContext 구조체 내부에 할당한 메모리를 해제
+  avformat_free_context(output_file_ctx.av_format_ctx);
+  output_file_ctx.av_format_ctx = nullptr;
+}
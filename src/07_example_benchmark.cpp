@@ -0,0 +1,769 @@
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersink.h>
+#include <libavformat/avformat.h>
+#include <libavutil/avutil.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+}
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+// 생성할 테스트 미디어 하나의 조건
+struct MediaSpec {
+  std::string codec;
+  int width;
+  int height;
+  // GOP 크기와 연속된 B 프레임의 최대 개수 (gop_size가 1이면 모든 프레임이 키 프레임)
+  int gop_size;
+  int max_b_frames;
+  std::string name;
+  std::string filename;
+  int64_t file_size;
+};
+
+struct BenchOptions {
+  // 측정할 예제 프로그램(01 ~ 05)이 있는 디렉터리 (기본값은 이 프로그램과 같은 디렉터리)
+  std::string example_dir;
+  const char* work_dir;
+  const char* output_path;
+  // 결과를 비교할 때 구분하기 위한 이름 (예: 커밋 해시)
+  const char* label;
+  // 05_example_filtering의 --video-filter로 넘기는 필터
+  const char* filter_desc;
+  int duration;
+  int frame_rate;
+  // 측정을 반복하는 횟수 (결과는 중앙값)
+  int repeat;
+  // 04_example_decoding의 --threads로 넘기는 디코더 스레드 수
+  int decoder_threads;
+  bool regenerate;
+  std::vector<std::string> codecs;
+  std::vector<std::pair<int, int>> sizes;
+  std::vector<std::pair<int, int>> gops;
+};
+
+// 측정할 예제 프로그램과 입력 파일 뒤에 붙이는 인자
+struct ExampleStage {
+  const char* name;
+  const char* program;
+  std::vector<std::string> args;
+};
+
+// 미디어 하나에 대한 측정 결과
+// 시간은 예제 프로그램을 실행해서 끝날 때까지 걸린 시간 (프로세스 시작 시간 포함, 밀리초)이고
+// 처리량은 그 시간과 미리 세어둔 패킷 수, 비디오 프레임 수, 파일 크기로 계산
+struct BenchResult {
+  MediaSpec spec;
+  int error;
+  const char* failed_stage;
+  int64_t packet_count;
+  int64_t frame_count;
+  double probe_ms;
+  double demux_ms;
+  double remux_ms;
+  double decode_ms;
+  double filter_ms;
+  double demux_packets_per_sec;
+  double remux_mb_per_sec;
+  double decode_fps;
+  double filter_fps;
+};
+
+// 테스트 미디어를 생성할 때 사용하는 lavfi 소스 -> 인코더 -> 출력 스트림
+struct SourceStream {
+  AVFilterGraph* av_filter_graph;
+  AVFilterContext* sink_filter_ctx;
+  AVCodecContext* encoder_ctx;
+  AVStream* out_stream;
+  int64_t next_pts;
+  bool finished;
+};
+
+int parse_pairs(const char* spec, const char* format, std::vector<std::pair<int, int>>* pairs);
+void parse_list(const char* spec, std::vector<std::string>* items);
+int generate_media(MediaSpec* spec, const BenchOptions& options);
+int open_source(SourceStream* source, AVFormatContext* av_format_ctx, const char* filter_desc,
+                AVCodec* av_encoder, const MediaSpec& spec, const BenchOptions& options);
+int encode_source(SourceStream* source, AVFormatContext* av_format_ctx, AVFrame* av_frame);
+void close_source(SourceStream* source);
+int check_examples(const BenchOptions& options);
+int run_benchmark(BenchResult* result, const BenchOptions& options);
+int count_media(const char* filename, int64_t* packet_count, int64_t* frame_count);
+int run_example(const BenchOptions& options, const char* program,
+                const std::vector<std::string>& args, int64_t* elapsed);
+int measure_startup(const BenchOptions& options, double* startup_ms);
+double median(std::vector<double> values);
+int write_results(const std::vector<BenchResult>& results, const BenchOptions& options,
+                  double startup_ms);
+std::string escape_json(const std::string& value);
+
+int main(int argc, const char** argv) {
+  av_log_set_level(AV_LOG_ERROR);
+
+  BenchOptions options;
+  std::string program = argv[0];
+  size_t slash = program.rfind('/');
+  options.example_dir = slash != std::string::npos ? program.substr(0, slash) : ".";
+  options.work_dir = "bench_media";
+  options.output_path = "benchmark.json";
+  options.label = "";
+  options.filter_desc = "scale=iw/2:ih/2";
+  options.duration = 5;
+  options.frame_rate = 25;
+  options.repeat = 3;
+  options.decoder_threads = 1;
+  options.regenerate = false;
+
+  const char* codecs = "mpeg4,ffv1";
+  const char* sizes = "320x240,1280x720";
+  const char* gops = "12:2,1:0";
+
+  for (int index = 1; index < argc; ++index) {
+    if (strcmp(argv[index], "--examples") == 0 && index + 1 < argc) {
+      options.example_dir = argv[++index];
+    } else if (strcmp(argv[index], "--work-dir") == 0 && index + 1 < argc) {
+      options.work_dir = argv[++index];
+    } else if (strcmp(argv[index], "--output") == 0 && index + 1 < argc) {
+      options.output_path = argv[++index];
+    } else if (strcmp(argv[index], "--label") == 0 && index + 1 < argc) {
+      options.label = argv[++index];
+    } else if (strcmp(argv[index], "--codecs") == 0 && index + 1 < argc) {
+      codecs = argv[++index];
+    } else if (strcmp(argv[index], "--sizes") == 0 && index + 1 < argc) {
+      sizes = argv[++index];
+    } else if (strcmp(argv[index], "--gops") == 0 && index + 1 < argc) {
+      gops = argv[++index];
+    } else if (strcmp(argv[index], "--duration") == 0 && index + 1 < argc) {
+      options.duration = atoi(argv[++index]);
+    } else if (strcmp(argv[index], "--repeat") == 0 && index + 1 < argc) {
+      options.repeat = atoi(argv[++index]);
+    } else if (strcmp(argv[index], "--threads") == 0 && index + 1 < argc) {
+      options.decoder_threads = atoi(argv[++index]);
+    } else if (strcmp(argv[index], "--filter") == 0 && index + 1 < argc) {
+      options.filter_desc = argv[++index];
+    } else if (strcmp(argv[index], "--regenerate") == 0) {
+      options.regenerate = true;
+    } else {
+      printf("Unknown option : %s\n", argv[index]);
+      printf("usage: %s [--output file] [--work-dir dir] [--examples dir] [--label name] "
+             "[--repeat N] [--threads N]\n",
+             argv[0]);
+      printf("media options: [--codecs mpeg4,ffv1] [--sizes 320x240,1280x720] "
+             "[--gops gop:b_frames,...] [--duration seconds] [--regenerate]\n");
+      printf("filter options: [--filter desc]\n");
+      return -1;
+    }
+  }
+
+  parse_list(codecs, &options.codecs);
+  if (options.codecs.empty() || parse_pairs(sizes, "%dx%d%n", &options.sizes) < 0 ||
+      parse_pairs(gops, "%d:%d%n", &options.gops) < 0) {
+    printf("Invalid media options\n");
+    return -1;
+  }
+
+  if (options.duration <= 0 || options.repeat <= 0) {
+    printf("Duration and repeat must be positive\n");
+    return -1;
+  }
+
+  if (check_examples(options) < 0) {
+    return -1;
+  }
+
+  // 프로세스를 시작하는 데 걸리는 시간 (모든 측정값에 포함되어 있으므로 작은 파일의 결과를 볼 때 참고)
+  double startup_ms = 0;
+  if (measure_startup(options, &startup_ms) < 0) {
+    return -1;
+  }
+  printf("process startup : %.2f ms\n", startup_ms);
+
+  // 생성한 미디어는 같은 조건이면 항상 같은 파일이므로 다음 실행에서 다시 사용
+  if (mkdir(options.work_dir, 0755) < 0 && errno != EEXIST) {
+    printf("Failed to create work directory %s\n", options.work_dir);
+    return -1;
+  }
+
+  std::vector<BenchResult> results;
+  for (const std::string& codec : options.codecs) {
+    for (const std::pair<int, int>& size : options.sizes) {
+      for (const std::pair<int, int>& gop : options.gops) {
+        BenchResult result = {};
+        result.spec.codec = codec;
+        result.spec.width = size.first;
+        result.spec.height = size.second;
+        result.spec.gop_size = gop.first;
+        result.spec.max_b_frames = gop.second;
+
+        char name[128];
+        snprintf(name, sizeof(name), "%s_%dx%d_g%d_b%d_%ds", codec.c_str(), size.first,
+                 size.second, gop.first, gop.second, options.duration);
+        result.spec.name = name;
+        result.spec.filename = std::string(options.work_dir) + "/" + name + ".mkv";
+
+        if (generate_media(&result.spec, options) < 0) {
+          result.error = -1;
+          result.failed_stage = "generate";
+        } else {
+          run_benchmark(&result, options);
+        }
+
+        if (result.error < 0) {
+          printf("%-36s : failed at %s\n", name, result.failed_stage);
+        } else {
+          printf("%-36s : probe %.2f ms, demux %.0f packets/s, remux %.1f MB/s, "
+                 "decode %.1f fps, filter %.1f fps\n",
+                 name, result.probe_ms, result.demux_packets_per_sec, result.remux_mb_per_sec,
+                 result.decode_fps, result.filter_fps);
+        }
+        results.push_back(result);
+      }
+    }
+  }
+
+  if (write_results(results, options, startup_ms) < 0) {
+    return -1;
+  }
+  printf("results written to %s\n", options.output_path);
+
+  for (const BenchResult& result : results) {
+    if (result.error < 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int parse_pairs(const char* spec, const char* format, std::vector<std::pair<int, int>>* pairs) {
+  // 쉼표로 구분한 두 정수의 목록 (예: 320x240,1280x720 또는 12:2,1:0)
+  const char* cursor = spec;
+  while (*cursor) {
+    std::pair<int, int> pair;
+    int length = 0;
+    if (sscanf(cursor, format, &pair.first, &pair.second, &length) != 2 || pair.first <= 0 ||
+        pair.second < 0) {
+      return -1;
+    }
+    pairs->push_back(pair);
+
+    cursor += length;
+    if (*cursor == ',') {
+      ++cursor;
+    } else if (*cursor) {
+      return -1;
+    }
+  }
+
+  return pairs->empty() ? -1 : 0;
+}
+
+void parse_list(const char* spec, std::vector<std::string>* items) {
+  std::string item;
+  for (const char* cursor = spec;; ++cursor) {
+    if (*cursor == ',' || !*cursor) {
+      if (!item.empty()) {
+        items->push_back(item);
+      }
+      item.clear();
+      if (!*cursor) {
+        break;
+      }
+    } else {
+      item += *cursor;
+    }
+  }
+}
+
+int generate_media(MediaSpec* spec, const BenchOptions& options) {
+  struct stat file_stat;
+  if (!options.regenerate && stat(spec->filename.c_str(), &file_stat) == 0 &&
+      file_stat.st_size > 0) {
+    spec->file_size = file_stat.st_size;
+    return 0;
+  }
+
+  AVCodec* video_encoder = avcodec_find_encoder_by_name(spec->codec.c_str());
+  AVCodec* audio_encoder = avcodec_find_encoder_by_name("aac");
+  if (!video_encoder || video_encoder->type != AVMEDIA_TYPE_VIDEO || !audio_encoder) {
+    printf("Couldn't find encoder %s\n", spec->codec.c_str());
+    return -1;
+  }
+
+  AVFormatContext* av_format_ctx = nullptr;
+  if (avformat_alloc_output_context2(&av_format_ctx, nullptr, "matroska",
+                                     spec->filename.c_str()) < 0) {
+    printf("Couldn't create output AVFormatContext\n");
+    return -1;
+  }
+  // 같은 조건이면 라이브러리 버전 정보나 생성 시각에 상관없이 같은 파일이 나오도록 함
+  av_format_ctx->flags |= AVFMT_FLAG_BITEXACT;
+
+  // testsrc2와 sine은 외부 파일 없이 매번 같은 영상과 소리를 만드는 lavfi 소스
+  char video_desc[256];
+  char audio_desc[256];
+  snprintf(video_desc, sizeof(video_desc), "testsrc2=size=%dx%d:rate=%d:duration=%d",
+           spec->width, spec->height, options.frame_rate, options.duration);
+  snprintf(audio_desc, sizeof(audio_desc),
+           "sine=frequency=440:beep_factor=4:sample_rate=48000:duration=%d,"
+           "aformat=sample_fmts=fltp:channel_layouts=stereo",
+           options.duration);
+
+  SourceStream sources[2] = {};
+  int ret = open_source(&sources[0], av_format_ctx, video_desc, video_encoder, *spec, options);
+  if (ret >= 0) {
+    ret = open_source(&sources[1], av_format_ctx, audio_desc, audio_encoder, *spec, options);
+  }
+
+  if (ret >= 0 && avio_open(&av_format_ctx->pb, spec->filename.c_str(), AVIO_FLAG_WRITE) < 0) {
+    printf("Failed to create output file\n");
+    ret = -1;
+  }
+
+  if (ret >= 0 && avformat_write_header(av_format_ctx, nullptr) < 0) {
+    printf("Failed writing header into output file\n");
+    ret = -1;
+  }
+
+  AVFrame* av_frame = av_frame_alloc();
+  if (!av_frame) {
+    ret = -1;
+  }
+
+  // 두 소스 중 타임스탬프가 앞선 쪽을 먼저 인코딩해서 먹서가 패킷을 오래 들고 있지 않게 함
+  while (ret >= 0 && !(sources[0].finished && sources[1].finished)) {
+    SourceStream* source = nullptr;
+    for (SourceStream& candidate : sources) {
+      if (!candidate.finished &&
+          (!source || av_compare_ts(candidate.next_pts, candidate.encoder_ctx->time_base,
+                                    source->next_pts, source->encoder_ctx->time_base) < 0)) {
+        source = &candidate;
+      }
+    }
+
+    ret = av_buffersink_get_frame(source->sink_filter_ctx, av_frame);
+    if (ret == AVERROR_EOF) {
+      // 소스가 끝나면 인코더를 flush
+      source->finished = true;
+      ret = encode_source(source, av_format_ctx, nullptr);
+      continue;
+    } else if (ret < 0) {
+      printf("Error occurred when getting frame from lavfi source\n");
+      break;
+    }
+
+    av_frame->pts = av_rescale_q(av_frame->pts,
+                                 av_buffersink_get_time_base(source->sink_filter_ctx),
+                                 source->encoder_ctx->time_base);
+    source->next_pts = av_frame->pts;
+    ret = encode_source(source, av_format_ctx, av_frame);
+    av_frame_unref(av_frame);
+  }
+
+  if (ret >= 0 && av_write_trailer(av_format_ctx) < 0) {
+    printf("Failed writing trailer into output file\n");
+    ret = -1;
+  }
+
+  av_frame_free(&av_frame);
+  close_source(&sources[0]);
+  close_source(&sources[1]);
+  avio_closep(&av_format_ctx->pb);
+  avformat_free_context(av_format_ctx);
+
+  if (ret < 0) {
+    // 중간에 실패한 파일은 다음 실행에서 다시 사용하지 않도록 지움
+    unlink(spec->filename.c_str());
+    return -1;
+  }
+
+  if (stat(spec->filename.c_str(), &file_stat) < 0) {
+    return -1;
+  }
+  spec->file_size = file_stat.st_size;
+
+  return 0;
+}
+
+int open_source(SourceStream* source, AVFormatContext* av_format_ctx, const char* filter_desc,
+                AVCodec* av_encoder, const MediaSpec& spec, const BenchOptions& options) {
+  source->encoder_ctx = avcodec_alloc_context3(av_encoder);
+  source->av_filter_graph = avfilter_graph_alloc();
+  if (!source->encoder_ctx || !source->av_filter_graph) {
+    return -1;
+  }
+
+  AVCodecContext* encoder_ctx = source->encoder_ctx;
+  bool video = av_encoder->type == AVMEDIA_TYPE_VIDEO;
+  std::string desc = filter_desc;
+  if (video) {
+    // 인코더가 지원하는 픽셀 포맷 중 yuv420p에 가장 가까운 포맷으로 변환
+    AVPixelFormat pix_fmt = AV_PIX_FMT_YUV420P;
+    if (av_encoder->pix_fmts) {
+      pix_fmt = avcodec_find_best_pix_fmt_of_list(av_encoder->pix_fmts, pix_fmt, 0, nullptr);
+    }
+    desc += ",format=";
+    desc += av_get_pix_fmt_name(pix_fmt);
+
+    encoder_ctx->width = spec.width;
+    encoder_ctx->height = spec.height;
+    encoder_ctx->pix_fmt = pix_fmt;
+    encoder_ctx->time_base = av_make_q(1, options.frame_rate);
+    encoder_ctx->framerate = av_make_q(options.frame_rate, 1);
+    encoder_ctx->gop_size = spec.gop_size;
+    encoder_ctx->max_b_frames = spec.max_b_frames;
+  } else {
+    encoder_ctx->sample_fmt = AV_SAMPLE_FMT_FLTP;
+    encoder_ctx->sample_rate = 48000;
+    encoder_ctx->channel_layout = AV_CH_LAYOUT_STEREO;
+    encoder_ctx->channels = 2;
+    encoder_ctx->time_base = av_make_q(1, encoder_ctx->sample_rate);
+  }
+
+  // 프레임 스레딩은 인코더의 결과가 스레드 수에 따라 달라질 수 있으므로 단일 스레드로 인코딩
+  encoder_ctx->thread_count = 1;
+  encoder_ctx->flags |= AV_CODEC_FLAG_BITEXACT;
+  if (av_format_ctx->oformat->flags & AVFMT_GLOBALHEADER) {
+    encoder_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+  }
+
+  if (avcodec_open2(encoder_ctx, av_encoder, nullptr) < 0) {
+    printf("Couldn't open encoder %s\n", av_encoder->name);
+    return -1;
+  }
+
+  // 입력이 없는 소스 필터 체인의 출력을 buffersink에 연결
+  AVFilterInOut* inputs = nullptr;
+  AVFilterInOut* outputs = nullptr;
+  if (avfilter_graph_parse2(source->av_filter_graph, desc.c_str(), &inputs, &outputs) < 0 ||
+      inputs || !outputs || outputs->next) {
+    printf("Failed to parse lavfi source %s\n", desc.c_str());
+    avfilter_inout_free(&inputs);
+    avfilter_inout_free(&outputs);
+    return -1;
+  }
+
+  int ret = avfilter_graph_create_filter(&source->sink_filter_ctx,
+                                         avfilter_get_by_name(video ? "buffersink" : "abuffersink"),
+                                         "out", nullptr, nullptr, source->av_filter_graph);
+  if (ret >= 0) {
+    ret = avfilter_link(outputs->filter_ctx, outputs->pad_idx, source->sink_filter_ctx, 0);
+  }
+  avfilter_inout_free(&outputs);
+  if (ret < 0 || avfilter_graph_config(source->av_filter_graph, nullptr) < 0) {
+    printf("Failed to configure lavfi source %s\n", desc.c_str());
+    return -1;
+  }
+
+  if (!video && encoder_ctx->frame_size > 0) {
+    av_buffersink_set_frame_size(source->sink_filter_ctx, encoder_ctx->frame_size);
+  }
+
+  source->out_stream = avformat_new_stream(av_format_ctx, nullptr);
+  if (!source->out_stream ||
+      avcodec_parameters_from_context(source->out_stream->codecpar, encoder_ctx) < 0) {
+    printf("Failed to allocate output stream\n");
+    return -1;
+  }
+  source->out_stream->time_base = encoder_ctx->time_base;
+
+  return 0;
+}
+
+int encode_source(SourceStream* source, AVFormatContext* av_format_ctx, AVFrame* av_frame) {
+  if (av_frame) {
+    av_frame->pict_type = AV_PICTURE_TYPE_NONE;
+  }
+
+  int ret = avcodec_send_frame(source->encoder_ctx, av_frame);
+  if (ret < 0) {
+    printf("Couldn't send AVFrame to encoder\n");
+    return ret;
+  }
+
+  AVPacket* av_packet = av_packet_alloc();
+  if (!av_packet) {
+    return AVERROR(ENOMEM);
+  }
+
+  while ((ret = avcodec_receive_packet(source->encoder_ctx, av_packet)) >= 0) {
+    av_packet_rescale_ts(av_packet, source->encoder_ctx->time_base,
+                         source->out_stream->time_base);
+    av_packet->stream_index = source->out_stream->index;
+    ret = av_interleaved_write_frame(av_format_ctx, av_packet);
+    if (ret < 0) {
+      printf("Error occurred when writing packet into file\n");
+      break;
+    }
+  }
+  av_packet_free(&av_packet);
+
+  return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+void close_source(SourceStream* source) {
+  avcodec_free_context(&source->encoder_ctx);
+  avfilter_graph_free(&source->av_filter_graph);
+}
+
+int check_examples(const BenchOptions& options) {
+  const char* programs[] = {"01_example_scanning", "02_example_demuxing", "03_example_remuxing",
+                            "04_example_decoding", "05_example_filtering"};
+  for (const char* program : programs) {
+    std::string path = options.example_dir + "/" + program;
+    if (access(path.c_str(), X_OK) < 0) {
+      printf("Couldn't find %s (use --examples to set the directory)\n", path.c_str());
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int run_benchmark(BenchResult* result, const BenchOptions& options) {
+  const std::string& filename = result->spec.filename;
+  std::string remux_filename = std::string(options.work_dir) + "/remux.mkv";
+  char threads[16];
+  snprintf(threads, sizeof(threads), "%d", options.decoder_threads);
+
+  // 측정 코드를 따로 두지 않고 각 예제 프로그램을 그대로 실행하므로 예제를 고치면 결과에 바로 반영됨
+  // 04, 05는 비디오 처리 속도만 보도록 오디오 스트림을 사용하지 않음
+  const ExampleStage stages[] = {
+          {"probe", "01_example_scanning", {filename}},
+          {"demux", "02_example_demuxing", {filename, "--bench"}},
+          {"remux", "03_example_remuxing", {filename, remux_filename}},
+          {"decode", "04_example_decoding", {filename, "--audio", "none", "--threads", threads}},
+          {"filter", "05_example_filtering",
+           {filename, "--audio", "none", "--video-filter", options.filter_desc}},
+  };
+  const int stage_count = sizeof(stages) / sizeof(stages[0]);
+
+  if (count_media(filename.c_str(), &result->packet_count, &result->frame_count) < 0) {
+    result->failed_stage = "count";
+    result->error = -1;
+    return -1;
+  }
+
+  // 첫 번째 실행은 파일을 페이지 캐시에 올리는 용도로만 사용하고 결과에서 제외
+  std::vector<double> elapsed_ms[stage_count];
+  for (int run = 0; run <= options.repeat && !result->failed_stage; ++run) {
+    for (int stage = 0; stage < stage_count; ++stage) {
+      int64_t elapsed;
+      if (run_example(options, stages[stage].program, stages[stage].args, &elapsed) < 0) {
+        result->failed_stage = stages[stage].name;
+        break;
+      }
+      if (run > 0) {
+        elapsed_ms[stage].push_back(elapsed / 1000.0);
+      }
+    }
+  }
+  unlink(remux_filename.c_str());
+
+  if (result->failed_stage) {
+    result->error = -1;
+    return -1;
+  }
+
+  result->probe_ms = median(elapsed_ms[0]);
+  result->demux_ms = median(elapsed_ms[1]);
+  result->remux_ms = median(elapsed_ms[2]);
+  result->decode_ms = median(elapsed_ms[3]);
+  result->filter_ms = median(elapsed_ms[4]);
+  result->demux_packets_per_sec = result->packet_count * 1000.0 / FFMAX(result->demux_ms, 0.001);
+  result->remux_mb_per_sec = result->spec.file_size / (1024.0 * 1024.0) * 1000.0 /
+                             FFMAX(result->remux_ms, 0.001);
+  result->decode_fps = result->frame_count * 1000.0 / FFMAX(result->decode_ms, 0.001);
+  result->filter_fps = result->frame_count * 1000.0 / FFMAX(result->filter_ms, 0.001);
+
+  return 0;
+}
+
+int count_media(const char* filename, int64_t* packet_count, int64_t* frame_count) {
+  // 처리량을 계산할 때 나눌 패킷 수와 비디오 프레임 수 (측정 시간에는 포함하지 않음)
+  // 생성한 미디어는 비디오 패킷 하나에 프레임이 하나씩 들어 있음
+  AVFormatContext* av_format_ctx = nullptr;
+  if (avformat_open_input(&av_format_ctx, filename, nullptr, nullptr) < 0 ||
+      avformat_find_stream_info(av_format_ctx, nullptr) < 0) {
+    printf("Couldn't open input file %s\n", filename);
+    if (av_format_ctx) {
+      avformat_close_input(&av_format_ctx);
+    }
+    return -1;
+  }
+
+  int v_index = av_find_best_stream(av_format_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+  AVPacket* av_packet = av_packet_alloc();
+  int ret = av_packet ? 0 : AVERROR(ENOMEM);
+
+  *packet_count = *frame_count = 0;
+  while (ret >= 0 && (ret = av_read_frame(av_format_ctx, av_packet)) >= 0) {
+    ++*packet_count;
+    if (av_packet->stream_index == v_index) {
+      ++*frame_count;
+    }
+    av_packet_unref(av_packet);
+  }
+
+  av_packet_free(&av_packet);
+  avformat_close_input(&av_format_ctx);
+
+  return ret == AVERROR_EOF ? 0 : -1;
+}
+
+int run_example(const BenchOptions& options, const char* program,
+                const std::vector<std::string>& args, int64_t* elapsed) {
+  std::string path = options.example_dir + "/" + program;
+  std::vector<char*> argv;
+  argv.push_back((char*) path.c_str());
+  for (const std::string& arg : args) {
+    argv.push_back((char*) arg.c_str());
+  }
+  argv.push_back(nullptr);
+
+  // 예제가 출력하는 내용은 측정에 영향을 주지 않도록 /dev/null로 보냄
+  int64_t start_time = av_gettime_relative();
+  pid_t pid = fork();
+  if (pid < 0) {
+    printf("Failed to run %s\n", program);
+    return -1;
+  }
+  if (pid == 0) {
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd >= 0) {
+      dup2(null_fd, STDOUT_FILENO);
+      dup2(null_fd, STDERR_FILENO);
+      close(null_fd);
+    }
+    execv(path.c_str(), argv.data());
+    _exit(127);
+  }
+
+  int status = 0;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      printf("Failed to wait for %s\n", program);
+      return -1;
+    }
+  }
+  *elapsed = av_gettime_relative() - start_time;
+
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    printf("%s failed (status %d)\n", program, WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+    return -1;
+  }
+
+  return 0;
+}
+
+int measure_startup(const BenchOptions& options, double* startup_ms) {
+  // 인자 없이 실행하면 사용법만 출력하고 끝나므로 라이브러리를 불러오고 종료하는 시간만 남음
+  std::vector<double> elapsed_ms;
+  for (int run = 0; run <= options.repeat; ++run) {
+    int64_t elapsed;
+    if (run_example(options, "02_example_demuxing", std::vector<std::string>(), &elapsed) < 0) {
+      return -1;
+    }
+    if (run > 0) {
+      elapsed_ms.push_back(elapsed / 1000.0);
+    }
+  }
+
+  *startup_ms = median(elapsed_ms);
+  return 0;
+}
+
+double median(std::vector<double> values) {
+  if (values.empty()) {
+    return 0.0;
+  }
+
+  std::sort(values.begin(), values.end());
+  size_t middle = values.size() / 2;
+  return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+
+int write_results(const std::vector<BenchResult>& results, const BenchOptions& options,
+                  double startup_ms) {
+  FILE* file = fopen(options.output_path, "w");
+  if (!file) {
+    printf("Failed to create %s\n", options.output_path);
+    return -1;
+  }
+
+  // 커밋 사이에 비교할 수 있도록 빌드와 라이브러리 정보를 함께 기록
+#ifdef NDEBUG
+  const char* build_type = "release";
+#else
+  const char* build_type = "debug";
+#endif
+  fprintf(file,
+          "{\"label\":\"%s\",\"ffmpeg\":\"%s\",\"build\":\"%s\",\"duration\":%d,"
+          "\"frame_rate\":%d,\"repeat\":%d,\"threads\":%d,\"filter\":\"%s\","
+          "\"startup_ms\":%.3f,\"results\":[",
+          escape_json(options.label).c_str(), escape_json(av_version_info()).c_str(), build_type,
+          options.duration, options.frame_rate, options.repeat, options.decoder_threads,
+          escape_json(options.filter_desc).c_str(), startup_ms);
+
+  for (size_t index = 0; index < results.size(); ++index) {
+    const BenchResult& result = results[index];
+    const MediaSpec& spec = result.spec;
+    fprintf(file,
+            "%s\n  {\"name\":\"%s\",\"codec\":\"%s\",\"width\":%d,\"height\":%d,\"gop\":%d,"
+            "\"b_frames\":%d,\"file_bytes\":%lld",
+            index > 0 ? "," : "", escape_json(spec.name).c_str(),
+            escape_json(spec.codec).c_str(), spec.width, spec.height, spec.gop_size,
+            spec.max_b_frames, (long long) spec.file_size);
+    if (result.error < 0) {
+      fprintf(file, ",\"status\":\"error\",\"stage\":\"%s\"}", result.failed_stage);
+      continue;
+    }
+    fprintf(file,
+            ",\"status\":\"ok\",\"packets\":%lld,\"frames\":%lld,\"probe_ms\":%.3f,"
+            "\"demux_ms\":%.3f,\"remux_ms\":%.3f,\"decode_ms\":%.3f,\"filter_ms\":%.3f,"
+            "\"demux_packets_per_sec\":%.1f,\"remux_mb_per_sec\":%.2f,\"decode_fps\":%.2f,"
+            "\"filter_fps\":%.2f}",
+            (long long) result.packet_count, (long long) result.frame_count, result.probe_ms,
+            result.demux_ms, result.remux_ms, result.decode_ms, result.filter_ms,
+            result.demux_packets_per_sec, result.remux_mb_per_sec, result.decode_fps,
+            result.filter_fps);
+  }
+  fprintf(file, "\n]}\n");
+
+  if (fclose(file) != 0) {
+    printf("Failed to write %s\n", options.output_path);
+    return -1;
+  }
+
+  return 0;
+}
+
+std::string escape_json(const std::string& value) {
+  std::string escaped;
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if ((unsigned char) c < 0x20) {
+      char buffer[8];
+      snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+      escaped += buffer;
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}